@@ -1,27 +1,34 @@
 #include "Application.h"
+#include "benchmark.h"
+#include "parallel.h"
 #include <time.h>
 
 const unsigned VECTORS_IN_MATRIX = sizeof(D3DXMATRIX)/sizeof(D3DXVECTOR4);
+// c45-c98 is the palette of bones for SKINNING: set by the model before drawing each run of its clusters (see palette.h)
+const unsigned SHADER_REG_BONE_PALETTE = 45;
 
 namespace
 {
     const int         WINDOW_SIZE = 600;
     const D3DCOLOR    BACKGROUND_COLOR = D3DCOLOR_XRGB( 15, 15, 25 );
     const bool        INITIAL_WIREFRAME_STATE = false;
+    const bool        INITIAL_SOFTWARE_DEFORMATION = false;
     const D3DCOLOR    BLACK = D3DCOLOR_XRGB( 0, 0, 0 );
     const float       ROTATE_STEP = D3DX_PI/30.0f;
     const float       POINT_MOVING_STEP = 0.03f;
     const char       *SHADOW_SHADER_FILENAME = "shadow.vsh";
+    const char       *FILTER_SHADER_FILENAME = "target.psh"; // of the target plane, for the benchmark
     const DWORD       STENCIL_REF_VALUE = 50;
     const unsigned    FILTER_SIZE = 3;
     const unsigned    FILTER_REGS_COUNT = 5;
+    const unsigned    MAX_STATUS_LENGTH = 128;
+    const Index       BENCHMARK_VERTICES_COUNT = 100000;
+    const unsigned    BENCHMARK_FILTER_SIZE = 256;
 
 
     //---------------- VERTEX SHADER CONSTANTS ---------------------------
     //    c0-c3 is the view matrix
     const unsigned    SHADER_REG_VIEW_MX = 0;
-    //    c4-c7 is the first bone matrix for SKINNING
-    //    c8-c11 is the second bone matrix for SKINNING
     //    c4 is final radius for MORPHING
     //    c5 is MORPHING parameter
     const unsigned    SHADER_REG_MODEL_DATA = 4;
@@ -30,10 +37,8 @@ namespace
     const unsigned    SHADER_REG_DIFFUSE_COEF = 14;
     const float       SHADER_VAL_DIFFUSE_COEF = 0.7f;
     //    c15 is ambient color
-    const unsigned    SHADER_REG_AMBIENT_COLOR = 15;
     const D3DCOLOR    SHADER_VAL_AMBIENT_COLOR = D3DCOLOR_XRGB(20, 20, 20);
     //    c16 is point light color
-    const unsigned    SHADER_REG_POINT_COLOR = 16;
     const D3DCOLOR    SHADER_VAL_POINT_COLOR = D3DCOLOR_XRGB(204, 204, 100);
     //    c17 is point light position
     const unsigned    SHADER_REG_POINT_POSITION = 17;
@@ -42,7 +47,6 @@ namespace
     const unsigned    SHADER_REG_ATTENUATION = 18;
     const D3DXVECTOR3 SHADER_VAL_ATTENUATION  (1.0f, 0, 0.3f);
     //    c19 is specular coefficient
-    const unsigned    SHADER_REG_SPECULAR_COEF = 19;
     const float       SHADER_VAL_SPECULAR_COEF = 0.4f;
     //    c20 is specular constant 'f'
     const unsigned    SHADER_REG_SPECULAR_F = 20;
@@ -66,6 +70,7 @@ namespace
         D3DXVECTOR3(  1.5f,  0.5f, 0 ),
         D3DXVECTOR3(  0.5f,  1.5f, 0 ),
     };
+    //    c45 - c98 is the palette of bones for SKINNING (SHADER_REG_BONE_PALETTE)
 
     const float       NO_FILTER[FILTER_SIZE*FILTER_SIZE] = 
     {
@@ -113,8 +118,9 @@ namespace
 
 Application::Application()
 : d3d(NULL), device(NULL), window(WINDOW_SIZE, WINDOW_SIZE), camera(5, 0.68f, 0), // Constants selected for better view of the scene
-  point_light_enabled(true), ambient_light_enabled(true), point_light_position(SHADER_VAL_POINT_POSITION),
-  plane(NULL), light_source(NULL), target_texture(NULL), target_plane(NULL), filter(NO_FILTER)
+  point_light_enabled(true), ambient_light_enabled(true), specular_enabled(true), point_light_position(SHADER_VAL_POINT_POSITION),
+  culled_triangles_count(0), lit_fetched_bytes(0), shadow_fetched_bytes(0), shader_source_slots(0), shader_slots(0), plane(NULL), light_source(NULL), target_texture(NULL), target_plane(NULL), filter(NO_FILTER),
+  deformed_shader(NULL), deformed_shadow_shader(NULL), software_deformation(INITIAL_SOFTWARE_DEFORMATION), threads_count(get_threads_count()), workers(threads_count)
 {
     try
     {
@@ -166,7 +172,7 @@ void Application::init_device()
     toggle_wireframe();
 }
 
-inline void Application::draw_model(Model *model, float time, bool shadow)
+inline DWORD64 Application::draw_model(Model *model, float time, bool shadow)
 {
     static D3DXVECTOR4 model_constants[SHADER_SPACE_MODEL_DATA];
     static unsigned constants_used;
@@ -181,7 +187,50 @@ inline void Application::draw_model(Model *model, float time, bool shadow)
     // Draw
     model->set_shaders_and_decl(shadow);
     model->set_textures(shadow, FILTER_REGS_COUNT);
-    model->draw();
+    // shadows are drawn whole: culled clusters may cast visible shadows
+    if( shadow )
+        return model->draw(true);
+    return model->draw_visible();
+}
+
+DWORD Application::cull_models()
+{
+    Frustum frustum( camera.get_matrix() );
+    D3DXVECTOR3 eye = camera.get_eye();
+    RECT rect = window.get_client_rect();
+    const float viewport_height = static_cast<float>( rect.bottom - rect.top );
+
+    DWORD culled = plane->cull( frustum, eye );
+    for ( Models::iterator iter = models.begin(); iter != models.end(); ++iter )
+    {
+        (*iter)->select_lod( camera, viewport_height ); // clusters of the chosen level are culled
+        culled += (*iter)->cull( frustum, eye );
+    }
+    return culled;
+}
+
+void Application::deform_models(float time)
+{
+    for ( Models::iterator iter = models.begin(); iter != models.end(); ++iter )
+    {
+        (*iter)->set_time( time );
+        (*iter)->deform_vertices( threads_count );
+    }
+}
+
+void Application::show_status(DWORD culled, DWORD64 lit_bytes, DWORD64 shadow_bytes)
+{
+    if( culled == culled_triangles_count && lit_bytes == lit_fetched_bytes && shadow_bytes == shadow_fetched_bytes )
+        return;
+    culled_triangles_count = culled;
+    lit_fetched_bytes = lit_bytes;
+    shadow_fetched_bytes = shadow_bytes;
+
+    const DWORD64 KILOBYTE = 1024;
+    TCHAR status[MAX_STATUS_LENGTH];
+    _stprintf_s( status, MAX_STATUS_LENGTH, _T("%lu triangles culled, vertices fetched: %I64u KB lit, %I64u KB shadows"),
+                 static_cast<unsigned long>(culled_triangles_count), lit_fetched_bytes/KILOBYTE, shadow_fetched_bytes/KILOBYTE );
+    window.set_status( status );
 }
 
 void Application::render()
@@ -193,6 +242,7 @@ void Application::render()
 
     D3DCOLOR ambient_color = ambient_light_enabled ? SHADER_VAL_AMBIENT_COLOR : BLACK;
     D3DCOLOR point_color = point_light_enabled ? SHADER_VAL_POINT_COLOR : BLACK;
+    float specular_coef = specular_enabled ? SHADER_VAL_SPECULAR_COEF : 0;
     D3DXMATRIX shadow_proj_matrix = plane->get_projection_matrix(point_light_position);
 
     D3DXVECTOR3 texcoord_multiplier (1.0f/target_texture->get_float_width(), 1.0f/target_texture->get_float_height(), 0);
@@ -203,7 +253,7 @@ void Application::render()
     set_shader_color ( SHADER_REG_POINT_COLOR,    point_color               );
     set_shader_point ( SHADER_REG_POINT_POSITION, point_light_position      );
     set_shader_vector( SHADER_REG_ATTENUATION,    SHADER_VAL_ATTENUATION    );
-    set_shader_float ( SHADER_REG_SPECULAR_COEF,  SHADER_VAL_SPECULAR_COEF  );
+    set_shader_float ( SHADER_REG_SPECULAR_COEF,  specular_coef             );
     set_shader_float ( SHADER_REG_SPECULAR_F,     SHADER_VAL_SPECULAR_F     );
     set_shader_point ( SHADER_REG_EYE,            camera.get_eye()          );
     set_shader_matrix( SHADER_REG_SHADOW_PROJ_MX, shadow_proj_matrix        );
@@ -219,6 +269,9 @@ void Application::render()
         set_pixel_shader_float( SHADER_REG_FILTER + i, filter[ SHADER_VAL_INDEX_FILTER[i] ]/FILTER_COEFF );
     }
 
+    const DWORD culled = cull_models();
+    deform_models( time ); // for the chosen levels of detail
+
     // Set render target
     target_texture->set_as_target();
     check_render( device->Clear( 0, NULL, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER | D3DCLEAR_STENCIL, BACKGROUND_COLOR, 1.0f, 0 ) );
@@ -232,20 +285,22 @@ void Application::render()
     set_render_state( D3DRS_STENCILFUNC, D3DCMP_EQUAL );
     set_render_state( D3DRS_STENCILPASS, D3DSTENCILOP_INCRSAT );
     set_render_state( D3DRS_ALPHABLENDENABLE, TRUE );
+    DWORD64 shadow_bytes = 0;
     if ( point_light_enabled )
     {
         for ( Models::iterator iter = models.begin(); iter != models.end(); ++iter )
         {
-            draw_model( *iter, time, true );
+            shadow_bytes += draw_model( *iter, time, true );
         }
     }
     // Draw models
     set_render_state( D3DRS_ZENABLE, TRUE );
     set_render_state( D3DRS_STENCILFUNC, D3DCMP_ALWAYS );
     set_render_state( D3DRS_ALPHABLENDENABLE, FALSE );
+    DWORD64 lit_bytes = 0;
     for ( Models::iterator iter = models.begin(); iter != models.end(); ++iter )
     {
-        draw_model( *iter, time, false );
+        lit_bytes += draw_model( *iter, time, false );
     }
     // Set render target
     target_texture->unset_as_target();
@@ -258,6 +313,8 @@ void Application::render()
     
     // Present the backbuffer contents to the display
     check_render( device->Present( NULL, NULL, NULL, NULL ) );
+
+    show_status( culled, lit_bytes, shadow_bytes );
 }
 
 IDirect3DDevice9 * Application::get_device()
@@ -268,6 +325,9 @@ IDirect3DDevice9 * Application::get_device()
 void Application::add_model(Model &model)
 {
     models.push_back( &model );
+    model.set_shader_features( get_shader_features() );
+    if( software_deformation )
+        model.set_software_deformation( deformed_shader, deformed_shadow_shader );
 }
 
 void Application::remove_model(Model &model)
@@ -346,6 +406,96 @@ void Application::process_key(unsigned code)
     case '4':
         filter = EDGE_FILTER;
         break;
+    case 'B':
+        benchmark_software();
+        break;
+    case 'C':
+        toggle_software_deformation();
+        break;
+    case 'I':
+        show_shader_slots();
+        break;
+    case VK_F1:
+        point_light_enabled = !point_light_enabled;
+        set_shader_features();
+        break;
+    case VK_F2:
+        ambient_light_enabled = !ambient_light_enabled;
+        set_shader_features();
+        break;
+    case VK_F3:
+        specular_enabled = !specular_enabled;
+        set_shader_features();
+        break;
+    }
+}
+
+LightingConstants Application::get_lighting_constants() const
+{
+    LightingConstants constants;
+    constants.diffuse_coef = SHADER_VAL_DIFFUSE_COEF;
+    constants.ambient_color = D3DXCOLOR( ambient_light_enabled ? SHADER_VAL_AMBIENT_COLOR : BLACK );
+    constants.point_color = D3DXCOLOR( point_light_enabled ? SHADER_VAL_POINT_COLOR : BLACK );
+    constants.point_position = point_light_position;
+    constants.attenuation = SHADER_VAL_ATTENUATION;
+    constants.specular_coef = specular_enabled ? SHADER_VAL_SPECULAR_COEF : 0;
+    constants.specular_f = SHADER_VAL_SPECULAR_F;
+    constants.eye = camera.get_eye();
+    return constants;
+}
+
+void Application::benchmark_software()
+{
+    // the chosen filter, as render() sets it
+    float filter_taps[FILTER_TAPS_COUNT];
+    for( unsigned i = 0; i < FILTER_TAPS_COUNT; ++i )
+        filter_taps[i] = filter[ SHADER_VAL_INDEX_FILTER[i] ];
+    SoftwareThroughput throughput;
+    ::benchmark_software( BENCHMARK_VERTICES_COUNT, get_lighting_constants(), camera.get_matrix(), BENCHMARK_FILTER_SIZE,
+                          FILTER_SHADER_FILENAME, filter_taps, get_threads_count(), throughput );
+
+    TCHAR status[MAX_STATUS_LENGTH];
+    _stprintf_s( status, MAX_STATUS_LENGTH, _T("software, M vertices/s: skinning %.1f, morphing %.1f, lighting %.1f; M pixels/s: filter %.1f (scalar %.1f)"),
+                 throughput.skinning, throughput.morphing, throughput.lighting, throughput.filtering, throughput.reference_filtering );
+    window.set_status( status );
+}
+
+void Application::show_shader_slots()
+{
+    TCHAR status[MAX_STATUS_LENGTH];
+    _stprintf_s( status, MAX_STATUS_LENGTH, _T("shader instruction slots: %u in the files, %u optimized"), shader_source_slots, shader_slots );
+    window.set_status( status );
+}
+
+DWORD Application::get_shader_features() const
+{
+    return ( point_light_enabled ? SHADER_FEATURE_POINT_LIGHT : 0 ) |
+           ( ambient_light_enabled ? SHADER_FEATURE_AMBIENT : 0 ) |
+           ( specular_enabled ? SHADER_FEATURE_SPECULAR : 0 );
+}
+
+void Application::set_shader_features()
+{
+    const DWORD features = get_shader_features();
+    for ( Models::iterator iter = models.begin(); iter != models.end(); ++iter )
+        (*iter)->set_shader_features( features );
+    if( plane != NULL )
+        plane->set_shader_features( features );
+    if( light_source != NULL )
+        light_source->set_shader_features( features );
+}
+
+void Application::toggle_software_deformation()
+{
+    if( deformed_shader == NULL )
+        return; // no shaders to draw deformed vertices
+    software_deformation = !software_deformation;
+    for ( Models::iterator iter = models.begin(); iter != models.end(); ++iter )
+    {
+        if( software_deformation )
+            (*iter)->set_software_deformation( deformed_shader, deformed_shadow_shader );
+        else
+            (*iter)->set_software_deformation( NULL, NULL );
     }
 }
 
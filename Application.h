@@ -4,6 +4,8 @@
 #include "Window.h"
 #include "Vertex.h"
 #include "Model.h"
+#include "lighting.h"
+#include "parallel.h"
 
 #pragma warning( disable : 4996 ) // disable deprecated warning 
 #pragma warning( disable : 4995 ) // disable deprecated warning 
@@ -12,6 +14,7 @@
 #pragma warning( default : 4995 ) // disable deprecated warning 
 
 extern const unsigned VECTORS_IN_MATRIX;
+extern const unsigned SHADER_REG_BONE_PALETTE;
 typedef std::list<Model*> Models;
 
 class Application
@@ -22,6 +25,7 @@ private:
 
     bool point_light_enabled;
     bool ambient_light_enabled;
+    bool specular_enabled;
 
     Window window;
 
@@ -34,8 +38,22 @@ private:
 
     Camera camera;
 
+    // Shaders of models deformed on the CPU (see Model::set_software_deformation()), when it is turned on
+    VertexShader *deformed_shader;
+    VertexShader *deformed_shadow_shader;
+    bool software_deformation;
+    unsigned threads_count;
+    WorkerPool workers; // of threads_count, for every parallel_for() of a frame
+
     D3DXVECTOR3 point_light_position;
 
+    // shown in the window title
+    DWORD culled_triangles_count;
+    DWORD64 lit_fetched_bytes;      // bytes of vertices fetched by the models in the lit pass...
+    DWORD64 shadow_fetched_bytes;   // ... and in the shadow pass
+    unsigned shader_source_slots;   // instruction slots of the shader files...
+    unsigned shader_slots;          // ... and of the shaders as they are assembled (see shader_opt.h)
+
     const float *filter;
 
     // Initialization steps:
@@ -84,8 +102,17 @@ private:
 
     void rotate_models(float phi);
     void process_key(unsigned code);
-
-    void draw_model(Model *model, float time, bool shadow);
+    LightingConstants get_lighting_constants() const; // as render() sets them
+    void benchmark_software(); // shows the throughput in the window title
+    void toggle_software_deformation();
+    void show_shader_slots(); // in the window title
+    DWORD get_shader_features() const; // of the lights which are on (see shader_variants.h)
+    void set_shader_features(); // switches the models to the variants of their shaders for the lights
+
+    DWORD cull_models(); // returns number of triangles culled
+    void deform_models(float time); // models deformed in software, once for both passes
+    DWORD64 draw_model(Model *model, float time, bool shadow); // returns number of bytes of vertices fetched
+    void show_status(DWORD culled, DWORD64 lit_bytes, DWORD64 shadow_bytes);
     void render();
 
     // Deinitialization steps:
@@ -95,10 +122,25 @@ private:
 public:
     Application();
     IDirect3DDevice9 * get_device();
+    const D3DXVECTOR3 &get_point_light_position() const { return point_light_position; }
 
     void add_model(Model &model);
-    void set_plane(Plane &_plane) { plane = &_plane; }
-    void set_light_source_model(LightSource &_light_source) { light_source = &_light_source; }
+    void set_plane(Plane &_plane) { plane = &_plane; _plane.set_shader_features( get_shader_features() ); }
+    void set_light_source_model(LightSource &_light_source)
+    {
+        light_source = &_light_source;
+        _light_source.set_shader_features( get_shader_features() );
+    }
+    void add_shader_slots(unsigned source_slots, unsigned slots)
+    {
+        shader_source_slots += source_slots;
+        shader_slots += slots;
+    }
+    void set_deformed_shaders(VertexShader &vertex_shader, VertexShader &shadow_vertex_shader)
+    {
+        deformed_shader = &vertex_shader;
+        deformed_shadow_shader = &shadow_vertex_shader;
+    }
     void create_target_plane(VertexShader &vertex_shader, PixelShader &pixel_shader,
                              const TexturedVertex *vertices, unsigned int vertices_count,
                              const Index *indices, unsigned int indices_count)
@@ -158,3 +158,12 @@ D3DXVECTOR3 Camera::get_eye() const
 {
     return spheric_to_cartesian( eye_spheric );
 }
+
+float Camera::get_screen_scale(const D3DXVECTOR3 &center, float radius) const
+{
+    // w of a projected point is its depth (see PROJ_MX)
+    float depth = mx._41*center.x + mx._42*center.y + mx._43*center.z + mx._44 - radius;
+    if( depth < NEAR_CLIP )
+        depth = NEAR_CLIP;
+    return PROJ_MX._22/depth;
+}
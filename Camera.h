@@ -44,4 +44,6 @@ public:
 
     D3DXMATRIX get_matrix() const;
     D3DXVECTOR3 get_eye() const;
+    // How many viewport half-heights a unit of length takes on the screen at the nearest point of the sphere
+    float get_screen_scale(const D3DXVECTOR3 &center, float radius) const;
 };
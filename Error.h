@@ -1,6 +1,6 @@
 #pragma once
 #include <exception>
-#include <tchar.h>
+#include "platform.h"
 
 class RuntimeError : public std::exception
 {
@@ -101,6 +101,25 @@ class NoTargetPlaneError : public RuntimeError
 public:
     NoTargetPlaneError() : RuntimeError( _T("Error: attempting to run application when no target plane created") ) {}
 };
+class ShaderFileError : public RuntimeError
+{
+public:
+    ShaderFileError() : RuntimeError( _T("Error while reading shader file") ) {}
+};
+class ShaderParseError : public RuntimeError
+{
+private:
+    unsigned line;
+public:
+    // `line' of the shader text (from 1)
+    explicit ShaderParseError(unsigned line) : RuntimeError( _T("Error while parsing shader assembly") ), line(line) {}
+    unsigned get_line() const { return line; }
+};
+class MeshCacheError : public RuntimeError
+{
+public:
+    MeshCacheError() : RuntimeError( _T("Error while decoding cached mesh") ) {}
+};
 
 inline void check_render( HRESULT res )
 {
@@ -1,70 +1,220 @@
 #include "Model.h"
 #include "matrices.h"
+#include "skinning.h"
+#include "plane.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <map>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
 
 namespace
 {
-    const float SKINNING_PERIOD = 2.0f;
-    const float SKINNING_OMEGA = 2.0f*D3DX_PI/SKINNING_PERIOD;
-    const float SKINNING_ANGLE = D3DX_PI/8.0f;
-
     const float MORPHING_PERIOD = 3.0f;
     const float MORPHING_OMEGA = 2.0f*D3DX_PI/MORPHING_PERIOD;
+    const unsigned MORPHING_POSES_PER_PERIOD = 64;
+    // vertices of the mesh which are already on the sphere are not kept by its blend shape
+    const float MORPHING_MIN_DELTA = 1e-5f;
 
     const unsigned MORPHING_CONSTANTS_USED = 2; // final radius and t
     const unsigned LIGHT_SOURCE_CONSTANTS_USED = 1; // radius
 }
 
 extern const unsigned VECTORS_IN_MATRIX;
+extern const unsigned SHADER_REG_BONE_PALETTE;
 
 Model::Model(   IDirect3DDevice9 *device, D3DPRIMITIVETYPE primitive_type,
                 VertexShader &vertex_shader, VertexShader &shadow_vertex_shader, PixelShader &pixel_shader, PixelShader &shadow_pixel_shader,
-                VertexDeclaration &vertex_declaration, unsigned vertex_size,
-                const Vertex *vertices, unsigned vertices_count, const Index *indices, unsigned indices_count,
-                unsigned primitives_count, D3DXVECTOR3 position, D3DXVECTOR3 rotation )
+                VertexFormat &vertex_format,
+                const VertexSource &vertices, const Index *indices, unsigned indices_count,
+                unsigned primitives_count, const Cluster *clusters, unsigned clusters_count, bool cull_back_faces,
+                const LodLevel *lods, unsigned lods_count, D3DXVECTOR3 position, D3DXVECTOR3 rotation )
  
-: device(device), vertices_count(vertices_count), primitives_count(primitives_count),
-  primitive_type(primitive_type), vertex_buffer(NULL), index_buffer(NULL),
-  position(position), rotation(rotation), 
+: device(device), vertices_count(vertices.get_vertices_count()), primitives_count(primitives_count),
+  primitive_type(primitive_type), index_buffer(NULL), short_index_buffer(NULL),
+  position(position), rotation(rotation), cull_back_faces(cull_back_faces), bounds_center(0, 0, 0), bounds_radius(0), lod(0),
+  deformed_vertex_shader(NULL), deformed_shadow_vertex_shader(NULL), shader_features(ALL_SHADER_FEATURES),
   vertex_shader(vertex_shader), shadow_vertex_shader(shadow_vertex_shader), pixel_shader(pixel_shader), shadow_pixel_shader(shadow_pixel_shader),
-  vertex_declaration(vertex_declaration), vertex_size(vertex_size)
+  vertex_format(vertex_format)
 {
-    _ASSERT(vertices != NULL);
     _ASSERT(indices != NULL);
+    _ASSERT( clusters != NULL || clusters_count == 0 );
+    _ASSERT( lods != NULL || lods_count == 0 );
+    for( unsigned i = 0; i < VERTEX_STREAMS_COUNT; ++i )
+    {
+        vertex_buffers[i] = NULL;
+        deformed_buffers[i] = NULL;
+    }
     try
     {
-        const unsigned vertices_size = vertices_count*vertex_size;
-        const unsigned indices_size = indices_count*sizeof(indices[0]);
+        // the source fills all streams at once: the locked buffers are the only copy of vertices it writes
+        VOID* streams_to_fill[VERTEX_STREAMS_COUNT];
+        for( unsigned i = 0; i < VERTEX_STREAMS_COUNT; ++i )
+        {
+            const UINT stream_size = get_count( get_array_size( this->vertices_count, vertex_format.get_stream_size(i) ) );
+
+            if(FAILED( device->CreateVertexBuffer( stream_size, D3DUSAGE_WRITEONLY, 0, D3DPOOL_DEFAULT, &vertex_buffers[i], NULL ) ))
+                throw VertexBufferInitError();
+
+            if(FAILED( vertex_buffers[i]->Lock( 0, stream_size, &streams_to_fill[i], 0 ) ))
+            {
+                for( unsigned j = 0; j < i; ++j )
+                    vertex_buffers[j]->Unlock();
+                throw VertexBufferFillError();
+            }
+        }
+        try
+        {
+            vertices.write_streams( vertex_format, streams_to_fill );
+        }
+        // using catch(...) because every caught exception is rethrown
+        catch(...)
+        {
+            for( unsigned i = 0; i < VERTEX_STREAMS_COUNT; ++i )
+                vertex_buffers[i]->Unlock();
+            throw;
+        }
+        for( unsigned i = 0; i < VERTEX_STREAMS_COUNT; ++i )
+            vertex_buffers[i]->Unlock();
+
+        this->clusters.assign( clusters, clusters + clusters_count );
+        this->lods.assign( lods, lods + lods_count );
+        D3DCAPS9 caps;
+        limits = SUCCEEDED( device->GetDeviceCaps( &caps ) ) ? get_draw_limits( caps.MaxPrimitiveCount, caps.MaxVertexIndex )
+                                                              : get_draw_limits( 0, 0 );
+        build_index_buffers( indices, indices_count );
+        update_bounds();
+        show_all_clusters();
+    
+        update_matrix();
+    }
+    // using catch(...) because every caught exception is rethrown
+    catch(...)
+    {
+        release_interfaces();
+        throw;
+    }
+}
 
-        if(FAILED( device->CreateVertexBuffer( vertices_size, D3DUSAGE_WRITEONLY, 0, D3DPOOL_DEFAULT, &vertex_buffer, NULL ) ))
-            throw VertexBufferInitError();
-        
+void Model::build_index_buffers(const Index *indices, unsigned indices_count)
+{
+    // parts with their primitive types (only ranges and base vertices of these clusters are used)
+    std::vector<Cluster> parts;
+    std::vector<D3DPRIMITIVETYPE> part_types;
+    if( !clusters.empty() )
+    {
+        parts = clusters;
+        part_types.resize( clusters.size(), primitive_type );
+        for( unsigned i = 0; i < lods.size(); ++i )
+        {
+            for( DWORD j = lods[i].first_cluster; j < lods[i].first_cluster + lods[i].clusters_count && j < clusters.size(); ++j )
+                part_types[j] = static_cast<D3DPRIMITIVETYPE>( lods[i].primitive_type );
+        }
+    }
+    else
+    {
+        Cluster part = Cluster();
+        for( unsigned i = 0; i < lods.size(); ++i )
+        {
+            part.first_index = lods[i].first_index;
+            part.indices_count = lods[i].indices_count;
+            part.base_vertex = lods[i].first_vertex;
+            parts.push_back( part );
+            part_types.push_back( static_cast<D3DPRIMITIVETYPE>( lods[i].primitive_type ) );
+        }
+        if( lods.empty() )
+        {
+            part.first_index = 0;
+            part.indices_count = ( primitive_type == D3DPT_TRIANGLESTRIP ) ? primitives_count + 2 : primitives_count*VERTICES_PER_TRIANGLE;
+            part.base_vertex = 0;
+            parts.push_back( part );
+            part_types.push_back( primitive_type );
+        }
+    }
 
-        if(FAILED( device->CreateIndexBuffer( indices_size, D3DUSAGE_WRITEONLY, INDEX_FORMAT, D3DPOOL_DEFAULT, &index_buffer, NULL ) ))
-            throw IndexBufferInitError();
+    // every range of the given indices is split once, even if several parts share it (see MeshChain::add_chunk())
+    std::vector<SubRange> subranges;
+    std::vector<DWORD> part_subranges_begin( parts.size() );
+    std::vector<DWORD> part_subranges_end( parts.size() );
+    std::map< std::pair<DWORD, DWORD>, unsigned > split_parts; // the first part with this range
+    for( unsigned i = 0; i < parts.size(); ++i )
+    {
+        _ASSERT( static_cast<DWORD64>(parts[i].first_index) + parts[i].indices_count <= indices_count );
+        const std::pair<DWORD, DWORD> range( parts[i].first_index, parts[i].indices_count );
+        std::map< std::pair<DWORD, DWORD>, unsigned >::const_iterator found = split_parts.find( range );
+        if( found != split_parts.end() )
+        {
+            part_subranges_begin[i] = part_subranges_begin[found->second];
+            part_subranges_end[i] = part_subranges_end[found->second];
+            continue;
+        }
+        split_parts[range] = i;
+        part_subranges_begin[i] = static_cast<DWORD>( subranges.size() );
+        if( range.second != 0 )
+            split_range( indices, range.first, range.second, part_types[i], limits, subranges );
+        part_subranges_end[i] = static_cast<DWORD>( subranges.size() );
+    }
 
-        // fill the vertex buffer.
-        VOID* vertices_to_fill;
-        if(FAILED( vertex_buffer->Lock( 0, vertices_size, &vertices_to_fill, 0 ) ))
-            throw VertexBufferFillError();
-        memcpy( vertices_to_fill, vertices, vertices_size );
-        vertex_buffer->Unlock();
+    // places of sub-ranges in the buffers of their index sizes
+    std::vector<DWORD> buffer_first_indices( subranges.size() );
+    DWORD64 indices_counts[2] = { 0, 0 }; // 32-bit and 16-bit ones
+    for( unsigned i = 0; i < subranges.size(); ++i )
+    {
+        DWORD64 &buffer_indices_count = indices_counts[subranges[i].short_indices ? 1 : 0];
+        buffer_first_indices[i] = get_count( buffer_indices_count );
+        buffer_indices_count += subranges[i].indices_count;
+    }
+
+    for( unsigned short_indices = 0; short_indices <= 1; ++short_indices )
+    {
+        if( indices_counts[short_indices] == 0 )
+            continue;
+        const size_t index_size = short_indices ? sizeof(ShortIndex) : sizeof(Index);
+        const UINT indices_size = get_count( get_array_size( indices_counts[short_indices], index_size ) );
+        IDirect3DIndexBuffer9 *&buffer = short_indices ? short_index_buffer : index_buffer;
+        if(FAILED( device->CreateIndexBuffer( indices_size, D3DUSAGE_WRITEONLY, short_indices ? SHORT_INDEX_FORMAT : INDEX_FORMAT,
+                                              D3DPOOL_DEFAULT, &buffer, NULL ) ))
+            throw IndexBufferInitError();
 
         // fill the index buffer.
         VOID* indices_to_fill;
-        if(FAILED( index_buffer->Lock( 0, indices_size, &indices_to_fill, 0 ) ))
+        if(FAILED( buffer->Lock( 0, indices_size, &indices_to_fill, 0 ) ))
             throw IndexBufferFillError();
-        memcpy( indices_to_fill, indices, indices_size );
-        index_buffer->Unlock();
-    
-        update_matrix();
+        for( unsigned i = 0; i < subranges.size(); ++i )
+        {
+            if( subranges[i].short_indices != (short_indices != 0) )
+                continue;
+            const size_t offset = static_cast<size_t>( buffer_first_indices[i] )*index_size;
+            write_subrange( indices, subranges[i], static_cast<BYTE*>(indices_to_fill) + offset );
+        }
+        buffer->Unlock();
     }
-    // using catch(...) because every caught exception is rethrown
-    catch(...)
+
+    part_ranges.clear();
+    part_ranges_begin.resize( parts.size() + 1 );
+    for( unsigned i = 0; i < parts.size(); ++i )
     {
-        release_interfaces();
-        throw;
+        part_ranges_begin[i] = static_cast<DWORD>( part_ranges.size() );
+        for( DWORD j = part_subranges_begin[i]; j < part_subranges_end[i]; ++j )
+        {
+            const SubRange &subrange = subranges[j];
+            const Index shift = subrange.rebased ? subrange.min_index : 0;
+            IndexRange range;
+            range.first_index = buffer_first_indices[j];
+            range.indices_count = subrange.indices_count;
+            range.base_vertex = parts[i].base_vertex + shift;
+            range.min_index = subrange.min_index - shift;
+            range.vertices_count = subrange.max_index - subrange.min_index + 1;
+            range.short_indices = subrange.short_indices;
+            range.source_first_index = subrange.first_index;
+            range.palette = 0; // see init_clusters()
+            part_ranges.push_back( range );
+        }
     }
+    part_ranges_begin[parts.size()] = static_cast<DWORD>( part_ranges.size() );
 }
+
 void Model::set_textures(bool shadow, unsigned samplers_count /*= 1*/)
 {
     UNREFERENCED_PARAMETER(shadow);
@@ -74,11 +224,237 @@ void Model::set_textures(bool shadow, unsigned samplers_count /*= 1*/)
     }
 }
 
-void Model::draw() const
+DWORD64 Model::draw(bool shadow /*= false*/) const
+{
+    if( !clusters.empty() )
+        return draw_ranges( all_ranges.empty() ? NULL : &all_ranges[0], static_cast<unsigned>( all_ranges.size() ), shadow );
+    // the part of the chosen level, or of the whole mesh
+    const unsigned part = lods.empty() ? 0 : lod;
+    const DWORD begin = part_ranges_begin[part];
+    return draw_ranges( part_ranges.empty() ? NULL : &part_ranges[begin], part_ranges_begin[part + 1] - begin, shadow );
+}
+
+void Model::init_clusters()
+{
+    for( unsigned i = 0; i < clusters.size(); ++i )
+    {
+        add_deformation_to_bounds( clusters[i] );
+        // parts are the clusters
+        for( DWORD j = part_ranges_begin[i]; j < part_ranges_begin[i + 1]; ++j )
+            part_ranges[j].palette = get_palette(i);
+    }
+    update_bounds();
+    show_all_clusters();
+}
+
+void Model::update_bounds()
+{
+    // sphere around the bounding box of cluster spheres
+    const unsigned clusters_count = static_cast<unsigned>( clusters.size() );
+    bounds_center = D3DXVECTOR3(0, 0, 0);
+    bounds_radius = 0;
+    if( clusters_count > 0 )
+    {
+        D3DXVECTOR3 min_corner = clusters[0].center;
+        D3DXVECTOR3 max_corner = clusters[0].center;
+        for( unsigned i = 0; i < clusters_count; ++i )
+        {
+            const Cluster &cluster = clusters[i];
+            const D3DXVECTOR3 radius_vector( cluster.radius, cluster.radius, cluster.radius );
+            const D3DXVECTOR3 cluster_min = cluster.center - radius_vector;
+            const D3DXVECTOR3 cluster_max = cluster.center + radius_vector;
+            D3DXVec3Minimize( &min_corner, &min_corner, &cluster_min );
+            D3DXVec3Maximize( &max_corner, &max_corner, &cluster_max );
+        }
+        bounds_center = (min_corner + max_corner)/2;
+        for( unsigned i = 0; i < clusters_count; ++i )
+        {
+            D3DXVECTOR3 to_cluster = clusters[i].center - bounds_center;
+            const float distance = D3DXVec3Length(&to_cluster) + clusters[i].radius;
+            if( distance > bounds_radius )
+                bounds_radius = distance;
+        }
+    }
+}
+
+void Model::get_lod_clusters(unsigned &first_cluster, unsigned &end_cluster) const
+{
+    first_cluster = lods.empty() ? 0 : lods[lod].first_cluster;
+    end_cluster = lods.empty() ? static_cast<unsigned>( clusters.size() ) : first_cluster + lods[lod].clusters_count;
+    _ASSERT( end_cluster <= clusters.size() );
+}
+
+void Model::add_part(std::vector<IndexRange> &ranges, unsigned part) const
+{
+    const D3DPRIMITIVETYPE level_primitive_type = lods.empty() ? primitive_type : static_cast<D3DPRIMITIVETYPE>(lods[lod].primitive_type);
+    for( DWORD i = part_ranges_begin[part]; i < part_ranges_begin[part + 1]; ++i )
+    {
+        const IndexRange &range = part_ranges[i];
+        if( !ranges.empty() && join_range( ranges.back(), range, level_primitive_type, limits ) )
+            continue;
+        ranges.push_back( range );
+    }
+}
+
+void Model::show_all_clusters()
+{
+    unsigned first_cluster, end_cluster;
+    get_lod_clusters( first_cluster, end_cluster );
+    all_ranges.clear();
+    for( unsigned i = first_cluster; i < end_cluster; ++i )
+        add_part( all_ranges, i );
+    // everything is visible until culled
+    visible_ranges = all_ranges;
+}
+
+DWORD Model::cull(const Frustum &frustum, const D3DXVECTOR3 &eye)
+{
+    DWORD culled_triangles_count = 0;
+    visible_ranges.clear();
+    unsigned first_cluster, end_cluster;
+    get_lod_clusters( first_cluster, end_cluster );
+    for( unsigned i = first_cluster; i < end_cluster; ++i )
+    {
+        const Cluster &cluster = clusters[i];
+        if( !is_cluster_visible( cluster, rotation_and_position, frustum, eye, cull_back_faces ) )
+        {
+            culled_triangles_count += cluster.triangles_count;
+            continue;
+        }
+        add_part( visible_ranges, i );
+    }
+    return culled_triangles_count;
+}
+
+DWORD64 Model::draw_visible() const
+{
+    if( clusters.empty() )
+        return draw();
+    return draw_ranges( visible_ranges.empty() ? NULL : &visible_ranges[0], static_cast<unsigned>( visible_ranges.size() ), false );
+}
+
+DWORD64 Model::draw_ranges(const IndexRange *ranges, unsigned ranges_count, bool shadow) const
+{
+    const D3DPRIMITIVETYPE level_primitive_type = lods.empty() ? primitive_type : static_cast<D3DPRIMITIVETYPE>(lods[lod].primitive_type);
+
+    // the shadow pass binds only the stream its declaration reads
+    const VertexFormat &format = get_drawn_format();
+    IDirect3DVertexBuffer9 * const *buffers = is_deformed_in_software() ? deformed_buffers : vertex_buffers;
+    unsigned fetched_vertex_size = 0;
+    for( unsigned i = 0; i < VertexFormat::get_streams_count(shadow); ++i )
+    {
+        check_render( device->SetStreamSource( i, buffers[i], 0, format.get_stream_size(i) ) );
+        fetched_vertex_size += format.get_stream_size(i);
+    }
+    DWORD64 fetched_bytes = 0;
+    bool indices_set = false;
+    bool short_indices_set = false;
+    bool palette_set = false;
+    unsigned palette = 0;
+    for( unsigned i = 0; i < ranges_count; ++i )
+    {
+        const IndexRange &range = ranges[i];
+        const DWORD range_primitives_count = get_primitives_count( level_primitive_type, range.indices_count );
+        if( range_primitives_count == 0 )
+            continue;
+        // vertices deformed in software need no constants
+        if( !is_deformed_in_software() && ( !palette_set || palette != range.palette ) )
+        {
+            set_palette( range.palette );
+            palette_set = true;
+            palette = range.palette;
+        }
+        if( !indices_set || short_indices_set != range.short_indices )
+        {
+            check_render( device->SetIndices( range.short_indices ? short_index_buffer : index_buffer ) );
+            indices_set = true;
+            short_indices_set = range.short_indices;
+        }
+        check_render( device->DrawIndexedPrimitive( level_primitive_type, range.base_vertex, range.min_index, range.vertices_count,
+                                                    range.first_index, range_primitives_count ) );
+        fetched_bytes += static_cast<DWORD64>( range.vertices_count )*fetched_vertex_size;
+    }
+    return fetched_bytes;
+}
+
+void Model::select_lod(const Camera &camera, float viewport_height)
 {
-    check_render( device->SetStreamSource( 0, vertex_buffer, 0, vertex_size ) );
-    check_render( device->SetIndices( index_buffer ) );
-    check_render( device->DrawIndexedPrimitive( primitive_type, 0, 0, vertices_count, 0, primitives_count ) );
+    if( lods.empty() )
+        return;
+    const D3DXVECTOR3 center = transform_point( rotation_and_position, bounds_center );
+    const float pixels_per_unit = camera.get_screen_scale( center, bounds_radius )*viewport_height/2;
+    const unsigned chosen = choose_lod( &lods[0], static_cast<unsigned>( lods.size() ), lod, pixels_per_unit );
+    if( chosen != lod )
+    {
+        lod = chosen;
+        show_all_clusters();
+    }
+}
+
+VertexFormat &Model::get_drawn_format() const
+{
+    return is_deformed_in_software() ? Vertex::get_format( device ) : vertex_format;
+}
+
+void Model::set_software_deformation(VertexShader *vertex_shader, VertexShader *shadow_vertex_shader)
+{
+    _ASSERT( ( vertex_shader == NULL ) == ( shadow_vertex_shader == NULL ) );
+    if( !can_deform() )
+        return;
+    if( vertex_shader != NULL && deformed_buffers[0] == NULL )
+    {
+        // the buffers are rewritten every frame, so they are created when they are needed first
+        const VertexFormat &format = Vertex::get_format( device );
+        for( unsigned i = 0; i < VERTEX_STREAMS_COUNT; ++i )
+        {
+            const UINT stream_size = get_count( get_array_size( vertices_count, format.get_stream_size(i) ) );
+            if(FAILED( device->CreateVertexBuffer( stream_size, D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, 0, D3DPOOL_DEFAULT, &deformed_buffers[i], NULL ) ))
+            {
+                // NULL again, so that the destructor does not release them twice and the next call retries
+                for( unsigned j = 0; j < VERTEX_STREAMS_COUNT; ++j )
+                {
+                    release_interface( deformed_buffers[j] );
+                    deformed_buffers[j] = NULL;
+                }
+                throw VertexBufferInitError();
+            }
+        }
+    }
+    deformed_vertex_shader = vertex_shader;
+    deformed_shadow_vertex_shader = shadow_vertex_shader;
+}
+
+void Model::deform_vertices(unsigned threads_count)
+{
+    if( !is_deformed_in_software() )
+        return;
+    const VertexFormat &format = Vertex::get_format( device );
+    _ASSERT( VERTEX_STREAMS_COUNT == 2 );
+    _ASSERT( format.get_stream_size(0) == sizeof(DeformedPosition) && format.get_stream_size(1) == sizeof(DeformedNormal) );
+
+    // only vertices of the chosen level are drawn: the rest of the buffers may be left discarded
+    DeformedStreams streams = DeformedStreams();
+    streams.first_vertex = lods.empty() ? 0 : lods[lod].first_vertex;
+    streams.end_vertex = lods.empty() ? vertices_count : lods[lod].first_vertex + lods[lod].vertices_count;
+    if( streams.first_vertex == streams.end_vertex )
+        return;
+    void *locked[VERTEX_STREAMS_COUNT];
+    for( unsigned i = 0; i < VERTEX_STREAMS_COUNT; ++i )
+    {
+        const UINT offset = get_count( get_array_size( streams.first_vertex, format.get_stream_size(i) ) );
+        const UINT size = get_count( get_array_size( streams.end_vertex - streams.first_vertex, format.get_stream_size(i) ) );
+        if(FAILED( deformed_buffers[i]->Lock( offset, size, &locked[i], D3DLOCK_DISCARD ) ))
+        {
+            for( unsigned j = 0; j < i; ++j )
+                deformed_buffers[j]->Unlock();
+            throw VertexBufferFillError();
+        }
+    }
+    streams.positions = static_cast<DeformedPosition*>( locked[0] );
+    streams.normals = static_cast<DeformedNormal*>( locked[1] );
+    deform( threads_count, streams );
+    for( unsigned i = 0; i < VERTEX_STREAMS_COUNT; ++i )
+        deformed_buffers[i]->Unlock();
 }
 
 void Model::update_matrix()
@@ -99,8 +475,13 @@ const D3DXMATRIX &Model::get_rotation_and_position() const
 
 void Model::release_interfaces()
 {
-    release_interface(vertex_buffer);
+    for( unsigned i = 0; i < VERTEX_STREAMS_COUNT; ++i )
+    {
+        release_interface(vertex_buffers[i]);
+        release_interface(deformed_buffers[i]);
+    }
     release_interface(index_buffer);
+    release_interface(short_index_buffer);
 }
 
 Model::~Model()
@@ -112,44 +493,146 @@ Model::~Model()
 
 SkinningModel::SkinningModel(IDirect3DDevice9 *device, D3DPRIMITIVETYPE primitive_type, VertexShader &vertex_shader, VertexShader &shadow_vertex_shader, PixelShader &pixel_shader,
                              const SkinningVertex *vertices, unsigned int vertices_count, const Index *indices, unsigned int indices_count,
-                             unsigned int primitives_count, D3DXVECTOR3 position, D3DXVECTOR3 rotation, D3DXVECTOR3 bone_center)
-: Model(device, primitive_type, vertex_shader, shadow_vertex_shader, pixel_shader, pixel_shader, SkinningVertex::get_declaration(device), sizeof(SkinningVertex), vertices, vertices_count, indices, indices_count, primitives_count, position, rotation),
-  bone_center(bone_center)
+                             unsigned int primitives_count, const Cluster *clusters, unsigned clusters_count, bool cull_back_faces,
+                             const LodLevel *lods, unsigned lods_count, D3DXVECTOR3 position, D3DXVECTOR3 rotation, D3DXVECTOR3 bone_center,
+                             unsigned bones_count, const BonePalette *palettes, unsigned palettes_count)
+: Model(device, primitive_type, vertex_shader, shadow_vertex_shader, pixel_shader, pixel_shader, SkinningVertex::get_format(device), InterleavedVertices(vertices, vertices_count), indices, indices_count, primitives_count,
+        clusters, clusters_count, cull_back_faces, lods, lods_count, position, rotation),
+  bone_center(bone_center), bones(bones_count, rotate_x_matrix(0.0f)), palettes(palettes, palettes + palettes_count),
+  poses(SKINNING_PERIOD, SKINNING_POSES_PER_PERIOD, bones_count*sizeof(D3DXMATRIX)/sizeof(float)),
+  software_vertices(SOFTWARE_SKINNING_VERTEX_COLUMNS, vertices_count), colors(vertices_count)
 {
-    _ASSERT( BONES_COUNT <= sizeof(D3DXVECTOR4) ); // to fit weights into vertex shader register
-    for(unsigned i = 0; i < BONES_COUNT; ++i)
-        bones[i] = rotate_x_matrix(0.0f);
+    _ASSERT( bones_count > 0 && bones_count <= MAX_BONES_COUNT );
+    _ASSERT( palettes != NULL && palettes_count > 0 );
+    _ASSERT( BONE_INFLUENCES_COUNT <= sizeof(D3DXVECTOR4)/sizeof(float) ); // to fit weights into vertex shader register
+    for( unsigned i = 0; i < palettes_count; ++i )
+    {
+        const BonePalette &palette = palettes[i];
+        if( cluster_palettes.size() < palette.first_cluster + palette.clusters_count )
+            cluster_palettes.resize( palette.first_cluster + palette.clusters_count, 0 );
+        for( DWORD j = palette.first_cluster; j < palette.first_cluster + palette.clusters_count; ++j )
+            cluster_palettes[j] = i;
+    }
+
+    // software skinning takes all bones of the mesh at once
+    load_software_vertices( vertices, vertices_count, software_vertices );
+    for( unsigned i = 0; i < palettes_count; ++i )
+    {
+        const BonePalette &palette = palettes[i];
+        _ASSERT( palette.first_vertex + palette.vertices_count <= vertices_count );
+        for( unsigned j = 0; j < BONE_INFLUENCES_COUNT; ++j )
+        {
+            float *column = software_vertices.get_column(SOFTWARE_BONE + j);
+            for( Index k = palette.first_vertex; k < palette.first_vertex + palette.vertices_count; ++k )
+                column[k] = palette.bones[static_cast<unsigned>( column[k] )];
+        }
+    }
+    software_vertices.pad();
+    for( Index i = 0; i < vertices_count; ++i )
+        colors[i] = vertices[i].color;
+    sample_bent_bones( bone_center, bones_count, poses );
+    bend_bones( 0.0f, bone_center, bones_count, &bones[0] );
+    init_clusters();
 }
 
 void SkinningModel::set_time(float time)
 {
-    // first bone will set the rotation
-    float angle = SKINNING_ANGLE*sin(SKINNING_OMEGA*time);
-    bones[0] = rotate_x_matrix( angle, bone_center );
-    // others will still be a unity matrix
+    poses.get( time, bones[0] );
 }
 
-unsigned SkinningModel::set_constants(D3DXVECTOR4 *out_data, unsigned buffer_size) const
-// returns number of constant registers used
+void SkinningModel::deform(unsigned threads_count, DeformedStreams &res) const
+{
+    res.colors = &colors[0];
+    skin_deformed_vertices( software_vertices, &bones[0], static_cast<unsigned>( bones.size() ), threads_count, res );
+}
+
+unsigned SkinningModel::get_palette(unsigned cluster) const
+{
+    _ASSERT( cluster < cluster_palettes.size() ); // clusters of the partition (see palette.h)
+    return ( cluster < cluster_palettes.size() ) ? cluster_palettes[cluster] : 0;
+}
+
+void SkinningModel::set_palette(unsigned palette) const
+{
+    _ASSERT( palette < palettes.size() );
+    // 4x3 matrices: the rows of a bone but the last one
+    const BonePalette &bone_palette = palettes[palette];
+    D3DXVECTOR4 registers[BONE_PALETTE_SIZE*REGISTERS_PER_BONE];
+    for( unsigned i = 0; i < bone_palette.bones_count; ++i )
+    {
+        _ASSERT( bone_palette.bones[i] < bones.size() );
+        memcpy( &registers[i*REGISTERS_PER_BONE], &bones[bone_palette.bones[i]], REGISTERS_PER_BONE*sizeof(D3DXVECTOR4) );
+    }
+    check_render( get_device()->SetVertexShaderConstantF( SHADER_REG_BONE_PALETTE, *registers, bone_palette.bones_count*REGISTERS_PER_BONE ) );
+}
+
+void SkinningModel::add_deformation_to_bounds(Cluster &cluster) const
 {
-    _ASSERT( buffer_size >= BONES_COUNT*VECTORS_IN_MATRIX ); // enough space?
-    memcpy(out_data, bones, BONES_COUNT*VECTORS_IN_MATRIX*sizeof(D3DXVECTOR4));
-    return BONES_COUNT*VECTORS_IN_MATRIX;
+    // every bone rotates around the x axis through `bone_center' by at most SKINNING_ANGLE,
+    // and a point moves by at most the chord of this angle (blending by weights only makes the way shorter)
+    D3DXVECTOR3 from_bone_center = cluster.center - bone_center;
+    const float max_distance = D3DXVec3Length(&from_bone_center) + cluster.radius;
+    cluster.radius += 2*max_distance*sin(SKINNING_ANGLE/2);
+    cluster.cone_angle += SKINNING_ANGLE;
 }
 
 // -------------------------------------- MorphingModel -------------------------------------------------------------
 
 MorphingModel::MorphingModel(IDirect3DDevice9 *device, D3DPRIMITIVETYPE primitive_type, VertexShader &vertex_shader, VertexShader &shadow_vertex_shader, PixelShader &pixel_shader,
                              const Vertex *vertices, unsigned int vertices_count, const Index *indices, unsigned int indices_count,
-                             unsigned int primitives_count, D3DXVECTOR3 position, D3DXVECTOR3 rotation, float final_radius)
-: Model(device, primitive_type, vertex_shader, shadow_vertex_shader, pixel_shader, pixel_shader, Vertex::get_declaration(device), sizeof(Vertex), vertices, vertices_count, indices, indices_count, primitives_count, position, rotation),
-  morphing_param(1), final_radius(final_radius)
+                             unsigned int primitives_count, const Cluster *clusters, unsigned clusters_count, bool cull_back_faces,
+                             const LodLevel *lods, unsigned lods_count, D3DXVECTOR3 position, D3DXVECTOR3 rotation, float final_radius)
+: Model(device, primitive_type, vertex_shader, shadow_vertex_shader, pixel_shader, pixel_shader, Vertex::get_format(device), InterleavedVertices(vertices, vertices_count), indices, indices_count, primitives_count,
+        clusters, clusters_count, cull_back_faces, lods, lods_count, position, rotation),
+  morphing_param(1), final_radius(final_radius), poses(MORPHING_PERIOD, MORPHING_POSES_PER_PERIOD, 1),
+  shapes(vertices, vertices_count), colors(vertices_count)
 {
+    for( unsigned i = 0; i < MORPHING_POSES_PER_PERIOD; ++i )
+    {
+        const float param = (-cos(MORPHING_OMEGA*poses.get_sample_time(i)) + 1.0f)/2.0f; // parameter of morhing: 0 to 1
+        poses.set_pose( i, &param );
+    }
+
+    // the target of morphing.vsh at t = 1: p*final_radius/|p| with the normal p/|p|
+    std::vector<Vertex> sphere( vertices, vertices + vertices_count );
+    for( Index i = 0; i < vertices_count; ++i )
+    {
+        const D3DXVECTOR3 direction = vertices[i].pos/D3DXVec3Length( &vertices[i].pos );
+        sphere[i].pos = direction*final_radius;
+        sphere[i].set_normal( direction );
+        colors[i] = vertices[i].color;
+    }
+    shapes.add_target( &sphere[0], MORPHING_MIN_DELTA );
+    init_clusters();
 }
 
 void MorphingModel::set_time(float time)
 {
-    morphing_param = (-cos(MORPHING_OMEGA*time) + 1.0f)/2.0f; // parameter of morhing: 0 to 1
+    poses.get( time, &morphing_param );
+}
+
+void MorphingModel::deform(unsigned threads_count, DeformedStreams &res) const
+{
+    res.colors = &colors[0];
+    shapes.blend( &morphing_param, threads_count, res );
+}
+
+void MorphingModel::add_deformation_to_bounds(Cluster &cluster) const
+{
+    const float center_distance = D3DXVec3Length(&cluster.center);
+
+    // normals are turned to the radius: add the cone of radius directions of the cluster
+    if( center_distance <= cluster.radius )
+        cluster.cone_angle = D3DX_PI;
+    else
+        merge_normal_cone( cluster, cluster.center/center_distance, asin(cluster.radius/center_distance) );
+
+    // a point p moves along its radius from |p| to final_radius
+    const float nearest = ( center_distance > cluster.radius ) ? center_distance - cluster.radius : 0.0f;
+    const float farthest = center_distance + cluster.radius;
+    const float inward_way = fabs(final_radius - nearest);
+    const float outward_way = fabs(final_radius - farthest);
+    cluster.radius += ( inward_way > outward_way ) ? inward_way : outward_way;
 }
 
 unsigned MorphingModel::set_constants(D3DXVECTOR4 *out_data, unsigned buffer_size) const
@@ -163,14 +646,13 @@ unsigned MorphingModel::set_constants(D3DXVECTOR4 *out_data, unsigned buffer_siz
 
 // ------------------------------------------- Plane ----------------------------------------------------------------
 
-Plane::Plane( IDirect3DDevice9 *device, D3DPRIMITIVETYPE primitive_type, VertexShader &vertex_shader, PixelShader &pixel_shader, const Vertex *vertices,
-              unsigned vertices_count, const Index *indices, unsigned indices_count, unsigned primitives_count,
-              D3DXVECTOR3 position, D3DXVECTOR3 rotation )
-              : Model(device, primitive_type, vertex_shader, vertex_shader, pixel_shader, pixel_shader, Vertex::get_declaration(device), sizeof(Vertex), vertices, vertices_count, indices, indices_count,
-        primitives_count, position, rotation)
+Plane::Plane( IDirect3DDevice9 *device, D3DPRIMITIVETYPE primitive_type, VertexShader &vertex_shader, PixelShader &pixel_shader,
+              const VertexSource &vertices, const Index *indices, unsigned indices_count, unsigned primitives_count,
+              const Cluster *clusters, unsigned clusters_count, bool cull_back_faces, D3DXVECTOR3 position, D3DXVECTOR3 rotation )
+              : Model(device, primitive_type, vertex_shader, vertex_shader, pixel_shader, pixel_shader, Vertex::get_format(device), vertices, indices, indices_count,
+        primitives_count, clusters, clusters_count, cull_back_faces, NULL, 0, position, rotation)
 {
-    _ASSERT( vertices_count > 0 );
-    D3DXVECTOR4 normal_4d = vertices[0].normal;
+    D3DXVECTOR4 normal_4d( PLANE_NORMAL, 0 );
     D3DXMATRIX rotation_mx = rotate_matrix(rotation);
     D3DXVec4Transform( &normal_4d, &normal_4d, &rotation_mx );
 
@@ -213,10 +695,10 @@ D3DXMATRIX Plane::get_projection_matrix(const D3DXVECTOR3 light_position) const
 // --------------------------------------------- Light Source --------------------------------------------------------
 
 LightSource::LightSource( IDirect3DDevice9 *device, D3DPRIMITIVETYPE primitive_type, VertexShader &vertex_shader, PixelShader &pixel_shader,
-                          const Vertex *vertices, unsigned vertices_count, const Index *indices, unsigned indices_count, unsigned primitives_count,
+                          const VertexSource &vertices, const Index *indices, unsigned indices_count, unsigned primitives_count,
                           D3DXVECTOR3 position, D3DXVECTOR3 rotation, float radius )
-: Model(device, primitive_type, vertex_shader, vertex_shader, pixel_shader, pixel_shader, Vertex::get_declaration(device), sizeof(Vertex), vertices, vertices_count, indices, indices_count,
-        primitives_count, position, rotation), radius(radius)
+: Model(device, primitive_type, vertex_shader, vertex_shader, pixel_shader, pixel_shader, Vertex::get_format(device), vertices, indices, indices_count,
+        primitives_count, NULL, 0, false, NULL, 0, position, rotation), radius(radius)
 {}
 
 unsigned LightSource::set_constants(D3DXVECTOR4 *out_data, unsigned buffer_size) const
@@ -232,8 +714,8 @@ unsigned LightSource::set_constants(D3DXVECTOR4 *out_data, unsigned buffer_size)
 TexturedModel::TexturedModel( IDirect3DDevice9 *device, D3DPRIMITIVETYPE primitive_type, VertexShader &vertex_shader, PixelShader &pixel_shader,
                               const TexturedVertex *vertices, unsigned int vertices_count, const Index *indices, unsigned int indices_count,
                               unsigned int primitives_count, D3DXVECTOR3 position, D3DXVECTOR3 rotation, Texture &texture)
-: Model(device, primitive_type, vertex_shader, vertex_shader, pixel_shader, pixel_shader, TexturedVertex::get_declaration(device), sizeof(TexturedVertex),
-        vertices, vertices_count, indices, indices_count, primitives_count, position, rotation),
+: Model(device, primitive_type, vertex_shader, vertex_shader, pixel_shader, pixel_shader, TexturedVertex::get_format(device),
+        InterleavedVertices(vertices, vertices_count), indices, indices_count, primitives_count, NULL, 0, false, NULL, 0, position, rotation),
   texture(texture)
 {
 }
@@ -1,14 +1,23 @@
 #pragma once
 #include "main.h"
 #include "Vertex.h"
+#include "VertexDeclaration.h"
 #include "shaders.h"
 #include "Texture.h"
+#include "clusters.h"
+#include "lod.h"
+#include "split.h"
+#include "palette.h"
+#include "pose_cache.h"
+#include "software.h"
+#include "blend_shapes.h"
+#include "Camera.h"
 
 class Model
 {
 private:
     IDirect3DDevice9    *device;
-    VertexDeclaration   &vertex_declaration;
+    VertexFormat        &vertex_format;
     VertexShader        &vertex_shader;
     VertexShader        &shadow_vertex_shader;
     PixelShader         &pixel_shader;
@@ -18,39 +27,96 @@ private:
     unsigned    primitives_count;
 
     D3DPRIMITIVETYPE        primitive_type;
-    IDirect3DVertexBuffer9  *vertex_buffer;
-    IDirect3DIndexBuffer9   *index_buffer;
-    unsigned vertex_size;
+    IDirect3DVertexBuffer9  *vertex_buffers[VERTEX_STREAMS_COUNT]; // streams of the vertex format
+    IDirect3DIndexBuffer9   *index_buffer;          // 32-bit indices of sub-ranges which need them...
+    IDirect3DIndexBuffer9   *short_index_buffer;    // ... and 16-bit ones of the rest (see split.h)
+    DrawLimits limits;
 
     D3DXVECTOR3 position;
     D3DXVECTOR3 rotation;
     D3DXMATRIX rotation_and_position;
 
+    // Clusters for culling (see clusters.h) with bounds covering deformation
+    std::vector<Cluster> clusters;
+    bool cull_back_faces;
+    // Drawn parts are clusters if there are any, else levels of detail, else the whole mesh; a part is split
+    // into sub-ranges within the limits of the device: ranges of part i are [part_ranges_begin[i], part_ranges_begin[i + 1])
+    std::vector<IndexRange> part_ranges;
+    std::vector<DWORD> part_ranges_begin;
+    std::vector<IndexRange> all_ranges;     // clusters of the chosen level; neighbouring clusters are drawn together
+    std::vector<IndexRange> visible_ranges; // ... and only visible ones of them
+    D3DXVECTOR3 bounds_center; // model-space sphere around all clusters
+    float bounds_radius;
+
+    // Levels of detail sharing the buffers (see lod.h): without them the whole buffers are drawn
+    std::vector<LodLevel> lods;
+    unsigned lod; // the chosen one
+
+    // Software deformation (see set_software_deformation()): dynamic buffers of plain vertices and the shaders passing them through
+    IDirect3DVertexBuffer9  *deformed_buffers[VERTEX_STREAMS_COUNT];
+    VertexShader            *deformed_vertex_shader;
+    VertexShader            *deformed_shadow_vertex_shader;
+
+    DWORD shader_features; // of the variants of the vertex shaders (see shaders.h)
+
+    VertexFormat &get_drawn_format() const; // of the buffers which are drawn
     void update_matrix();
+    void get_lod_clusters(unsigned &first_cluster, unsigned &end_cluster) const; // clusters of the chosen level
+    void show_all_clusters();
+    void add_part(std::vector<IndexRange> &ranges, unsigned part) const; // joins its ranges to the last range if possible
+    DWORD64 draw_ranges(const IndexRange *ranges, unsigned ranges_count, bool shadow) const;
+    void build_index_buffers(const Index *indices, unsigned indices_count); // for the parts, once
+    void update_bounds(); // the sphere around all clusters
 
     void release_interfaces();
 
+protected:
+    IDirect3DDevice9 *get_device() const { return device; }
+    // Clusters may need their own constants: draws set the palette of a cluster before drawing it
+    // (if it is not set yet), and clusters of different palettes are never drawn by one call
+    virtual unsigned get_palette(unsigned cluster) const { UNREFERENCED_PARAMETER(cluster); return 0; }
+    virtual void set_palette(unsigned palette) const { UNREFERENCED_PARAMETER(palette); }
+    // Enlarges model-space bounds of the cluster so that they contain it deformed by the vertex shader at any time
+    virtual void add_deformation_to_bounds(Cluster &cluster) const { UNREFERENCED_PARAMETER(cluster); }
+    // Models deformed by their vertex shaders can do it on the CPU: deform() writes vertices of the buffers
+    // deformed at the time of the last set_time() into `res' (see software.h)
+    virtual bool can_deform() const { return false; }
+    virtual void deform(unsigned threads_count, DeformedStreams &res) const { UNREFERENCED_PARAMETER(threads_count); UNREFERENCED_PARAMETER(res); }
+    // Applies get_palette() and add_deformation_to_bounds() to the clusters: the constructor of Model cannot call the overrides,
+    // so models overriding them call it once at the end of their constructors
+    void init_clusters();
+
 public:
+    // Vertices are written by their source straight into the locked vertex buffers. The index buffers are built once,
+    // of the given indices. `clusters' are for culling (see clusters.h): without them
+    // draw_visible() draws the whole model; `cull_back_faces' is for closed models which are never seen from inside.
+    // `lods' are levels of detail in the buffers (see lod.h), clusters of each level are culled and drawn when it is chosen
     Model(  IDirect3DDevice9 *device,
             D3DPRIMITIVETYPE primitive_type,
             VertexShader &vertex_shader,
             VertexShader &shadow_vertex_shader,
             PixelShader &pixel_shader,
             PixelShader &shadow_pixel_shader,
-            VertexDeclaration &vertex_declaration,
-            unsigned vertex_size,
-            const Vertex *vertices,
-            unsigned vertices_count,
+            VertexFormat &vertex_format,
+            const VertexSource &vertices,
             const Index *indices,
             unsigned indices_count,
             unsigned primitives_count,
+            const Cluster *clusters,
+            unsigned clusters_count,
+            bool cull_back_faces,
+            const LodLevel *lods,
+            unsigned lods_count,
             D3DXVECTOR3 position,
             D3DXVECTOR3 rotation);
     
     void set_shaders_and_decl(bool shadow)
     {
-        vertex_declaration.set();
-        shadow ? shadow_vertex_shader.set() : vertex_shader.set();
+        get_drawn_format().set(shadow);
+        if( is_deformed_in_software() )
+            shadow ? deformed_shadow_vertex_shader->set(shader_features) : deformed_vertex_shader->set(shader_features);
+        else
+            shadow ? shadow_vertex_shader.set(shader_features) : vertex_shader.set(shader_features);
         shadow ? shadow_pixel_shader.set() : pixel_shader.set();
     }
     virtual void set_textures(bool shadow, unsigned samplers_count = 1);
@@ -62,7 +128,29 @@ public:
     const D3DXMATRIX &get_rotation_and_position() const;
     void rotate(float phi);
     
-    virtual void draw() const;
+    // Draws return numbers of bytes of vertices fetched (by each draw call from streams the pass reads);
+    // the shadow pass reads stream 0 only (see VertexFormat)
+    DWORD64 draw(bool shadow = false) const;
+
+    // Finds clusters to be drawn by draw_visible(), returns number of triangles culled
+    DWORD cull(const Frustum &frustum, const D3DXVECTOR3 &eye);
+    DWORD64 draw_visible() const;
+
+    // Chooses the level of detail for the current camera and the viewport of `viewport_height' pixels
+    void select_lod(const Camera &camera, float viewport_height);
+    unsigned get_lod() const { return lod; }
+
+    // Deformed models (skinned or morphed) are drawn twice, by the shadow pass and by the lit one. With software deformation
+    // they are deformed on the CPU once per frame (by deform_vertices()) into dynamic buffers of plain vertices,
+    // which both passes read with the given shaders passing the deformed vertices through (deformed.vsh and deformed_shadow.vsh).
+    // NULL shaders turn it off. Models without deformation are drawn as they are
+    void set_software_deformation(VertexShader *vertex_shader, VertexShader *shadow_vertex_shader);
+    bool is_deformed_in_software() const { return deformed_vertex_shader != NULL; }
+    // Lighting paths the model is drawn with (ShaderFeature flags): the vertex shaders are set as variants without the others
+    void set_shader_features(DWORD features) { shader_features = features; }
+    // Deforms vertices of the chosen level at the time of the last set_time(), if the model is deformed in software;
+    // `threads_count' as of parallel.h
+    void deform_vertices(unsigned threads_count);
 
     virtual ~Model();
 private:
@@ -71,11 +159,26 @@ private:
     Model &operator=(const Model&);
 };
 
+// Skinned by a chain of bones (see SkinningVertex::set_chain_position()) which bend it around `bone_center'.
+// Vertices are partitioned into palettes of bones (see palette.h): the model is drawn by its clusters only.
+// They bend as bend_bones() of skinning.h; bones of the period are sampled once (see pose_cache.h), set_time() interpolates them
 class SkinningModel : public Model
 {
 private:
     D3DXVECTOR3 bone_center;
-    D3DXMATRIX bones[BONES_COUNT];
+    std::vector<D3DXMATRIX> bones;
+    std::vector<BonePalette> palettes;
+    std::vector<unsigned> cluster_palettes;
+    PoseCache poses; // all bones of each sample
+    // for software deformation: vertices of the buffers with bones of the mesh (not of palettes) and their colors
+    SoftwareColumns software_vertices;
+    std::vector<D3DCOLOR> colors;
+protected:
+    virtual unsigned get_palette(unsigned cluster) const;
+    virtual void set_palette(unsigned palette) const;
+    virtual void add_deformation_to_bounds(Cluster &cluster) const;
+    virtual bool can_deform() const { return true; }
+    virtual void deform(unsigned threads_count, DeformedStreams &res) const;
 public:
     SkinningModel(  IDirect3DDevice9 *device,
                     D3DPRIMITIVETYPE primitive_type,
@@ -87,20 +190,41 @@ public:
                     const Index *indices,
                     unsigned indices_count,
                     unsigned primitives_count,
+                    const Cluster *clusters,
+                    unsigned clusters_count,
+                    bool cull_back_faces,
+                    const LodLevel *lods,
+                    unsigned lods_count,
                     D3DXVECTOR3 position,
                     D3DXVECTOR3 rotation,
-                    D3DXVECTOR3 bone_center);
+                    D3DXVECTOR3 bone_center,
+                    unsigned bones_count,
+                    const BonePalette *palettes,
+                    unsigned palettes_count);
+
+    // for software skinning (see skinning.h)
+    const D3DXMATRIX *get_bones() const { return &bones[0]; }
+    unsigned get_bones_count() const { return static_cast<unsigned>( bones.size() ); }
 
     // Overrides:
     virtual void set_time(float time);
-    virtual unsigned set_constants(D3DXVECTOR4 *out_data, unsigned buffer_size) const; // returns number of constant registers used
 };
 
+// The morphing parameter of the period is sampled once as bones of SkinningModel are.
+// On the CPU the morph is a blend shape (see blend_shapes.h): the sphere is its target, the parameter is its weight
 class MorphingModel : public Model
 {
 private:
     float morphing_param;
     float final_radius;
+    PoseCache poses; // the morphing parameter of each sample
+    // for software deformation
+    BlendShapes shapes;
+    std::vector<D3DCOLOR> colors;
+protected:
+    virtual void add_deformation_to_bounds(Cluster &cluster) const;
+    virtual bool can_deform() const { return true; }
+    virtual void deform(unsigned threads_count, DeformedStreams &res) const;
 public:
     MorphingModel(  IDirect3DDevice9 *device,
                     D3DPRIMITIVETYPE primitive_type,
@@ -112,15 +236,25 @@ public:
                     const Index *indices,
                     unsigned indices_count,
                     unsigned primitives_count,
+                    const Cluster *clusters,
+                    unsigned clusters_count,
+                    bool cull_back_faces,
+                    const LodLevel *lods,
+                    unsigned lods_count,
                     D3DXVECTOR3 position,
                     D3DXVECTOR3 rotation,
                     float final_radius);
 
+    // for software morphing (see morphing.h)
+    float get_final_radius() const { return final_radius; }
+    float get_morphing_param() const { return morphing_param; }
+
     // Overrides:
     virtual void set_time(float time);
     virtual unsigned set_constants(D3DXVECTOR4 *out_data, unsigned buffer_size) const; // returns number of constant registers used
 };
 
+// A plane of the plane() generators: in model space it is z = 0 with the normal PLANE_NORMAL
 class Plane : public Model
 {
 private:
@@ -131,11 +265,13 @@ public:
             D3DPRIMITIVETYPE primitive_type,
             VertexShader &vertex_shader,
             PixelShader &pixel_shader,
-            const Vertex *vertices,
-            unsigned vertices_count,
+            const VertexSource &vertices,
             const Index *indices,
             unsigned indices_count,
             unsigned primitives_count,
+            const Cluster *clusters,
+            unsigned clusters_count,
+            bool cull_back_faces,
             D3DXVECTOR3 position,
             D3DXVECTOR3 rotation);
 
@@ -151,8 +287,7 @@ public:
                  D3DPRIMITIVETYPE primitive_type,
                  VertexShader &vertex_shader,
                  PixelShader &pixel_shader,
-                 const Vertex *vertices,
-                 unsigned vertices_count,
+                 const VertexSource &vertices,
                  const Index *indices,
                  unsigned indices_count,
                  unsigned primitives_count,
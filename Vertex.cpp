@@ -1,27 +1,62 @@
 #include "Vertex.h"
+#include <cmath>
 
 ///////////////////////// C O N S T A N T S /////////////////////////////////////////////
 const D3DFORMAT INDEX_FORMAT = D3DFMT_INDEX32;
+const D3DFORMAT SHORT_INDEX_FORMAT = D3DFMT_INDEX16;
+const Index SHORT_INDEX_MAX = 0xFFFF;
 
-//////////////////////////// D E C L A R A T I O N ///////////////////////////////////////////////
-VertexDeclaration::VertexDeclaration(IDirect3DDevice9 *device, const D3DVERTEXELEMENT9* vertex_declaration)
-: device(device), vertex_decl(NULL)
-{
-    _ASSERT(device != NULL);
-    if( FAILED( device->CreateVertexDeclaration(vertex_declaration, &vertex_decl) ) )
-        throw VertexDeclarationInitError();
-}
-
-void VertexDeclaration::set()
+/////////////////////////// H E L P E R S ///////////////////////////////////////////////
+DWORD strip_to_list(const Index *strip_indices, DWORD strip_indices_count, Index *list_indices)
 {
-    check_render( device->SetVertexDeclaration(vertex_decl) );
+    _ASSERT(strip_indices != NULL);
+    _ASSERT(list_indices != NULL);
+    DWORD index = 0; // current list index
+    for( DWORD i = 2; i < strip_indices_count; ++i )
+    {
+        Index i1 = strip_indices[i - 2];
+        Index i2 = strip_indices[i - 1];
+        Index i3 = strip_indices[i];
+        if( i1 == i2 || i2 == i3 || i1 == i3 )
+            continue; // degenerate: used for jumps inside strip
+        // every odd triangle of a strip has reversed order of vertices
+        if( i % 2 == 0 )
+            add_triangle( i1, i2, i3, list_indices, index );
+        else
+            add_triangle( i2, i1, i3, list_indices, index );
+    }
+    return index;
 }
 
-VertexDeclaration::~VertexDeclaration()
+void SkinningVertex::set_chain_position(float chain_position, unsigned bones_count)
 {
-    release_interface( vertex_decl );
+    _ASSERT( bones_count > 0 && bones_count <= MAX_BONES_COUNT );
+    _ASSERT( BONE_INFLUENCES_COUNT == 4 ); // a cubic B-spline has 4 weights
+    // the segment between bones `segment' and `segment + 1' and the position `t' on it
+    const float position = chain_position*(bones_count - 1);
+    int segment = static_cast<int>( floor(position) );
+    if( segment > static_cast<int>( bones_count ) - 2 )
+        segment = static_cast<int>( bones_count ) - 2;
+    if( segment < 0 )
+        segment = 0;
+    const float t = position - segment;
+    weights[0] = (1 - t)*(1 - t)*(1 - t)/6;
+    weights[1] = (3*t*t*t - 6*t*t + 4)/6;
+    weights[2] = (-3*t*t*t + 3*t*t + 3*t + 1)/6;
+    weights[3] = t*t*t/6;
+    // bones beyond the ends of the chain are the end ones
+    for( int i = 0; i < BONE_INFLUENCES_COUNT; ++i )
+    {
+        int bone = segment - 1 + i;
+        if( bone > static_cast<int>( bones_count ) - 1 )
+            bone = static_cast<int>( bones_count ) - 1;
+        if( bone < 0 )
+            bone = 0;
+        bones[i] = static_cast<BYTE>( bone );
+    }
 }
 
+//////////////////////////// D E C L A R A T I O N ///////////////////////////////////////////////
 const D3DVERTEXELEMENT9 VERTEX_DECL_ARRAY[] =
 {
     {0, 0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0},
@@ -35,7 +70,8 @@ const D3DVERTEXELEMENT9 SKINNING_VERTEX_DECL_ARRAY[] =
     {0, 0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0},
     {0, 12, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_NORMAL, 0},
     {0, 28, D3DDECLTYPE_D3DCOLOR, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_COLOR, 0},
-    {0, 32, D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 0},
+    {0, 32, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_BLENDWEIGHT, 0},
+    {0, 48, D3DDECLTYPE_D3DCOLOR, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_BLENDINDICES, 0},
     D3DDECL_END()
 };
 
@@ -47,3 +83,30 @@ extern const D3DVERTEXELEMENT9 TEXTURED_VERTEX_DECL_ARRAY[] =
     {0, 32, D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 0},
     D3DDECL_END()
 };
+
+const D3DVERTEXELEMENT9 VERTEX_STREAMS_DECL_ARRAY[] =
+{
+    {0, 0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0},
+    {1, 0, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_NORMAL, 0},
+    {1, 16, D3DDECLTYPE_D3DCOLOR, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_COLOR, 0},
+    D3DDECL_END()
+};
+
+const D3DVERTEXELEMENT9 SKINNING_VERTEX_STREAMS_DECL_ARRAY[] =
+{
+    {0, 0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0},
+    {0, 12, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_BLENDWEIGHT, 0},
+    {0, 28, D3DDECLTYPE_D3DCOLOR, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_BLENDINDICES, 0},
+    {1, 0, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_NORMAL, 0},
+    {1, 16, D3DDECLTYPE_D3DCOLOR, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_COLOR, 0},
+    D3DDECL_END()
+};
+
+const D3DVERTEXELEMENT9 TEXTURED_VERTEX_STREAMS_DECL_ARRAY[] =
+{
+    {0, 0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0},
+    {1, 0, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_NORMAL, 0},
+    {1, 16, D3DDECLTYPE_D3DCOLOR, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_COLOR, 0},
+    {1, 20, D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 0},
+    D3DDECL_END()
+};
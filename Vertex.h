@@ -1,13 +1,22 @@
 #pragma once
-#include "main.h"
+#include "common.h"
+
+// Declarations of vertices for the device are in VertexDeclaration.h
+struct IDirect3DDevice9;
+class VertexFormat;
 
 ///////////////////////// C O N S T A N T S /////////////////////////////////////////////
 typedef DWORD Index;
 extern const D3DFORMAT INDEX_FORMAT;
+// Indices of ranges spanning at most SHORT_INDEX_MAX+1 vertices are drawn from 16-bit index buffers (see split.h)
+typedef WORD ShortIndex;
+extern const D3DFORMAT SHORT_INDEX_FORMAT;
+extern const Index SHORT_INDEX_MAX;
 
 // They must be macros, not constants, because they must be known at compile-time (they are used for array initialization in another module)
 #define VERTICES_PER_TRIANGLE 3
 #define PLANES_PER_PYRAMID 8
+#define VERTEX_STREAMS_COUNT 2
 
 /////////////////////////// H E L P E R S ///////////////////////////////////////////////
 inline int rand_col_comp()
@@ -28,21 +37,29 @@ inline void add_triangle( Index i1, Index i2, Index i3, Index *indices, DWORD &c
     indices[current_index++] = i3 + offset;
 }
 
+// Converts indices of D3DPT_TRIANGLESTRIP into indices of D3DPT_TRIANGLELIST, skipping degenerate triangles.
+// `list_indices' must have space for 3*(strip_indices_count - 2) indices; returns number of list indices written
+DWORD strip_to_list(const Index *strip_indices, DWORD strip_indices_count, Index *list_indices);
+
+// Number of triangles drawn from `indices_count' indices (including degenerate ones of a strip)
+inline DWORD get_primitives_count(D3DPRIMITIVETYPE primitive_type, DWORD indices_count)
+{
+    _ASSERT( primitive_type == D3DPT_TRIANGLELIST || primitive_type == D3DPT_TRIANGLESTRIP );
+    if( primitive_type == D3DPT_TRIANGLESTRIP )
+        return indices_count > 2 ? indices_count - 2 : 0;
+    return indices_count/VERTICES_PER_TRIANGLE;
+}
+
 //////////////////////////// D E C L A R A T I O N ///////////////////////////////////////////////
+// Interleaved vertices as they are generated and cached...
 extern const D3DVERTEXELEMENT9 VERTEX_DECL_ARRAY[];
 extern const D3DVERTEXELEMENT9 SKINNING_VERTEX_DECL_ARRAY[];
 extern const D3DVERTEXELEMENT9 TEXTURED_VERTEX_DECL_ARRAY[];
-
-class VertexDeclaration
-{
-private:
-    IDirect3DDevice9            *device;
-    IDirect3DVertexDeclaration9 *vertex_decl;   // vertex declaration
-public:
-    VertexDeclaration(IDirect3DDevice9 *device, const D3DVERTEXELEMENT9* vertex_declaration);
-    void set();
-    ~VertexDeclaration();
-};
+// ... and split into streams as they are drawn: stream 0 has everything shadow shaders read
+// (the position, and the weights and bones of skinning), stream 1 has the rest (the normal, the color...)
+extern const D3DVERTEXELEMENT9 VERTEX_STREAMS_DECL_ARRAY[];
+extern const D3DVERTEXELEMENT9 SKINNING_VERTEX_STREAMS_DECL_ARRAY[];
+extern const D3DVERTEXELEMENT9 TEXTURED_VERTEX_STREAMS_DECL_ARRAY[];
 
 //////////////////////////// C L A S S E S ///////////////////////////////////////////////
 class Vertex
@@ -68,39 +85,30 @@ public:
         color = random_color();
         set_normal(normal);
     }
-    static VertexDeclaration &get_declaration(IDirect3DDevice9 *device)
-    {
-        static VertexDeclaration decl(device, VERTEX_DECL_ARRAY);
-        return decl;
-    }
+    static VertexFormat &get_format(IDirect3DDevice9 *device);
 };
 
 class SkinningVertex : public Vertex
 {
 public:
-    float weights[BONES_COUNT]; // Weights for skinning
-    void set_weight(float weight)
-    {
-        weights[0] = weight;
-        weights[1] = 1 - weight;
-    }
+    float weights[BONE_INFLUENCES_COUNT];   // Weights for skinning...
+    BYTE bones[BONE_INFLUENCES_COUNT];      // ... of these bones: of the mesh, or of its palette in vertex buffers (see palette.h)
+    // Bones of a chain (e.g. of a spine) are evenly spaced from 0 to 1 along it: the vertex at `chain_position'
+    // is blended between the nearest of `bones_count' bones by weights of a uniform cubic B-spline, so the chain bends smoothly
+    void set_chain_position(float chain_position, unsigned bones_count);
     SkinningVertex()
     {
-        set_weight(1.0f);
+        set_chain_position(0, 1);
     }
-    SkinningVertex(D3DXVECTOR3 pos, D3DCOLOR color, float weight, D3DXVECTOR3 normal) : Vertex(pos, color, normal)
+    SkinningVertex(D3DXVECTOR3 pos, D3DCOLOR color, float chain_position, unsigned bones_count, D3DXVECTOR3 normal) : Vertex(pos, color, normal)
     {
-        set_weight(weight);
+        set_chain_position(chain_position, bones_count);
     }
-    SkinningVertex(D3DXVECTOR3 pos, float weight, D3DXVECTOR3 normal) : Vertex(pos, normal)
+    SkinningVertex(D3DXVECTOR3 pos, float chain_position, unsigned bones_count, D3DXVECTOR3 normal) : Vertex(pos, normal)
     {
-        set_weight(weight);
-    }
-    static VertexDeclaration &get_declaration(IDirect3DDevice9 *device)
-    {
-        static VertexDeclaration decl(device, TEXTURED_VERTEX_DECL_ARRAY);
-        return decl;
+        set_chain_position(chain_position, bones_count);
     }
+    static VertexFormat &get_format(IDirect3DDevice9 *device);
 };
 
 class TexturedVertex : public Vertex
@@ -112,9 +120,5 @@ public:
         : Vertex(pos, color, normal), u(u), v(v) {}
     TexturedVertex(D3DXVECTOR3 pos, D3DXVECTOR3 normal, float u, float v)
         : Vertex(pos, normal), u(u), v(v) {}
-    static VertexDeclaration &get_declaration(IDirect3DDevice9 *device)
-    {
-        static VertexDeclaration decl(device, TEXTURED_VERTEX_DECL_ARRAY);
-        return decl;
-    }
+    static VertexFormat &get_format(IDirect3DDevice9 *device);
 };
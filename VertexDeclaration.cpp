@@ -0,0 +1,153 @@
+#include "VertexDeclaration.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+VertexDeclaration::VertexDeclaration(IDirect3DDevice9 *device, const D3DVERTEXELEMENT9* vertex_declaration)
+: device(device), vertex_decl(NULL)
+{
+    _ASSERT(device != NULL);
+    if( FAILED( device->CreateVertexDeclaration(vertex_declaration, &vertex_decl) ) )
+        throw VertexDeclarationInitError();
+}
+
+void VertexDeclaration::set()
+{
+    check_render( device->SetVertexDeclaration(vertex_decl) );
+}
+
+VertexDeclaration::~VertexDeclaration()
+{
+    release_interface( vertex_decl );
+}
+
+namespace
+{
+    const D3DVERTEXELEMENT9 DECL_END = D3DDECL_END();
+
+    bool is_end(const D3DVERTEXELEMENT9 &element)
+    {
+        return element.Stream == DECL_END.Stream;
+    }
+
+    unsigned get_element_size(BYTE type)
+    {
+        switch( type )
+        {
+        case D3DDECLTYPE_FLOAT1:    return sizeof(float);
+        case D3DDECLTYPE_FLOAT2:    return 2*sizeof(float);
+        case D3DDECLTYPE_FLOAT3:    return 3*sizeof(float);
+        case D3DDECLTYPE_FLOAT4:    return 4*sizeof(float);
+        case D3DDECLTYPE_D3DCOLOR:  return sizeof(D3DCOLOR);
+        default:
+            _ASSERT( false ); // not used by vertices of this application
+            return 0;
+        }
+    }
+
+    // The element of the same meaning in another declaration
+    const D3DVERTEXELEMENT9 *find_element(const D3DVERTEXELEMENT9 *elements, const D3DVERTEXELEMENT9 &element)
+    {
+        for( ; !is_end( *elements ); ++elements )
+        {
+            if( elements->Usage == element.Usage && elements->UsageIndex == element.UsageIndex )
+                return elements;
+        }
+        return NULL;
+    }
+
+    // Elements of stream 0 with the end mark
+    std::vector<D3DVERTEXELEMENT9> get_shadow_elements(const D3DVERTEXELEMENT9 *elements)
+    {
+        std::vector<D3DVERTEXELEMENT9> res;
+        for( ; !is_end( *elements ); ++elements )
+        {
+            if( elements->Stream == 0 )
+                res.push_back( *elements );
+        }
+        res.push_back( DECL_END );
+        return res;
+    }
+}
+
+VertexFormat::VertexFormat(IDirect3DDevice9 *device, const D3DVERTEXELEMENT9 *interleaved_elements, const D3DVERTEXELEMENT9 *stream_elements, unsigned vertex_size)
+: interleaved_elements(interleaved_elements), stream_elements(stream_elements), vertex_size(vertex_size),
+  declaration(device, stream_elements), shadow_declaration(device, &get_shadow_elements(stream_elements)[0])
+{
+    for( unsigned i = 0; i < VERTEX_STREAMS_COUNT; ++i )
+        stream_sizes[i] = 0;
+    for( const D3DVERTEXELEMENT9 *element = stream_elements; !is_end( *element ); ++element )
+    {
+        _ASSERT( element->Stream < VERTEX_STREAMS_COUNT );
+        _ASSERT( find_element( interleaved_elements, *element ) != NULL ); // every split element is taken from the vertex
+        const unsigned end = element->Offset + get_element_size( element->Type );
+        if( end > stream_sizes[element->Stream] )
+            stream_sizes[element->Stream] = end;
+    }
+}
+
+void VertexFormat::split(const void *vertices, Index vertices_count, unsigned stream, void *res_stream) const
+{
+    _ASSERT( vertices != NULL );
+    _ASSERT( res_stream != NULL );
+    _ASSERT( stream < VERTEX_STREAMS_COUNT );
+    const BYTE *source = static_cast<const BYTE*>( vertices );
+    BYTE *res = static_cast<BYTE*>( res_stream );
+    const unsigned stream_size = stream_sizes[stream];
+    for( const D3DVERTEXELEMENT9 *element = stream_elements; !is_end( *element ); ++element )
+    {
+        if( element->Stream != stream )
+            continue;
+        const D3DVERTEXELEMENT9 *source_element = find_element( interleaved_elements, *element );
+        const unsigned size = get_element_size( element->Type );
+        _ASSERT( source_element != NULL && source_element->Type == element->Type );
+        for( Index i = 0; i < vertices_count; ++i )
+            memcpy( res + i*stream_size + element->Offset, source + i*vertex_size + source_element->Offset, size );
+    }
+}
+
+void VertexFormat::get_columns(void * const *streams, VertexColumn *res_columns) const
+{
+    _ASSERT( streams != NULL );
+    _ASSERT( res_columns != NULL );
+    _ASSERT( vertex_size % sizeof(DWORD) == 0 );
+    for( unsigned i = 0; i < vertex_size/sizeof(DWORD); ++i )
+    {
+        res_columns[i].destination = NULL;
+        res_columns[i].stride = 0;
+        res_columns[i].offset = 0;
+    }
+    for( const D3DVERTEXELEMENT9 *element = stream_elements; !is_end( *element ); ++element )
+    {
+        const D3DVERTEXELEMENT9 *source_element = find_element( interleaved_elements, *element );
+        _ASSERT( source_element != NULL && source_element->Offset % sizeof(DWORD) == 0 && element->Offset % sizeof(DWORD) == 0 );
+        for( unsigned k = 0; k < get_element_size( element->Type )/sizeof(DWORD); ++k )
+        {
+            VertexColumn &column = res_columns[source_element->Offset/sizeof(DWORD) + k];
+            column.destination = static_cast<BYTE*>( streams[element->Stream] );
+            column.stride = stream_sizes[element->Stream];
+            column.offset = element->Offset + k*sizeof(DWORD);
+        }
+    }
+}
+
+VertexFormat &Vertex::get_format(IDirect3DDevice9 *device)
+{
+    static VertexFormat format(device, VERTEX_DECL_ARRAY, VERTEX_STREAMS_DECL_ARRAY, sizeof(Vertex));
+    return format;
+}
+
+VertexFormat &SkinningVertex::get_format(IDirect3DDevice9 *device)
+{
+    static VertexFormat format(device, SKINNING_VERTEX_DECL_ARRAY, SKINNING_VERTEX_STREAMS_DECL_ARRAY, sizeof(SkinningVertex));
+    return format;
+}
+
+VertexFormat &TexturedVertex::get_format(IDirect3DDevice9 *device)
+{
+    static VertexFormat format(device, TEXTURED_VERTEX_DECL_ARRAY, TEXTURED_VERTEX_STREAMS_DECL_ARRAY, sizeof(TexturedVertex));
+    return format;
+}
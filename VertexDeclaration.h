@@ -0,0 +1,82 @@
+#pragma once
+#include "main.h"
+#include "Vertex.h"
+#include "codec.h"
+
+// Declarations of vertices of Vertex.h for the device, made once for each vertex type (see Vertex::get_format())
+
+class VertexDeclaration
+{
+private:
+    IDirect3DDevice9            *device;
+    IDirect3DVertexDeclaration9 *vertex_decl;   // vertex declaration
+public:
+    VertexDeclaration(IDirect3DDevice9 *device, const D3DVERTEXELEMENT9* vertex_declaration);
+    void set();
+    ~VertexDeclaration();
+private:
+    // No copying!
+    VertexDeclaration(const VertexDeclaration&);
+    VertexDeclaration &operator=(const VertexDeclaration&);
+};
+
+// How vertices of a type are put into vertex buffers: interleaved vertices are split into VERTEX_STREAMS_COUNT streams.
+// The shadow pass uses the declaration of stream 0 only, so it fetches neither normals nor colors
+class VertexFormat
+{
+private:
+    const D3DVERTEXELEMENT9 *interleaved_elements;
+    const D3DVERTEXELEMENT9 *stream_elements;
+    unsigned vertex_size;
+    unsigned stream_sizes[VERTEX_STREAMS_COUNT];
+    VertexDeclaration declaration;
+    VertexDeclaration shadow_declaration;
+public:
+    VertexFormat(IDirect3DDevice9 *device, const D3DVERTEXELEMENT9 *interleaved_elements, const D3DVERTEXELEMENT9 *stream_elements, unsigned vertex_size);
+    void set(bool shadow) { shadow ? shadow_declaration.set() : declaration.set(); }
+
+    unsigned get_vertex_size() const { return vertex_size; } // of an interleaved vertex
+    unsigned get_stream_size(unsigned stream) const
+    {
+        _ASSERT( stream < VERTEX_STREAMS_COUNT );
+        return stream_sizes[stream];
+    }
+    // Number of streams the pass reads
+    static unsigned get_streams_count(bool shadow) { return shadow ? 1 : VERTEX_STREAMS_COUNT; }
+
+    // Copies elements of the stream from interleaved vertices into `res_stream' of vertices_count*get_stream_size(stream) bytes
+    void split(const void *vertices, Index vertices_count, unsigned stream, void *res_stream) const;
+    // Where DWORD columns of interleaved vertices go in `streams' (see decode_vertex_columns()): `res_columns' are
+    // get_vertex_size()/sizeof(DWORD) columns, those of elements which are not split get NULL destinations
+    void get_columns(void * const *streams, VertexColumn *res_columns) const;
+};
+
+// Vertices for vertex buffers: a model takes them from a source, which writes them straight into the locked streams
+// of its buffers (e.g. decodes them from the mesh cache), so there is no interleaved copy to be split
+class VertexSource
+{
+public:
+    virtual Index get_vertices_count() const = 0;
+    // `res_streams' are VERTEX_STREAMS_COUNT locked streams of the format for get_vertices_count() vertices
+    virtual void write_streams(const VertexFormat &format, void * const *res_streams) const = 0;
+
+    virtual ~VertexSource() {}
+};
+
+// Interleaved vertices in memory (e.g. which are deformed on the CPU too): they are split into the streams
+class InterleavedVertices : public VertexSource
+{
+private:
+    const void *vertices;
+    Index vertices_count;
+public:
+    InterleavedVertices(const void *vertices, Index vertices_count) : vertices(vertices), vertices_count(vertices_count) {}
+
+    // Overrides:
+    virtual Index get_vertices_count() const { return vertices_count; }
+    virtual void write_streams(const VertexFormat &format, void * const *res_streams) const
+    {
+        for( unsigned i = 0; i < VERTEX_STREAMS_COUNT; ++i )
+            format.split( vertices, vertices_count, i, res_streams[i] );
+    }
+};
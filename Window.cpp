@@ -4,6 +4,7 @@ namespace
 {
     const TCHAR *WINDOW_CLASS = _T("Filtering");
     const TCHAR *WINDOW_TITLE = _T("Filtering");
+    const unsigned MAX_TITLE_LENGTH = 256;
 }
 
 Window::Window(int width, int height)
@@ -57,6 +58,13 @@ RECT Window::get_client_rect() const
     return rect;
 }
 
+void Window::set_status(const TCHAR *status) const
+{
+    TCHAR title[MAX_TITLE_LENGTH];
+    _stprintf_s( title, MAX_TITLE_LENGTH, _T("%s - %s"), WINDOW_TITLE, status );
+    SetWindowText( hwnd, title );
+}
+
 void Window::unregister_class()
 {
     UnregisterClass( WINDOW_CLASS, window_class.hInstance );
@@ -14,6 +14,7 @@ public:
     void show() const;
     void update() const;
     RECT get_client_rect() const;
+    void set_status(const TCHAR *status) const; // shows `status' in the title after the name of the window
 
     static LRESULT WINAPI MsgProc( HWND, UINT, WPARAM, LPARAM );
 
@@ -0,0 +1,31 @@
+#include "arena.h"
+
+const size_t ARENA_ALIGNMENT = 16; // enough for SSE
+
+Arena::Arena(size_t size)
+: memory(NULL), size(size), used(0)
+{
+    if( size != 0 )
+    {
+        memory = static_cast<BYTE*>( _aligned_malloc( size, ARENA_ALIGNMENT ) );
+        if( memory == NULL )
+            throw NoMemoryError();
+    }
+}
+
+void *Arena::allocate(size_t bytes)
+{
+    const size_t allocation_size = get_allocation_size( bytes );
+    _ASSERT( allocation_size <= size - used ); // the size must have been counted right
+    if( allocation_size > size - used )
+        throw NoMemoryError();
+    void *res = memory + used;
+    used += allocation_size;
+    return res;
+}
+
+Arena::~Arena()
+{
+    if( memory != NULL )
+        _aligned_free( memory );
+}
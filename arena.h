@@ -0,0 +1,33 @@
+#pragma once
+#include "main.h"
+
+extern const size_t ARENA_ALIGNMENT;
+
+// One block of memory for arrays which live equally long (e.g. all generated meshes of the scene):
+// they are taken from it one after another and are freed all at once with the arena.
+// The size is counted up front (see get_allocation_size()), so the arena is allocated once and never grows
+class Arena
+{
+private:
+    BYTE *memory;
+    size_t size;
+    size_t used;
+public:
+    explicit Arena(size_t size);
+
+    // Throws NoMemoryError if the rest of the arena is too small
+    void *allocate(size_t bytes);
+    template<class Type> Type *allocate_array(size_t count) { return static_cast<Type*>( allocate( get_array_size( count, sizeof(Type) ) ) ); }
+
+    // Space taken by allocate(bytes), for counting the size of an arena
+    static size_t get_allocation_size(size_t bytes) { return get_array_size( (static_cast<DWORD64>(bytes) + ARENA_ALIGNMENT - 1)/ARENA_ALIGNMENT, ARENA_ALIGNMENT ); }
+
+    size_t get_size() const { return size; }
+    size_t get_used() const { return used; }
+
+    ~Arena();
+private:
+    // No copying!
+    Arena(const Arena&);
+    Arena &operator=(const Arena&);
+};
@@ -0,0 +1,163 @@
+#include "benchmark.h"
+#include "skinning.h"
+#include "morphing.h"
+#include "matrices.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+const double BENCHMARK_TIME = 0.25;
+
+namespace
+{
+    const float BENCHMARK_BONE_ANGLE = D3DX_PI/8.0f;
+    const unsigned BENCHMARK_BONES_COUNT = 64;
+    const float BENCHMARK_FINAL_RADIUS = 1.5f;
+    const float BENCHMARK_MORPHING_PARAM = 0.5f;
+    const float GOLDEN_ANGLE = D3DX_PI*(3.0f - 2.236068f); // pi*(3 - sqrt(5)): turns of a spiral covering a sphere evenly
+
+    // Everything a kernel is run with
+    struct BENCHMARK_PARAMS
+    {
+        const SoftwareColumns *vertices;
+        const SoftwareColumns *skinning_vertices;
+        const D3DXMATRIX *bones;
+        const D3DXMATRIX *position_and_rotation;
+        const D3DXMATRIX *view;
+        const LightingConstants *lighting;
+        unsigned threads_count;
+        SoftwareColumns *res;
+        // of the filter pass
+        const PsSurface *filter_source;
+        const float *filter_taps;
+        const PixelShaderInterpreter *filter_shader;
+        const PsGradient *filter_textures;
+        const PsGradient *filter_colors;
+        D3DCOLOR *filter_res;
+    };
+
+    // A kernel returns the number of vertices or pixels it has processed
+    typedef DWORD64 (*BenchmarkKernel)(const BENCHMARK_PARAMS &params);
+
+    DWORD64 run_skinning(const BENCHMARK_PARAMS &params)
+    {
+        skin_vertices( *params.skinning_vertices, params.bones, BENCHMARK_BONES_COUNT, *params.position_and_rotation, *params.view,
+                       *params.lighting, params.threads_count, *params.res );
+        return params.res->get_count();
+    }
+
+    DWORD64 run_morphing(const BENCHMARK_PARAMS &params)
+    {
+        morph_vertices( *params.vertices, BENCHMARK_FINAL_RADIUS, BENCHMARK_MORPHING_PARAM, *params.position_and_rotation, *params.view,
+                        *params.lighting, params.threads_count, *params.res );
+        return params.res->get_count();
+    }
+
+    DWORD64 run_lighting(const BENCHMARK_PARAMS &params)
+    {
+        light_vertices( *params.vertices, *params.lighting, true, params.threads_count, *params.res );
+        return params.res->get_count();
+    }
+
+    DWORD64 run_filtering(const BENCHMARK_PARAMS &params)
+    {
+        const PsSurface &source = *params.filter_source;
+        run_pixel_shader( *params.filter_shader, params.filter_textures, params.filter_colors, source.width, source.height,
+                          params.threads_count, params.filter_res );
+        return static_cast<DWORD64>( source.width )*source.height;
+    }
+
+    DWORD64 run_reference_filtering(const BENCHMARK_PARAMS &params)
+    {
+        const PsSurface &source = *params.filter_source;
+        filter_surface( source, params.filter_taps, params.filter_res );
+        return static_cast<DWORD64>( source.width )*source.height;
+    }
+
+    double measure(BenchmarkKernel kernel, const BENCHMARK_PARAMS &params)
+    // millions of vertices (or pixels) per second
+    {
+        LARGE_INTEGER frequency;
+        LARGE_INTEGER start;
+        LARGE_INTEGER now;
+        QueryPerformanceFrequency( &frequency );
+        QueryPerformanceCounter( &start );
+        double seconds = 0;
+        DWORD64 vertices_count = 0;
+        do
+        {
+            vertices_count += kernel( params );
+            QueryPerformanceCounter( &now );
+            seconds = static_cast<double>( now.QuadPart - start.QuadPart )/static_cast<double>( frequency.QuadPart );
+        } while( seconds < BENCHMARK_TIME );
+        return static_cast<double>( vertices_count )/seconds/1e6;
+    }
+}
+
+void benchmark_software( Index vertices_count, const LightingConstants &lighting, const D3DXMATRIX &view,
+                         unsigned filter_size, const char *filter_shader_filename, const float filter_taps[FILTER_TAPS_COUNT],
+                         unsigned threads_count, SoftwareThroughput &res )
+{
+    _ASSERT( vertices_count > 0 );
+    _ASSERT( filter_size > 0 && filter_shader_filename != NULL && filter_taps != NULL );
+    // points of a spiral from the south pole to the north one, skinned by a chain of bones along the height
+    std::vector<SkinningVertex> skinning_vertices( vertices_count );
+    std::vector<Vertex> vertices( vertices_count );
+    for( Index i = 0; i < vertices_count; ++i )
+    {
+        const float z = 2.0f*(i + 0.5f)/vertices_count - 1.0f;
+        const float r = sqrt(1.0f - z*z);
+        const float phi = GOLDEN_ANGLE*i;
+        const D3DXVECTOR3 point( r*cos(phi), r*sin(phi), z );
+        skinning_vertices[i] = SkinningVertex( point, random_color(), (z + 1.0f)/2.0f, BENCHMARK_BONES_COUNT, point );
+        vertices[i] = skinning_vertices[i];
+    }
+    SoftwareColumns skinning_columns( SOFTWARE_SKINNING_VERTEX_COLUMNS, vertices_count );
+    SoftwareColumns columns( SOFTWARE_VERTEX_COLUMNS, vertices_count );
+    SoftwareColumns output( SOFTWARE_OUTPUT_COLUMNS, vertices_count );
+    load_software_vertices( &skinning_vertices[0], vertices_count, skinning_columns );
+    load_software_vertices( &vertices[0], vertices_count, columns );
+
+    // the bones turn by angles growing along the chain (as in SkinningModel)
+    D3DXMATRIX bones[BENCHMARK_BONES_COUNT];
+    for( unsigned i = 0; i < BENCHMARK_BONES_COUNT; ++i )
+        bones[i] = rotate_x_matrix( BENCHMARK_BONE_ANGLE*i/(BENCHMARK_BONES_COUNT - 1) );
+    const D3DXMATRIX position_and_rotation = rotate_x_matrix( 0.0f );
+    BENCHMARK_PARAMS params;
+    params.vertices = &columns;
+    params.skinning_vertices = &skinning_columns;
+    params.bones = bones;
+    params.position_and_rotation = &position_and_rotation;
+    params.view = &view;
+    params.lighting = &lighting;
+    params.threads_count = threads_count;
+    params.res = &output;
+
+    // the filter pass of random texels
+    std::vector<D3DCOLOR> texels( get_count( static_cast<DWORD64>( filter_size )*filter_size ) );
+    for( unsigned i = 0; i < texels.size(); ++i )
+        texels[i] = random_color();
+    std::vector<D3DCOLOR> filtered( texels.size() );
+    const PsSurface source = { &texels[0], filter_size, filter_size, filter_size };
+    ShaderCode filter_code;
+    load_shader( filter_shader_filename, filter_code );
+    PixelShaderInterpreter filter_shader( filter_code );
+    PsGradient filter_textures[SHADER_PS_TEXTURE_REGISTERS];
+    PsGradient filter_colors[SHADER_PS_INPUT_REGISTERS];
+    set_filter_pass( source, filter_taps, filter_shader, filter_textures, filter_colors );
+    params.filter_source = &source;
+    params.filter_taps = filter_taps;
+    params.filter_shader = &filter_shader;
+    params.filter_textures = filter_textures;
+    params.filter_colors = filter_colors;
+    params.filter_res = &filtered[0];
+
+    res.skinning = measure( run_skinning, params );
+    res.morphing = measure( run_morphing, params );
+    res.lighting = measure( run_lighting, params );
+    res.filtering = measure( run_filtering, params );
+    res.reference_filtering = measure( run_reference_filtering, params );
+}
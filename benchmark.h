@@ -0,0 +1,24 @@
+#pragma once
+#include "main.h"
+#include "lighting.h"
+#include "filter.h"
+
+// Throughput of software vertex processing (see software.h), in millions of vertices per second...
+struct SoftwareThroughput
+{
+    double skinning;    // skin_vertices()
+    double morphing;    // morph_vertices()
+    double lighting;    // light_vertices() alone, with specular light
+    // ... and of the filter pass (see filter.h), in millions of pixels per second
+    double filtering;           // target.psh run by the interpreter
+    double reference_filtering; // filter_surface(), by one thread
+};
+
+// Measures it on `vertices_count' vertices of a unit sphere with the lighting and the view of the scene, and on a random
+// `filter_size' x `filter_size' texture filtered by `filter_taps' with the pixel shader of the file (see filter.h);
+// each kernel is run with `threads_count' threads again and again for BENCHMARK_TIME seconds.
+// Throws ShaderFileError or ShaderParseError if the shader cannot be read
+extern const double BENCHMARK_TIME;
+void benchmark_software( Index vertices_count, const LightingConstants &lighting, const D3DXMATRIX &view,
+                         unsigned filter_size, const char *filter_shader_filename, const float filter_taps[FILTER_TAPS_COUNT],
+                         unsigned threads_count, SoftwareThroughput &res );
@@ -0,0 +1,167 @@
+#include "blend_shapes.h"
+#include "parallel.h"
+#include <emmintrin.h>
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <algorithm>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+const float BLEND_SHAPES_MIN_WEIGHT = 0.001f;
+
+namespace
+{
+    const unsigned BASE_COLUMNS = SOFTWARE_NORMAL_Z + 1; // positions and normals: colors are not blended
+    const unsigned DELTA_COMPONENTS = 6; // of a vertex: its position and its normal
+    const unsigned DELTAS_PER_BATCH = DELTA_COMPONENTS*SOFTWARE_BATCH_SIZE;
+    const float QUANTUM_MAX = 32767.0f;
+    // Batches blended at once: blending targets one after another, the sums stay in the cache
+    const DWORD CHUNK_BATCHES = 128;
+
+    // Everything the threads share
+    struct BLENDING_PARAMS
+    {
+        const SoftwareColumns *base;
+        const BlendTarget *targets;
+        const float *weights;
+        unsigned targets_count;
+        DeformedStreams *res;
+    };
+
+    // x, y, z of the position of the vertex, then of its normal (as columns of the base)
+    float get_component(const Vertex &vertex, unsigned component)
+    {
+        return ( component < 3 ) ? vertex.pos[component] : vertex.normal[component - 3];
+    }
+
+    // 4 quantised deltas (of the lanes of a batch) as floats multiplied by `scale'
+    inline __m128 load_deltas(const short *deltas, __m128 scale)
+    {
+        const __m128i words = _mm_loadl_epi64( reinterpret_cast<const __m128i*>( deltas ) );
+        const __m128i integers = _mm_srai_epi32( _mm_unpacklo_epi16( words, words ), 16 ); // sign-extended
+        return _mm_mul_ps( _mm_cvtepi32_ps( integers ), scale );
+    }
+
+    void blend_batches(void *context, unsigned thread, DWORD begin, DWORD end)
+    // batches [begin, end) from the first batch of the deformed streams
+    {
+        UNREFERENCED_PARAMETER(thread);
+        const BLENDING_PARAMS &params = *static_cast<BLENDING_PARAMS*>(context);
+        const DWORD first_batch = get_first_batch( *params.res );
+
+        float sums[BASE_COLUMNS][CHUNK_BATCHES*SOFTWARE_BATCH_SIZE];
+        for( DWORD chunk_begin = first_batch + begin; chunk_begin < first_batch + end; chunk_begin += CHUNK_BATCHES )
+        {
+            const DWORD chunk_end = std::min( chunk_begin + CHUNK_BATCHES, first_batch + end );
+            const Index first = chunk_begin*SOFTWARE_BATCH_SIZE;
+            const Index count = ( chunk_end - chunk_begin )*SOFTWARE_BATCH_SIZE;
+            for( unsigned i = 0; i < BASE_COLUMNS; ++i )
+                memcpy( sums[i], params.base->get_column(i) + first, count*sizeof(float) );
+
+            for( unsigned i = 0; i < params.targets_count; ++i )
+            {
+                const float weight = params.weights[i];
+                if( fabs(weight) < BLEND_SHAPES_MIN_WEIGHT )
+                    continue;
+                const BlendTarget &target = params.targets[i];
+                const __m128 position_scale = _mm_set1_ps( weight*target.position_scale );
+                const __m128 normal_scale = _mm_set1_ps( weight*target.normal_scale );
+                // batches of the target in the chunk
+                DWORD j = static_cast<DWORD>( std::lower_bound( target.batches.begin(), target.batches.end(), chunk_begin ) - target.batches.begin() );
+                for( ; j < target.batches.size() && target.batches[j] < chunk_end; ++j )
+                {
+                    const Index lane = ( target.batches[j] - chunk_begin )*SOFTWARE_BATCH_SIZE;
+                    const short *deltas = &target.deltas[j*DELTAS_PER_BATCH];
+                    for( unsigned k = 0; k < DELTA_COMPONENTS; ++k )
+                    {
+                        const __m128 delta = load_deltas( deltas + k*SOFTWARE_BATCH_SIZE, ( k < 3 ) ? position_scale : normal_scale );
+                        _mm_storeu_ps( sums[k] + lane, _mm_add_ps( _mm_loadu_ps( sums[k] + lane ), delta ) );
+                    }
+                }
+            }
+
+            for( Index lane = 0; lane < count; lane += SOFTWARE_BATCH_SIZE )
+            {
+                const SoftwareVector position = { _mm_loadu_ps( sums[SOFTWARE_POSITION_X] + lane ), _mm_loadu_ps( sums[SOFTWARE_POSITION_Y] + lane ),
+                                                  _mm_loadu_ps( sums[SOFTWARE_POSITION_Z] + lane ) };
+                const SoftwareVector normal = { _mm_loadu_ps( sums[SOFTWARE_NORMAL_X] + lane ), _mm_loadu_ps( sums[SOFTWARE_NORMAL_Y] + lane ),
+                                                _mm_loadu_ps( sums[SOFTWARE_NORMAL_Z] + lane ) };
+                store_deformed( position, normal, first + lane, *params.res );
+            }
+        }
+    }
+}
+
+BlendShapes::BlendShapes(const Vertex *vertices, Index vertices_count)
+: base(BASE_COLUMNS, vertices_count)
+{
+    _ASSERT( vertices != NULL || vertices_count == 0 );
+    for( Index i = 0; i < vertices_count; ++i )
+    {
+        for( unsigned j = 0; j < BASE_COLUMNS; ++j )
+            base.get_column(j)[i] = get_component( vertices[i], j );
+    }
+    base.pad();
+}
+
+void BlendShapes::add_target(const Vertex *vertices, float min_delta)
+{
+    _ASSERT( vertices != NULL || base.get_count() == 0 );
+    const Index vertices_count = base.get_count();
+    targets.push_back( BlendTarget() );
+    BlendTarget &target = targets.back();
+
+    // the largest deltas are the largest quanta
+    float max_position_delta = 0;
+    float max_normal_delta = 0;
+    for( Index i = 0; i < vertices_count; ++i )
+    {
+        for( unsigned j = 0; j < DELTA_COMPONENTS; ++j )
+        {
+            const float delta = fabs( get_component( vertices[i], j ) - base.get_column(j)[i] );
+            float &max_delta = ( j < 3 ) ? max_position_delta : max_normal_delta;
+            if( delta > max_delta )
+                max_delta = delta;
+        }
+    }
+    target.position_scale = max_position_delta/QUANTUM_MAX;
+    target.normal_scale = max_normal_delta/QUANTUM_MAX;
+
+    for( DWORD batch = 0; batch < base.get_batches_count(); ++batch )
+    {
+        short deltas[DELTAS_PER_BATCH];
+        bool moving = false;
+        for( unsigned lane = 0; lane < SOFTWARE_BATCH_SIZE; ++lane )
+        {
+            // the padding of the base repeats the last vertex, so does the padding of deltas
+            const Index vertex = std::min( batch*SOFTWARE_BATCH_SIZE + lane, vertices_count - 1 );
+            for( unsigned j = 0; j < DELTA_COMPONENTS; ++j )
+            {
+                const float delta = get_component( vertices[vertex], j ) - base.get_column(j)[vertex];
+                const float scale = ( j < 3 ) ? target.position_scale : target.normal_scale;
+                moving = moving || fabs(delta) > min_delta;
+                deltas[j*SOFTWARE_BATCH_SIZE + lane] = static_cast<short>( ( scale > 0 ) ? floor( delta/scale + 0.5f ) : 0 );
+            }
+        }
+        if( moving )
+        {
+            target.batches.push_back( batch );
+            target.deltas.insert( target.deltas.end(), deltas, deltas + DELTAS_PER_BATCH );
+        }
+    }
+}
+
+void BlendShapes::blend(const float *weights, unsigned threads_count, DeformedStreams &res) const
+{
+    _ASSERT( weights != NULL || targets.empty() );
+    _ASSERT( res.first_vertex <= res.end_vertex && res.end_vertex <= base.get_count() );
+
+    BLENDING_PARAMS params;
+    params.base = &base;
+    params.targets = targets.empty() ? NULL : &targets[0];
+    params.weights = weights;
+    params.targets_count = get_targets_count();
+    params.res = &res;
+    parallel_for( get_end_batch(res) - get_first_batch(res), threads_count, blend_batches, &params );
+}
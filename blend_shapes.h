@@ -0,0 +1,50 @@
+#pragma once
+#include "common.h"
+#include "software.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// Blend shapes: a base mesh and morph targets (shapes of the same vertices) blended on the CPU by weights,
+// p = p0 + sum of w_i*(p_i - p0), and so normals. A target keeps deltas of those vertices only which it moves:
+// its batches of SOFTWARE_BATCH_SIZE vertices (see software.h) with a moving vertex, the deltas quantised to 16 bits,
+// so memory grows with the moved vertices rather than with the number of targets times the mesh.
+// The shapes are shared: every instance blends them by its own weights
+
+// Targets of smaller weights are skipped
+extern const float BLEND_SHAPES_MIN_WEIGHT;
+
+// Deltas of a target
+struct BlendTarget
+{
+    float position_scale;       // a delta is its quantised value times the scale
+    float normal_scale;
+    std::vector<DWORD> batches; // batches with moving vertices, ascending...
+    std::vector<short> deltas;  // ... and their deltas: x, y, z of positions, then of normals, each of all lanes of the batch
+};
+
+class BlendShapes
+{
+private:
+    SoftwareColumns base; // positions and normals
+    std::vector<BlendTarget> targets;
+public:
+    BlendShapes(const Vertex *vertices, Index vertices_count);
+
+    // `vertices' of the target are the base ones moved; a vertex moves if a coordinate of its position
+    // or of its normal changes by more than `min_delta'
+    void add_target(const Vertex *vertices, float min_delta);
+
+    Index get_vertices_count() const { return base.get_count(); }
+    unsigned get_targets_count() const { return static_cast<unsigned>( targets.size() ); }
+    // Number of batches of deltas kept by the target (of base.get_batches_count() at most)
+    DWORD get_target_batches_count(unsigned target) const { return static_cast<DWORD>( targets[target].batches.size() ); }
+
+    // Vertices [res.first_vertex, res.end_vertex) blended by `weights' (of every target) into `res', in model space.
+    // Normals are not normalized: the pass-through shaders do it as they do after skinning.
+    // Batches of vertices are split between `threads_count' threads (see parallel.h)
+    void blend(const float *weights, unsigned threads_count, DeformedStreams &res) const;
+};
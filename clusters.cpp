@@ -0,0 +1,299 @@
+#include "clusters.h"
+#include "stripify.h"
+#include "matrices.h"
+
+const DWORD CLUSTER_MAX_TRIANGLES = 128;
+
+namespace
+{
+    // Normals of a cluster are within 60 degrees from the normal of its first (non-degenerate) triangle, so that the normal cone stays narrow
+    const float CLUSTER_MIN_NORMAL_COS = 0.5f;
+
+    const float HALF_PI = D3DX_PI/2;
+
+    inline float clamped_acos(float cosine)
+    {
+        return acos( cosine > 1.0f ? 1.0f : ( cosine < -1.0f ? -1.0f : cosine ) );
+    }
+
+    D3DXVECTOR3 triangle_normal(const D3DXVECTOR3 *positions, const D3DXVECTOR3 *normals, const Index *triangle)
+    // returns the normal of the triangle plane turned outside as vertex normals are, or zero for a degenerate triangle
+    {
+        D3DXVECTOR3 edge1 = positions[triangle[1]] - positions[triangle[0]];
+        D3DXVECTOR3 edge2 = positions[triangle[2]] - positions[triangle[0]];
+        D3DXVECTOR3 normal;
+        D3DXVec3Cross( &normal, &edge1, &edge2 );
+        D3DXVec3Normalize( &normal, &normal );
+
+        D3DXVECTOR3 outer = normals[triangle[0]] + normals[triangle[1]] + normals[triangle[2]];
+        if( D3DXVec3Dot( &normal, &outer ) < 0 )
+            normal = -normal;
+        return normal;
+    }
+
+    void compute_bounds( const D3DXVECTOR3 *positions, const std::vector<D3DXVECTOR3> &triangle_normals,
+                         const Index *indices, const std::vector<DWORD> &triangles, Cluster &cluster )
+    {
+        _ASSERT( !triangles.empty() );
+        // bounding sphere around the center of the bounding box
+        D3DXVECTOR3 min_corner = positions[indices[triangles[0]*VERTICES_PER_TRIANGLE]];
+        D3DXVECTOR3 max_corner = min_corner;
+        for( unsigned i = 0; i < triangles.size(); ++i )
+        {
+            for( unsigned j = 0; j < VERTICES_PER_TRIANGLE; ++j )
+            {
+                const D3DXVECTOR3 &p = positions[indices[triangles[i]*VERTICES_PER_TRIANGLE + j]];
+                D3DXVec3Minimize( &min_corner, &min_corner, &p );
+                D3DXVec3Maximize( &max_corner, &max_corner, &p );
+            }
+        }
+        cluster.center = (min_corner + max_corner)/2;
+        cluster.radius = 0;
+        for( unsigned i = 0; i < triangles.size(); ++i )
+        {
+            for( unsigned j = 0; j < VERTICES_PER_TRIANGLE; ++j )
+            {
+                D3DXVECTOR3 radius_vector = positions[indices[triangles[i]*VERTICES_PER_TRIANGLE + j]] - cluster.center;
+                const float distance = D3DXVec3Length(&radius_vector);
+                if( distance > cluster.radius )
+                    cluster.radius = distance;
+            }
+        }
+
+        // normal cone around the average normal (degenerate triangles have zero normals and are never seen)
+        D3DXVECTOR3 axis(0, 0, 0);
+        for( unsigned i = 0; i < triangles.size(); ++i )
+            axis += triangle_normals[triangles[i]];
+        D3DXVec3Normalize( &cluster.cone_axis, &axis );
+        if( D3DXVec3LengthSq(&cluster.cone_axis) == 0 )
+        {
+            cluster.cone_angle = D3DX_PI;
+            return;
+        }
+        cluster.cone_angle = 0;
+        for( unsigned i = 0; i < triangles.size(); ++i )
+        {
+            const D3DXVECTOR3 &normal = triangle_normals[triangles[i]];
+            if( D3DXVec3LengthSq(&normal) == 0 )
+                continue;
+            const float angle = clamped_acos( D3DXVec3Dot(&normal, &cluster.cone_axis) );
+            if( angle > cluster.cone_angle )
+                cluster.cone_angle = angle;
+        }
+    }
+}
+
+// -------------------------------------- Frustum -------------------------------------------------------------------
+
+Frustum::Frustum(const D3DXMATRIX &view_projection)
+{
+    // a point is inside if -w <= x <= w, -w <= y <= w, 0 <= z, where (x,y,z,w) = view_projection*(p,1)
+    const D3DXMATRIX &m = view_projection;
+    D3DXVECTOR4 row_x( m._11, m._12, m._13, m._14 );
+    D3DXVECTOR4 row_y( m._21, m._22, m._23, m._24 );
+    D3DXVECTOR4 row_z( m._31, m._32, m._33, m._34 );
+    D3DXVECTOR4 row_w( m._41, m._42, m._43, m._44 );
+
+    planes[0] = row_w + row_x;
+    planes[1] = row_w - row_x;
+    planes[2] = row_w + row_y;
+    planes[3] = row_w - row_y;
+    planes[4] = row_z;
+    for( unsigned i = 0; i < PLANES_COUNT; ++i )
+    {
+        D3DXVECTOR3 normal( planes[i].x, planes[i].y, planes[i].z );
+        planes[i] /= D3DXVec3Length(&normal);
+    }
+}
+
+bool Frustum::intersects_sphere(const D3DXVECTOR3 &center, float radius) const
+{
+    const D3DXVECTOR4 point(center, 1.0f);
+    for( unsigned i = 0; i < PLANES_COUNT; ++i )
+    {
+        if( D3DXVec4Dot( &planes[i], &point ) < -radius )
+            return false;
+    }
+    return true;
+}
+
+// -------------------------------------- Clusters ------------------------------------------------------------------
+
+void build_clusters( const D3DXVECTOR3 *positions, const D3DXVECTOR3 *normals, Index vertices_count,
+                     Index *indices, DWORD indices_count, std::vector<Cluster> &clusters )
+{
+    _ASSERT(positions != NULL);
+    _ASSERT(normals != NULL);
+    _ASSERT(indices != NULL);
+    const DWORD triangles_count = indices_count/VERTICES_PER_TRIANGLE;
+    clusters.clear();
+
+    // triangles around each vertex v are vertex_triangles[first_triangle[v]] ... vertex_triangles[first_triangle[v+1]-1]
+    std::vector<DWORD> first_triangle(vertices_count + 1, 0);
+    for( DWORD i = 0; i < triangles_count*VERTICES_PER_TRIANGLE; ++i )
+        ++first_triangle[indices[i] + 1];
+    for( Index v = 0; v < vertices_count; ++v )
+        first_triangle[v + 1] += first_triangle[v];
+    std::vector<DWORD> vertex_triangles(triangles_count*VERTICES_PER_TRIANGLE);
+    std::vector<DWORD> filled(first_triangle.begin(), first_triangle.end() - 1);
+    for( DWORD i = 0; i < triangles_count*VERTICES_PER_TRIANGLE; ++i )
+        vertex_triangles[filled[indices[i]]++] = i/VERTICES_PER_TRIANGLE;
+
+    std::vector<D3DXVECTOR3> triangle_normals(triangles_count);
+    for( DWORD t = 0; t < triangles_count; ++t )
+        triangle_normals[t] = triangle_normal( positions, normals, &indices[t*VERTICES_PER_TRIANGLE] );
+
+    // growing clusters in breadth: starting from the first free triangle (generators give them in a good order)
+    // and taking free triangles which share a vertex and have a close normal
+    std::vector<bool> clustered(triangles_count, false);
+    std::vector<bool> queued(triangles_count, false);
+    std::vector<DWORD> queue, cluster_triangles;
+    std::vector<Index> reordered(triangles_count*VERTICES_PER_TRIANGLE);
+    DWORD reordered_count = 0;
+    for( DWORD seed = 0; seed < triangles_count; ++seed )
+    {
+        if( clustered[seed] )
+            continue;
+        queue.clear();
+        cluster_triangles.clear();
+        queue.push_back(seed);
+        queued[seed] = true;
+        D3DXVECTOR3 reference_normal = triangle_normals[seed]; // zero until the first non-degenerate triangle
+        for( unsigned next = 0; next < queue.size() && cluster_triangles.size() < CLUSTER_MAX_TRIANGLES; ++next )
+        {
+            const DWORD t = queue[next];
+            clustered[t] = true;
+            cluster_triangles.push_back(t);
+            if( D3DXVec3LengthSq( &reference_normal ) == 0 )
+                reference_normal = triangle_normals[t];
+            for( unsigned i = 0; i < VERTICES_PER_TRIANGLE; ++i )
+            {
+                const Index v = indices[t*VERTICES_PER_TRIANGLE + i];
+                for( DWORD j = first_triangle[v]; j < first_triangle[v + 1]; ++j )
+                {
+                    const DWORD neighbour = vertex_triangles[j];
+                    if( queued[neighbour] || clustered[neighbour] )
+                        continue;
+                    if( D3DXVec3Dot( &triangle_normals[neighbour], &reference_normal ) < CLUSTER_MIN_NORMAL_COS &&
+                        D3DXVec3LengthSq( &triangle_normals[neighbour] ) != 0 && D3DXVec3LengthSq( &reference_normal ) != 0 )
+                        continue;
+                    queued[neighbour] = true;
+                    queue.push_back(neighbour);
+                }
+            }
+        }
+        // triangles which did not fit are free again
+        for( unsigned i = 0; i < queue.size(); ++i )
+            queued[queue[i]] = false;
+
+        Cluster cluster;
+        cluster.first_index = reordered_count;
+        cluster.triangles_count = 0;
+        for( unsigned i = 0; i < cluster_triangles.size(); ++i )
+        {
+            const Index *triangle = &indices[cluster_triangles[i]*VERTICES_PER_TRIANGLE];
+            if( triangle[0] != triangle[1] && triangle[1] != triangle[2] && triangle[0] != triangle[2] )
+                ++cluster.triangles_count;
+            for( unsigned j = 0; j < VERTICES_PER_TRIANGLE; ++j )
+                reordered[reordered_count++] = triangle[j];
+        }
+        cluster.indices_count = reordered_count - cluster.first_index;
+        cluster.base_vertex = 0;
+        cluster.vertices_count = vertices_count;
+        compute_bounds( positions, triangle_normals, indices, cluster_triangles, cluster );
+        clusters.push_back(cluster);
+    }
+
+    if( reordered_count != 0 )
+        memcpy( indices, &reordered[0], reordered_count*sizeof(indices[0]) );
+}
+
+void build_cluster( const D3DXVECTOR3 *positions, const D3DXVECTOR3 *normals, Index vertices_count,
+                    const Index *indices, DWORD indices_count, Cluster &cluster )
+{
+    _ASSERT(positions != NULL);
+    _ASSERT(normals != NULL);
+    _ASSERT(indices != NULL);
+    const DWORD triangles_count = indices_count/VERTICES_PER_TRIANGLE;
+    _ASSERT( triangles_count > 0 );
+    std::vector<D3DXVECTOR3> triangle_normals(triangles_count);
+    std::vector<DWORD> triangles(triangles_count);
+    cluster.triangles_count = 0;
+    for( DWORD t = 0; t < triangles_count; ++t )
+    {
+        const Index *triangle = &indices[t*VERTICES_PER_TRIANGLE];
+        triangle_normals[t] = triangle_normal( positions, normals, triangle );
+        triangles[t] = t;
+        if( triangle[0] != triangle[1] && triangle[1] != triangle[2] && triangle[0] != triangle[2] )
+            ++cluster.triangles_count;
+    }
+    cluster.first_index = 0;
+    cluster.indices_count = triangles_count*VERTICES_PER_TRIANGLE;
+    cluster.base_vertex = 0;
+    cluster.vertices_count = vertices_count;
+    compute_bounds( positions, triangle_normals, indices, triangles, cluster );
+}
+
+void merge_normal_cone(Cluster &cluster, const D3DXVECTOR3 &axis, float angle)
+{
+    if( cluster.cone_angle >= HALF_PI || angle >= HALF_PI )
+    {
+        cluster.cone_angle = D3DX_PI;
+        return;
+    }
+    const float between = clamped_acos( D3DXVec3Dot(&cluster.cone_axis, &axis) );
+    if( cluster.cone_angle >= between + angle )
+        return; // the cone already contains the other one
+    if( angle >= between + cluster.cone_angle )
+    {
+        cluster.cone_axis = axis;
+        cluster.cone_angle = angle;
+        return;
+    }
+    // the new axis is turned from the old one to the other axis in their plane
+    const float new_angle = (cluster.cone_angle + angle + between)/2;
+    const float turn = new_angle - cluster.cone_angle;
+    const D3DXVECTOR3 new_axis = ( cluster.cone_axis*sin(between - turn) + axis*sin(turn) )/sin(between);
+    D3DXVec3Normalize( &cluster.cone_axis, &new_axis );
+    cluster.cone_angle = new_angle;
+}
+
+D3DPRIMITIVETYPE choose_primitive_type(Index *indices, DWORD &indices_count, Index vertices_count, std::vector<Cluster> &clusters)
+{
+    if( clusters.empty() )
+        return D3DPT_TRIANGLELIST;
+    std::vector<DWORD> range_starts(clusters.size());
+    for( unsigned i = 0; i < clusters.size(); ++i )
+        range_starts[i] = clusters[i].first_index;
+
+    D3DPRIMITIVETYPE primitive_type = choose_primitive_type( indices, indices_count, vertices_count, &range_starts[0], static_cast<unsigned>(clusters.size()) );
+
+    for( unsigned i = 0; i < clusters.size(); ++i )
+    {
+        const DWORD range_end = ( i + 1 < clusters.size() ) ? range_starts[i + 1] : indices_count;
+        clusters[i].first_index = range_starts[i];
+        clusters[i].indices_count = range_end - range_starts[i];
+    }
+    return primitive_type;
+}
+
+bool is_cluster_visible( const Cluster &cluster, const D3DXMATRIX &model_matrix,
+                         const Frustum &frustum, const D3DXVECTOR3 &eye, bool cull_back_faces )
+{
+    const D3DXVECTOR3 center = transform_point( model_matrix, cluster.center );
+    if( !frustum.intersects_sphere( center, cluster.radius ) )
+        return false;
+    if( !cull_back_faces || cluster.cone_angle >= HALF_PI )
+        return true;
+
+    D3DXVECTOR3 to_cluster = center - eye;
+    const float distance = D3DXVec3Length(&to_cluster);
+    if( distance <= cluster.radius )
+        return true;
+    const D3DXVECTOR3 axis = transform_vector( model_matrix, cluster.cone_axis );
+    // every direction from the eye to the sphere is within `sphere_angle' from the direction to its center;
+    // faces are turned away if all these directions are less than 90 degrees from all the normals
+    const float view_angle = clamped_acos( D3DXVec3Dot(&to_cluster, &axis)/distance );
+    const float sphere_angle = asin( cluster.radius/distance );
+    return view_angle + cluster.cone_angle + sphere_angle >= HALF_PI;
+}
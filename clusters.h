@@ -0,0 +1,60 @@
+#pragma once
+#include "common.h"
+#include "Vertex.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// Maximal number of triangles in a cluster
+extern const DWORD CLUSTER_MAX_TRIANGLES;
+
+// A small piece of a mesh which is culled as a whole: its triangles are a range of the index buffer
+// drawn with its own base vertex (so that equal chunks of a grid may share indices).
+// Bounds are in model space and do not take deformation into account (see Model::add_deformation_to_bounds())
+struct Cluster
+{
+    D3DXVECTOR3 center;     // bounding sphere
+    float radius;
+    D3DXVECTOR3 cone_axis;  // normal cone: all outer normals are within `cone_angle' from `cone_axis',
+    float cone_angle;       // ... D3DX_PI/2 or more means that the cluster may be seen from any side
+    DWORD first_index;
+    DWORD indices_count;
+    DWORD triangles_count;  // not counting degenerate triangles joining strips
+    DWORD base_vertex;      // added to the indices of the cluster
+    DWORD vertices_count;   // number of vertices from `base_vertex' which the indices may refer to
+};
+
+// Frustum of the camera, built from its view-projection matrix: the far plane is ignored (FAR_CLIP is huge)
+class Frustum
+{
+private:
+    static const unsigned PLANES_COUNT = 5;
+    D3DXVECTOR4 planes[PLANES_COUNT]; // (normal, d) with normal looking inside and normalized
+public:
+    explicit Frustum(const D3DXMATRIX &view_projection);
+    bool intersects_sphere(const D3DXVECTOR3 &center, float radius) const;
+};
+
+// Splits indexed triangle list into clusters of at most CLUSTER_MAX_TRIANGLES adjacent triangles with close normals.
+// Triangles are reordered so that each cluster is a range of `indices'
+void build_clusters( const D3DXVECTOR3 *positions, const D3DXVECTOR3 *normals, Index vertices_count,
+                     Index *indices, DWORD indices_count, std::vector<Cluster> &clusters );
+
+// Makes one cluster of all the triangles of the list (e.g. of a chunk of a grid), its range is the whole list
+void build_cluster( const D3DXVECTOR3 *positions, const D3DXVECTOR3 *normals, Index vertices_count,
+                    const Index *indices, DWORD indices_count, Cluster &cluster );
+
+// Chooses primitive type like choose_primitive_type() from stripify.h, but each cluster stays a separate range:
+// `indices' are a list on input; ranges of clusters are updated
+D3DPRIMITIVETYPE choose_primitive_type(Index *indices, DWORD &indices_count, Index vertices_count, std::vector<Cluster> &clusters);
+
+// Widens the normal cone of the cluster to contain the given cone too
+void merge_normal_cone(Cluster &cluster, const D3DXVECTOR3 &axis, float angle);
+
+// Returns false if the cluster (transformed by `model_matrix') is surely invisible: out of the frustum or,
+// when `cull_back_faces' (for closed models seen from outside), turned away from the eye
+bool is_cluster_visible( const Cluster &cluster, const D3DXMATRIX &model_matrix,
+                         const Frustum &frustum, const D3DXVECTOR3 &eye, bool cull_back_faces );
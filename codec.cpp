@@ -0,0 +1,194 @@
+#include "codec.h"
+
+namespace
+{
+    const unsigned MAX_INDEX_DISTANCE = 3;
+    const unsigned VARINT_BITS = 7;
+    const BYTE VARINT_MORE = 0x80;
+    const unsigned MAX_VARINT_SIZE = 5; // of a DWORD
+
+    // Predictors of a vertex column
+    const BYTE PREDICT_PREVIOUS = 1;
+    const BYTE PREDICT_LINEAR = 2;
+
+    inline DWORD zigzag(DWORD difference)
+    // ... -2, -1, 0, 1, 2 ... (in two's complement) become ... 3, 1, 0, 2, 4 ...
+    {
+        return (difference << 1) ^ (0 - (difference >> 31));
+    }
+
+    inline DWORD unzigzag(DWORD code)
+    {
+        return (code >> 1) ^ (0 - (code & 1));
+    }
+
+    inline unsigned varint_size(DWORD value)
+    {
+        unsigned size = 1;
+        while( value >= VARINT_MORE )
+        {
+            value >>= VARINT_BITS;
+            ++size;
+        }
+        return size;
+    }
+
+    inline void write_varint(DWORD value, std::vector<BYTE> &res)
+    {
+        while( value >= VARINT_MORE )
+        {
+            res.push_back( static_cast<BYTE>( value | VARINT_MORE ) );
+            value >>= VARINT_BITS;
+        }
+        res.push_back( static_cast<BYTE>( value ) );
+    }
+
+    inline bool read_varint(const BYTE *&data, const BYTE *end, DWORD &value)
+    {
+        // one byte is the common case of regular meshes
+        if( data != end && *data < VARINT_MORE )
+        {
+            value = *data++;
+            return true;
+        }
+        value = 0;
+        for( unsigned i = 0; i < MAX_VARINT_SIZE && data != end; ++i )
+        {
+            const BYTE byte = *data++;
+            value |= static_cast<DWORD>( byte & ~VARINT_MORE ) << (i*VARINT_BITS);
+            if( ( byte & VARINT_MORE ) == 0 )
+                return i + 1 < MAX_VARINT_SIZE || byte < (1 << (32 - (MAX_VARINT_SIZE - 1)*VARINT_BITS)); // no bits beyond 32
+        }
+        return false;
+    }
+
+    // The i-th value of a column of vertices of `stride' DWORDs, and its prediction from the previous ones
+    inline DWORD column_value(const DWORD *column, unsigned stride, Index i)
+    {
+        return column[static_cast<size_t>(i)*stride];
+    }
+
+    inline DWORD predict_vertex(const DWORD *column, unsigned stride, Index i, BYTE predictor)
+    {
+        if( i == 0 )
+            return 0;
+        const DWORD previous = column_value( column, stride, i - 1 );
+        if( predictor == PREDICT_PREVIOUS || i == 1 )
+            return previous;
+        return 2*previous - column_value( column, stride, i - 2 );
+    }
+}
+
+void encode_indices(const Index *indices, DWORD indices_count, std::vector<BYTE> &res)
+{
+    _ASSERT( indices != NULL || indices_count == 0 );
+    // the distance with the shortest code
+    unsigned best_distance = 1;
+    DWORD64 best_size = 0;
+    for( unsigned distance = 1; distance <= MAX_INDEX_DISTANCE; ++distance )
+    {
+        DWORD64 size = 0;
+        for( DWORD i = 0; i < indices_count; ++i )
+            size += varint_size( zigzag( indices[i] - ( i >= distance ? indices[i - distance] : 0 ) ) );
+        if( distance == 1 || size < best_size )
+        {
+            best_distance = distance;
+            best_size = size;
+        }
+    }
+
+    res.reserve( res.size() + 1 + static_cast<size_t>( best_size ) );
+    res.push_back( static_cast<BYTE>( best_distance ) );
+    for( DWORD i = 0; i < indices_count; ++i )
+        write_varint( zigzag( indices[i] - ( i >= best_distance ? indices[i - best_distance] : 0 ) ), res );
+}
+
+bool decode_indices(const BYTE *data, size_t size, Index *res_indices, DWORD indices_count)
+{
+    _ASSERT( data != NULL || size == 0 );
+    _ASSERT( res_indices != NULL || indices_count == 0 );
+    const BYTE *end = data + size;
+    if( data == end )
+        return false;
+    const unsigned distance = *data++;
+    if( distance == 0 || distance > MAX_INDEX_DISTANCE )
+        return false;
+    for( DWORD i = 0; i < indices_count; ++i )
+    {
+        DWORD code;
+        if( !read_varint( data, end, code ) )
+            return false;
+        res_indices[i] = unzigzag( code ) + ( i >= distance ? res_indices[i - distance] : 0 );
+    }
+    return data == end;
+}
+
+void encode_vertices(const void *vertices, unsigned vertex_size, Index vertices_count, std::vector<BYTE> &res)
+{
+    _ASSERT( vertices != NULL || vertices_count == 0 );
+    _ASSERT( vertex_size % sizeof(DWORD) == 0 );
+    const unsigned stride = vertex_size/sizeof(DWORD);
+    for( unsigned j = 0; j < stride; ++j )
+    {
+        const DWORD *column = static_cast<const DWORD*>(vertices) + j;
+        DWORD64 previous_size = 0;
+        DWORD64 linear_size = 0;
+        for( Index i = 0; i < vertices_count; ++i )
+        {
+            const DWORD value = column_value( column, stride, i );
+            previous_size += varint_size( zigzag( value - predict_vertex( column, stride, i, PREDICT_PREVIOUS ) ) );
+            linear_size += varint_size( zigzag( value - predict_vertex( column, stride, i, PREDICT_LINEAR ) ) );
+        }
+        const BYTE predictor = ( linear_size < previous_size ) ? PREDICT_LINEAR : PREDICT_PREVIOUS;
+        res.push_back( predictor );
+        for( Index i = 0; i < vertices_count; ++i )
+            write_varint( zigzag( column_value( column, stride, i ) - predict_vertex( column, stride, i, predictor ) ), res );
+    }
+}
+
+bool decode_vertices(const BYTE *data, size_t size, void *res_vertices, unsigned vertex_size, Index vertices_count)
+{
+    _ASSERT( res_vertices != NULL || vertices_count == 0 );
+    if( vertex_size % sizeof(DWORD) != 0 )
+        return false;
+    const unsigned columns_count = vertex_size/sizeof(DWORD);
+    std::vector<VertexColumn> columns( columns_count );
+    for( unsigned j = 0; j < columns_count; ++j )
+    {
+        columns[j].destination = static_cast<BYTE*>(res_vertices);
+        columns[j].stride = vertex_size;
+        columns[j].offset = j*sizeof(DWORD);
+    }
+    return decode_vertex_columns( data, size, columns.empty() ? NULL : &columns[0], columns_count, vertices_count );
+}
+
+bool decode_vertex_columns(const BYTE *data, size_t size, const VertexColumn *columns, unsigned columns_count, Index vertices_count)
+{
+    _ASSERT( data != NULL || size == 0 );
+    _ASSERT( columns != NULL || columns_count == 0 );
+    const BYTE *end = data + size;
+    for( unsigned j = 0; j < columns_count; ++j )
+    {
+        if( data == end )
+            return false;
+        const BYTE predictor = *data++;
+        if( predictor != PREDICT_PREVIOUS && predictor != PREDICT_LINEAR )
+            return false;
+        BYTE *destination = ( columns[j].destination != NULL ) ? columns[j].destination + columns[j].offset : NULL;
+        // the two previous values are kept here, so the destination is only written
+        DWORD previous = 0;
+        DWORD before_previous = 0;
+        for( Index i = 0; i < vertices_count; ++i )
+        {
+            DWORD code;
+            if( !read_varint( data, end, code ) )
+                return false;
+            const DWORD prediction = ( predictor == PREDICT_PREVIOUS || i < 2 ) ? previous : 2*previous - before_previous;
+            before_previous = previous;
+            previous = unzigzag( code ) + prediction;
+            if( destination != NULL )
+                *reinterpret_cast<DWORD*>( destination + static_cast<size_t>(i)*columns[j].stride ) = previous;
+        }
+    }
+    return data == end;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "common.h"
+#include "Vertex.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// Lossless codec of vertex and index streams (e.g. for the mesh cache). Generated meshes are regular,
+// so every value is predicted from the previous ones and only the difference is written: it is zigzag-coded
+// (small negative numbers become small positive ones) and written as a varint (7 bits per byte, the high bit
+// means "more bytes follow"), so most values of a regular mesh take one byte instead of four.
+// Decoders check the data and return false if it is broken or does not match the expected counts
+
+// Each index is predicted by the index 1, 2 or 3 positions back, whichever gives the shortest code:
+// 2 suits strips (their indices alternate between two rows), 3 suits lists of grids.
+// Appends the code to `res'
+void encode_indices(const Index *indices, DWORD indices_count, std::vector<BYTE> &res);
+bool decode_indices(const BYTE *data, size_t size, Index *res_indices, DWORD indices_count);
+
+// Vertices are coded by columns of DWORDs (components of attributes): each column is predicted by the same
+// column of the previous vertex or linearly by the two previous ones, whichever is shorter for the column.
+// Differences are taken between bit patterns, so floats are restored exactly.
+// `vertex_size' must be a multiple of sizeof(DWORD). Appends the code to `res'
+void encode_vertices(const void *vertices, unsigned vertex_size, Index vertices_count, std::vector<BYTE> &res);
+bool decode_vertices(const BYTE *data, size_t size, void *res_vertices, unsigned vertex_size, Index vertices_count);
+
+// Where decode_vertex_columns() writes a column: at `offset' bytes into each vertex of `stride' bytes from `destination'.
+// So columns can be scattered straight into the streams of a vertex format (see VertexFormat::get_columns())
+struct VertexColumn
+{
+    BYTE *destination;  // NULL: the column is only checked
+    unsigned stride;
+    unsigned offset;
+};
+
+// Decodes the code of encode_vertices() of `columns_count' columns (vertex_size/sizeof(DWORD)) into their destinations.
+// Decoded values are never read back, so destinations may be locked write-only buffers
+bool decode_vertex_columns(const BYTE *data, size_t size, const VertexColumn *columns, unsigned columns_count, Index vertices_count);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "platform.h"
+#include <cstdlib>
+#include <ctime>
+#include "Error.h"
+
+// Helpers of all modules, with or without a device (see platform.h); those of D3D interfaces are in main.h
+
+// They must be macros, not constants, because they must be known at compile-time (they are used for array initialization in another module)
+#define BONE_INFLUENCES_COUNT 4 // bones blended for a vertex of skinning
+#define MAX_BONES_COUNT 256     // of a skinned mesh: bone indices of vertices are bytes
+
+// a helper to call delete[] on pointer to an array(!) if it is not NULL
+template<class Type> void delete_array(Type **dynamic_array)
+{
+    _ASSERT(dynamic_array != NULL);
+    if( *dynamic_array != NULL)
+    {
+        delete[] *dynamic_array;
+        *dynamic_array = NULL;
+    }
+}
+
+// a helper to find out a size of an array defined with `array[]={...}' without doing `sizeof(array)/sizeof(array[0])'
+template<size_t SIZE, class T> inline size_t array_size(T (&array)[SIZE])
+{
+    UNREFERENCED_PARAMETER(array);
+    return SIZE;
+}
+
+// helpers for sizes of big meshes: they are counted in 64 bits, so they never wrap around,
+// and NoMemoryError is thrown when the result does not fit into its type
+inline DWORD get_count(DWORD64 count)
+{
+    if( count > MAXDWORD )
+        throw NoMemoryError();
+    return static_cast<DWORD>( count );
+}
+inline size_t get_array_size(DWORD64 count, size_t element_size)
+{
+    _ASSERT( element_size != 0 );
+    const DWORD64 size = count*element_size;
+    if( count > static_cast<size_t>(-1) || size/element_size != count || size > static_cast<size_t>(-1) )
+        throw NoMemoryError();
+    return static_cast<size_t>( size );
+}
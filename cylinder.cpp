@@ -4,15 +4,6 @@ const Index CYLINDER_EDGES_PER_BASE = 300;
 const Index CYLINDER_EDGES_PER_HEIGHT = 250;
 const Index CYLINDER_EDGES_PER_CAP = 100;
 
-const Index CYLINDER_VERTICES_COUNT 
-    = (CYLINDER_EDGES_PER_BASE)*((CYLINDER_EDGES_PER_HEIGHT + 1) + 2 + 2*(CYLINDER_EDGES_PER_CAP -1)) // vertices per CYLINDER_EDGES_PER_HEIGHT+1 levels plus last ans first levels again, plus CYLINDER_EDGES_PER_CAP-1 levels per each of 2 caps
-    + 2 // plus centers of 2 caps
-    + CYLINDER_EDGES_PER_HEIGHT; // plus jump between top and bottom
-const DWORD CYLINDER_INDICES_COUNT
-    = 2*(CYLINDER_EDGES_PER_BASE + 1)*(CYLINDER_EDGES_PER_HEIGHT + 2*(CYLINDER_EDGES_PER_CAP - 1)) // indices per CYLINDER_EDGES_PER_HEIGHT levels plus CYLINDER_EDGES_PER_CAP-1 levels per each of 2 caps
-    + 2*(2*CYLINDER_EDGES_PER_BASE + 1) // plus 2 ends of caps
-    + CYLINDER_EDGES_PER_HEIGHT + 2;  // plus jump between top and bottom
-
 namespace
 {
     struct GENERATION_PARAMS
@@ -26,6 +17,12 @@ namespace
         // colors
         const D3DCOLOR *colors;
         unsigned colors_count;
+        // skinning
+        unsigned bones_count;
+        // numbers of edges
+        Index edges_per_base;
+        Index edges_per_height;
+        Index edges_per_cap;
         // options
         bool radial_strips; // radial (depending on step) or vertical (depending on level) color distribution
         bool vertical;      // vertical (for cylinder side) or horisontal (for caps) moving whe generating
@@ -34,12 +31,12 @@ namespace
 
     void generate_levels(Index &vertex, DWORD &index, const GENERATION_PARAMS &params)
     {
-        const float STEP_ANGLE = 2*D3DX_PI/CYLINDER_EDGES_PER_BASE;
-        const float STEP_UP = params.height/CYLINDER_EDGES_PER_HEIGHT;
-        const float STEP_RADIAL = params.radius/CYLINDER_EDGES_PER_CAP;
+        const float STEP_ANGLE = 2*D3DX_PI/params.edges_per_base;
+        const float STEP_UP = params.height/params.edges_per_height;
+        const float STEP_RADIAL = params.radius/params.edges_per_cap;
 
-        Index levels_count = params.vertical ? CYLINDER_EDGES_PER_HEIGHT + 1 : CYLINDER_EDGES_PER_CAP;
-        Index levels_or_steps_count = params.radial_strips ? CYLINDER_EDGES_PER_BASE : levels_count;
+        Index levels_count = params.vertical ? params.edges_per_height + 1 : params.edges_per_cap;
+        Index levels_or_steps_count = params.radial_strips ? params.edges_per_base : levels_count;
         _ASSERT(params.colors_count != 0);
         Index part_size = (levels_or_steps_count + params.colors_count)/params.colors_count; // `+ colors_count' just for excluding a bound of interval [0, colors_count)
         
@@ -49,7 +46,7 @@ namespace
     
         for( Index level = 0; level < levels_count; ++level )
         {
-            for( Index step = 0; step < CYLINDER_EDGES_PER_BASE; ++step )
+            for( Index step = 0; step < params.edges_per_base; ++step )
             {
                 float radius = params.vertical ? params.radius : (params.radius - STEP_RADIAL*level);
                 float z, weight;
@@ -57,7 +54,7 @@ namespace
                 if (params.vertical)
                 {
                     z = level*STEP_UP;
-                    weight = static_cast<float>(level)/CYLINDER_EDGES_PER_HEIGHT;
+                    weight = static_cast<float>(level)/params.edges_per_height;
                     normal = D3DXVECTOR3( cos(step*STEP_ANGLE), sin(step*STEP_ANGLE), 0 );
                 }
                 else
@@ -77,22 +74,22 @@ namespace
                     // * last vertices (for top cap)
                     //    OR
                     // * first vertices (for bottom cap)
-                    unsigned copy_from = params.top ? vertex - CYLINDER_EDGES_PER_BASE : step;
+                    unsigned copy_from = params.top ? vertex - params.edges_per_base : step;
                     params.res_vertices[vertex] = params.res_vertices[copy_from];
                     params.res_vertices[vertex].set_normal( normal );
                     params.res_vertices[vertex].color = color;
                     ++vertex;
                     continue;
                 }
-                params.res_vertices[vertex] = SkinningVertex(position, color, weight, normal);
+                params.res_vertices[vertex] = SkinningVertex(position, color, weight, params.bones_count, normal);
                 if( level != 0 )
                 {
-                    params.res_indices[index++] = vertex - CYLINDER_EDGES_PER_BASE; // from previous level
-                    params.res_indices[index++] = vertex;                           // from current level
-                    if( step == CYLINDER_EDGES_PER_BASE - 1 ) // last step
+                    params.res_indices[index++] = vertex - params.edges_per_base; // from previous level
+                    params.res_indices[index++] = vertex;                         // from current level
+                    if( step == params.edges_per_base - 1 ) // last step
                     {
-                        params.res_indices[index++] = vertex - 2*CYLINDER_EDGES_PER_BASE + 1; // first from previuos level
-                        params.res_indices[index++] = vertex - CYLINDER_EDGES_PER_BASE + 1; // first from current level
+                        params.res_indices[index++] = vertex - 2*params.edges_per_base + 1; // first from previuos level
+                        params.res_indices[index++] = vertex - params.edges_per_base + 1; // first from current level
                     }
                 }
                 ++vertex;
@@ -102,31 +99,36 @@ namespace
         {
             // for caps: add center vertex and triangles with it
             D3DXVECTOR3 position = D3DXVECTOR3( 0, 0, z_if_horisontal );
-            params.res_vertices[vertex] = SkinningVertex( position, params.colors[0], weight_if_horisontal, normal_if_horisontal );
-            for( Index step = 0; step < CYLINDER_EDGES_PER_BASE; ++step )
+            params.res_vertices[vertex] = SkinningVertex( position, params.colors[0], weight_if_horisontal, params.bones_count, normal_if_horisontal );
+            for( Index step = 0; step < params.edges_per_base; ++step )
             {
-                params.res_indices[index++] = vertex - CYLINDER_EDGES_PER_BASE + step;
+                params.res_indices[index++] = vertex - params.edges_per_base + step;
                 params.res_indices[index++] = vertex;
             }
-            params.res_indices[index++] = vertex - CYLINDER_EDGES_PER_BASE;
+            params.res_indices[index++] = vertex - params.edges_per_base;
             ++vertex;
         }
     }
 }
 
 void cylinder( float radius, float height,
-               const D3DCOLOR *colors, unsigned colors_count,
-               SkinningVertex *res_vertices, Index *res_indices)
+               const D3DCOLOR *colors, unsigned colors_count, unsigned bones_count,
+               SkinningVertex *res_vertices, Index *res_indices,
+               Index edges_per_base /*= CYLINDER_EDGES_PER_BASE*/,
+               Index edges_per_height /*= CYLINDER_EDGES_PER_HEIGHT*/,
+               Index edges_per_cap /*= CYLINDER_EDGES_PER_CAP*/ )
 // Writes data into arrays given as `res_vertices' and `res_indices',
+// vertices are skinned by a chain of `bones_count' bones from the bottom to the top
 {
     Index vertex = 0; // current vertex
     DWORD index = 0; // current index
     
     _ASSERT(res_vertices != NULL);
     _ASSERT(res_indices != NULL);
-    _ASSERT(CYLINDER_EDGES_PER_BASE != 0);
-    _ASSERT(CYLINDER_EDGES_PER_HEIGHT != 0);
-    _ASSERT(CYLINDER_EDGES_PER_CAP != 0);
+    _ASSERT(edges_per_base != 0);
+    _ASSERT(edges_per_height != 0);
+    _ASSERT(edges_per_cap != 0);
+    _ASSERT(bones_count != 0 && bones_count <= MAX_BONES_COUNT);
 
     GENERATION_PARAMS params;
     // output buffers
@@ -138,6 +140,12 @@ void cylinder( float radius, float height,
     // colors
     params.colors = colors;
     params.colors_count = colors_count;
+    // skinning
+    params.bones_count = bones_count;
+    // numbers of edges
+    params.edges_per_base = edges_per_base;
+    params.edges_per_height = edges_per_height;
+    params.edges_per_cap = edges_per_cap;
     // options
     params.radial_strips = false;
     params.vertical = true;
@@ -151,11 +159,11 @@ void cylinder( float radius, float height,
     generate_levels(vertex, index, params);
 
     // Go from last level to first inside cylinder
-    const float STEP_UP = params.height/CYLINDER_EDGES_PER_HEIGHT;
-    for( unsigned level = CYLINDER_EDGES_PER_HEIGHT; level != 0; --level )
+    const float STEP_UP = params.height/edges_per_height;
+    for( unsigned level = edges_per_height; level != 0; --level )
     {
         res_vertices[vertex] = SkinningVertex( D3DXVECTOR3(0, 0, level*STEP_UP),
-                                               static_cast<float>(level)/CYLINDER_EDGES_PER_HEIGHT,
+                                               static_cast<float>(level)/edges_per_height, bones_count,
                                                D3DXVECTOR3(0,0,1.0f) );
         res_indices[index++] = vertex;
         ++vertex;
@@ -169,3 +177,12 @@ void cylinder( float radius, float height,
     params.top = false;
     generate_levels(vertex, index, params);
 }
+
+void cylinder( const CylinderDesc &desc, MeshSink &sink )
+{
+    SkinningVertex *res_vertices = lock_vertices<SkinningVertex>( sink, desc.vertices_count() );
+    Index *res_indices = sink.lock_indices( desc.indices_count() );
+    cylinder( desc.radius, desc.height, desc.colors, desc.colors_count, desc.bones_count, res_vertices, res_indices,
+              desc.edges_per_base, desc.edges_per_height, desc.edges_per_cap );
+    sink.unlock( desc.primitive_type() );
+}
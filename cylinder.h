@@ -1,15 +1,64 @@
 #pragma once
-#include "main.h"
+#include "common.h"
 #include "Vertex.h"
+#include "mesh_sink.h"
 
 extern const Index CYLINDER_EDGES_PER_BASE;
 extern const Index CYLINDER_EDGES_PER_HEIGHT;
 extern const Index CYLINDER_EDGES_PER_CAP;
 
-extern const Index CYLINDER_VERTICES_COUNT;
-extern const DWORD CYLINDER_INDICES_COUNT; // Calculated for TRIANGLESTRIP primitive type
+// Sizes of the cylinder for any numbers of edges, calculated for TRIANGLESTRIP primitive type
+inline Index cylinder_vertices_count(Index edges_per_base, Index edges_per_height, Index edges_per_cap)
+{
+    return edges_per_base*((edges_per_height + 1) + 2 + 2*(edges_per_cap - 1)) // vertices per edges_per_height+1 levels plus last and first levels again, plus edges_per_cap-1 levels per each of 2 caps
+        + 2 // plus centers of 2 caps
+        + edges_per_height; // plus jump between top and bottom
+}
+inline DWORD cylinder_indices_count(Index edges_per_base, Index edges_per_height, Index edges_per_cap)
+{
+    return 2*(edges_per_base + 1)*(edges_per_height + 2*(edges_per_cap - 1)) // indices per edges_per_height levels plus edges_per_cap-1 levels per each of 2 caps
+        + 2*(2*edges_per_base + 1) // plus 2 ends of caps
+        + edges_per_height + 2;  // plus jump between top and bottom
+}
 
 // Writes data into arrays given as `res_vertices' and `res_indices',
+// vertices are skinned by a chain of `bones_count' bones from the bottom to the top
 void cylinder( float radius, float height,
-               const D3DCOLOR *colors, unsigned colors_count,
-               SkinningVertex *res_vertices, Index *res_indices);
+               const D3DCOLOR *colors, unsigned colors_count, unsigned bones_count,
+               SkinningVertex *res_vertices, Index *res_indices,
+               Index edges_per_base = CYLINDER_EDGES_PER_BASE,
+               Index edges_per_height = CYLINDER_EDGES_PER_HEIGHT,
+               Index edges_per_cap = CYLINDER_EDGES_PER_CAP );
+
+// Everything the cylinder depends on, with its sizes
+struct CylinderDesc
+{
+    float radius;
+    float height;
+    const D3DCOLOR *colors;
+    unsigned colors_count;
+    unsigned bones_count;
+    Index edges_per_base;
+    Index edges_per_height;
+    Index edges_per_cap;
+
+    CylinderDesc( float radius, float height, const D3DCOLOR *colors, unsigned colors_count, unsigned bones_count,
+                  Index edges_per_base = CYLINDER_EDGES_PER_BASE,
+                  Index edges_per_height = CYLINDER_EDGES_PER_HEIGHT,
+                  Index edges_per_cap = CYLINDER_EDGES_PER_CAP )
+    : radius(radius), height(height), colors(colors), colors_count(colors_count), bones_count(bones_count),
+      edges_per_base(edges_per_base), edges_per_height(edges_per_height), edges_per_cap(edges_per_cap) {}
+
+    Index vertices_count() const { return cylinder_vertices_count(edges_per_base, edges_per_height, edges_per_cap); }
+    DWORD indices_count() const { return cylinder_indices_count(edges_per_base, edges_per_height, edges_per_cap); }
+    D3DPRIMITIVETYPE primitive_type() const { return D3DPT_TRIANGLESTRIP; }
+
+    // The same cylinder with numbers of edges halved `times' times (e.g. for a coarser level of detail)
+    CylinderDesc halved(unsigned times) const
+    {
+        return CylinderDesc( radius, height, colors, colors_count, bones_count, edges_per_base >> times, edges_per_height >> times, edges_per_cap >> times );
+    }
+};
+
+// The same written into the sink
+void cylinder( const CylinderDesc &desc, MeshSink &sink );
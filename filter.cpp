@@ -0,0 +1,83 @@
+#include "filter.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <algorithm>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// ( 0, -1), (-1,  0), ( 0,  0), ( 1,  0), ( 0,  1)
+const int FILTER_TAP_X[FILTER_TAPS_COUNT] = { 0, -1, 0, 1, 0 };
+const int FILTER_TAP_Y[FILTER_TAPS_COUNT] = { -1, 0, 0, 0, 1 };
+const float FILTER_PASS_SCALE = 5.0f;
+
+namespace
+{
+    const float FILTER_BIAS = 0.1f; // c6 of target.psh: just a little lighter
+    const unsigned COLOR_COMPONENTS = 3;
+
+    BYTE to_byte(float value)
+    // saturated and rounded as the interpreter writes the target
+    {
+        return static_cast<BYTE>( std::max( 0.0f, std::min( value, 1.0f ) )*255.0f + 0.5f );
+    }
+
+    unsigned wrap(int coordinate, unsigned size)
+    {
+        const int res = coordinate % static_cast<int>( size );
+        return static_cast<unsigned>( res < 0 ? res + static_cast<int>( size ) : res );
+    }
+}
+
+void filter_surface(const PsSurface &source, const float taps[FILTER_TAPS_COUNT], D3DCOLOR *res)
+{
+    _ASSERT( source.texels != NULL && taps != NULL );
+    _ASSERT( res != NULL || source.width*source.height == 0 );
+    for( unsigned y = 0; y < source.height; ++y )
+    {
+        for( unsigned x = 0; x < source.width; ++x )
+        {
+            float sums[COLOR_COMPONENTS] = { FILTER_BIAS, FILTER_BIAS, FILTER_BIAS };
+            for( unsigned i = 0; i < FILTER_TAPS_COUNT; ++i )
+            {
+                const unsigned texel_x = wrap( static_cast<int>(x) + FILTER_TAP_X[i], source.width );
+                const unsigned texel_y = wrap( static_cast<int>(y) + FILTER_TAP_Y[i], source.height );
+                const D3DXCOLOR texel( source.texels[texel_y*source.pitch + texel_x] );
+                sums[0] += taps[i]*texel.r;
+                sums[1] += taps[i]*texel.g;
+                sums[2] += taps[i]*texel.b;
+            }
+            res[y*source.width + x] = D3DCOLOR_ARGB( to_byte(FILTER_BIAS), to_byte(sums[0]), to_byte(sums[1]), to_byte(sums[2]) );
+        }
+    }
+}
+
+void set_filter_pass( const PsSurface &source, const float taps[FILTER_TAPS_COUNT], PixelShaderInterpreter &shader,
+                      PsGradient textures[SHADER_PS_TEXTURE_REGISTERS], PsGradient colors[SHADER_PS_INPUT_REGISTERS] )
+{
+    _ASSERT( source.width > 0 && source.height > 0 );
+    const float texel_width = 1.0f/source.width;
+    const float texel_height = 1.0f/source.height;
+    for( unsigned i = 0; i < SHADER_PS_TEXTURE_REGISTERS; ++i )
+    {
+        // the center of the pixel (x + 0.5, y + 0.5) samples the center of the texel of the tap
+        textures[i].origin = D3DXVECTOR4( 0, 0, 0, 0 );
+        if( i < FILTER_TAPS_COUNT )
+        {
+            textures[i].origin.x = FILTER_TAP_X[i]*texel_width;
+            textures[i].origin.y = FILTER_TAP_Y[i]*texel_height;
+            const float tap = taps[i]/FILTER_PASS_SCALE;
+            const float constant[SHADER_COMPONENTS] = { tap, tap, tap, tap };
+            shader.set_constants( i, constant, 1 );
+            shader.set_texture( i, source, D3DTEXF_POINT );
+        }
+        textures[i].ddx = D3DXVECTOR4( texel_width, 0, 0, 0 );
+        textures[i].ddy = D3DXVECTOR4( 0, texel_height, 0, 0 );
+    }
+    for( unsigned i = 0; i < SHADER_PS_INPUT_REGISTERS; ++i )
+    {
+        colors[i].origin = D3DXVECTOR4( 0, 0, 0, 0 );
+        colors[i].ddx = D3DXVECTOR4( 0, 0, 0, 0 );
+        colors[i].ddy = D3DXVECTOR4( 0, 0, 0, 0 );
+    }
+}
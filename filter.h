@@ -0,0 +1,26 @@
+#pragma once
+#include "common.h"
+#include "ps_interpreter.h"
+
+// The filter pass of the application (target.vsh and target.psh) without a device. target.psh reads 5 taps of the 3x3 filter:
+// the texel of the pixel and its 4 neighbours (c0-c4, see SHADER_VAL_INDEX_FILTER of Application.cpp). Each of R, G, B
+// of the result is the sum of taps times their texels plus 0.1, saturated; alpha is 0.1
+
+// They must be macros, not constants, because they must be known at compile-time (they are used for array initialization in another module)
+#define FILTER_TAPS_COUNT 5
+
+// Offsets of the texels of the taps from the pixel, in the order of c0-c4
+extern const int FILTER_TAP_X[FILTER_TAPS_COUNT];
+extern const int FILTER_TAP_Y[FILTER_TAPS_COUNT];
+// c0-c4 are the taps divided by it, target.psh multiplies their sum back
+extern const float FILTER_PASS_SCALE;
+
+// The scalar reference of the pass: filters the `source' into `res' of its size (rows `source.width' texels apart) by `taps'
+// (values of the filter cells, as the application keeps them). Addresses wrap as the sampler's do; components are rounded to 8 bits
+void filter_surface(const PsSurface &source, const float taps[FILTER_TAPS_COUNT], D3DCOLOR *res);
+
+// Sets up `shader' (of target.psh) to filter the `source' by `taps' as the application does on the device: c0-c4 are the taps
+// divided by FILTER_PASS_SCALE, samplers 0-4 point-sample the source, and t0-t4 of `textures' are interpolated over the target
+// of the size of the source, each tap at the center of its texel. run_pixel_shader() with `textures' and `colors' then does the pass
+void set_filter_pass( const PsSurface &source, const float taps[FILTER_TAPS_COUNT], PixelShaderInterpreter &shader,
+                      PsGradient textures[SHADER_PS_TEXTURE_REGISTERS], PsGradient colors[SHADER_PS_INPUT_REGISTERS] );
@@ -0,0 +1,241 @@
+#include "geodesic.h"
+#include "normals.h"
+#include "parallel.h"
+#include "tessellate.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#include <map>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+namespace
+{
+    const unsigned ICOSAHEDRON_VERTICES_COUNT = 12;
+    const unsigned ICOSAHEDRON_FACES_COUNT = 20;
+    const DWORD GEODESIC_MAX_FREQUENCY = 1024;
+    const float GOLDEN_RATIO = 1.618034f;
+
+    // front faces are clockwise (as tessellate() makes them)
+    const Index icosahedron_indices[ICOSAHEDRON_FACES_COUNT*VERTICES_PER_TRIANGLE] =
+    {
+        0, 5, 11,
+        0, 1, 5,
+        0, 7, 1,
+        0, 10, 7,
+        0, 11, 10,
+        1, 9, 5,
+        5, 4, 11,
+        11, 2, 10,
+        10, 6, 7,
+        7, 8, 1,
+        3, 4, 9,
+        3, 2, 4,
+        3, 6, 2,
+        3, 8, 6,
+        3, 9, 8,
+        4, 5, 9,
+        2, 11, 4,
+        6, 10, 2,
+        8, 7, 6,
+        9, 1, 8,
+    };
+
+    void get_icosahedron_vertices( float radius, D3DXVECTOR3 *positions )
+    {
+        const float t = GOLDEN_RATIO;
+        const D3DXVECTOR3 corners[ICOSAHEDRON_VERTICES_COUNT] =
+        {
+            D3DXVECTOR3( -1,  t,  0 ), D3DXVECTOR3(  1,  t,  0 ), D3DXVECTOR3( -1, -t,  0 ), D3DXVECTOR3(  1, -t,  0 ),
+            D3DXVECTOR3(  0, -1,  t ), D3DXVECTOR3(  0,  1,  t ), D3DXVECTOR3(  0, -1, -t ), D3DXVECTOR3(  0,  1, -t ),
+            D3DXVECTOR3(  t,  0, -1 ), D3DXVECTOR3(  t,  0,  1 ), D3DXVECTOR3( -t,  0, -1 ), D3DXVECTOR3( -t,  0,  1 ),
+        };
+        for( unsigned i = 0; i < ICOSAHEDRON_VERTICES_COUNT; ++i )
+        {
+            D3DXVec3Normalize( &positions[i], &corners[i] );
+            positions[i] *= radius;
+        }
+    }
+
+    // The point (row, column) of a face tessellated like tessellate(): rows go from `a' to the side `bc'
+    inline D3DXVECTOR3 face_point( const D3DXVECTOR3 &a, const D3DXVECTOR3 &b, const D3DXVECTOR3 &c,
+                                   DWORD frequency, DWORD row, DWORD column )
+    {
+        return ( a*static_cast<float>(frequency - row) + b*static_cast<float>(row - column) + c*static_cast<float>(column) )
+               /static_cast<float>(frequency);
+    }
+
+    float projected_error( const D3DXVECTOR3 &a, const D3DXVECTOR3 &b, const D3DXVECTOR3 &c, DWORD frequency )
+    // the largest distance between the unit sphere and the planes of triangles of the face projected onto it
+    {
+        float error = 0;
+        for( DWORD row = 0; row < frequency; ++row )
+        {
+            for( DWORD column = 0; column <= row; ++column )
+            {
+                // the triangle below the point, and the one to the right of it
+                for( unsigned k = 0; k < 2; ++k )
+                {
+                    if( k == 1 && column == row )
+                        continue;
+                    D3DXVECTOR3 p1 = face_point( a, b, c, frequency, row, column );
+                    D3DXVECTOR3 p2 = face_point( a, b, c, frequency, row + 1, column + k );
+                    D3DXVECTOR3 p3 = ( k == 0 ) ? face_point( a, b, c, frequency, row + 1, column + 1 )
+                                                : face_point( a, b, c, frequency, row, column + 1 );
+                    D3DXVec3Normalize( &p1, &p1 );
+                    D3DXVec3Normalize( &p2, &p2 );
+                    D3DXVec3Normalize( &p3, &p3 );
+                    D3DXVECTOR3 edge1 = p2 - p1;
+                    D3DXVECTOR3 edge2 = p3 - p1;
+                    D3DXVECTOR3 normal;
+                    D3DXVec3Cross( &normal, &edge1, &edge2 );
+                    D3DXVec3Normalize( &normal, &normal );
+                    const float triangle_error = 1.0f - fabs( D3DXVec3Dot( &normal, &p1 ) );
+                    if( triangle_error > error )
+                        error = triangle_error;
+                }
+            }
+        }
+        return error;
+    }
+
+    // Points of the edges of the icosahedron: the k-th point from the smaller corner to the bigger one
+    // is first_point + k - 1, so the two faces of the edge get the same vertex
+    class EdgeCache
+    {
+    private:
+        std::map< std::pair<Index, Index>, Index > first_points;
+    public:
+        // Returns true if the points are new and must be written from `first_point'
+        bool get( Index corner1, Index corner2, Index &first_point, Index next_point )
+        {
+            const std::pair<Index, Index> edge( ( corner1 < corner2 ) ? corner1 : corner2, ( corner1 < corner2 ) ? corner2 : corner1 );
+            std::map< std::pair<Index, Index>, Index >::const_iterator found = first_points.find( edge );
+            if( found != first_points.end() )
+            {
+                first_point = found->second;
+                return false;
+            }
+            first_points[edge] = first_point = next_point;
+            return true;
+        }
+    };
+}
+
+DWORD geodesic_frequency(float radius, float max_error)
+{
+    _ASSERT( radius > 0 );
+    _ASSERT( max_error > 0 );
+    // all faces are equal, so the first one is measured
+    D3DXVECTOR3 corners[ICOSAHEDRON_VERTICES_COUNT];
+    get_icosahedron_vertices( 1.0f, corners );
+    const D3DXVECTOR3 &a = corners[icosahedron_indices[0]];
+    const D3DXVECTOR3 &b = corners[icosahedron_indices[1]];
+    const D3DXVECTOR3 &c = corners[icosahedron_indices[2]];
+    DWORD frequency = 1;
+    while( frequency < GEODESIC_MAX_FREQUENCY && projected_error( a, b, c, frequency )*radius > max_error )
+        ++frequency;
+    return frequency;
+}
+
+void geodesic_sphere( float radius, Vertex *res_vertices, Index *res_indices, D3DCOLOR color, DWORD frequency )
+{
+    _ASSERT( res_vertices != NULL );
+    _ASSERT( res_indices != NULL );
+    _ASSERT( frequency != 0 );
+    const Index vertices_count = geodesic_vertices_count( frequency );
+    const DWORD indices_count = geodesic_indices_count( frequency );
+
+    // points are written straight into the vertices, normals are set in place when all triangles are there
+    const D3DXVECTOR3 no_normal(0, 0, 0);
+    D3DXVECTOR3 corners[ICOSAHEDRON_VERTICES_COUNT];
+    get_icosahedron_vertices( radius, corners );
+    for( Index i = 0; i < ICOSAHEDRON_VERTICES_COUNT; ++i )
+        res_vertices[i] = Vertex( corners[i], color, no_normal );
+    Index vertex = ICOSAHEDRON_VERTICES_COUNT; // current vertex
+    DWORD index = 0; // current index
+
+    EdgeCache edges;
+    std::vector<Index> face_points( tesselated_vertices_count( frequency ) ); // indices of points of the face by rows
+    for( unsigned face = 0; face < ICOSAHEDRON_FACES_COUNT; ++face )
+    {
+        const Index *face_corners = &icosahedron_indices[face*VERTICES_PER_TRIANGLE];
+        const D3DXVECTOR3 &a = corners[face_corners[0]];
+        const D3DXVECTOR3 &b = corners[face_corners[1]];
+        const D3DXVECTOR3 &c = corners[face_corners[2]];
+
+        // the first point of each row is on the edge `ab', the last one is on `ac', the last row is the edge `bc'
+        for( DWORD row = 0, point = 0; row <= frequency; ++row )
+        {
+            for( DWORD column = 0; column <= row; ++column, ++point )
+            {
+                // the corner or the edge the point lies on (row and column are its steps from the ends of the edge)
+                Index corner1 = 0, corner2 = 0;
+                DWORD step = 0;
+                if( row == 0 || ( row == frequency && ( column == 0 || column == frequency ) ) )
+                {
+                    face_points[point] = face_corners[( row == 0 ) ? 0 : ( ( column == 0 ) ? 1 : 2 )];
+                    continue;
+                }
+                if( column == 0 )
+                {
+                    corner1 = face_corners[0]; corner2 = face_corners[1]; step = row;
+                }
+                else if( column == row )
+                {
+                    corner1 = face_corners[0]; corner2 = face_corners[2]; step = row;
+                }
+                else if( row == frequency )
+                {
+                    corner1 = face_corners[1]; corner2 = face_corners[2]; step = column;
+                }
+                else
+                {
+                    res_vertices[vertex] = Vertex( face_point( a, b, c, frequency, row, column ), color, no_normal );
+                    face_points[point] = vertex++;
+                    continue;
+                }
+
+                Index first_point = 0;
+                if( edges.get( corner1, corner2, first_point, vertex ) )
+                {
+                    // the points of the whole edge from the smaller corner
+                    const Index from = ( corner1 < corner2 ) ? corner1 : corner2;
+                    const Index to = ( corner1 < corner2 ) ? corner2 : corner1;
+                    for( DWORD k = 1; k < frequency; ++k )
+                    {
+                        const D3DXVECTOR3 edge_point = ( corners[from]*static_cast<float>(frequency - k) + corners[to]*static_cast<float>(k) )
+                                                       /static_cast<float>(frequency);
+                        res_vertices[vertex++] = Vertex( edge_point, color, no_normal );
+                    }
+                }
+                face_points[point] = first_point + ( ( corner1 < corner2 ) ? step : frequency - step ) - 1;
+            }
+        }
+
+        // triangles like tessellate() makes: below the point and to the right of it
+        for( DWORD row = 0, point = 0; row < frequency; ++row )
+        {
+            for( DWORD column = 0; column <= row; ++column, ++point )
+            {
+                const Index below = point + row + 1; // the point (row + 1, column)
+                add_triangle( face_points[point], face_points[below], face_points[below + 1], res_indices, index );
+                if( column != row )
+                    add_triangle( face_points[point], face_points[below + 1], face_points[point + 1], res_indices, index );
+            }
+        }
+    }
+    _ASSERT( vertex == vertices_count );
+    _ASSERT( index == indices_count );
+
+    smooth_normals( res_vertices, vertices_count, res_indices, indices_count, NORMALS_BY_ANGLE, D3DX_PI, get_threads_count() );
+}
+
+void geodesic_sphere( const GeodesicDesc &desc, MeshSink &sink )
+{
+    Vertex *res_vertices = lock_vertices<Vertex>( sink, desc.vertices_count() );
+    Index *res_indices = sink.lock_indices( desc.indices_count() );
+    geodesic_sphere( desc.radius, res_vertices, res_indices, desc.color, desc.frequency );
+    sink.unlock( desc.primitive_type() );
+}
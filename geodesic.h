@@ -0,0 +1,42 @@
+#pragma once
+#include "main.h"
+#include "Vertex.h"
+#include "mesh_sink.h"
+
+// Every face of the icosahedron is divided into frequency^2 triangles: 10*frequency^2 + 2 vertices are shared between faces
+inline Index geodesic_vertices_count(DWORD frequency)
+{
+    return get_count( 10*static_cast<DWORD64>(frequency)*frequency + 2 );
+}
+inline DWORD geodesic_indices_count(DWORD frequency)
+{
+    return get_count( 20*VERTICES_PER_TRIANGLE*static_cast<DWORD64>(frequency)*frequency );
+}
+
+// The smallest frequency at which the geodesic sphere projected onto the sphere of `radius'
+// is at most `max_error' from it (compare with tessellate_adaptive())
+DWORD geodesic_frequency(float radius, float max_error);
+
+// Geodesic sphere: the icosahedron inscribed into the sphere of `radius' with faces tessellated like tessellate().
+// Points stay on the faces, a vertex shader projects them onto the sphere (see morphing.vsh and light_source.vsh).
+// Unlike tessellated pyramid() faces have equal triangles and share their vertices: a point on an edge of the icosahedron
+// is taken from the cache of the edge, so it is written once. Normals are smoothed by angles (see smooth_normals())
+void geodesic_sphere( float radius, Vertex *res_vertices, Index *res_indices, D3DCOLOR color, DWORD frequency );
+
+// Everything the geodesic sphere depends on, with its sizes
+struct GeodesicDesc
+{
+    float radius;
+    D3DCOLOR color;
+    DWORD frequency;
+
+    GeodesicDesc( float radius, D3DCOLOR color, DWORD frequency )
+    : radius(radius), color(color), frequency(frequency) {}
+
+    Index vertices_count() const { return geodesic_vertices_count(frequency); }
+    DWORD indices_count() const { return geodesic_indices_count(frequency); }
+    D3DPRIMITIVETYPE primitive_type() const { return D3DPT_TRIANGLELIST; }
+};
+
+// The same written into the sink
+void geodesic_sphere( const GeodesicDesc &desc, MeshSink &sink );
@@ -0,0 +1,193 @@
+#include "lighting.h"
+#include "parallel.h"
+#include <emmintrin.h>
+#include <cfloat>
+
+namespace
+{
+    // `lit' of the shaders clamps the power to this
+    const float MAX_SPECULAR_F = 128.0f;
+    // exp2() of smaller numbers would be a denormal (their floor is -127, the exponent of denormals)...
+    const float MIN_EXP2 = -125.99f;
+    // ... and of larger ones would overflow the exponent: it stays finite, so that 0 times it is still 0
+    const float MAX_EXP2 = 127.99f;
+    // denormals times it are normalized
+    const float DENORMAL_SCALE = 8388608.0f; // 2**23
+    const float DENORMAL_SCALE_LOG2 = 23.0f;
+    // mantissas over it are halved, so that log2 is taken of m from [sqrt(1/2), sqrt(2))
+    const float SQRT2 = 1.41421356f;
+    // 2/(k*ln 2): log2(m) = 2/ln 2*atanh(t) = sum of them times t**k over odd k, where t = (m - 1)/(m + 1) is within 0.172
+    const float ATANH_LOG2_1 = 2.88539008f;
+    const float ATANH_LOG2_3 = 0.961796694f;
+    const float ATANH_LOG2_5 = 0.577078016f;
+    const float ATANH_LOG2_7 = 0.412198583f;
+    const float ATANH_LOG2_9 = 0.320598898f;
+    const float ATANH_LOG2_11 = 0.262308189f;
+
+    SoftwareVector set_vector(const D3DXVECTOR3 &vector)
+    {
+        SoftwareVector res = { _mm_set1_ps(vector.x), _mm_set1_ps(vector.y), _mm_set1_ps(vector.z) };
+        return res;
+    }
+
+    void set_color(const D3DXCOLOR &color, __m128 res[SOFTWARE_COLOR_COMPONENTS])
+    {
+        res[0] = _mm_set1_ps(color.r);
+        res[1] = _mm_set1_ps(color.g);
+        res[2] = _mm_set1_ps(color.b);
+        res[3] = _mm_set1_ps(color.a);
+    }
+
+    __m128 polynomial5(__m128 x, float c0, float c1, float c2, float c3, float c4, float c5)
+    // by Horner's rule
+    {
+        __m128 res = _mm_set1_ps(c5);
+        res = _mm_add_ps( _mm_mul_ps(res, x), _mm_set1_ps(c4) );
+        res = _mm_add_ps( _mm_mul_ps(res, x), _mm_set1_ps(c3) );
+        res = _mm_add_ps( _mm_mul_ps(res, x), _mm_set1_ps(c2) );
+        res = _mm_add_ps( _mm_mul_ps(res, x), _mm_set1_ps(c1) );
+        return _mm_add_ps( _mm_mul_ps(res, x), _mm_set1_ps(c0) );
+    }
+}
+
+__m128 fast_log2(__m128 x)
+// the exponent plus log2 of the mantissa m by the series of atanh; denormals are normalized first
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 denormal = _mm_cmplt_ps( x, _mm_set1_ps(FLT_MIN) );
+    x = _mm_or_ps( _mm_and_ps( denormal, _mm_mul_ps(x, _mm_set1_ps(DENORMAL_SCALE)) ), _mm_andnot_ps( denormal, x ) );
+    const __m128i bits = _mm_castps_si128(x);
+    __m128 exponent = _mm_cvtepi32_ps( _mm_sub_epi32( _mm_srli_epi32(bits, 23), _mm_set1_epi32(127) ) );
+    exponent = _mm_sub_ps( exponent, _mm_and_ps( denormal, _mm_set1_ps(DENORMAL_SCALE_LOG2) ) );
+    __m128 mantissa = _mm_or_ps( _mm_and_ps( x, _mm_castsi128_ps( _mm_set1_epi32(0x007FFFFF) ) ), one );
+    const __m128 large = _mm_cmpgt_ps( mantissa, _mm_set1_ps(SQRT2) );
+    mantissa = _mm_mul_ps( mantissa, _mm_sub_ps( one, _mm_and_ps( large, _mm_set1_ps(0.5f) ) ) );
+    exponent = _mm_add_ps( exponent, _mm_and_ps( large, one ) );
+    const __m128 t = _mm_mul_ps( _mm_sub_ps(mantissa, one), fast_reciprocal( _mm_add_ps(mantissa, one) ) );
+    const __m128 p = polynomial5( _mm_mul_ps(t, t), ATANH_LOG2_1, ATANH_LOG2_3, ATANH_LOG2_5, ATANH_LOG2_7, ATANH_LOG2_9, ATANH_LOG2_11 );
+    return _mm_add_ps( exponent, _mm_mul_ps( p, t ) );
+}
+
+__m128 fast_exp2(__m128 x)
+// 2**floor(x) made in the exponent bits, times 2**fraction by a polynomial
+{
+    x = _mm_min_ps( _mm_max_ps( x, _mm_set1_ps(MIN_EXP2) ), _mm_set1_ps(MAX_EXP2) );
+    const __m128i integer = _mm_cvtps_epi32( _mm_sub_ps( x, _mm_set1_ps(0.5f) ) );
+    const __m128 fraction = _mm_sub_ps( x, _mm_cvtepi32_ps(integer) );
+    const __m128 integer_power = _mm_castsi128_ps( _mm_slli_epi32( _mm_add_epi32(integer, _mm_set1_epi32(127)), 23 ) );
+    const __m128 fraction_power = polynomial5( fraction, 9.9999994e-1f, 6.9315308e-1f, 2.4015361e-1f, 5.5826318e-2f, 8.9893397e-3f, 1.8775767e-3f );
+    return _mm_mul_ps( integer_power, fraction_power );
+}
+
+__m128 fast_power(__m128 x, __m128 y)
+{
+    const __m128 positive = _mm_cmpgt_ps( x, _mm_setzero_ps() );
+    return _mm_and_ps( positive, fast_exp2( _mm_mul_ps( y, fast_log2(x) ) ) );
+}
+
+SoftwareLighting::SoftwareLighting(const LightingConstants &constants, bool specular)
+: diffuse_coef( _mm_set1_ps(constants.diffuse_coef) ), point_position( set_vector(constants.point_position) ),
+  specular_coef( _mm_set1_ps(constants.specular_coef) ), specular(specular), eye( set_vector(constants.eye) )
+{
+    set_color( constants.ambient_color, ambient_color );
+    set_color( constants.point_color, point_color );
+    attenuation[0] = _mm_set1_ps( constants.attenuation.x );
+    attenuation[1] = _mm_set1_ps( constants.attenuation.y );
+    attenuation[2] = _mm_set1_ps( constants.attenuation.z );
+    float f = constants.specular_f;
+    if( f > MAX_SPECULAR_F )
+        f = MAX_SPECULAR_F;
+    if( f < -MAX_SPECULAR_F )
+        f = -MAX_SPECULAR_F;
+    specular_f = _mm_set1_ps(f);
+}
+
+void SoftwareLighting::light( const SoftwareVector &position, const SoftwareVector &normal,
+                              const __m128 color[SOFTWARE_COLOR_COMPONENTS], __m128 res_color[SOFTWARE_COLOR_COMPONENTS] ) const
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const SoftwareVector n = scale( normal, fast_reciprocal_sqrt( dot(normal, normal) ) );
+
+    // direction to the light and its attenuation 1/(a + b*d + c*d**2)
+    SoftwareVector l = subtract( point_position, position );
+    const __m128 distance2 = dot(l, l);
+    const __m128 inv_distance = fast_reciprocal_sqrt( distance2 );
+    l = scale( l, inv_distance );
+    const __m128 distance = _mm_mul_ps( distance2, inv_distance );
+    const __m128 attenuation_sum = _mm_add_ps( _mm_add_ps( attenuation[0], _mm_mul_ps(attenuation[1], distance) ),
+                                               _mm_mul_ps( attenuation[2], distance2 ) );
+    const __m128 attenuation_coef = fast_reciprocal( attenuation_sum );
+
+    // diffuse: cos(theta)
+    const __m128 cos_theta = dot( l, n );
+    const __m128 diffuse = _mm_mul_ps( _mm_mul_ps( cos_theta, diffuse_coef ), attenuation_coef );
+
+    // specular: cos(phi)**f, where phi is between the reflected light r = 2*(l, n)*n - l and the eye
+    __m128 specular_light = zero;
+    if( specular )
+    {
+        const SoftwareVector to_eye = subtract( eye, position );
+        const SoftwareVector v = scale( to_eye, fast_reciprocal_sqrt( dot(to_eye, to_eye) ) );
+        const SoftwareVector r = subtract( scale( n, _mm_add_ps(cos_theta, cos_theta) ), l );
+        const __m128 cos_phi = _mm_max_ps( dot(r, v), zero );
+        specular_light = _mm_mul_ps( _mm_mul_ps( fast_power(cos_phi, specular_f), specular_coef ), attenuation_coef );
+    }
+
+    for( unsigned i = 0; i < SOFTWARE_COLOR_COMPONENTS; ++i )
+    {
+        const __m128 light = _mm_add_ps( _mm_add_ps( _mm_max_ps( _mm_mul_ps(point_color[i], diffuse), zero ),
+                                                     _mm_max_ps( _mm_mul_ps(point_color[i], specular_light), zero ) ),
+                                         ambient_color[i] );
+        res_color[i] = _mm_min_ps( _mm_max_ps( _mm_mul_ps(color[i], light), zero ), one );
+    }
+}
+
+// ----- light_vertices -----
+
+namespace
+{
+    struct LIGHTING_PARAMS
+    {
+        const SoftwareColumns *vertices;
+        const LightingConstants *lighting;
+        bool specular;
+        SoftwareColumns *res;
+    };
+
+    void light_batches(void *context, unsigned thread, DWORD begin, DWORD end)
+    // batches [begin, end)
+    {
+        UNREFERENCED_PARAMETER(thread);
+        const LIGHTING_PARAMS &params = *static_cast<LIGHTING_PARAMS*>(context);
+        const SoftwareColumns &vertices = *params.vertices;
+        const SoftwareLighting lighting( *params.lighting, params.specular );
+        for( DWORD batch = begin; batch < end; ++batch )
+        {
+            const Index first = batch*SOFTWARE_BATCH_SIZE;
+            __m128 color[SOFTWARE_COLOR_COMPONENTS];
+            for( unsigned i = 0; i < SOFTWARE_COLOR_COMPONENTS; ++i )
+                color[i] = _mm_loadu_ps( vertices.get_column(SOFTWARE_COLOR_R + i) + first );
+            __m128 res_color[SOFTWARE_COLOR_COMPONENTS];
+            lighting.light( load_vector( vertices, SOFTWARE_POSITION_X, first ), load_vector( vertices, SOFTWARE_NORMAL_X, first ),
+                            color, res_color );
+            for( unsigned i = 0; i < SOFTWARE_COLOR_COMPONENTS; ++i )
+                _mm_storeu_ps( params.res->get_column(SOFTWARE_OUT_R + i) + first, res_color[i] );
+        }
+    }
+}
+
+void light_vertices( const SoftwareColumns &vertices, const LightingConstants &lighting, bool specular,
+                     unsigned threads_count, SoftwareColumns &res )
+{
+    _ASSERT( vertices.get_columns_count() >= SOFTWARE_VERTEX_COLUMNS );
+    _ASSERT( res.get_columns_count() == SOFTWARE_OUTPUT_COLUMNS );
+    _ASSERT( res.get_count() == vertices.get_count() );
+
+    LIGHTING_PARAMS params;
+    params.vertices = &vertices;
+    params.lighting = &lighting;
+    params.specular = specular;
+    params.res = &res;
+    parallel_for( vertices.get_batches_count(), threads_count, light_batches, &params );
+}
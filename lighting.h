@@ -0,0 +1,51 @@
+#pragma once
+#include "common.h"
+#include "software.h"
+
+// What lighting of the vertex shaders takes from constant registers c14-c21 (see Application.cpp)
+struct LightingConstants
+{
+    float       diffuse_coef;       // c14
+    D3DXCOLOR   ambient_color;      // c15
+    D3DXCOLOR   point_color;        // c16
+    D3DXVECTOR3 point_position;     // c17
+    D3DXVECTOR3 attenuation;        // c18: a, b, c of 1/(a + b*d + c*d**2)
+    float       specular_coef;      // c19
+    float       specular_f;         // c20
+    D3DXVECTOR3 eye;                // c21
+};
+
+// The specular power of the lighting below by polynomials, in each lane. log2 of positive numbers (denormals too)...
+__m128 fast_log2(__m128 x);
+// ... and exp2, which is clamped to normalized numbers: from 2**-125.99 to 2**127.99 (so that it is never infinite)...
+__m128 fast_exp2(__m128 x);
+// ... make x**y where x > 0, and 0 where it is not (as `lit' of the shaders makes it)
+__m128 fast_power(__m128 x, __m128 y);
+
+// The lighting block of skinning.vsh, morphing.vsh and plane.vsh on the CPU: ambient light, diffuse light of the point light
+// with attenuation, and its specular light unless `specular' is false (plane.vsh has none). A color of the vertex
+// is multiplied by the light and saturated, as oD0 is. Reciprocals and square roots are SSE estimates with a Newton step,
+// and the specular power is exp2(f*log2(x)) by polynomials: the light is within 1e-4 of the exact one, far below a step of 8-bit colors
+class SoftwareLighting
+{
+private:
+    __m128 diffuse_coef;
+    __m128 ambient_color[SOFTWARE_COLOR_COMPONENTS];
+    __m128 point_color[SOFTWARE_COLOR_COMPONENTS];
+    SoftwareVector point_position;
+    __m128 attenuation[3];
+    __m128 specular_coef;
+    __m128 specular_f;
+    bool specular;
+    SoftwareVector eye;
+public:
+    SoftwareLighting(const LightingConstants &constants, bool specular);
+    // of a batch in world space; `normal' need not be normalized
+    void light( const SoftwareVector &position, const SoftwareVector &normal,
+                const __m128 color[SOFTWARE_COLOR_COMPONENTS], __m128 res_color[SOFTWARE_COLOR_COMPONENTS] ) const;
+};
+
+// Lights `vertices' (SOFTWARE_VERTEX_COLUMNS in world space) into color columns (from SOFTWARE_OUT_R) of `res',
+// splitting batches between `threads_count' threads (see parallel.h). Positions of `res' are not touched
+void light_vertices( const SoftwareColumns &vertices, const LightingConstants &lighting, bool specular,
+                     unsigned threads_count, SoftwareColumns &res );
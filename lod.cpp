@@ -0,0 +1,172 @@
+#include "lod.h"
+#include "stripify.h"
+
+const float LOD_MAX_EDGE_PIXELS = 2.0f;
+const float LOD_HYSTERESIS = 0.25f;
+
+namespace
+{
+    float average_edge_length(const D3DXVECTOR3 *positions, const Index *indices, DWORD indices_count)
+    // of a triangle list, not counting degenerate triangles
+    {
+        float length_sum = 0;
+        DWORD edges_count = 0;
+        for( DWORD i = 0; i + VERTICES_PER_TRIANGLE <= indices_count; i += VERTICES_PER_TRIANGLE )
+        {
+            const Index *triangle = &indices[i];
+            if( triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2] )
+                continue;
+            for( unsigned j = 0; j < VERTICES_PER_TRIANGLE; ++j )
+            {
+                D3DXVECTOR3 edge = positions[triangle[(j + 1) % VERTICES_PER_TRIANGLE]] - positions[triangle[j]];
+                length_sum += D3DXVec3Length(&edge);
+            }
+            edges_count += VERTICES_PER_TRIANGLE;
+        }
+        return ( edges_count != 0 ) ? length_sum/edges_count : 0.0f;
+    }
+}
+
+void MeshChain::reserve(Arena &arena, Index max_vertices_count, DWORD max_indices_count)
+{
+    _ASSERT( vertices == NULL && indices == NULL );
+    vertices = arena.allocate_array<BYTE>( get_array_size( max_vertices_count, vertex_size ) );
+    indices = arena.allocate_array<Index>( max_indices_count );
+    this->max_vertices_count = max_vertices_count;
+    this->max_indices_count = max_indices_count;
+}
+
+void *MeshChain::append_vertices(Index level_vertices_count)
+{
+    _ASSERT( level_vertices_count <= max_vertices_count - vertices_count ); // reserve() must have counted it
+    if( level_vertices_count > max_vertices_count - vertices_count )
+        throw NoMemoryError();
+    void *res = vertices + vertices_count*vertex_size;
+    vertices_count += level_vertices_count;
+    return res;
+}
+
+Index *MeshChain::append_indices(DWORD level_indices_count)
+{
+    _ASSERT( level_indices_count <= max_indices_count - indices_count );
+    if( level_indices_count > max_indices_count - indices_count )
+        throw NoMemoryError();
+    Index *res = indices + indices_count;
+    indices_count += level_indices_count;
+    return res;
+}
+
+void MeshChain::add_level( const D3DXVECTOR3 *positions, const D3DXVECTOR3 *normals, Index level_vertices_count,
+                           D3DPRIMITIVETYPE primitive_type, DWORD level_indices_count )
+{
+    _ASSERT( level_vertices_count <= get_vertices_count() );
+    _ASSERT( level_indices_count <= get_indices_count() );
+    LodLevel level;
+    level.first_vertex = get_vertices_count() - level_vertices_count;
+    level.vertices_count = level_vertices_count;
+    level.first_index = get_indices_count() - level_indices_count;
+    level.first_cluster = get_clusters_count();
+
+    // the level is clustered as a list, which has space enough for any chosen primitive type
+    Index *list_indices = indices + level.first_index;
+    const DWORD list_indices_count = get_list_indices_count( primitive_type, level_indices_count );
+    _ASSERT( list_indices_count <= max_indices_count - level.first_index );
+    if( primitive_type == D3DPT_TRIANGLESTRIP && level_indices_count != 0 )
+    {
+        const std::vector<Index> strip_indices( list_indices, list_indices + level_indices_count );
+        strip_to_list( &strip_indices[0], level_indices_count, list_indices );
+    }
+    level.edge_length = average_edge_length( positions, list_indices, list_indices_count );
+
+    std::vector<Cluster> level_clusters;
+    build_clusters( positions, normals, level_vertices_count, list_indices, list_indices_count, level_clusters );
+    level.indices_count = list_indices_count;
+    level.primitive_type = choose_primitive_type( list_indices, level.indices_count, level_vertices_count, level_clusters );
+    indices_count = level.first_index + level.indices_count;
+
+    for( unsigned i = 0; i < level_clusters.size(); ++i )
+    {
+        level_clusters[i].first_index += level.first_index;
+        level_clusters[i].base_vertex += level.first_vertex;
+        clusters.push_back( level_clusters[i] );
+    }
+    level.clusters_count = static_cast<DWORD>( level_clusters.size() );
+    levels.push_back( level );
+}
+
+void MeshChain::add_chunked_level()
+{
+    LodLevel level;
+    level.first_vertex = get_vertices_count();
+    level.vertices_count = 0;
+    level.first_index = get_indices_count();
+    level.indices_count = 0;
+    level.primitive_type = D3DPT_TRIANGLELIST;
+    level.first_cluster = get_clusters_count();
+    level.clusters_count = 0;
+    level.edge_length = 0;
+    levels.push_back( level );
+    patterns.clear();
+}
+
+void MeshChain::add_chunk( const D3DXVECTOR3 *positions, const D3DXVECTOR3 *normals, Index chunk_vertices_count,
+                           DWORD pattern_indices_count )
+{
+    _ASSERT( !levels.empty() );
+    _ASSERT( chunk_vertices_count <= get_vertices_count() );
+    _ASSERT( pattern_indices_count != 0 && pattern_indices_count <= get_indices_count() );
+    LodLevel &level = levels.back();
+    _ASSERT( level.first_cluster + level.clusters_count == get_clusters_count() ); // the last level is a chunked one
+
+    const DWORD pattern_first_index = get_indices_count() - pattern_indices_count;
+    const Index *pattern = indices + pattern_first_index;
+    Cluster cluster;
+    build_cluster( positions, normals, chunk_vertices_count, pattern, pattern_indices_count, cluster );
+    cluster.base_vertex = get_vertices_count() - chunk_vertices_count;
+
+    // the average edge of the level is weighted by numbers of triangles
+    DWORD level_triangles_count = 0;
+    for( DWORD i = level.first_cluster; i < get_clusters_count(); ++i )
+        level_triangles_count += clusters[i].triangles_count;
+    const float chunk_edge_length = average_edge_length( positions, pattern, pattern_indices_count );
+    if( level_triangles_count + cluster.triangles_count != 0 )
+        level.edge_length = ( level.edge_length*level_triangles_count + chunk_edge_length*cluster.triangles_count )/( level_triangles_count + cluster.triangles_count );
+
+    // the pattern is looked for among the patterns of the level: if it is there, the written copy is dropped
+    cluster.first_index = pattern_first_index;
+    for( unsigned i = 0; i < patterns.size(); ++i )
+    {
+        const DWORD pattern_end = ( i + 1 < patterns.size() ) ? patterns[i + 1] : pattern_first_index;
+        if( pattern_end - patterns[i] == pattern_indices_count &&
+            memcmp( &indices[patterns[i]], pattern, pattern_indices_count*sizeof(pattern[0]) ) == 0 )
+        {
+            cluster.first_index = patterns[i];
+            break;
+        }
+    }
+    if( cluster.first_index == pattern_first_index )
+    {
+        patterns.push_back( cluster.first_index );
+        level.indices_count += pattern_indices_count;
+    }
+    else
+    {
+        indices_count = pattern_first_index;
+    }
+
+    level.vertices_count += chunk_vertices_count;
+    ++level.clusters_count;
+    clusters.push_back( cluster );
+}
+
+unsigned choose_lod(const LodLevel *levels, unsigned levels_count, unsigned current, float pixels_per_unit)
+{
+    _ASSERT( levels != NULL );
+    _ASSERT( levels_count > 0 );
+    unsigned lod = ( current < levels_count ) ? current : levels_count - 1;
+    while( lod > 0 && levels[lod].edge_length*pixels_per_unit > LOD_MAX_EDGE_PIXELS )
+        --lod;
+    while( lod + 1 < levels_count && levels[lod + 1].edge_length*pixels_per_unit <= LOD_MAX_EDGE_PIXELS*(1 - LOD_HYSTERESIS) )
+        ++lod;
+    return lod;
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include "main.h"
+#include "Vertex.h"
+#include "clusters.h"
+#include "mesh_sink.h"
+#include "arena.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// Longest (average) edge of the chosen level on the screen, in pixels
+extern const float LOD_MAX_EDGE_PIXELS;
+// A coarser level is chosen only when its edges are shorter than LOD_MAX_EDGE_PIXELS by this part
+extern const float LOD_HYSTERESIS;
+
+// One level of detail of a mesh. All levels of a model share one vertex buffer and one index buffer:
+// indices of a level are relative to its first vertex (which is given as a base vertex index when drawing),
+// or, for a chunked level, to the first vertex of each chunk (see Cluster::base_vertex)
+struct LodLevel
+{
+    DWORD first_vertex;
+    DWORD vertices_count;
+    DWORD first_index;
+    DWORD indices_count;
+    DWORD primitive_type;   // D3DPRIMITIVETYPE
+    DWORD first_cluster;    // clusters of the level (their ranges are in the whole index buffer)
+    DWORD clusters_count;
+    float edge_length;      // average length of an edge in model space
+};
+
+template<class VertexType> class ChainSink;
+
+// Collects levels of detail (from the finest to the coarsest one) into shared arrays taken from an arena.
+// Each level is split into clusters and gets its own primitive type (see clusters.h).
+// Levels are written by generators in place through ChainSink
+class MeshChain
+{
+private:
+    unsigned vertex_size;
+    BYTE *vertices;
+    Index vertices_count;
+    Index max_vertices_count;
+    Index *indices;
+    DWORD indices_count;
+    DWORD max_indices_count;
+    std::vector<Cluster> clusters;
+    std::vector<LodLevel> levels;
+    std::vector<DWORD> patterns; // first indices of index patterns of the last chunked level
+
+    // Space for a level or a chunk at the end of the arrays
+    void *append_vertices(Index vertices_count);
+    Index *append_indices(DWORD indices_count);
+    // The level or the chunk is the last `vertices_count' vertices and `indices_count' indices
+    void add_level( const D3DXVECTOR3 *positions, const D3DXVECTOR3 *normals, Index level_vertices_count,
+                    D3DPRIMITIVETYPE primitive_type, DWORD level_indices_count );
+    void add_chunk( const D3DXVECTOR3 *positions, const D3DXVECTOR3 *normals, Index chunk_vertices_count,
+                    DWORD pattern_indices_count );
+
+    template<class VertexType> friend class ChainSink;
+public:
+    explicit MeshChain(unsigned vertex_size)
+    : vertex_size(vertex_size), vertices(NULL), vertices_count(0), max_vertices_count(0),
+      indices(NULL), indices_count(0), max_indices_count(0) {}
+
+    // Takes arrays for all the levels from the arena: `max_indices_count' counts indices of all levels as triangle lists
+    void reserve(Arena &arena, Index max_vertices_count, DWORD max_indices_count);
+    // Size of the arena taken by reserve()
+    static size_t get_arena_size(unsigned vertex_size, Index max_vertices_count, DWORD max_indices_count)
+    {
+        return Arena::get_allocation_size( get_array_size( max_vertices_count, vertex_size ) )
+             + Arena::get_allocation_size( get_array_size( max_indices_count, sizeof(Index) ) );
+    }
+
+    // A level made of chunks (e.g. of a big grid) which are written next by a ChainSink for chunks. Every chunk is a cluster
+    // with its own vertices and base vertex, so chunks with equal triangle lists (patterns) share their indices
+    void add_chunked_level();
+
+    const void *get_vertices() const { return vertices; }
+    Index get_vertices_count() const { return vertices_count; }
+    const Index *get_indices() const { return indices; }
+    DWORD get_indices_count() const { return indices_count; }
+    const Cluster *get_clusters() const { return clusters.empty() ? NULL : &clusters[0]; }
+    DWORD get_clusters_count() const { return static_cast<DWORD>( clusters.size() ); }
+    const LodLevel *get_levels() const { return levels.empty() ? NULL : &levels[0]; }
+    DWORD get_levels_count() const { return static_cast<DWORD>( levels.size() ); }
+
+private:
+    // No copying!
+    MeshChain(const MeshChain&);
+    MeshChain &operator=(const MeshChain&);
+};
+
+// Lets a generator write a mesh straight into the arrays of the chain: every mesh written becomes
+// the next level of detail, or the next chunk of the last level if `chunks' is true (see MeshChain::add_chunked_level())
+template<class VertexType> class ChainSink : public MeshSink
+{
+private:
+    MeshChain &chain;
+    bool chunks;
+    const VertexType *locked_vertices;
+    Index locked_vertices_count;
+    DWORD locked_indices_count;
+public:
+    ChainSink(MeshChain &chain, bool chunks)
+    : chain(chain), chunks(chunks), locked_vertices(NULL), locked_vertices_count(0), locked_indices_count(0)
+    {
+        _ASSERT( sizeof(VertexType) == chain.vertex_size );
+    }
+
+    // Overrides:
+    virtual unsigned get_vertex_size() const { return sizeof(VertexType); }
+    virtual void *lock_vertices(Index vertices_count)
+    {
+        void *res = chain.append_vertices( vertices_count );
+        locked_vertices = static_cast<const VertexType*>( res );
+        locked_vertices_count = vertices_count;
+        return res;
+    }
+    virtual Index *lock_indices(DWORD indices_count)
+    {
+        locked_indices_count = indices_count;
+        return chain.append_indices( indices_count );
+    }
+    virtual void unlock(D3DPRIMITIVETYPE primitive_type)
+    {
+        _ASSERT( locked_vertices != NULL );
+        std::vector<D3DXVECTOR3> positions(locked_vertices_count + 1); // +1 to have an element to point at
+        std::vector<D3DXVECTOR3> normals(locked_vertices_count + 1);
+        for( Index i = 0; i < locked_vertices_count; ++i )
+        {
+            positions[i] = locked_vertices[i].pos;
+            normals[i] = D3DXVECTOR3(locked_vertices[i].normal.x, locked_vertices[i].normal.y, locked_vertices[i].normal.z);
+        }
+        if( chunks )
+        {
+            _ASSERT( primitive_type == D3DPT_TRIANGLELIST );
+            chain.add_chunk( &positions[0], &normals[0], locked_vertices_count, locked_indices_count );
+        }
+        else
+        {
+            chain.add_level( &positions[0], &normals[0], locked_vertices_count, primitive_type, locked_indices_count );
+        }
+        locked_vertices = NULL;
+    }
+};
+
+// Chooses the coarsest level with edges of at most LOD_MAX_EDGE_PIXELS when a model-space unit
+// takes `pixels_per_unit' pixels on the screen. The `current' level is kept while it is not too coarse
+// and the next one is not fine enough with a margin of LOD_HYSTERESIS, so levels do not flicker at the boundary
+unsigned choose_lod(const LodLevel *levels, unsigned levels_count, unsigned current, float pixels_per_unit);
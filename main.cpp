@@ -3,7 +3,11 @@
 #include "Model.h"
 #include "cylinder.h"
 #include "plane.h"
-#include "pyramid.h"
+#include "geodesic.h"
+#include "lod.h"
+#include "stripify.h"
+#include "mesh_cache.h"
+#include "palette.h"
 
 namespace
 {
@@ -11,6 +15,8 @@ namespace
     const char *SKINNING_SHADOW_SHADER_FILENAME = "skinning_shadow.vsh";
     const char *MORPHING_SHADER_FILENAME = "morphing.vsh";
     const char *MORPHING_SHADOW_SHADER_FILENAME = "morphing_shadow.vsh";
+    const char *DEFORMED_SHADER_FILENAME = "deformed.vsh";
+    const char *DEFORMED_SHADOW_SHADER_FILENAME = "deformed_shadow.vsh";
     const char *PLANE_SHADER_FILENAME = "plane.vsh";
     const char *LIGHT_SOURCE_SHADER_FILENAME = "light_source.vsh";
     const char *TARGET_VERTEX_SHADER_FILENAME = "target.vsh";
@@ -28,32 +34,134 @@ namespace
     const D3DCOLOR SPHERE_COLOR = D3DCOLOR_XRGB(255, 150, 0);
     const D3DCOLOR SECOND_CYLINDER_COLOR = D3DCOLOR_XRGB(0, 70, 220);
     const D3DCOLOR PLANE_COLOR = D3DCOLOR_XRGB(50,255,50);
+    const float PLANE_SIZE = 40;
+    const D3DXVECTOR3 PLANE_POSITION(0, 0, -1.2f);
+
+    // The plane is made of square chunks which are culled separately. It is lit per-vertex, so chunks near the light
+    // are dense, and each next doubling of PLANE_DENSE_RADIUS halves the number of cells of farther chunks
+    const unsigned PLANE_CHUNKS_PER_SIDE = 20;
+    const Index PLANE_CHUNK_MAX_CELLS = 32;
+    const Index PLANE_CHUNK_MIN_CELLS = 2;
+    const float PLANE_DENSE_RADIUS = 2.0f;
 
     const float SPHERE_RADIUS = 0.7071f;
     const float LIGHT_SOURCE_RADIUS = 0.08f;
 
-    const DWORD SPHERE_TESSELATE_DEGREE = 40;
-    const Index SPHERE_ALL_TESSELATED_VERTICES_COUNT = pyramid_vertices_count(SPHERE_TESSELATE_DEGREE); // per 8 tessellated triangles
-    const DWORD SPHERE_ALL_TESSELATED_INDICES_COUNT = pyramid_indices_count(SPHERE_TESSELATE_DEGREE); // per 8 tessellated triangles
+    const float SPHERE_MAX_ERROR = 0.0004f; // of the finest level, about as of a uniform tessellation with degree 40
+
+    const float LIGHT_SOURCE_MAX_ERROR = 0.001f;
+
+    // Levels of detail of deformed models: every next level has half as many edges in each direction
+    // (for the sphere: 4 times bigger error, which is the same for a uniform tessellation)
+    const unsigned CYLINDER_LODS_COUNT = 5;
+
+    // Cylinders bend along chains of more bones than a palette holds (see palette.h)
+    const unsigned CYLINDER_BONES_COUNT = 100;
+    const unsigned SPHERE_LODS_COUNT = 4;
+    const float SPHERE_LOD_ERROR_FACTOR = 4.0f;
+
+    // Helpers collecting everything the generated meshes depend on (see MeshParams)
+    void add_cylinder_params(MeshParams &params, const CylinderDesc &desc)
+    {
+        params.add(desc.radius).add(desc.height).add(desc.colors_count).add(desc.colors, desc.colors_count).add(desc.bones_count)
+              .add(desc.edges_per_base).add(desc.edges_per_height).add(desc.edges_per_cap).add(CYLINDER_LODS_COUNT);
+    }
+
+    void add_geodesic_params(MeshParams &params, const GeodesicDesc &desc)
+    {
+        params.add(desc.radius).add(desc.color).add(desc.frequency);
+    }
+
+    void add_sphere_params(MeshParams &params, float radius, D3DCOLOR color)
+    {
+        params.add(radius).add(color).add(SPHERE_MAX_ERROR).add(SPHERE_LODS_COUNT).add(SPHERE_LOD_ERROR_FACTOR);
+    }
+
+    // Descriptors of levels of detail (or of chunks) of the meshes, from the finest level
+    void get_cylinder_levels( const CylinderDesc &desc, std::vector<CylinderDesc> &levels )
+    {
+        for( unsigned level = 0; level < CYLINDER_LODS_COUNT; ++level )
+            levels.push_back( desc.halved(level) );
+    }
+
+    void get_sphere_levels( float radius, D3DCOLOR color, std::vector<GeodesicDesc> &levels )
+    {
+        float max_error = SPHERE_MAX_ERROR;
+        for( unsigned level = 0; level < SPHERE_LODS_COUNT; ++level )
+        {
+            levels.push_back( GeodesicDesc( radius, color, geodesic_frequency( radius, max_error ) ) );
+            max_error *= SPHERE_LOD_ERROR_FACTOR;
+        }
+    }
+
+    // Chunks of the plane around the point (dense_x, dense_y)
+    void get_plane_chunks( float dense_x, float dense_y, D3DCOLOR color, std::vector<PlaneChunkDesc> &chunks )
+    {
+        const float chunk_side = PLANE_SIZE/PLANE_CHUNKS_PER_SIDE;
+        for( unsigned i = 0; i < PLANE_CHUNKS_PER_SIDE; ++i )
+        {
+            for( unsigned j = 0; j < PLANE_CHUNKS_PER_SIDE; ++j )
+            {
+                const float x = -PLANE_SIZE/2 + i*chunk_side;
+                const float y = -PLANE_SIZE/2 + j*chunk_side;
+                // distance to the nearest point of the chunk
+                const float dx = ( dense_x < x ) ? x - dense_x : ( ( dense_x > x + chunk_side ) ? dense_x - x - chunk_side : 0 );
+                const float dy = ( dense_y < y ) ? y - dense_y : ( ( dense_y > y + chunk_side ) ? dense_y - y - chunk_side : 0 );
+                const float distance = sqrt( dx*dx + dy*dy );
+
+                Index cells = PLANE_CHUNK_MAX_CELLS;
+                for( float radius = PLANE_DENSE_RADIUS; distance > radius && cells > PLANE_CHUNK_MIN_CELLS; radius *= 2 )
+                    cells /= 2;
+
+                chunks.push_back( PlaneChunkDesc( x, y, chunk_side, cells, color ) );
+            }
+        }
+    }
+
+    // Sizes of the chain of `levels' for MeshChain::reserve(). Chunks sharing index patterns take less than that, but not more
+    template<class Desc> void count_levels(const std::vector<Desc> &levels, Index &vertices_count, DWORD &indices_count)
+    {
+        DWORD64 vertices_sum = 0;
+        DWORD64 indices_sum = 0;
+        for( unsigned i = 0; i < levels.size(); ++i )
+        {
+            vertices_sum += levels[i].vertices_count();
+            indices_sum += get_list_indices_count( levels[i].primitive_type(), levels[i].indices_count() );
+        }
+        vertices_count = get_count( vertices_sum );
+        indices_count = get_count( indices_sum );
+    }
 
-    const DWORD LIGHT_SOURCE_TESSELATE_DEGREE = 10;
-    const Index LIGHT_SOURCE_ALL_TESSELATED_VERTICES_COUNT = PLANES_PER_PYRAMID*tesselated_vertices_count(LIGHT_SOURCE_TESSELATE_DEGREE); // per 8 tessellated triangles
-    const DWORD LIGHT_SOURCE_ALL_TESSELATED_INDICES_COUNT = PLANES_PER_PYRAMID*tesselated_indices_count(LIGHT_SOURCE_TESSELATE_DEGREE); // per 8 tessellated triangles
+    template<class Desc> size_t get_arena_size(unsigned vertex_size, const std::vector<Desc> &levels)
+    {
+        Index vertices_count;
+        DWORD indices_count;
+        count_levels( levels, vertices_count, indices_count );
+        return MeshChain::get_arena_size( vertex_size, vertices_count, indices_count );
+    }
 
+    // Writes `levels' into the chain taking its arrays from the arena: every one is a level of detail,
+    // or a chunk of one chunked level if `chunks' is true
+    template<class VertexType, class Desc> void generate( MeshChain &chain, Arena &arena, const std::vector<Desc> &levels,
+                                                          void (*generator)(const Desc&, MeshSink&), bool chunks )
+    {
+        Index vertices_count;
+        DWORD indices_count;
+        count_levels( levels, vertices_count, indices_count );
+        chain.reserve( arena, vertices_count, indices_count );
+
+        if( chunks )
+            chain.add_chunked_level();
+        ChainSink<VertexType> sink( chain, chunks );
+        for( unsigned i = 0; i < levels.size(); ++i )
+            generator( levels[i], sink );
+    }
 }
 
 INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, INT )
 {
     srand( static_cast<unsigned>( time(NULL) ) );
     
-    SkinningVertex * cylinder_vertices = NULL;
-    Index * cylinder_indices = NULL;
-    Vertex * sphere_vertices = NULL;
-    Index * sphere_indices = NULL;
-    Vertex * plane_vertices = NULL;
-    Index * plane_indices = NULL;
-    Vertex * light_source_vertices = NULL;
-    Index * light_source_indices = NULL;
     try
     {
         try
@@ -64,108 +172,197 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, INT )
             VertexShader skinning_shadow_shader(app.get_device(), SKINNING_SHADOW_SHADER_FILENAME);
             VertexShader morphing_shader(app.get_device(), MORPHING_SHADER_FILENAME);
             VertexShader morphing_shadow_shader(app.get_device(), MORPHING_SHADOW_SHADER_FILENAME);
+            VertexShader deformed_shader(app.get_device(), DEFORMED_SHADER_FILENAME);
+            VertexShader deformed_shadow_shader(app.get_device(), DEFORMED_SHADOW_SHADER_FILENAME);
             VertexShader plane_shader(app.get_device(), PLANE_SHADER_FILENAME);
             VertexShader light_source_shader(app.get_device(), LIGHT_SOURCE_SHADER_FILENAME);
             VertexShader target_vertex_shader(app.get_device(), TARGET_VERTEX_SHADER_FILENAME);
             PixelShader  no_pixel_shader(app.get_device());
             PixelShader  target_pixel_shader(app.get_device(), TARGET_PIXEL_SHADER_FILENAME);
+            const VertexShader *vertex_shaders[] = { &skinning_shader, &skinning_shadow_shader, &morphing_shader, &morphing_shadow_shader,
+                                                     &deformed_shader, &deformed_shadow_shader, &plane_shader, &light_source_shader,
+                                                     &target_vertex_shader };
+            for( unsigned i = 0; i < array_size(vertex_shaders); ++i )
+                app.add_shader_slots( vertex_shaders[i]->get_source_slots(), vertex_shaders[i]->get_slots() );
+            app.add_shader_slots( target_pixel_shader.get_source_slots(), target_pixel_shader.get_slots() );
             
-            // -------------------------- C y l i n d e r -----------------------
+            // ---------------------------- M e s h e s -------------------------
+            // Meshes are taken from the cache; the missing ones are generated into one arena counted up front
+            const CylinderDesc cylinder1_desc( 0.7f, 2.0f, colors, colors_count, CYLINDER_BONES_COUNT );
+            const CylinderDesc cylinder2_desc( 0.3f, 2.3f, &SECOND_CYLINDER_COLOR, 1, CYLINDER_BONES_COUNT );
+            const GeodesicDesc light_source_desc( LIGHT_SOURCE_RADIUS, D3DCOLOR_XRGB(0,0,0) /* ignored */,
+                                                  geodesic_frequency( LIGHT_SOURCE_RADIUS, LIGHT_SOURCE_MAX_ERROR ) );
+            const D3DXVECTOR3 dense_point = app.get_point_light_position() - PLANE_POSITION; // its projection onto the plane is (x, y)
+
+            MeshParams cylinder1_params("cylinder");
+            add_cylinder_params( cylinder1_params, cylinder1_desc );
+            CachedMesh cylinder1_mesh( cylinder1_params, SKINNING_VERTEX_DECL_ARRAY, sizeof(SkinningVertex) );
+
+            MeshParams cylinder2_params("cylinder");
+            add_cylinder_params( cylinder2_params, cylinder2_desc );
+            CachedMesh cylinder2_mesh( cylinder2_params, SKINNING_VERTEX_DECL_ARRAY, sizeof(SkinningVertex) );
+
+            MeshParams sphere_params("geodesic sphere");
+            add_sphere_params( sphere_params, SPHERE_RADIUS, SPHERE_COLOR );
+            CachedMesh sphere_mesh( sphere_params, VERTEX_DECL_ARRAY, sizeof(Vertex) );
+
+            MeshParams plane_params("plane chunks");
+            plane_params.add(PLANE_SIZE).add(PLANE_COLOR).add(PLANE_CHUNKS_PER_SIDE).add(PLANE_CHUNK_MAX_CELLS).add(PLANE_CHUNK_MIN_CELLS);
+            plane_params.add(dense_point.x).add(dense_point.y).add(PLANE_DENSE_RADIUS);
+            CachedMesh plane_mesh( plane_params, VERTEX_DECL_ARRAY, sizeof(Vertex) );
 
-            cylinder_vertices = new SkinningVertex[CYLINDER_VERTICES_COUNT];
-            cylinder_indices = new Index[CYLINDER_INDICES_COUNT];
+            MeshParams light_source_params("geodesic sphere");
+            add_geodesic_params( light_source_params, light_source_desc );
+            CachedMesh light_source_mesh( light_source_params, VERTEX_DECL_ARRAY, sizeof(Vertex) );
 
-            float height = 2.0f;
-            cylinder( 0.7f, height,
-                      colors, colors_count,
-                      cylinder_vertices, cylinder_indices );
+            std::vector<CylinderDesc> cylinder1_levels;
+            std::vector<CylinderDesc> cylinder2_levels;
+            std::vector<GeodesicDesc> sphere_levels;
+            std::vector<PlaneChunkDesc> plane_chunks;
+            std::vector<GeodesicDesc> light_source_levels;
+            if( !cylinder1_mesh.is_loaded() )
+                get_cylinder_levels( cylinder1_desc, cylinder1_levels );
+            if( !cylinder2_mesh.is_loaded() )
+                get_cylinder_levels( cylinder2_desc, cylinder2_levels );
+            if( !sphere_mesh.is_loaded() )
+                get_sphere_levels( SPHERE_RADIUS, SPHERE_COLOR, sphere_levels );
+            if( !plane_mesh.is_loaded() )
+                get_plane_chunks( dense_point.x, dense_point.y, PLANE_COLOR, plane_chunks );
+            if( !light_source_mesh.is_loaded() )
+                light_source_levels.push_back( light_source_desc );
 
+            const DWORD64 mesh_arena_size = static_cast<DWORD64>( get_arena_size( sizeof(SkinningVertex), cylinder1_levels ) ) +
+                                            get_arena_size( sizeof(SkinningVertex), cylinder2_levels ) +
+                                            get_arena_size( sizeof(Vertex), sphere_levels ) +
+                                            get_arena_size( sizeof(Vertex), plane_chunks ) +
+                                            get_arena_size( sizeof(Vertex), light_source_levels );
+            Arena mesh_arena( get_array_size( mesh_arena_size, 1 ) );
+            MeshChain cylinder1_chain( sizeof(SkinningVertex) );
+            MeshChain cylinder2_chain( sizeof(SkinningVertex) );
+            MeshChain sphere_chain( sizeof(Vertex) );
+            MeshChain plane_chain( sizeof(Vertex) );
+            MeshChain light_source_chain( sizeof(Vertex) );
+            // generated cylinders are partitioned into palettes of bones (see palette.h) and stored so: loaded ones are not partitioned again
+            BonePartition cylinder1_partition;
+            BonePartition cylinder2_partition;
+            if( !cylinder1_mesh.is_loaded() )
+            {
+                generate<SkinningVertex, CylinderDesc>( cylinder1_chain, mesh_arena, cylinder1_levels, cylinder, false );
+                partition_bones( cylinder1_chain, cylinder1_partition );
+                cylinder1_mesh.store( cylinder1_partition );
+            }
+            if( !cylinder2_mesh.is_loaded() )
+            {
+                generate<SkinningVertex, CylinderDesc>( cylinder2_chain, mesh_arena, cylinder2_levels, cylinder, false );
+                partition_bones( cylinder2_chain, cylinder2_partition );
+                cylinder2_mesh.store( cylinder2_partition );
+            }
+            if( !sphere_mesh.is_loaded() )
+            {
+                generate<Vertex, GeodesicDesc>( sphere_chain, mesh_arena, sphere_levels, geodesic_sphere, false );
+                sphere_mesh.store( sphere_chain );
+            }
+            if( !plane_mesh.is_loaded() )
+            {
+                generate<Vertex, PlaneChunkDesc>( plane_chain, mesh_arena, plane_chunks, plane_chunk, true );
+                plane_mesh.store( plane_chain );
+            }
+            if( !light_source_mesh.is_loaded() )
+            {
+                generate<Vertex, GeodesicDesc>( light_source_chain, mesh_arena, light_source_levels, geodesic_sphere, false );
+                light_source_mesh.store( light_source_chain );
+            }
+
+            // -------------------------- C y l i n d e r -----------------------
             SkinningModel cylinder1(app.get_device(),
-                                    D3DPT_TRIANGLESTRIP,
+                                    cylinder1_mesh.get_primitive_type(),
                                     skinning_shader,
                                     skinning_shadow_shader,
                                     no_pixel_shader,
-                                    cylinder_vertices,
-                                    CYLINDER_VERTICES_COUNT,
-                                    cylinder_indices,
-                                    CYLINDER_INDICES_COUNT,
-                                    CYLINDER_INDICES_COUNT - 2,
-                                    D3DXVECTOR3(0.5f, 0.5f, -height/2),
+                                    cylinder1_mesh.get_vertices<SkinningVertex>(),
+                                    cylinder1_mesh.get_vertices_count(),
+                                    cylinder1_mesh.get_indices(),
+                                    cylinder1_mesh.get_indices_count(),
+                                    cylinder1_mesh.get_primitives_count(),
+                                    cylinder1_mesh.get_clusters(),
+                                    cylinder1_mesh.get_clusters_count(),
+                                    true,
+                                    cylinder1_mesh.get_lods(),
+                                    cylinder1_mesh.get_lods_count(),
+                                    D3DXVECTOR3(0.5f, 0.5f, -cylinder1_desc.height/2),
                                     D3DXVECTOR3(0,0,0),
-                                    D3DXVECTOR3(0,0,-1));
-
-            height = 2.3f;
-            cylinder( 0.3f, height,
-                      &SECOND_CYLINDER_COLOR, 1,
-                      cylinder_vertices, cylinder_indices );
+                                    D3DXVECTOR3(0,0,-1),
+                                    cylinder1_desc.bones_count,
+                                    cylinder1_mesh.get_palettes(),
+                                    cylinder1_mesh.get_palettes_count());
 
             SkinningModel cylinder2(app.get_device(),
-                                    D3DPT_TRIANGLESTRIP,
+                                    cylinder2_mesh.get_primitive_type(),
                                     skinning_shader,
                                     skinning_shadow_shader,
                                     no_pixel_shader,
-                                    cylinder_vertices,
-                                    CYLINDER_VERTICES_COUNT,
-                                    cylinder_indices,
-                                    CYLINDER_INDICES_COUNT,
-                                    CYLINDER_INDICES_COUNT - 2,
-                                    D3DXVECTOR3(-1.0f, 0.5f, height/2),
+                                    cylinder2_mesh.get_vertices<SkinningVertex>(),
+                                    cylinder2_mesh.get_vertices_count(),
+                                    cylinder2_mesh.get_indices(),
+                                    cylinder2_mesh.get_indices_count(),
+                                    cylinder2_mesh.get_primitives_count(),
+                                    cylinder2_mesh.get_clusters(),
+                                    cylinder2_mesh.get_clusters_count(),
+                                    true,
+                                    cylinder2_mesh.get_lods(),
+                                    cylinder2_mesh.get_lods_count(),
+                                    D3DXVECTOR3(-1.0f, 0.5f, cylinder2_desc.height/2),
                                     D3DXVECTOR3(D3DX_PI,0,-D3DX_PI/4),
-                                    D3DXVECTOR3(0,0,1));
-
-            
-            // -------------------------- P y r a m i d -----------------------
-            sphere_vertices = new Vertex[SPHERE_ALL_TESSELATED_VERTICES_COUNT];
-            sphere_indices = new Index[SPHERE_ALL_TESSELATED_INDICES_COUNT];
+                                    D3DXVECTOR3(0,0,1),
+                                    cylinder2_desc.bones_count,
+                                    cylinder2_mesh.get_palettes(),
+                                    cylinder2_mesh.get_palettes_count());
 
-            pyramid(SPHERE_RADIUS*SPHERE_RADIUS, sphere_vertices, sphere_indices, SPHERE_COLOR, SPHERE_TESSELATE_DEGREE);
             
+            // --------------------------- S p h e r e ------------------------
             MorphingModel sphere( app.get_device(),
-                                  D3DPT_TRIANGLELIST,
+                                  sphere_mesh.get_primitive_type(),
                                   morphing_shader,
                                   morphing_shadow_shader,
                                   no_pixel_shader,
-                                  sphere_vertices,
-                                  SPHERE_ALL_TESSELATED_VERTICES_COUNT,
-                                  sphere_indices,
-                                  SPHERE_ALL_TESSELATED_INDICES_COUNT,
-                                  SPHERE_ALL_TESSELATED_INDICES_COUNT/VERTICES_PER_TRIANGLE,
+                                  sphere_mesh.get_vertices<Vertex>(),
+                                  sphere_mesh.get_vertices_count(),
+                                  sphere_mesh.get_indices(),
+                                  sphere_mesh.get_indices_count(),
+                                  sphere_mesh.get_primitives_count(),
+                                  sphere_mesh.get_clusters(),
+                                  sphere_mesh.get_clusters_count(),
+                                  true,
+                                  sphere_mesh.get_lods(),
+                                  sphere_mesh.get_lods_count(),
                                   D3DXVECTOR3(0, -1.3f, -0.2f),
                                   D3DXVECTOR3(0,0,0),
                                   SPHERE_RADIUS );
 
             // ----------------------------- P l a n e --------------------------
-            plane_vertices = new Vertex[PLANE_VERTICES_COUNT];
-            plane_indices = new Index[PLANE_INDICES_COUNT];
-            plane(40, 40, plane_vertices, plane_indices, PLANE_COLOR);
-
             Plane plane( app.get_device(),
-                         D3DPT_TRIANGLELIST,
+                         plane_mesh.get_primitive_type(),
                          plane_shader,
                          no_pixel_shader,
-                         plane_vertices,
-                         PLANE_VERTICES_COUNT,
-                         plane_indices,
-                         PLANE_INDICES_COUNT,
-                         PLANE_INDICES_COUNT/VERTICES_PER_TRIANGLE,
-                         D3DXVECTOR3(0, 0, -1.2f),
+                         plane_mesh,
+                         plane_mesh.get_indices(),
+                         plane_mesh.get_indices_count(),
+                         plane_mesh.get_primitives_count(),
+                         plane_mesh.get_clusters(),
+                         plane_mesh.get_clusters_count(),
+                         false, // seen from both sides
+                         PLANE_POSITION,
                          D3DXVECTOR3(0,0,0) );
 
             // -------------------------- Light source --------------------------
-            light_source_vertices = new Vertex[LIGHT_SOURCE_ALL_TESSELATED_VERTICES_COUNT];
-            light_source_indices = new Index[LIGHT_SOURCE_ALL_TESSELATED_INDICES_COUNT];
-
-            pyramid(LIGHT_SOURCE_RADIUS*LIGHT_SOURCE_RADIUS, light_source_vertices, light_source_indices, D3DCOLOR_XRGB(0,0,0) /* ignored */, LIGHT_SOURCE_TESSELATE_DEGREE);
-
             LightSource light_source( app.get_device(),
-                                      D3DPT_TRIANGLELIST,
+                                      light_source_mesh.get_primitive_type(),
                                       light_source_shader,
                                       no_pixel_shader,
-                                      light_source_vertices,
-                                      LIGHT_SOURCE_ALL_TESSELATED_VERTICES_COUNT,
-                                      light_source_indices,
-                                      LIGHT_SOURCE_ALL_TESSELATED_INDICES_COUNT,
-                                      LIGHT_SOURCE_ALL_TESSELATED_INDICES_COUNT/VERTICES_PER_TRIANGLE,
+                                      light_source_mesh,
+                                      light_source_mesh.get_indices(),
+                                      light_source_mesh.get_indices_count(),
+                                      light_source_mesh.get_primitives_count(),
                                       D3DXVECTOR3(0,0,0),
                                       D3DXVECTOR3(0,0,0),
                                       LIGHT_SOURCE_RADIUS);
@@ -180,6 +377,7 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, INT )
             };
             Index target_indices[] = { 0, 1, 2, 1, 2, 3 };
             // ---------------------------- a d d i n g -------------------------
+            app.set_deformed_shaders(deformed_shader, deformed_shadow_shader); // before the models: they may be deformed in software from the start
             app.add_model(cylinder1);
             app.add_model(cylinder2);
             app.add_model(sphere);
@@ -190,16 +388,6 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, INT )
                                     target_indices, array_size(target_indices));
 
             app.run();
-
-            // -------------------------- c l e a n   u p -----------------------
-            delete_array(&sphere_indices);
-            delete_array(&sphere_vertices);
-            delete_array(&cylinder_indices);
-            delete_array(&cylinder_vertices);
-            delete_array(&plane_indices);
-            delete_array(&plane_vertices);
-            delete_array(&light_source_indices);
-            delete_array(&light_source_vertices);
         }
         catch(std::bad_alloc)
         {
@@ -208,14 +396,6 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, INT )
     }
     catch(RuntimeError &e)
     {
-        delete_array(&sphere_indices);
-        delete_array(&sphere_vertices);
-        delete_array(&cylinder_indices);
-        delete_array(&cylinder_vertices);
-        delete_array(&plane_indices);
-        delete_array(&plane_vertices);
-        delete_array(&light_source_indices);
-        delete_array(&light_source_vertices);
         const TCHAR *MESSAGE_BOX_TITLE = _T("Filtering error!");
         MessageBox(NULL, e.message(), MESSAGE_BOX_TITLE, MB_OK | MB_ICONERROR);
         return -1;
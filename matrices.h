@@ -1,6 +1,6 @@
 #pragma once
 
-#include "main.h"
+#include "common.h"
 
 inline D3DXMATRIX shift_matrix(D3DXVECTOR3 shift)
 {
@@ -48,3 +48,18 @@ inline D3DXMATRIX rotate_and_shift_matrix(D3DXVECTOR3 angles, D3DXVECTOR3 shift)
 {
     return shift_matrix(shift)*rotate_matrix(angles);
 }
+
+// Transformations with these matrices: a point or a vector is a column multiplied from the right
+inline D3DXVECTOR3 transform_point(const D3DXMATRIX &m, const D3DXVECTOR3 &p)
+{
+    return D3DXVECTOR3( m._11*p.x + m._12*p.y + m._13*p.z + m._14,
+                        m._21*p.x + m._22*p.y + m._23*p.z + m._24,
+                        m._31*p.x + m._32*p.y + m._33*p.z + m._34 );
+}
+
+inline D3DXVECTOR3 transform_vector(const D3DXMATRIX &m, const D3DXVECTOR3 &v)
+{
+    return D3DXVECTOR3( m._11*v.x + m._12*v.y + m._13*v.z,
+                        m._21*v.x + m._22*v.y + m._23*v.z,
+                        m._31*v.x + m._32*v.y + m._33*v.z );
+}
@@ -0,0 +1,393 @@
+#include "mesh_cache.h"
+#include "codec.h"
+
+const DWORD MESH_FILE_VERSION = 9;
+const char *MESH_CACHE_DIRECTORY = "mesh_cache";
+
+namespace
+{
+    const DWORD MESH_FILE_MAGIC = 'M' | ('E' << 8) | ('S' << 16) | ('H' << 24);
+    const DWORD MESH_FILE_ALIGNMENT = 16;
+
+    const DWORD64 FNV_OFFSET_BASIS = 14695981039346656037ULL;
+    const DWORD64 FNV_PRIME = 1099511628211ULL;
+
+    const D3DVERTEXELEMENT9 DECLARATION_END = D3DDECL_END();
+
+    inline DWORD align(DWORD offset)
+    {
+        return (offset + MESH_FILE_ALIGNMENT - 1)/MESH_FILE_ALIGNMENT*MESH_FILE_ALIGNMENT;
+    }
+
+    unsigned declaration_size(const D3DVERTEXELEMENT9 *declaration)
+    // returns number of elements including D3DDECL_END()
+    {
+        unsigned size = 0;
+        while( declaration[size].Stream != DECLARATION_END.Stream )
+            ++size;
+        return size + 1;
+    }
+
+    // A blob is encoded only if the code is shorter than the raw data (it is not e.g. for random colors, whose varints
+    // are longer than their DWORDs). So a code as long as the raw data is the raw data, used from the mapping in place
+    inline bool is_raw(DWORD code_size, DWORD64 raw_size)
+    {
+        return code_size == raw_size;
+    }
+
+    bool write_blob(HANDLE file, const void *data, DWORD size, DWORD &written_total)
+    // writes `size' bytes and pads them with zeroes to the aligned size
+    {
+        static const BYTE ZEROES[MESH_FILE_ALIGNMENT] = {0};
+        DWORD written = 0;
+        if( size != 0 && ( !WriteFile(file, data, size, &written, NULL) || written != size ) )
+            return false;
+        written_total += size;
+
+        DWORD padding = align(written_total) - written_total;
+        if( padding != 0 && ( !WriteFile(file, ZEROES, padding, &written, NULL) || written != padding ) )
+            return false;
+        written_total += padding;
+        return true;
+    }
+}
+
+// -------------------------------------- MeshParams ----------------------------------------------------------------
+
+MeshParams::MeshParams(const char *generator_name)
+{
+    _ASSERT( generator_name != NULL );
+    add( generator_name, static_cast<unsigned>( strlen(generator_name) ) + 1 );
+}
+
+MeshParams &MeshParams::add(const void *data, unsigned size)
+{
+    _ASSERT( data != NULL || size == 0 );
+    const BYTE *data_bytes = static_cast<const BYTE*>(data);
+    bytes.insert( bytes.end(), data_bytes, data_bytes + size );
+    return *this;
+}
+
+DWORD64 MeshParams::get_hash() const
+{
+    DWORD64 hash = FNV_OFFSET_BASIS;
+    for( unsigned i = 0; i < bytes.size(); ++i )
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// -------------------------------------- CachedMesh ----------------------------------------------------------------
+
+CachedMesh::CachedMesh( const MeshParams &params, const D3DVERTEXELEMENT9 *declaration, unsigned vertex_size )
+: params(params), declaration(declaration), vertex_size(vertex_size),
+  file(INVALID_HANDLE_VALUE), mapping(NULL), view(NULL), vertices(NULL), indices(NULL), vertices_count(0), indices_count(0),
+  clusters(NULL), clusters_count(0), lods(NULL), lods_count(0), palettes(NULL), palettes_count(0)
+{
+    _ASSERT( declaration != NULL );
+    DWORD64 key = params.get_hash();
+    sprintf_s( filename, sizeof(filename), "%s\\%08lx%08lx.mesh", MESH_CACHE_DIRECTORY,
+               static_cast<unsigned long>(key >> 32), static_cast<unsigned long>(key & 0xffffffff) );
+    if( map() && decode( get_header() ) )
+    {
+        const MeshFileHeader &header = get_header();
+        vertices_count = header.vertices_count;
+        indices_count = header.indices_count;
+        clusters = reinterpret_cast<const Cluster*>( view + header.clusters_offset );
+        clusters_count = header.clusters_count;
+        lods = reinterpret_cast<const LodLevel*>( view + header.lods_offset );
+        lods_count = header.lods_count;
+        palettes = reinterpret_cast<const BonePalette*>( view + header.palettes_offset );
+        palettes_count = header.palettes_count;
+    }
+    else
+    {
+        unmap();
+        vertices = NULL;
+        indices = NULL;
+        decoded_indices.clear();
+    }
+}
+
+bool CachedMesh::map()
+{
+    file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if( file == INVALID_HANDLE_VALUE )
+        return false;
+
+    DWORD file_size = GetFileSize( file, NULL );
+    if( file_size == INVALID_FILE_SIZE || file_size < sizeof(MeshFileHeader) )
+        return false;
+
+    mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( mapping == NULL )
+        return false;
+
+    view = static_cast<const BYTE*>( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+    if( view == NULL )
+        return false;
+
+    return is_valid( *reinterpret_cast<const MeshFileHeader*>(view), file_size );
+}
+
+bool CachedMesh::is_valid(const MeshFileHeader &header, DWORD file_size) const
+// checks that the file is a mesh we expect, not a stale or broken one
+{
+    DWORD64 key = params.get_hash();
+    const unsigned declaration_count = declaration_size(declaration);
+
+    if( header.magic != MESH_FILE_MAGIC || header.version != MESH_FILE_VERSION )
+        return false;
+    if( header.key_low != static_cast<DWORD>(key & 0xffffffff) || header.key_high != static_cast<DWORD>(key >> 32) )
+        return false;
+    if( header.vertex_size != vertex_size || vertex_size % sizeof(DWORD) != 0 || header.index_size != sizeof(Index) ||
+        header.params_size != params.get_size() || header.declaration_size != declaration_count )
+        return false;
+    if( header.lods_count == 0 )
+        return false;
+
+    // every blob must be inside the file
+    // (every vertex DWORD and every index takes at least a byte of the code)
+    if( header.vertices_count > file_size/(vertex_size/sizeof(DWORD)) || header.indices_count > file_size ||
+        header.clusters_count > file_size/sizeof(Cluster) || header.lods_count > file_size/sizeof(LodLevel) ||
+        header.palettes_count > file_size/sizeof(BonePalette) )
+        return false; // sizes of blobs would overflow
+    const DWORD blobs[][2] =
+    {
+        { header.params_offset,      params.get_size() },
+        { header.declaration_offset, declaration_count*sizeof(D3DVERTEXELEMENT9) },
+        { header.vertices_offset,    header.vertices_code_size },
+        { header.indices_offset,     header.indices_code_size },
+        { header.clusters_offset,    header.clusters_count*sizeof(Cluster) },
+        { header.lods_offset,        header.lods_count*sizeof(LodLevel) },
+        { header.palettes_offset,    header.palettes_count*sizeof(BonePalette) },
+    };
+    for( unsigned i = 0; i < array_size(blobs); ++i )
+    {
+        if( blobs[i][0] > file_size || blobs[i][1] > file_size - blobs[i][0] || blobs[i][0] % MESH_FILE_ALIGNMENT != 0 )
+            return false;
+    }
+
+    // the hash matched, but the parameters themselves must match too
+    if( memcmp( view + header.params_offset, params.get_data(), params.get_size() ) != 0 )
+        return false;
+    if( memcmp( view + header.declaration_offset, declaration, declaration_count*sizeof(D3DVERTEXELEMENT9) ) != 0 )
+        return false;
+
+    // clusters are drawn as ranges of indices with their own vertices
+    const Cluster *file_clusters = reinterpret_cast<const Cluster*>( view + header.clusters_offset );
+    for( DWORD i = 0; i < header.clusters_count; ++i )
+    {
+        if( file_clusters[i].first_index > header.indices_count ||
+            file_clusters[i].indices_count > header.indices_count - file_clusters[i].first_index ||
+            file_clusters[i].base_vertex > header.vertices_count ||
+            file_clusters[i].vertices_count > header.vertices_count - file_clusters[i].base_vertex )
+            return false;
+    }
+
+    // levels are drawn as ranges of vertices, indices and clusters
+    const LodLevel *file_lods = reinterpret_cast<const LodLevel*>( view + header.lods_offset );
+    for( DWORD i = 0; i < header.lods_count; ++i )
+    {
+        const LodLevel &level = file_lods[i];
+        if( level.primitive_type != D3DPT_TRIANGLELIST && level.primitive_type != D3DPT_TRIANGLESTRIP )
+            return false;
+        if( level.first_vertex > header.vertices_count || level.vertices_count > header.vertices_count - level.first_vertex ||
+            level.first_index > header.indices_count || level.indices_count > header.indices_count - level.first_index ||
+            level.first_cluster > header.clusters_count || level.clusters_count > header.clusters_count - level.first_cluster )
+            return false;
+    }
+
+    // palettes are drawn as runs of clusters with their own vertices
+    const BonePalette *file_palettes = reinterpret_cast<const BonePalette*>( view + header.palettes_offset );
+    for( DWORD i = 0; i < header.palettes_count; ++i )
+    {
+        const BonePalette &palette = file_palettes[i];
+        if( palette.first_cluster > header.clusters_count || palette.clusters_count > header.clusters_count - palette.first_cluster ||
+            palette.first_vertex > header.vertices_count || palette.vertices_count > header.vertices_count - palette.first_vertex ||
+            palette.bones_count > BONE_PALETTE_SIZE )
+            return false;
+    }
+
+    return true;
+}
+
+bool CachedMesh::decode(const MeshFileHeader &header)
+{
+    if( is_raw( header.vertices_code_size, static_cast<DWORD64>(header.vertices_count)*vertex_size ) )
+    {
+        vertices = view + header.vertices_offset;
+    }
+    else
+    {
+        // vertices are decoded later, where they go (see write_streams() and get_vertices()): here the code is only checked
+        std::vector<VertexColumn> checked_columns( vertex_size/sizeof(DWORD) );
+        if( !decode_vertex_columns( view + header.vertices_offset, header.vertices_code_size,
+                                    checked_columns.empty() ? NULL : &checked_columns[0],
+                                    static_cast<unsigned>( checked_columns.size() ), header.vertices_count ) )
+            return false;
+    }
+
+    if( is_raw( header.indices_code_size, static_cast<DWORD64>(header.indices_count)*sizeof(Index) ) )
+    {
+        indices = reinterpret_cast<const Index*>( view + header.indices_offset );
+        return true;
+    }
+    decoded_indices.resize( header.indices_count );
+    indices = decoded_indices.empty() ? NULL : &decoded_indices[0];
+    return decode_indices( view + header.indices_offset, header.indices_code_size, &decoded_indices[0], header.indices_count );
+}
+
+const void *CachedMesh::get_vertices() const
+{
+    if( vertices == NULL && is_loaded() )
+    {
+        const MeshFileHeader &header = get_header();
+        decoded_vertices.resize( get_array_size( vertices_count, vertex_size )/sizeof(DWORD) );
+        if( !decode_vertices( view + header.vertices_offset, header.vertices_code_size,
+                              decoded_vertices.empty() ? NULL : &decoded_vertices[0], vertex_size, vertices_count ) )
+            throw MeshCacheError(); // not expected: the code was checked when the mesh was loaded
+        vertices = decoded_vertices.empty() ? NULL : &decoded_vertices[0];
+    }
+    _ASSERT( vertices != NULL );
+    return vertices;
+}
+
+void CachedMesh::write_streams(const VertexFormat &format, void * const *res_streams) const
+{
+    _ASSERT( format.get_vertex_size() == vertex_size );
+    if( vertices != NULL )
+    {
+        // generated, raw in the mapping, or already decoded for the CPU
+        InterleavedVertices( vertices, vertices_count ).write_streams( format, res_streams );
+        return;
+    }
+    _ASSERT( is_loaded() );
+    const MeshFileHeader &header = get_header();
+    std::vector<VertexColumn> columns( vertex_size/sizeof(DWORD) );
+    format.get_columns( res_streams, &columns[0] );
+    if( !decode_vertex_columns( view + header.vertices_offset, header.vertices_code_size,
+                                &columns[0], static_cast<unsigned>( columns.size() ), vertices_count ) )
+        throw MeshCacheError(); // not expected: the code was checked when the mesh was loaded
+}
+
+bool CachedMesh::store(const MeshChain &generated)
+{
+    _ASSERT( generated.get_levels_count() > 0 );
+    _ASSERT( !is_loaded() );
+    vertices = generated.get_vertices();
+    indices = generated.get_indices();
+    vertices_count = generated.get_vertices_count();
+    indices_count = generated.get_indices_count();
+    clusters = generated.get_clusters();
+    clusters_count = generated.get_clusters_count();
+    lods = generated.get_levels();
+    lods_count = generated.get_levels_count();
+    return write();
+}
+
+bool CachedMesh::store(const BonePartition &partitioned)
+{
+    _ASSERT( !partitioned.lods.empty() && !partitioned.palettes.empty() );
+    _ASSERT( vertex_size == sizeof(SkinningVertex) );
+    _ASSERT( !is_loaded() );
+    vertices = &partitioned.vertices[0];
+    indices = &partitioned.indices[0];
+    vertices_count = get_count( partitioned.vertices.size() );
+    indices_count = get_count( partitioned.indices.size() );
+    clusters = partitioned.clusters.empty() ? NULL : &partitioned.clusters[0];
+    clusters_count = get_count( partitioned.clusters.size() );
+    lods = &partitioned.lods[0];
+    lods_count = get_count( partitioned.lods.size() );
+    palettes = &partitioned.palettes[0];
+    palettes_count = get_count( partitioned.palettes.size() );
+    return write();
+}
+
+bool CachedMesh::write()
+{
+    CreateDirectoryA( MESH_CACHE_DIRECTORY, NULL ); // if it already exists, it is ok
+
+    const unsigned declaration_count = declaration_size(declaration);
+    DWORD64 key = params.get_hash();
+
+    std::vector<BYTE> vertices_code;
+    std::vector<BYTE> indices_code;
+    encode_vertices( vertices, vertex_size, vertices_count, vertices_code );
+    encode_indices( indices, indices_count, indices_code );
+    // codes which do not pay off are replaced by the raw data (see is_raw())
+    const DWORD raw_vertices_size = vertices_count*vertex_size;
+    const DWORD raw_indices_size = indices_count*sizeof(Index);
+    const bool raw_vertices = ( vertices_code.size() >= raw_vertices_size );
+    const bool raw_indices = ( indices_code.size() >= raw_indices_size );
+
+    MeshFileHeader header;
+    ZeroMemory( &header, sizeof(header) );
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.key_low = static_cast<DWORD>(key & 0xffffffff);
+    header.key_high = static_cast<DWORD>(key >> 32);
+    header.vertex_size = vertex_size;
+    header.index_size = sizeof(Index);
+    header.vertices_count = vertices_count;
+    header.indices_count = indices_count;
+    header.params_size = params.get_size();
+    header.declaration_size = declaration_count;
+    header.params_offset = align( sizeof(header) );
+    header.declaration_offset = align( header.params_offset + header.params_size );
+    header.vertices_offset = align( header.declaration_offset + declaration_count*sizeof(D3DVERTEXELEMENT9) );
+    header.vertices_code_size = raw_vertices ? raw_vertices_size : static_cast<DWORD>( vertices_code.size() );
+    header.indices_offset = align( header.vertices_offset + header.vertices_code_size );
+    header.indices_code_size = raw_indices ? raw_indices_size : static_cast<DWORD>( indices_code.size() );
+    header.clusters_count = clusters_count;
+    header.clusters_offset = align( header.indices_offset + header.indices_code_size );
+    header.lods_count = lods_count;
+    header.lods_offset = align( header.clusters_offset + clusters_count*sizeof(Cluster) );
+    header.palettes_count = palettes_count;
+    header.palettes_offset = align( header.lods_offset + lods_count*sizeof(LodLevel) );
+
+    // writing to a temporary file and then renaming it, so that a half-written file is never taken for a mesh
+    char temp_filename[MAX_PATH];
+    sprintf_s( temp_filename, sizeof(temp_filename), "%s.tmp", filename );
+
+    HANDLE temp_file = CreateFileA( temp_filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if( temp_file == INVALID_HANDLE_VALUE )
+        return false;
+
+    DWORD written = 0;
+    bool ok = write_blob( temp_file, &header, sizeof(header), written )
+           && write_blob( temp_file, params.get_data(), params.get_size(), written )
+           && write_blob( temp_file, declaration, declaration_count*sizeof(D3DVERTEXELEMENT9), written )
+           && write_blob( temp_file, raw_vertices ? vertices : &vertices_code[0], header.vertices_code_size, written )
+           && write_blob( temp_file, raw_indices ? static_cast<const void*>( indices ) : &indices_code[0], header.indices_code_size, written )
+           && write_blob( temp_file, clusters, clusters_count*sizeof(Cluster), written )
+           && write_blob( temp_file, lods, lods_count*sizeof(LodLevel), written )
+           && write_blob( temp_file, palettes, palettes_count*sizeof(BonePalette), written );
+    CloseHandle( temp_file );
+
+    if( ok )
+        ok = ( MoveFileExA( temp_filename, filename, MOVEFILE_REPLACE_EXISTING ) != FALSE );
+    if( !ok )
+        DeleteFileA( temp_filename );
+    return ok;
+}
+
+void CachedMesh::unmap()
+{
+    if( view != NULL )
+        UnmapViewOfFile( view );
+    view = NULL;
+    if( mapping != NULL )
+        CloseHandle( mapping );
+    mapping = NULL;
+    if( file != INVALID_HANDLE_VALUE )
+        CloseHandle( file );
+    file = INVALID_HANDLE_VALUE;
+}
+
+CachedMesh::~CachedMesh()
+{
+    unmap();
+}
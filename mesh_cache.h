@@ -0,0 +1,150 @@
+#pragma once
+#include "main.h"
+#include "Vertex.h"
+#include "clusters.h"
+#include "lod.h"
+#include "palette.h"
+#include "VertexDeclaration.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+extern const DWORD MESH_FILE_VERSION;
+extern const char *MESH_CACHE_DIRECTORY;
+
+// Everything a generated mesh depends on: sizes, colors, tessellation constants...
+// Equal parameters give an equal mesh, so the hash of parameters is a key of the mesh in the cache
+class MeshParams
+{
+private:
+    std::vector<BYTE> bytes;
+public:
+    // `generator_name' is a part of parameters too: a cylinder and a plane with equal numbers are different meshes
+    explicit MeshParams(const char *generator_name);
+
+    MeshParams &add(const void *data, unsigned size);
+    template<class Type> MeshParams &add(const Type &value) { return add(static_cast<const void*>(&value), sizeof(value)); }
+    template<class Type> MeshParams &add(const Type *values, unsigned count) { return add(static_cast<const void*>(values), static_cast<unsigned>(count*sizeof(values[0]))); }
+
+    const BYTE *get_data() const { return bytes.empty() ? NULL : &bytes[0]; }
+    unsigned get_size() const { return static_cast<unsigned>( bytes.size() ); }
+    DWORD64 get_hash() const; // 64-bit FNV-1a of all the bytes added
+};
+
+// Binary mesh file: a header, generator parameters, vertex declaration, vertex blob, index blob, clusters, levels of detail
+// and palettes of bones (of skinned meshes, which are stored partitioned, see palette.h).
+// Every blob starts at an offset aligned to MESH_FILE_ALIGNMENT, so the mapped file can be used as is.
+// Vertices and indices are encoded (see codec.h): they are the most of the file and are decoded faster than read raw.
+// A blob whose code would not be shorter is stored raw: its code size is then its raw size
+struct MeshFileHeader
+{
+    DWORD magic;
+    DWORD version;
+    DWORD key_low;          // the key is MeshParams::get_hash(),
+    DWORD key_high;         // ... stored as two DWORDs
+    DWORD vertex_size;
+    DWORD index_size;
+    DWORD vertices_count;
+    DWORD indices_count;
+    DWORD params_size;
+    DWORD params_offset;
+    DWORD declaration_size; // number of elements including D3DDECL_END()
+    DWORD declaration_offset;
+    DWORD vertices_offset;
+    DWORD indices_offset;
+    DWORD clusters_count;
+    DWORD clusters_offset;
+    DWORD lods_count;       // at least one level: the whole mesh
+    DWORD lods_offset;
+    DWORD vertices_code_size; // sizes of the encoded blobs
+    DWORD indices_code_size;
+    DWORD palettes_count;
+    DWORD palettes_offset;
+};
+
+// A mesh from the cache (MESH_CACHE_DIRECTORY), mapped into memory: clusters, levels and palettes are used in place,
+// so are vertices and indices stored raw. Encoded indices are decoded from the mapping when the mesh is loaded.
+// Encoded vertices are only checked then: as a VertexSource the mesh decodes them straight into the locked streams
+// of a model, and get_vertices() decodes them into memory when they are needed on the CPU too (e.g. for software deformation).
+// If there is no such mesh in the cache (or it is stale), the caller generates it and calls store():
+// after that get_vertices() and get_indices() return the generated arrays.
+// Counts are stored in the file too, so the caller need not know them before loading.
+// A mesh is a chain of levels of detail (see lod.h); the finest level is the first one, so it is drawn as the mesh
+// by models which do not choose levels.
+// NOTE: MESH_FILE_VERSION must be increased when any generator changes its output for the same parameters
+class CachedMesh : public VertexSource
+{
+private:
+    const MeshParams &params;
+    const D3DVERTEXELEMENT9 *declaration;
+    unsigned vertex_size;
+
+    char filename[MAX_PATH];
+
+    HANDLE file;
+    HANDLE mapping;
+    const BYTE *view;
+
+    mutable const void *vertices;   // generated by the caller, raw in the view or decoded from it by get_vertices()
+    const Index *indices;           // generated, raw in the view or decoded
+    mutable std::vector<DWORD> decoded_vertices; // DWORDs to be aligned for any vertex
+    std::vector<Index> decoded_indices;
+    Index vertices_count;
+    DWORD indices_count;
+    const Cluster *clusters;
+    DWORD clusters_count;
+    const LodLevel *lods;
+    DWORD lods_count;
+    const BonePalette *palettes;
+    DWORD palettes_count;
+
+    bool map();     // returns false if there is no valid cached mesh
+    bool is_valid(const MeshFileHeader &header, DWORD file_size) const;
+    bool decode(const MeshFileHeader &header); // sets raw blobs, decodes indices and checks vertices; returns false if blobs are broken
+    const MeshFileHeader &get_header() const { return *reinterpret_cast<const MeshFileHeader*>(view); }
+    bool write(); // writes the mesh of the members into the cache
+    void unmap();
+
+public:
+    CachedMesh( const MeshParams &params,
+                const D3DVERTEXELEMENT9 *declaration,
+                unsigned vertex_size );
+
+    bool is_loaded() const { return view != NULL; }
+    const void *get_vertices() const; // decodes vertices of a loaded mesh on the first call
+    const Index *get_indices() const { _ASSERT( indices != NULL ); return indices; }
+    DWORD get_indices_count() const { return indices_count; }
+    const Cluster *get_clusters() const { return clusters; }
+    DWORD get_clusters_count() const { return clusters_count; }
+    const LodLevel *get_lods() const { _ASSERT( lods != NULL ); return lods; }
+    DWORD get_lods_count() const { return lods_count; }
+    const BonePalette *get_palettes() const { return palettes; }
+    DWORD get_palettes_count() const { return palettes_count; }
+    // of the finest level
+    D3DPRIMITIVETYPE get_primitive_type() const { return static_cast<D3DPRIMITIVETYPE>( get_lods()[0].primitive_type ); }
+    DWORD get_primitives_count() const { return ::get_primitives_count( get_primitive_type(), get_lods()[0].indices_count ); }
+    template<class VertexType> const VertexType *get_vertices() const
+    {
+        _ASSERT( sizeof(VertexType) == vertex_size );
+        return static_cast<const VertexType*>( get_vertices() );
+    }
+
+    // Writes generated mesh into the cache and uses it as this mesh data (so the chain must live while the mesh is used).
+    // Returns false if writing failed: it is not an error, just the next start will be slow again
+    bool store(const MeshChain &generated);
+    // The same of a skinned mesh partitioned into palettes: the partition is stored, so a loaded mesh is not partitioned again
+    bool store(const BonePartition &partitioned);
+
+    // Overrides:
+    virtual Index get_vertices_count() const { return vertices_count; }
+    virtual void write_streams(const VertexFormat &format, void * const *res_streams) const;
+
+    ~CachedMesh();
+private:
+    // No copying!
+    CachedMesh(const CachedMesh&);
+    CachedMesh &operator=(const CachedMesh&);
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include "common.h"
+#include "Vertex.h"
+
+// Destination of a generated mesh. A generator asks it for memory of the exact size and writes vertices
+// and indices straight into it, so there is no temporary array to be copied from (see ChainSink in lod.h)
+class MeshSink
+{
+public:
+    virtual unsigned get_vertex_size() const = 0;
+    // Memory for `vertices_count' vertices and `indices_count' indices, valid until unlock()
+    virtual void *lock_vertices(Index vertices_count) = 0;
+    virtual Index *lock_indices(DWORD indices_count) = 0;
+    // The mesh is written
+    virtual void unlock(D3DPRIMITIVETYPE primitive_type) = 0;
+
+    virtual ~MeshSink() {}
+};
+
+// a helper for generators: memory for vertices of the given type
+template<class VertexType> VertexType *lock_vertices(MeshSink &sink, Index vertices_count)
+{
+    _ASSERT( sink.get_vertex_size() == sizeof(VertexType) );
+    return static_cast<VertexType*>( sink.lock_vertices( vertices_count ) );
+}
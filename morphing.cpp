@@ -0,0 +1,87 @@
+#include "morphing.h"
+#include "parallel.h"
+
+namespace
+{
+    // Everything the threads share; SSE copies of the matrices are made by each thread on its stack
+    struct MORPHING_PARAMS
+    {
+        const SoftwareColumns *vertices;
+        float final_radius;
+        float morphing_param;
+        const D3DXMATRIX *position_and_rotation;
+        const D3DXMATRIX *view;
+        const LightingConstants *lighting;
+        SoftwareColumns *res;
+    };
+
+    // Position and normal of the batch from `first' morphed by `t' (the morphing parameter in all lanes)
+    void morph_batch( const SoftwareColumns &vertices, __m128 final_radius, __m128 t, Index first,
+                      SoftwareVector &morphed_position, SoftwareVector &morphed_normal )
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const SoftwareVector position = load_vector( vertices, SOFTWARE_POSITION_X, first );
+        const SoftwareVector normal = load_vector( vertices, SOFTWARE_NORMAL_X, first );
+
+        // p*(1 + t*(R/|p| - 1))
+        const __m128 inv_length = fast_reciprocal_sqrt( dot(position, position) );
+        const __m128 quotient = _mm_add_ps( _mm_mul_ps( _mm_sub_ps( _mm_mul_ps(inv_length, final_radius), one ), t ), one );
+        morphed_position = scale( position, quotient );
+        // n + t*(p/|p| - n), normalized
+        const SoftwareVector radius_direction = scale( position, inv_length );
+        morphed_normal = add( normal, scale( subtract(radius_direction, normal), t ) );
+        morphed_normal = scale( morphed_normal, fast_reciprocal_sqrt( dot(morphed_normal, morphed_normal) ) );
+    }
+
+    void morph_batches(void *context, unsigned thread, DWORD begin, DWORD end)
+    // batches [begin, end)
+    {
+        UNREFERENCED_PARAMETER(thread);
+        const MORPHING_PARAMS &params = *static_cast<MORPHING_PARAMS*>(context);
+        const SoftwareColumns &vertices = *params.vertices;
+
+        const __m128 final_radius = _mm_set1_ps( params.final_radius );
+        const __m128 t = _mm_set1_ps( params.morphing_param );
+        const SoftwareMatrix position_and_rotation( *params.position_and_rotation );
+        const SoftwareMatrix view( *params.view );
+        const SoftwareLighting lighting( *params.lighting, true );
+
+        for( DWORD batch = begin; batch < end; ++batch )
+        {
+            const Index first = batch*SOFTWARE_BATCH_SIZE;
+            SoftwareVector morphed_position;
+            SoftwareVector morphed_normal;
+            morph_batch( vertices, final_radius, t, first, morphed_position, morphed_normal );
+
+            const SoftwareVector world_position = transform_point( position_and_rotation, morphed_position );
+            const SoftwareVector world_normal = transform_vector( position_and_rotation, morphed_normal );
+
+            __m128 color[SOFTWARE_COLOR_COMPONENTS];
+            for( unsigned i = 0; i < SOFTWARE_COLOR_COMPONENTS; ++i )
+                color[i] = _mm_loadu_ps( vertices.get_column(SOFTWARE_COLOR_R + i) + first );
+            __m128 res_position[4];
+            __m128 res_color[SOFTWARE_COLOR_COMPONENTS];
+            project( view, world_position, res_position );
+            lighting.light( world_position, world_normal, color, res_color );
+            store_output( res_position, res_color, first, *params.res );
+        }
+    }
+}
+
+void morph_vertices( const SoftwareColumns &vertices, float final_radius, float morphing_param, const D3DXMATRIX &position_and_rotation,
+                     const D3DXMATRIX &view, const LightingConstants &lighting, unsigned threads_count, SoftwareColumns &res )
+{
+    _ASSERT( vertices.get_columns_count() == SOFTWARE_VERTEX_COLUMNS );
+    _ASSERT( res.get_columns_count() == SOFTWARE_OUTPUT_COLUMNS );
+    _ASSERT( res.get_count() == vertices.get_count() );
+
+    MORPHING_PARAMS params;
+    params.vertices = &vertices;
+    params.final_radius = final_radius;
+    params.morphing_param = morphing_param;
+    params.position_and_rotation = &position_and_rotation;
+    params.view = &view;
+    params.lighting = &lighting;
+    params.res = &res;
+    parallel_for( vertices.get_batches_count(), threads_count, morph_batches, &params );
+}
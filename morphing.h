@@ -0,0 +1,12 @@
+#pragma once
+#include "common.h"
+#include "lighting.h"
+
+// morphing.vsh on the CPU (see software.h): a vertex p moves along its radius to the sphere of `final_radius'
+// as `morphing_param' goes from 0 to 1, being p*(1 + t*(final_radius/|p| - 1)), and its normal turns
+// to the radius as n + t*(p/|p| - n) normalized. Then it is moved by the position-and-rotation matrix, lit and projected.
+// 1/|p| and lengths of normals are found by fast_reciprocal_sqrt().
+// `vertices' have SOFTWARE_VERTEX_COLUMNS, `res' has SOFTWARE_OUTPUT_COLUMNS of as many vertices;
+// batches of vertices are split between `threads_count' threads (see parallel.h)
+void morph_vertices( const SoftwareColumns &vertices, float final_radius, float morphing_param, const D3DXMATRIX &position_and_rotation,
+                     const D3DXMATRIX &view, const LightingConstants &lighting, unsigned threads_count, SoftwareColumns &res );
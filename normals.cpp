@@ -0,0 +1,211 @@
+#include "normals.h"
+#include "parallel.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#include <algorithm>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+namespace
+{
+    // Everything the parallel passes share. Each thread adds triangles into its own partial sums,
+    // so no two threads write the same memory and nothing has to be locked
+    struct NORMALS_PARAMS
+    {
+        const BYTE *positions;                          // `positions_stride' bytes apart
+        unsigned positions_stride;
+        Index vertices_count;
+        const Index *indices;
+        NormalWeighting weighting;
+        float min_cos;                                  // cosine of the crease angle
+        std::vector< std::vector<D3DXVECTOR3> > partial_sums; // per thread, per vertex
+        std::vector<D3DXVECTOR3> sums;                  // of own triangles, per vertex
+        std::vector<Index> sorted_vertices;             // vertices at the same position are neighbours here...
+        std::vector<Index> copies_begin;                // ... [copies_begin[v], copies_end[v]) of them are copies of v
+        std::vector<Index> copies_end;
+        D3DXVECTOR3 *res_normals;                       // either these...
+        Vertex *res_vertices;                           // ... or normals of these are written
+    };
+
+    inline const D3DXVECTOR3 &get_position(const BYTE *positions, unsigned stride, Index vertex)
+    {
+        return *reinterpret_cast<const D3DXVECTOR3*>( positions + static_cast<size_t>(vertex)*stride );
+    }
+
+    float corner_angle(const D3DXVECTOR3 &corner, const D3DXVECTOR3 &next, const D3DXVECTOR3 &previous)
+    {
+        D3DXVECTOR3 a = next - corner;
+        D3DXVECTOR3 b = previous - corner;
+        const float lengths = D3DXVec3Length(&a)*D3DXVec3Length(&b);
+        if( lengths == 0 )
+            return 0;
+        float cos_angle = D3DXVec3Dot(&a, &b)/lengths;
+        if( cos_angle > 1.0f )
+            cos_angle = 1.0f;
+        if( cos_angle < -1.0f )
+            cos_angle = -1.0f;
+        return acos(cos_angle);
+    }
+
+    void add_triangles(void *context, unsigned thread, DWORD begin, DWORD end)
+    // of triangles [begin, end) into partial sums of the thread
+    {
+        NORMALS_PARAMS &params = *static_cast<NORMALS_PARAMS*>(context);
+        std::vector<D3DXVECTOR3> &sums = params.partial_sums[thread];
+        for( DWORD i = begin; i < end; ++i )
+        {
+            const Index *triangle = &params.indices[i*VERTICES_PER_TRIANGLE];
+            const D3DXVECTOR3 &p1 = get_position( params.positions, params.positions_stride, triangle[0] );
+            const D3DXVECTOR3 &p2 = get_position( params.positions, params.positions_stride, triangle[1] );
+            const D3DXVECTOR3 &p3 = get_position( params.positions, params.positions_stride, triangle[2] );
+            // front faces are clockwise (as tessellate() makes them); the cross product is as long as the doubled area
+            D3DXVECTOR3 edge1 = p2 - p1;
+            D3DXVECTOR3 edge2 = p3 - p1;
+            D3DXVECTOR3 normal;
+            D3DXVec3Cross(&normal, &edge2, &edge1);
+            if( params.weighting == NORMALS_BY_AREA )
+            {
+                for( unsigned j = 0; j < VERTICES_PER_TRIANGLE; ++j )
+                    sums[triangle[j]] += normal;
+            }
+            else
+            {
+                const float length = D3DXVec3Length(&normal);
+                if( length == 0 )
+                    continue;
+                normal /= length;
+                sums[triangle[0]] += normal*corner_angle( p1, p2, p3 );
+                sums[triangle[1]] += normal*corner_angle( p2, p3, p1 );
+                sums[triangle[2]] += normal*corner_angle( p3, p1, p2 );
+            }
+        }
+    }
+
+    void reduce_sums(void *context, unsigned thread, DWORD begin, DWORD end)
+    // of vertices [begin, end) from partial sums of all threads
+    {
+        UNREFERENCED_PARAMETER(thread);
+        NORMALS_PARAMS &params = *static_cast<NORMALS_PARAMS*>(context);
+        for( DWORD v = begin; v < end; ++v )
+        {
+            D3DXVECTOR3 sum(0, 0, 0);
+            for( unsigned i = 0; i < params.partial_sums.size(); ++i )
+                sum += params.partial_sums[i][v];
+            params.sums[v] = sum;
+        }
+    }
+
+    void join_copies(void *context, unsigned thread, DWORD begin, DWORD end)
+    // normals of vertices [begin, end) from sums of their copies not beyond the crease
+    {
+        UNREFERENCED_PARAMETER(thread);
+        NORMALS_PARAMS &params = *static_cast<NORMALS_PARAMS*>(context);
+        for( DWORD v = begin; v < end; ++v )
+        {
+            D3DXVECTOR3 own;
+            D3DXVec3Normalize(&own, &params.sums[v]);
+            D3DXVECTOR3 normal = params.sums[v];
+            for( Index i = params.copies_begin[v]; i < params.copies_end[v]; ++i )
+            {
+                const Index copy = params.sorted_vertices[i];
+                if( copy == v )
+                    continue;
+                D3DXVECTOR3 other;
+                D3DXVec3Normalize(&other, &params.sums[copy]);
+                if( D3DXVec3Dot(&own, &other) >= params.min_cos )
+                    normal += params.sums[copy];
+            }
+            D3DXVec3Normalize(&normal, &normal);
+            if( params.res_vertices != NULL )
+                params.res_vertices[v].set_normal( normal );
+            else
+                params.res_normals[v] = normal;
+        }
+    }
+
+    class PositionLess
+    {
+    private:
+        const BYTE *positions;
+        unsigned stride;
+    public:
+        PositionLess(const BYTE *positions, unsigned stride) : positions(positions), stride(stride) {}
+        bool operator()(Index a, Index b) const
+        {
+            const D3DXVECTOR3 &pa = get_position( positions, stride, a );
+            const D3DXVECTOR3 &pb = get_position( positions, stride, b );
+            if( pa.x != pb.x )
+                return pa.x < pb.x;
+            if( pa.y != pb.y )
+                return pa.y < pb.y;
+            return pa.z < pb.z;
+        }
+    };
+
+    void smooth_strided_normals( const BYTE *positions, unsigned positions_stride, Index vertices_count, const Index *indices, DWORD indices_count,
+                                 NormalWeighting weighting, float crease_angle, unsigned threads_count, D3DXVECTOR3 *res_normals, Vertex *res_vertices )
+    // writes either `res_normals' or normals of `res_vertices'
+    {
+        _ASSERT( indices != NULL );
+        _ASSERT( threads_count > 0 );
+        if( vertices_count == 0 )
+            return;
+
+        NORMALS_PARAMS params;
+        params.positions = positions;
+        params.positions_stride = positions_stride;
+        params.vertices_count = vertices_count;
+        params.indices = indices;
+        params.weighting = weighting;
+        params.min_cos = cos(crease_angle);
+        params.partial_sums.resize( threads_count, std::vector<D3DXVECTOR3>( vertices_count, D3DXVECTOR3(0, 0, 0) ) );
+        params.sums.resize( vertices_count );
+        params.res_normals = res_normals;
+        params.res_vertices = res_vertices;
+
+        parallel_for( indices_count/VERTICES_PER_TRIANGLE, threads_count, add_triangles, &params );
+        parallel_for( vertices_count, threads_count, reduce_sums, &params );
+        params.partial_sums.clear();
+
+        // copies of a vertex are found by sorting vertices by position
+        params.sorted_vertices.resize( vertices_count );
+        for( Index v = 0; v < vertices_count; ++v )
+            params.sorted_vertices[v] = v;
+        std::sort( params.sorted_vertices.begin(), params.sorted_vertices.end(), PositionLess(positions, positions_stride) );
+        params.copies_begin.resize( vertices_count );
+        params.copies_end.resize( vertices_count );
+        for( Index first = 0, last = 0; first < vertices_count; first = last )
+        {
+            last = first + 1;
+            while( last < vertices_count && get_position( positions, positions_stride, params.sorted_vertices[last] ) ==
+                                            get_position( positions, positions_stride, params.sorted_vertices[first] ) )
+                ++last;
+            for( Index i = first; i < last; ++i )
+            {
+                params.copies_begin[params.sorted_vertices[i]] = first;
+                params.copies_end[params.sorted_vertices[i]] = last;
+            }
+        }
+
+        parallel_for( vertices_count, threads_count, join_copies, &params );
+    }
+}
+
+void smooth_normals( const D3DXVECTOR3 *positions, Index vertices_count, const Index *indices, DWORD indices_count,
+                     NormalWeighting weighting, float crease_angle, unsigned threads_count, D3DXVECTOR3 *res_normals )
+{
+    _ASSERT( positions != NULL );
+    _ASSERT( res_normals != NULL );
+    smooth_strided_normals( reinterpret_cast<const BYTE*>(positions), sizeof(positions[0]), vertices_count, indices, indices_count,
+                            weighting, crease_angle, threads_count, res_normals, NULL );
+}
+
+void smooth_normals( Vertex *vertices, Index vertices_count, const Index *indices, DWORD indices_count,
+                     NormalWeighting weighting, float crease_angle, unsigned threads_count )
+{
+    _ASSERT( vertices != NULL );
+    smooth_strided_normals( reinterpret_cast<const BYTE*>(&vertices[0].pos), sizeof(vertices[0]), vertices_count, indices, indices_count,
+                            weighting, crease_angle, threads_count, NULL, vertices );
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "common.h"
+#include "Vertex.h"
+
+// How much a triangle adds to normals of its vertices
+enum NormalWeighting
+{
+    NORMALS_BY_AREA,    // its area: big triangles dominate
+    NORMALS_BY_ANGLE,   // its angle at the vertex: does not depend on how the surface is tessellated
+};
+
+// Smooth normals of an indexed triangle list: a normal of a vertex is the weighted sum of normals of triangles around it.
+// Vertices at the same position are one point of the surface (e.g. copies on seams of tessellated faces):
+// a vertex takes triangles of another copy too, if their sum is at most `crease_angle' from the sum of its own triangles.
+// So a vertex has one normal and a crease can separate only different copies: 0 keeps them all flat, D3DX_PI smooths everything.
+// The work is split between `threads_count' threads (see parallel.h); `res_normals' are `vertices_count' unit vectors
+void smooth_normals( const D3DXVECTOR3 *positions, Index vertices_count, const Index *indices, DWORD indices_count,
+                     NormalWeighting weighting, float crease_angle, unsigned threads_count, D3DXVECTOR3 *res_normals );
+// The same of positions of the vertices: their normals are set in place, so generators need no arrays of positions and normals
+void smooth_normals( Vertex *vertices, Index vertices_count, const Index *indices, DWORD indices_count,
+                     NormalWeighting weighting, float crease_angle, unsigned threads_count );
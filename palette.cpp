@@ -0,0 +1,232 @@
+#include "palette.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <algorithm>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+namespace
+{
+    const Index NOT_COPIED = static_cast<Index>(-1);
+    const int NO_SLOT = -1;
+
+    // Adds bones of non-zero weights of the vertex to `bones' (which has every bone once)
+    void add_vertex_bones(const SkinningVertex &vertex, std::vector<BYTE> &bones)
+    {
+        for( unsigned i = 0; i < BONE_INFLUENCES_COUNT; ++i )
+        {
+            if( vertex.weights[i] != 0 && std::find( bones.begin(), bones.end(), vertex.bones[i] ) == bones.end() )
+                bones.push_back( vertex.bones[i] );
+        }
+    }
+
+    void add_indices_bones( const SkinningVertex *vertices, Index vertices_count, const Index *indices, DWORD indices_count,
+                            Index base_vertex, std::vector<BYTE> &bones )
+    {
+        for( DWORD i = 0; i < indices_count; ++i )
+        {
+            const Index vertex = base_vertex + indices[i];
+            _ASSERT( vertex < vertices_count );
+            UNREFERENCED_PARAMETER(vertices_count);
+            add_vertex_bones( vertices[vertex], bones );
+        }
+    }
+
+    // Not counting degenerate triangles (as Cluster::triangles_count)
+    DWORD count_triangles(const Index *indices, DWORD indices_count, D3DPRIMITIVETYPE primitive_type)
+    {
+        const DWORD step = ( primitive_type == D3DPT_TRIANGLESTRIP ) ? 1 : VERTICES_PER_TRIANGLE;
+        DWORD count = 0;
+        for( DWORD i = 0; i + VERTICES_PER_TRIANGLE <= indices_count; i += step )
+        {
+            if( indices[i] != indices[i + 1] && indices[i + 1] != indices[i + 2] && indices[i] != indices[i + 2] )
+                ++count;
+        }
+        return count;
+    }
+
+    // Splits the cluster into pieces whose bones fit into a palette, appends them to `pieces'
+    void split_cluster( const SkinningVertex *vertices, Index vertices_count, const Index *indices, const Cluster &cluster,
+                        D3DPRIMITIVETYPE primitive_type, std::vector<Cluster> &pieces )
+    {
+        // a strip is cut before even triangles only, so that its pieces keep the order of vertices of their triangles;
+        // pieces of a strip share 2 indices
+        const bool strip = ( primitive_type == D3DPT_TRIANGLESTRIP );
+        const DWORD step = strip ? 2 : VERTICES_PER_TRIANGLE;
+        const DWORD overlap = strip ? 2 : 0;
+        const Index *cluster_indices = indices + cluster.first_index;
+
+        Cluster piece = cluster;
+        std::vector<BYTE> bones;
+        std::vector<BYTE> more_bones;
+        for( DWORD i = 0; i + overlap < cluster.indices_count; i += step )
+        {
+            // the next triangle of a list, or the next two triangles of a strip
+            const DWORD end = ( i + step + overlap < cluster.indices_count ) ? i + step + overlap : cluster.indices_count;
+            more_bones = bones;
+            add_indices_bones( vertices, vertices_count, cluster_indices + i, end - i, cluster.base_vertex, more_bones );
+            if( more_bones.size() > BONE_PALETTE_SIZE )
+            {
+                piece.indices_count = cluster.first_index + i + overlap - piece.first_index;
+                piece.triangles_count = count_triangles( indices + piece.first_index, piece.indices_count, primitive_type );
+                pieces.push_back( piece );
+                piece.first_index = cluster.first_index + i;
+                more_bones.clear();
+                add_indices_bones( vertices, vertices_count, cluster_indices + i, end - i, cluster.base_vertex, more_bones );
+            }
+            bones.swap( more_bones );
+        }
+        piece.indices_count = cluster.first_index + cluster.indices_count - piece.first_index;
+        piece.triangles_count = count_triangles( indices + piece.first_index, piece.indices_count, primitive_type );
+        pieces.push_back( piece );
+    }
+
+    // The run of pieces with the palette: appends copies of their vertices and indices to `res'
+    void copy_run( const SkinningVertex *vertices, const Index *indices, const Cluster *pieces, DWORD pieces_count,
+                   BonePalette &palette, std::vector<Index> &copies, BonePartition &res )
+    {
+        int slots[MAX_BONES_COUNT];
+        for( unsigned i = 0; i < MAX_BONES_COUNT; ++i )
+            slots[i] = NO_SLOT;
+        for( unsigned i = 0; i < palette.bones_count; ++i )
+            slots[palette.bones[i]] = i;
+
+        const Index first_vertex = get_count( res.vertices.size() );
+        std::vector<Index> copied; // vertices of the mesh copied for the run, to clear `copies' after it
+        for( DWORD i = 0; i < pieces_count; ++i )
+        {
+            Cluster piece = pieces[i];
+            const DWORD first_index = get_count( res.indices.size() );
+            for( DWORD j = 0; j < piece.indices_count; ++j )
+            {
+                const Index vertex = piece.base_vertex + indices[piece.first_index + j];
+                if( copies[vertex] == NOT_COPIED )
+                {
+                    SkinningVertex copy = vertices[vertex];
+                    for( unsigned k = 0; k < BONE_INFLUENCES_COUNT; ++k )
+                    {
+                        // a bone of zero weight may be out of the palette: any slot does
+                        const int slot = ( copy.weights[k] != 0 ) ? slots[copy.bones[k]] : 0;
+                        _ASSERT( slot != NO_SLOT );
+                        copy.bones[k] = static_cast<BYTE>( slot );
+                    }
+                    copies[vertex] = get_count( res.vertices.size() ) - first_vertex;
+                    copied.push_back( vertex );
+                    res.vertices.push_back( copy );
+                }
+                res.indices.push_back( copies[vertex] );
+            }
+            piece.first_index = first_index;
+            piece.base_vertex = first_vertex;
+            res.clusters.push_back( piece );
+        }
+        const Index run_vertices_count = get_count( res.vertices.size() ) - first_vertex;
+        for( DWORD i = 0; i < pieces_count; ++i )
+            res.clusters[res.clusters.size() - 1 - i].vertices_count = run_vertices_count;
+        palette.first_vertex = first_vertex;
+        palette.vertices_count = run_vertices_count;
+        for( unsigned i = 0; i < copied.size(); ++i )
+            copies[copied[i]] = NOT_COPIED;
+    }
+}
+
+void partition_bones( const SkinningVertex *vertices, Index vertices_count, const Index *indices, D3DPRIMITIVETYPE primitive_type,
+                      const Cluster *clusters, unsigned clusters_count, const LodLevel *lods, unsigned lods_count,
+                      BonePartition &res )
+{
+    _ASSERT( vertices != NULL );
+    _ASSERT( indices != NULL );
+    _ASSERT( clusters != NULL || clusters_count == 0 );
+    _ASSERT( lods != NULL || lods_count == 0 );
+    _ASSERT( BONE_PALETTE_SIZE >= 4*BONE_INFLUENCES_COUNT ); // two triangles of a strip always fit
+
+    res.vertices.clear();
+    res.indices.clear();
+    res.clusters.clear();
+    res.lods.assign( lods, lods + lods_count );
+    res.palettes.clear();
+
+    // levels as ranges of clusters: clusters out of levels are the last one
+    std::vector<DWORD> level_ends;
+    std::vector<D3DPRIMITIVETYPE> level_types;
+    for( unsigned i = 0; i < lods_count; ++i )
+    {
+        _ASSERT( lods[i].first_cluster == ( i == 0 ? 0 : level_ends.back() ) ); // levels are in the order of their clusters
+        level_ends.push_back( lods[i].first_cluster + lods[i].clusters_count );
+        level_types.push_back( static_cast<D3DPRIMITIVETYPE>( lods[i].primitive_type ) );
+    }
+    if( level_ends.empty() || level_ends.back() < clusters_count )
+    {
+        level_ends.push_back( clusters_count );
+        level_types.push_back( primitive_type );
+    }
+
+    std::vector<Index> copies( vertices_count, NOT_COPIED ); // copies of vertices of the mesh in the current run
+    DWORD first_cluster = 0;
+    for( unsigned level = 0; level < level_ends.size(); ++level )
+    {
+        std::vector<Cluster> pieces;
+        for( DWORD i = first_cluster; i < level_ends[level]; ++i )
+            split_cluster( vertices, vertices_count, indices, clusters[i], level_types[level], pieces );
+        first_cluster = level_ends[level];
+
+        const DWORD level_first_cluster = get_count( res.clusters.size() );
+        const Index level_first_vertex = get_count( res.vertices.size() );
+        const DWORD level_first_index = get_count( res.indices.size() );
+        // runs of pieces taken while their bones fit
+        DWORD run_begin = 0;
+        std::vector<BYTE> bones;
+        std::vector<BYTE> more_bones;
+        for( DWORD i = 0; i <= pieces.size(); ++i )
+        {
+            if( i < pieces.size() )
+            {
+                more_bones = bones;
+                add_indices_bones( vertices, vertices_count, indices + pieces[i].first_index, pieces[i].indices_count,
+                                   pieces[i].base_vertex, more_bones );
+                if( more_bones.size() <= BONE_PALETTE_SIZE )
+                {
+                    bones.swap( more_bones );
+                    continue;
+                }
+            }
+            if( i == run_begin )
+                continue; // no pieces
+            BonePalette palette = BonePalette();
+            palette.first_cluster = get_count( res.clusters.size() );
+            palette.clusters_count = i - run_begin;
+            palette.bones_count = static_cast<unsigned>( bones.size() );
+            std::copy( bones.begin(), bones.end(), palette.bones );
+            copy_run( vertices, indices, &pieces[run_begin], i - run_begin, palette, copies, res );
+            res.palettes.push_back( palette );
+
+            // the piece which did not fit starts the next run
+            run_begin = i;
+            bones.clear();
+            if( i < pieces.size() )
+                add_indices_bones( vertices, vertices_count, indices + pieces[i].first_index, pieces[i].indices_count,
+                                   pieces[i].base_vertex, bones );
+        }
+
+        if( level < lods_count )
+        {
+            LodLevel &lod = res.lods[level];
+            lod.first_cluster = level_first_cluster;
+            lod.clusters_count = get_count( res.clusters.size() ) - level_first_cluster;
+            lod.first_vertex = level_first_vertex;
+            lod.vertices_count = get_count( res.vertices.size() ) - level_first_vertex;
+            lod.first_index = level_first_index;
+            lod.indices_count = get_count( res.indices.size() ) - level_first_index;
+        }
+    }
+}
+
+void partition_bones( const MeshChain &chain, BonePartition &res )
+{
+    _ASSERT( chain.get_levels_count() > 0 );
+    // every cluster of a chain is in a level, so the primitive type of clusters out of levels does not matter
+    partition_bones( static_cast<const SkinningVertex*>( chain.get_vertices() ), chain.get_vertices_count(), chain.get_indices(),
+                     static_cast<D3DPRIMITIVETYPE>( chain.get_levels()[0].primitive_type ), chain.get_clusters(), chain.get_clusters_count(),
+                     chain.get_levels(), chain.get_levels_count(), res );
+}
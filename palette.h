@@ -0,0 +1,50 @@
+#pragma once
+#include "main.h"
+#include "Vertex.h"
+#include "clusters.h"
+#include "lod.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// Skinning with more bones than constant registers: skinning shaders have room for a palette of BONE_PALETTE_SIZE bones
+// (see SHADER_REG_BONE_PALETTE). A bone takes REGISTERS_PER_BONE registers: matrices of bones are affine, so their last row
+// (0 0 0 1) is not stored and the shaders use m4x3. A mesh is partitioned offline into runs of clusters whose bones fit into
+// a palette; vertices keep indices of bones in the palette of their run, and each run is drawn after its palette is set.
+
+// They must be macros, not constants, because they must be known at compile-time (they are used for array initialization in another module)
+#define BONE_PALETTE_SIZE 18 // c45-c98 of skinning shaders
+#define REGISTERS_PER_BONE 3
+
+struct BonePalette
+{
+    DWORD first_cluster;            // clusters drawn with the palette...
+    DWORD clusters_count;
+    Index first_vertex;             // ... the vertices of their run...
+    Index vertices_count;
+    unsigned bones_count;
+    BYTE bones[BONE_PALETTE_SIZE];  // ... and bones of the mesh in its slots
+};
+
+// A mesh partitioned into palettes: the arguments of Model with its clusters and levels of detail
+struct BonePartition
+{
+    std::vector<SkinningVertex> vertices;
+    std::vector<Index> indices;
+    std::vector<Cluster> clusters;
+    std::vector<LodLevel> lods;
+    std::vector<BonePalette> palettes;
+};
+
+// Partitions the clusters of a mesh into runs whose bones (of non-zero weights) fit into a palette. Clusters with too many bones
+// are split into pieces first (bounds of a piece are of its cluster). Runs do not cross levels of detail; vertices of each run
+// are copied with indices of bones in its palette, and its clusters get copies of their indices relative to these vertices.
+// `primitive_type' is of the clusters which are not in levels; levels are drawn by their clusters only
+void partition_bones( const SkinningVertex *vertices, Index vertices_count, const Index *indices, D3DPRIMITIVETYPE primitive_type,
+                      const Cluster *clusters, unsigned clusters_count, const LodLevel *lods, unsigned lods_count,
+                      BonePartition &res );
+// The same of a generated chain of levels of SkinningVertex (see lod.h): it is partitioned once and stored in the mesh cache
+void partition_bones( const MeshChain &chain, BonePartition &res );
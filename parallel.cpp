@@ -0,0 +1,345 @@
+#include "parallel.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+    const unsigned MAX_THREADS_COUNT = MAXIMUM_WAIT_OBJECTS;
+    typedef HANDLE Thread;
+#else
+    const unsigned MAX_THREADS_COUNT = 64;
+    typedef pthread_t Thread;
+#endif
+
+    struct THREAD_PARAMS
+    {
+        ParallelTask task;
+        void *context;
+        unsigned thread;
+        DWORD begin;
+        DWORD end;
+    };
+
+    void run_task(const THREAD_PARAMS &params)
+    {
+        params.task( params.context, params.thread, params.begin, params.end );
+    }
+
+#ifdef _WIN32
+    DWORD WINAPI thread_proc(LPVOID param)
+    {
+        run_task( *static_cast<const THREAD_PARAMS*>(param) );
+        return 0;
+    }
+
+    bool start_thread(THREAD_PARAMS &params, Thread &res)
+    {
+        res = CreateThread( NULL, 0, thread_proc, &params, 0, NULL );
+        return res != NULL;
+    }
+
+    void join_threads(Thread *threads, unsigned count)
+    {
+        if( count != 0 )
+            WaitForMultipleObjects( count, threads, TRUE, INFINITE );
+        for( unsigned i = 0; i < count; ++i )
+            CloseHandle( threads[i] );
+    }
+#else
+    void *thread_proc(void *param)
+    {
+        run_task( *static_cast<const THREAD_PARAMS*>(param) );
+        return NULL;
+    }
+
+    bool start_thread(THREAD_PARAMS &params, Thread &res)
+    {
+        return pthread_create( &res, NULL, thread_proc, &params ) == 0;
+    }
+
+    void join_threads(Thread *threads, unsigned count)
+    {
+        for( unsigned i = 0; i < count; ++i )
+            pthread_join( threads[i], NULL );
+    }
+#endif
+}
+
+// The threads of a WorkerPool: each waits for its range of the current parallel_for(), does it and reports it done
+class Workers
+{
+private:
+    struct WORKER_PARAMS
+    {
+        Workers *workers;
+        unsigned index;
+    };
+
+    unsigned count; // started threads, besides the calling one
+    Thread threads[MAX_THREADS_COUNT];
+    WORKER_PARAMS worker_params[MAX_THREADS_COUNT];
+    THREAD_PARAMS params[MAX_THREADS_COUNT]; // ranges of the current call, one per worker
+    volatile bool quitting;
+#ifdef _WIN32
+    volatile LONG busy; // with a call: a nested one (or one from another thread) starts its own threads
+    HANDLE start_events[MAX_THREADS_COUNT];
+    HANDLE done_events[MAX_THREADS_COUNT];
+
+    static DWORD WINAPI worker_proc(LPVOID param);
+#else
+    pthread_mutex_t busy;
+    pthread_mutex_t mutex;
+    pthread_cond_t started;
+    pthread_cond_t done;
+    unsigned generation;   // of calls: workers wait for it to change
+    unsigned active_count; // workers with a range in the current call
+    unsigned remaining;    // ... which have not done it yet
+
+    static void *worker_proc(void *param);
+#endif
+    void work(unsigned index);
+public:
+    explicit Workers(unsigned threads_count);
+    // Does `ranges_count' ranges in parallel, the calling thread does the first one and those there are no workers for.
+    // Returns false (having done nothing) if the workers are busy
+    bool run(const THREAD_PARAMS *ranges, unsigned ranges_count);
+    ~Workers();
+};
+
+namespace
+{
+    Workers *pool_workers = NULL; // of the existing WorkerPool
+}
+
+#ifdef _WIN32
+Workers::Workers(unsigned threads_count)
+: count(0), quitting(false), busy(0)
+{
+    _ASSERT( threads_count > 0 && threads_count <= MAX_THREADS_COUNT );
+    for( unsigned i = 0; i + 1 < threads_count; ++i )
+    {
+        worker_params[i].workers = this;
+        worker_params[i].index = i;
+        start_events[i] = CreateEvent( NULL, FALSE, FALSE, NULL );
+        done_events[i] = CreateEvent( NULL, FALSE, FALSE, NULL );
+        threads[i] = NULL;
+        if( start_events[i] != NULL && done_events[i] != NULL )
+            threads[i] = CreateThread( NULL, 0, worker_proc, &worker_params[i], 0, NULL );
+        if( threads[i] == NULL )
+        {
+            if( start_events[i] != NULL )
+                CloseHandle( start_events[i] );
+            if( done_events[i] != NULL )
+                CloseHandle( done_events[i] );
+            break;
+        }
+        ++count;
+    }
+}
+
+DWORD WINAPI Workers::worker_proc(LPVOID param)
+{
+    const WORKER_PARAMS *worker = static_cast<const WORKER_PARAMS*>(param);
+    worker->workers->work( worker->index );
+    return 0;
+}
+
+void Workers::work(unsigned index)
+{
+    for( ;; )
+    {
+        WaitForSingleObject( start_events[index], INFINITE );
+        if( quitting )
+            return;
+        run_task( params[index] );
+        SetEvent( done_events[index] );
+    }
+}
+
+bool Workers::run(const THREAD_PARAMS *ranges, unsigned ranges_count)
+{
+    if( InterlockedCompareExchange( &busy, 1, 0 ) != 0 )
+        return false;
+    const unsigned workers_used = ( ranges_count - 1 < count ) ? ranges_count - 1 : count;
+    for( unsigned i = 0; i < workers_used; ++i )
+    {
+        params[i] = ranges[i + 1];
+        SetEvent( start_events[i] );
+    }
+    run_task( ranges[0] );
+    for( unsigned i = workers_used + 1; i < ranges_count; ++i )
+        run_task( ranges[i] );
+    if( workers_used != 0 )
+        WaitForMultipleObjects( workers_used, done_events, TRUE, INFINITE );
+    InterlockedExchange( &busy, 0 );
+    return true;
+}
+
+Workers::~Workers()
+{
+    quitting = true;
+    for( unsigned i = 0; i < count; ++i )
+        SetEvent( start_events[i] );
+    join_threads( threads, count );
+    for( unsigned i = 0; i < count; ++i )
+    {
+        CloseHandle( start_events[i] );
+        CloseHandle( done_events[i] );
+    }
+}
+#else
+Workers::Workers(unsigned threads_count)
+: count(0), quitting(false), generation(0), active_count(0), remaining(0)
+{
+    _ASSERT( threads_count > 0 && threads_count <= MAX_THREADS_COUNT );
+    pthread_mutex_init( &busy, NULL );
+    pthread_mutex_init( &mutex, NULL );
+    pthread_cond_init( &started, NULL );
+    pthread_cond_init( &done, NULL );
+    for( unsigned i = 0; i + 1 < threads_count; ++i )
+    {
+        worker_params[i].workers = this;
+        worker_params[i].index = i;
+        if( pthread_create( &threads[i], NULL, worker_proc, &worker_params[i] ) != 0 )
+            break;
+        ++count;
+    }
+}
+
+void *Workers::worker_proc(void *param)
+{
+    const WORKER_PARAMS *worker = static_cast<const WORKER_PARAMS*>(param);
+    worker->workers->work( worker->index );
+    return NULL;
+}
+
+void Workers::work(unsigned index)
+{
+    unsigned seen_generation = 0;
+    for( ;; )
+    {
+        pthread_mutex_lock( &mutex );
+        while( generation == seen_generation && !quitting )
+            pthread_cond_wait( &started, &mutex );
+        const bool quit = quitting;
+        const bool active = index < active_count;
+        seen_generation = generation;
+        pthread_mutex_unlock( &mutex );
+        if( quit )
+            return;
+        if( !active )
+            continue;
+
+        run_task( params[index] );
+        pthread_mutex_lock( &mutex );
+        if( --remaining == 0 )
+            pthread_cond_signal( &done );
+        pthread_mutex_unlock( &mutex );
+    }
+}
+
+bool Workers::run(const THREAD_PARAMS *ranges, unsigned ranges_count)
+{
+    if( pthread_mutex_trylock( &busy ) != 0 )
+        return false;
+    const unsigned workers_used = ( ranges_count - 1 < count ) ? ranges_count - 1 : count;
+    pthread_mutex_lock( &mutex );
+    for( unsigned i = 0; i < workers_used; ++i )
+        params[i] = ranges[i + 1];
+    active_count = workers_used;
+    remaining = workers_used;
+    ++generation;
+    pthread_cond_broadcast( &started );
+    pthread_mutex_unlock( &mutex );
+
+    run_task( ranges[0] );
+    for( unsigned i = workers_used + 1; i < ranges_count; ++i )
+        run_task( ranges[i] );
+
+    pthread_mutex_lock( &mutex );
+    while( remaining != 0 )
+        pthread_cond_wait( &done, &mutex );
+    pthread_mutex_unlock( &mutex );
+    pthread_mutex_unlock( &busy );
+    return true;
+}
+
+Workers::~Workers()
+{
+    pthread_mutex_lock( &mutex );
+    quitting = true;
+    pthread_cond_broadcast( &started );
+    pthread_mutex_unlock( &mutex );
+    join_threads( threads, count );
+    pthread_cond_destroy( &done );
+    pthread_cond_destroy( &started );
+    pthread_mutex_destroy( &mutex );
+    pthread_mutex_destroy( &busy );
+}
+#endif
+
+WorkerPool::WorkerPool(unsigned threads_count)
+: workers(new Workers(threads_count))
+{
+    _ASSERT( pool_workers == NULL );
+    pool_workers = workers;
+}
+
+WorkerPool::~WorkerPool()
+{
+    pool_workers = NULL;
+    delete workers;
+}
+
+unsigned get_threads_count()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo( &info );
+    unsigned threads_count = static_cast<unsigned>( info.dwNumberOfProcessors );
+#else
+    const long processors_count = sysconf( _SC_NPROCESSORS_ONLN );
+    unsigned threads_count = ( processors_count > 0 ) ? static_cast<unsigned>( processors_count ) : 1;
+#endif
+    if( threads_count == 0 )
+        threads_count = 1;
+    if( threads_count > MAX_THREADS_COUNT )
+        threads_count = MAX_THREADS_COUNT;
+    return threads_count;
+}
+
+void parallel_for(DWORD items_count, unsigned threads_count, ParallelTask task, void *context)
+{
+    _ASSERT( task != NULL );
+    _ASSERT( threads_count > 0 && threads_count <= MAX_THREADS_COUNT );
+
+    THREAD_PARAMS params[MAX_THREADS_COUNT];
+    Thread threads[MAX_THREADS_COUNT];
+    unsigned started_count = 0;
+    for( unsigned i = 0; i < threads_count; ++i )
+    {
+        params[i].task = task;
+        params[i].context = context;
+        params[i].thread = i;
+        params[i].begin = static_cast<DWORD>( static_cast<DWORD64>(items_count)*i/threads_count );
+        params[i].end = static_cast<DWORD>( static_cast<DWORD64>(items_count)*(i + 1)/threads_count );
+    }
+    if( pool_workers != NULL && pool_workers->run( params, threads_count ) )
+        return;
+
+    for( unsigned i = 1; i < threads_count; ++i )
+    {
+        if( start_thread( params[i], threads[started_count] ) )
+            ++started_count;
+        else
+            run_task( params[i] );
+    }
+
+    run_task( params[0] );
+
+    join_threads( threads, started_count );
+}
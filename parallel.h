@@ -0,0 +1,32 @@
+#pragma once
+#include "common.h"
+
+// A part of a work: items [begin, end) done by the thread number `thread' (from 0 to threads count - 1).
+// It must not throw: an exception cannot leave a thread
+typedef void (*ParallelTask)(void *context, unsigned thread, DWORD begin, DWORD end);
+
+// Number of threads to split a work between: one per logical processor
+unsigned get_threads_count();
+
+// Splits `items_count' items into `threads_count' equal ranges and does them in parallel, the calling thread
+// does the first one. Returns when all of them are done. If a thread cannot be started, its range is done by the calling thread.
+// Threads are those of the WorkerPool if one exists and is not busy with another parallel_for(), else they are started for the call
+void parallel_for(DWORD items_count, unsigned threads_count, ParallelTask task, void *context);
+
+class Workers; // see parallel.cpp
+
+// Threads for parallel_for() started once: starting and joining threads costs tens of microseconds, as much as deforming
+// a small model, so a program calling parallel_for() every frame keeps a pool for its lifetime.
+// `threads_count' includes the calling thread, as in parallel_for(). Only one pool may exist at a time
+class WorkerPool
+{
+private:
+    Workers *workers;
+public:
+    explicit WorkerPool(unsigned threads_count);
+    ~WorkerPool();
+private:
+    // No copying!
+    WorkerPool(const WorkerPool&);
+    WorkerPool &operator=(const WorkerPool&);
+};
@@ -1,26 +1,26 @@
 #include "plane.h"
 
 const int PLANE_STEPS_PER_HALF_SIDE = 300;
-const Index PLANE_VERTICES_COUNT = (2*PLANE_STEPS_PER_HALF_SIDE + 1)*(2*PLANE_STEPS_PER_HALF_SIDE + 1);
-const DWORD PLANE_INDICES_COUNT = 2*VERTICES_PER_TRIANGLE*(2*PLANE_STEPS_PER_HALF_SIDE)*(2*PLANE_STEPS_PER_HALF_SIDE);
+const D3DXVECTOR3 PLANE_NORMAL(0, 0, 1);
 
-void plane(float length, float width, Vertex *res_vertices, Index *res_indices, D3DCOLOR color)
+void plane(float length, float width, Vertex *res_vertices, Index *res_indices, D3DCOLOR color,
+           int steps_per_half_side /*= PLANE_STEPS_PER_HALF_SIDE*/)
 {
     Index vertex = 0; // current vertex
     DWORD index = 0; // current index
-    _ASSERT(PLANE_STEPS_PER_HALF_SIDE != 0);
+    _ASSERT(steps_per_half_side != 0);
 
-    const float x_step = length/(2*PLANE_STEPS_PER_HALF_SIDE);
-    const float y_step = width/(2*PLANE_STEPS_PER_HALF_SIDE);
-    const Index vertices_in_line = (2*PLANE_STEPS_PER_HALF_SIDE + 1);
-    D3DXVECTOR3 normal(0, 0, 1);
+    const float x_step = length/(2*steps_per_half_side);
+    const float y_step = width/(2*steps_per_half_side);
+    const Index vertices_in_line = (2*steps_per_half_side + 1);
+    const D3DXVECTOR3 &normal = PLANE_NORMAL;
 
-    for( int i = -PLANE_STEPS_PER_HALF_SIDE; i <= PLANE_STEPS_PER_HALF_SIDE; ++i )
+    for( int i = -steps_per_half_side; i <= steps_per_half_side; ++i )
     {
-        for( int j = -PLANE_STEPS_PER_HALF_SIDE; j <= PLANE_STEPS_PER_HALF_SIDE; ++j )
+        for( int j = -steps_per_half_side; j <= steps_per_half_side; ++j )
         {
             res_vertices[vertex] = Vertex( D3DXVECTOR3( x_step*i, y_step*j, 0), color, normal);
-            if( i != -PLANE_STEPS_PER_HALF_SIDE && j != -PLANE_STEPS_PER_HALF_SIDE)
+            if( i != -steps_per_half_side && j != -steps_per_half_side)
             {
                 // if not first line and column
                 add_triangle(vertex, vertex-1, vertex-1-vertices_in_line, res_indices, index);
@@ -30,3 +30,45 @@ void plane(float length, float width, Vertex *res_vertices, Index *res_indices,
         }
     }
 }
+
+void plane(const PlaneDesc &desc, MeshSink &sink)
+{
+    Vertex *res_vertices = lock_vertices<Vertex>( sink, desc.vertices_count() );
+    Index *res_indices = sink.lock_indices( desc.indices_count() );
+    plane( desc.length, desc.width, res_vertices, res_indices, desc.color, desc.steps_per_half_side );
+    sink.unlock( desc.primitive_type() );
+}
+
+void plane_chunk(float x, float y, float side, Index cells, Vertex *res_vertices, Index *res_indices, D3DCOLOR color)
+{
+    Index vertex = 0; // current vertex
+    DWORD index = 0; // current index
+    _ASSERT(cells != 0);
+
+    const float step = side/cells;
+    const Index vertices_in_line = cells + 1;
+    const D3DXVECTOR3 &normal = PLANE_NORMAL;
+
+    for( Index i = 0; i <= cells; ++i )
+    {
+        for( Index j = 0; j <= cells; ++j )
+        {
+            res_vertices[vertex] = Vertex( D3DXVECTOR3( x + step*i, y + step*j, 0), color, normal);
+            if( i != 0 && j != 0 )
+            {
+                // if not first line and column
+                add_triangle(vertex, vertex-1, vertex-1-vertices_in_line, res_indices, index);
+                add_triangle(vertex, vertex-1-vertices_in_line, vertex-vertices_in_line, res_indices, index);
+            }
+            ++vertex;
+        }
+    }
+}
+
+void plane_chunk(const PlaneChunkDesc &desc, MeshSink &sink)
+{
+    Vertex *res_vertices = lock_vertices<Vertex>( sink, desc.vertices_count() );
+    Index *res_indices = sink.lock_indices( desc.indices_count() );
+    plane_chunk( desc.x, desc.y, desc.side, desc.cells, res_vertices, res_indices, desc.color );
+    sink.unlock( desc.primitive_type() );
+}
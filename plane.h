@@ -1,9 +1,75 @@
 #pragma once
-#include "main.h"
+#include "common.h"
 #include "Vertex.h"
+#include "mesh_sink.h"
 
 extern const int PLANE_STEPS_PER_HALF_SIDE;
-extern const Index PLANE_VERTICES_COUNT;
-extern const DWORD PLANE_INDICES_COUNT;
+// Planes are written at z = 0 facing +z
+extern const D3DXVECTOR3 PLANE_NORMAL;
 
-void plane(float length, float width, Vertex *res_vertices, Index *res_indices, D3DCOLOR color);
+// Sizes of big grids are counted in 64 bits (see get_count())
+inline Index plane_vertices_count(int steps_per_half_side)
+{
+    const DWORD64 side_vertices = 2*static_cast<DWORD64>(steps_per_half_side) + 1;
+    return get_count( side_vertices*side_vertices );
+}
+inline DWORD plane_indices_count(int steps_per_half_side)
+{
+    const DWORD64 side_cells = 2*static_cast<DWORD64>(steps_per_half_side);
+    return get_count( 2*VERTICES_PER_TRIANGLE*side_cells*side_cells );
+}
+
+void plane(float length, float width, Vertex *res_vertices, Index *res_indices, D3DCOLOR color,
+           int steps_per_half_side = PLANE_STEPS_PER_HALF_SIDE);
+
+// Everything the plane depends on, with its sizes
+struct PlaneDesc
+{
+    float length;
+    float width;
+    D3DCOLOR color;
+    int steps_per_half_side;
+
+    PlaneDesc(float length, float width, D3DCOLOR color, int steps_per_half_side = PLANE_STEPS_PER_HALF_SIDE)
+    : length(length), width(width), color(color), steps_per_half_side(steps_per_half_side) {}
+
+    Index vertices_count() const { return plane_vertices_count(steps_per_half_side); }
+    DWORD indices_count() const { return plane_indices_count(steps_per_half_side); }
+    D3DPRIMITIVETYPE primitive_type() const { return D3DPT_TRIANGLELIST; }
+};
+
+// The same written into the sink
+void plane(const PlaneDesc &desc, MeshSink &sink);
+
+// A square chunk of a plane grid with `cells' cells along each side. Chunks do not share vertices,
+// and indices of chunks with equal numbers of cells are equal
+inline Index plane_chunk_vertices_count(Index cells)
+{
+    return get_count( (static_cast<DWORD64>(cells) + 1)*(cells + 1) );
+}
+inline DWORD plane_chunk_indices_count(Index cells)
+{
+    return get_count( 2*VERTICES_PER_TRIANGLE*static_cast<DWORD64>(cells)*cells );
+}
+
+// Writes the chunk with the corner (x, y), triangulated like plane()
+void plane_chunk(float x, float y, float side, Index cells, Vertex *res_vertices, Index *res_indices, D3DCOLOR color);
+
+struct PlaneChunkDesc
+{
+    float x;
+    float y;
+    float side;
+    Index cells;
+    D3DCOLOR color;
+
+    PlaneChunkDesc(float x, float y, float side, Index cells, D3DCOLOR color)
+    : x(x), y(y), side(side), cells(cells), color(color) {}
+
+    Index vertices_count() const { return plane_chunk_vertices_count(cells); }
+    DWORD indices_count() const { return plane_chunk_indices_count(cells); }
+    D3DPRIMITIVETYPE primitive_type() const { return D3DPT_TRIANGLELIST; }
+};
+
+// The same written into the sink
+void plane_chunk(const PlaneChunkDesc &desc, MeshSink &sink);
@@ -0,0 +1,254 @@
+#pragma once
+
+// Types of the modules which need no device: vertices (Vertex.h), generators of meshes and their simplification
+// (simplify.h), software vertex processing (software.h), shader assembly (shader_asm.h), its optimizer and its interpreters.
+// With the DirectX SDK they are the types of D3D and D3DX; elsewhere (the tests of tests/ on Linux) they are defined here,
+// as far as these modules use them, so that the modules build without D3D. Nothing here creates or needs a device
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <tchar.h>
+#include <crtdbg.h>
+#include <d3d9types.h>
+#include <d3dx9math.h>
+
+#else
+
+#include <cassert>
+#include <cstring>
+#include <cmath>
+#include <stdint.h>
+
+typedef uint8_t     BYTE;
+typedef uint16_t    WORD;
+typedef uint32_t    DWORD;
+typedef uint64_t    DWORD64;
+typedef int32_t     HRESULT;
+typedef unsigned    UINT;
+typedef float       FLOAT;
+typedef char        TCHAR;
+
+#define MAXDWORD 0xFFFFFFFF
+#define _T(text) text
+#define _tprintf printf
+#define _ASSERT(expression) assert(expression)
+#define UNREFERENCED_PARAMETER(parameter) ( (void)(parameter) )
+#define ZeroMemory(destination, length) memset( (destination), 0, (length) )
+#define FAILED(result) ( static_cast<HRESULT>(result) < 0 )
+#define SUCCEEDED(result) ( static_cast<HRESULT>(result) >= 0 )
+
+// Values are those of d3d9types.h
+typedef DWORD D3DCOLOR;
+#define D3DCOLOR_ARGB(a, r, g, b) \
+    ( static_cast<D3DCOLOR>( ( ( (a) & 0xFF ) << 24 ) | ( ( (r) & 0xFF ) << 16 ) | ( ( (g) & 0xFF ) << 8 ) | ( (b) & 0xFF ) ) )
+#define D3DCOLOR_RGBA(r, g, b, a) D3DCOLOR_ARGB(a, r, g, b)
+#define D3DCOLOR_XRGB(r, g, b) D3DCOLOR_ARGB(0xFF, r, g, b)
+
+enum D3DFORMAT
+{
+    D3DFMT_INDEX16 = 101,
+    D3DFMT_INDEX32 = 102,
+};
+
+enum D3DPRIMITIVETYPE
+{
+    D3DPT_TRIANGLELIST = 4,
+    D3DPT_TRIANGLESTRIP = 5,
+};
+
+enum D3DTEXTUREFILTERTYPE
+{
+    D3DTEXF_NONE = 0,
+    D3DTEXF_POINT = 1,
+    D3DTEXF_LINEAR = 2,
+};
+
+enum D3DDECLTYPE
+{
+    D3DDECLTYPE_FLOAT1 = 0,
+    D3DDECLTYPE_FLOAT2 = 1,
+    D3DDECLTYPE_FLOAT3 = 2,
+    D3DDECLTYPE_FLOAT4 = 3,
+    D3DDECLTYPE_D3DCOLOR = 4,
+    D3DDECLTYPE_UBYTE4 = 5,
+    D3DDECLTYPE_UNUSED = 17,
+};
+
+enum D3DDECLMETHOD
+{
+    D3DDECLMETHOD_DEFAULT = 0,
+};
+
+enum D3DDECLUSAGE
+{
+    D3DDECLUSAGE_POSITION = 0,
+    D3DDECLUSAGE_BLENDWEIGHT,
+    D3DDECLUSAGE_BLENDINDICES,
+    D3DDECLUSAGE_NORMAL,
+    D3DDECLUSAGE_PSIZE,
+    D3DDECLUSAGE_TEXCOORD,
+    D3DDECLUSAGE_TANGENT,
+    D3DDECLUSAGE_BINORMAL,
+    D3DDECLUSAGE_TESSFACTOR,
+    D3DDECLUSAGE_POSITIONT,
+    D3DDECLUSAGE_COLOR,
+    D3DDECLUSAGE_FOG,
+    D3DDECLUSAGE_DEPTH,
+    D3DDECLUSAGE_SAMPLE,
+};
+
+struct D3DVERTEXELEMENT9
+{
+    WORD Stream;
+    WORD Offset;
+    BYTE Type;
+    BYTE Method;
+    BYTE Usage;
+    BYTE UsageIndex;
+};
+#define D3DDECL_END() { 0xFF, 0, D3DDECLTYPE_UNUSED, 0, 0, 0 }
+
+// As in d3dx9math.h (D3DX_PI is a float)
+#define D3DX_PI (3.141592654f)
+
+struct D3DXVECTOR3
+{
+    float x, y, z;
+
+    D3DXVECTOR3() {}
+    D3DXVECTOR3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+    operator float*() { return &x; }
+    operator const float*() const { return &x; }
+
+    D3DXVECTOR3 &operator+=(const D3DXVECTOR3 &v) { x += v.x; y += v.y; z += v.z; return *this; }
+    D3DXVECTOR3 &operator-=(const D3DXVECTOR3 &v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
+    D3DXVECTOR3 &operator*=(float k) { x *= k; y *= k; z *= k; return *this; }
+    D3DXVECTOR3 &operator/=(float k) { x /= k; y /= k; z /= k; return *this; }
+
+    D3DXVECTOR3 operator+() const { return *this; }
+    D3DXVECTOR3 operator-() const { return D3DXVECTOR3( -x, -y, -z ); }
+    D3DXVECTOR3 operator+(const D3DXVECTOR3 &v) const { return D3DXVECTOR3( x + v.x, y + v.y, z + v.z ); }
+    D3DXVECTOR3 operator-(const D3DXVECTOR3 &v) const { return D3DXVECTOR3( x - v.x, y - v.y, z - v.z ); }
+    D3DXVECTOR3 operator*(float k) const { return D3DXVECTOR3( x*k, y*k, z*k ); }
+    D3DXVECTOR3 operator/(float k) const { return D3DXVECTOR3( x/k, y/k, z/k ); }
+
+    bool operator==(const D3DXVECTOR3 &v) const { return x == v.x && y == v.y && z == v.z; }
+    bool operator!=(const D3DXVECTOR3 &v) const { return !( *this == v ); }
+};
+inline D3DXVECTOR3 operator*(float k, const D3DXVECTOR3 &v) { return v*k; }
+
+struct D3DXVECTOR4
+{
+    float x, y, z, w;
+
+    D3DXVECTOR4() {}
+    D3DXVECTOR4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+    D3DXVECTOR4(const D3DXVECTOR3 &v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+
+    operator float*() { return &x; }
+    operator const float*() const { return &x; }
+
+    D3DXVECTOR4 &operator/=(float k) { x /= k; y /= k; z /= k; w /= k; return *this; }
+
+    D3DXVECTOR4 operator+(const D3DXVECTOR4 &v) const { return D3DXVECTOR4( x + v.x, y + v.y, z + v.z, w + v.w ); }
+    D3DXVECTOR4 operator-(const D3DXVECTOR4 &v) const { return D3DXVECTOR4( x - v.x, y - v.y, z - v.z, w - v.w ); }
+};
+
+// Vector functions of d3dx9math.h which the generators of meshes use; as there, they return `out'
+inline float D3DXVec3Dot(const D3DXVECTOR3 *a, const D3DXVECTOR3 *b)
+{
+    return a->x*b->x + a->y*b->y + a->z*b->z;
+}
+inline float D3DXVec3LengthSq(const D3DXVECTOR3 *v)
+{
+    return D3DXVec3Dot( v, v );
+}
+inline float D3DXVec3Length(const D3DXVECTOR3 *v)
+{
+    return sqrt( D3DXVec3LengthSq( v ) );
+}
+inline D3DXVECTOR3 *D3DXVec3Cross(D3DXVECTOR3 *out, const D3DXVECTOR3 *a, const D3DXVECTOR3 *b)
+{
+    *out = D3DXVECTOR3( a->y*b->z - a->z*b->y, a->z*b->x - a->x*b->z, a->x*b->y - a->y*b->x );
+    return out;
+}
+// a zero vector stays zero
+inline D3DXVECTOR3 *D3DXVec3Normalize(D3DXVECTOR3 *out, const D3DXVECTOR3 *v)
+{
+    const float length = D3DXVec3Length( v );
+    *out = ( length != 0 ) ? *v/length : D3DXVECTOR3( 0, 0, 0 );
+    return out;
+}
+inline D3DXVECTOR3 *D3DXVec3Minimize(D3DXVECTOR3 *out, const D3DXVECTOR3 *a, const D3DXVECTOR3 *b)
+{
+    *out = D3DXVECTOR3( a->x < b->x ? a->x : b->x, a->y < b->y ? a->y : b->y, a->z < b->z ? a->z : b->z );
+    return out;
+}
+inline D3DXVECTOR3 *D3DXVec3Maximize(D3DXVECTOR3 *out, const D3DXVECTOR3 *a, const D3DXVECTOR3 *b)
+{
+    *out = D3DXVECTOR3( a->x > b->x ? a->x : b->x, a->y > b->y ? a->y : b->y, a->z > b->z ? a->z : b->z );
+    return out;
+}
+inline float D3DXVec4Dot(const D3DXVECTOR4 *a, const D3DXVECTOR4 *b)
+{
+    return a->x*b->x + a->y*b->y + a->z*b->z + a->w*b->w;
+}
+
+// Rows of the matrix are _1# to _4#, m[row][column] and (row, column) are the same elements
+struct D3DXMATRIX
+{
+    union
+    {
+        struct
+        {
+            float _11, _12, _13, _14;
+            float _21, _22, _23, _24;
+            float _31, _32, _33, _34;
+            float _41, _42, _43, _44;
+        };
+        float m[4][4];
+    };
+
+    D3DXMATRIX() {}
+    D3DXMATRIX( float _11, float _12, float _13, float _14,
+                float _21, float _22, float _23, float _24,
+                float _31, float _32, float _33, float _34,
+                float _41, float _42, float _43, float _44 )
+    : _11(_11), _12(_12), _13(_13), _14(_14), _21(_21), _22(_22), _23(_23), _24(_24),
+      _31(_31), _32(_32), _33(_33), _34(_34), _41(_41), _42(_42), _43(_43), _44(_44) {}
+
+    float &operator()(UINT row, UINT column) { return m[row][column]; }
+    float operator()(UINT row, UINT column) const { return m[row][column]; }
+    operator float*() { return &_11; }
+    operator const float*() const { return &_11; }
+
+    D3DXMATRIX operator*(const D3DXMATRIX &other) const
+    {
+        D3DXMATRIX res;
+        for( unsigned i = 0; i < 4; ++i )
+        {
+            for( unsigned j = 0; j < 4; ++j )
+                res.m[i][j] = m[i][0]*other.m[0][j] + m[i][1]*other.m[1][j] + m[i][2]*other.m[2][j] + m[i][3]*other.m[3][j];
+        }
+        return res;
+    }
+};
+
+// Components from 0 to 1
+struct D3DXCOLOR
+{
+    float r, g, b, a;
+
+    D3DXCOLOR() {}
+    D3DXCOLOR(float r, float g, float b, float a) : r(r), g(g), b(b), a(a) {}
+    D3DXCOLOR(DWORD argb)
+    : r( ( ( argb >> 16 ) & 0xFF )/255.0f ), g( ( ( argb >> 8 ) & 0xFF )/255.0f ), b( ( argb & 0xFF )/255.0f ),
+      a( ( ( argb >> 24 ) & 0xFF )/255.0f ) {}
+
+    operator float*() { return &r; }
+    operator const float*() const { return &r; }
+};
+
+#endif
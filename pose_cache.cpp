@@ -0,0 +1,38 @@
+#include "pose_cache.h"
+
+PoseCache::PoseCache(float period, unsigned poses_count, unsigned pose_size)
+: period(period), poses_count(poses_count), pose_size(pose_size)
+{
+    _ASSERT( period > 0 );
+    _ASSERT( poses_count > 0 );
+    _ASSERT( pose_size > 0 );
+    poses.resize( get_array_size( static_cast<DWORD64>( poses_count + 1 )*pose_size, sizeof(float) )/sizeof(float), 0.0f );
+}
+
+void PoseCache::set_pose(unsigned pose, const float *values)
+{
+    _ASSERT( pose < poses_count );
+    _ASSERT( values != NULL );
+    memcpy( &poses[pose*pose_size], values, pose_size*sizeof(float) );
+    if( pose == 0 )
+        memcpy( &poses[poses_count*pose_size], values, pose_size*sizeof(float) );
+}
+
+void PoseCache::get(float time, float *res) const
+{
+    _ASSERT( res != NULL );
+    // position within the period in samples: [0, poses_count)
+    float phase = fmod( time, period )/period;
+    if( phase < 0 )
+        phase += 1.0f;
+    const float sample = phase*poses_count;
+    unsigned pose = static_cast<unsigned>( sample );
+    if( pose >= poses_count ) // rounding of phase close to 1
+        pose = poses_count - 1;
+    const float t = sample - pose;
+
+    const float *from = &poses[pose*pose_size];
+    const float *to = from + pose_size;
+    for( unsigned i = 0; i < pose_size; ++i )
+        res[i] = from[i] + ( to[i] - from[i] )*t;
+}
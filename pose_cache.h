@@ -0,0 +1,36 @@
+#pragma once
+#include "common.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// Poses of a periodic animation sampled once: a pose is `pose_size' floats (bone matrices, morphing parameters...)
+// taken at `poses_count' moments evenly spread over the period. A pose at any time is then the linear interpolation
+// between the two nearest samples instead of evaluating the animation again.
+// Samples must be dense enough for the interpolation: e.g. a lerp of two rotation matrices is no rotation,
+// it is shorter by about 1 - cos(a/2) where `a' is the angle between the samples
+class PoseCache
+{
+private:
+    float period;
+    unsigned poses_count;
+    unsigned pose_size;
+    std::vector<float> poses; // poses_count + 1 of them: the last one is the first one again, for interpolation past the last sample
+public:
+    PoseCache(float period, unsigned poses_count, unsigned pose_size);
+
+    float get_period() const { return period; }
+    unsigned get_poses_count() const { return poses_count; }
+    unsigned get_pose_size() const { return pose_size; }
+    // Time of the sample `pose' (in [0, period))
+    float get_sample_time(unsigned pose) const { return period*pose/poses_count; }
+
+    // Every sample must be set before get() is called: the pose at get_sample_time(pose) from `pose_size' floats of `values'
+    void set_pose(unsigned pose, const float *values);
+
+    // Pose at `time' (any, not only within the first period) into `pose_size' floats of `res'
+    void get(float time, float *res) const;
+};
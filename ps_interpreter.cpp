@@ -0,0 +1,254 @@
+#include "ps_interpreter.h"
+#include "parallel.h"
+#include <cmath>
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <algorithm>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+namespace
+{
+    const float PS_MAX_VALUE = 8.0f;        // temporary registers of ps_1_4 are in [-8, 8]...
+    const float PS_MAX_CONSTANT = 1.0f;     // ... and constants in [-1, 1]
+    const unsigned QUAD_SIZE = 2;           // pixels of a side of a quad
+    const unsigned BATCH_WIDTH = SHADER_BATCH_SIZE/QUAD_SIZE; // pixels of a row of a batch
+
+    // Column and row of a lane in its batch: quads are side by side, pixels of a quad are in the order of rows
+    unsigned get_lane_x(unsigned lane)
+    {
+        return ( lane/( QUAD_SIZE*QUAD_SIZE ) )*QUAD_SIZE + lane%QUAD_SIZE;
+    }
+    unsigned get_lane_y(unsigned lane)
+    {
+        return ( lane/QUAD_SIZE )%QUAD_SIZE;
+    }
+
+    float clamp_constant(float value)
+    {
+        return std::max( -PS_MAX_CONSTANT, std::min( value, PS_MAX_CONSTANT ) );
+    }
+
+    D3DXCOLOR get_texel(const PsSurface &surface, int x, int y)
+    // addresses wrap
+    {
+        const int width = static_cast<int>( surface.width );
+        const int height = static_cast<int>( surface.height );
+        x %= width;
+        y %= height;
+        return D3DXCOLOR( surface.texels[( y < 0 ? y + height : y )*surface.pitch + ( x < 0 ? x + width : x )] );
+    }
+
+    D3DXCOLOR lerp(const D3DXCOLOR &a, const D3DXCOLOR &b, float t)
+    {
+        return D3DXCOLOR( a.r + ( b.r - a.r )*t, a.g + ( b.g - a.g )*t, a.b + ( b.b - a.b )*t, a.a + ( b.a - a.a )*t );
+    }
+
+    // Everything the threads of run_pixel_shader() share
+    struct RUN_PARAMS
+    {
+        const PixelShaderInterpreter *shader;
+        const PsGradient *textures;
+        const PsGradient *colors;
+        unsigned width;
+        unsigned height;
+        D3DCOLOR *res;
+    };
+
+    void interpolate(const PsGradient &gradient, unsigned x, unsigned y, BatchRegister &res)
+    // over the batch of pixels from (x, y)
+    {
+        float lanes_x[SHADER_BATCH_SIZE];
+        float lanes_y[SHADER_BATCH_SIZE];
+        for( unsigned j = 0; j < SHADER_BATCH_SIZE; ++j )
+        {
+            lanes_x[j] = static_cast<float>( x + get_lane_x(j) ) + 0.5f;
+            lanes_y[j] = static_cast<float>( y + get_lane_y(j) ) + 0.5f;
+        }
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+        {
+            const __m128 origin = _mm_set1_ps( gradient.origin[i] );
+            const __m128 ddx = _mm_set1_ps( gradient.ddx[i] );
+            const __m128 ddy = _mm_set1_ps( gradient.ddy[i] );
+            for( unsigned j = 0; j < SHADER_BATCH_SIZE; j += SHADER_SSE_LANES )
+            {
+                const __m128 value = _mm_add_ps( origin, _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( &lanes_x[j] ), ddx ),
+                                                                     _mm_mul_ps( _mm_loadu_ps( &lanes_y[j] ), ddy ) ) );
+                _mm_storeu_ps( &res.components[i][j], value );
+            }
+        }
+    }
+
+    void run_rows(void *context, unsigned thread, DWORD begin, DWORD end)
+    // pairs of rows [begin, end)
+    {
+        UNREFERENCED_PARAMETER(thread);
+        const RUN_PARAMS &params = *static_cast<RUN_PARAMS*>(context);
+        PsInputs inputs;
+        BatchRegister color;
+        for( DWORD pair = begin; pair < end; ++pair )
+        {
+            const unsigned y = pair*QUAD_SIZE;
+            for( unsigned x = 0; x < params.width; x += BATCH_WIDTH )
+            {
+                for( unsigned i = 0; i < SHADER_PS_TEXTURE_REGISTERS; ++i )
+                    interpolate( params.textures[i], x, y, inputs.textures[i] );
+                for( unsigned i = 0; i < SHADER_PS_INPUT_REGISTERS; ++i )
+                    interpolate( params.colors[i], x, y, inputs.colors[i] );
+                params.shader->run( inputs, color );
+
+                // pixels out of the target are shaded, but not written
+                for( unsigned j = 0; j < SHADER_BATCH_SIZE; ++j )
+                {
+                    const unsigned pixel_x = x + get_lane_x(j);
+                    const unsigned pixel_y = y + get_lane_y(j);
+                    if( pixel_x >= params.width || pixel_y >= params.height )
+                        continue;
+                    BYTE bytes[SHADER_COMPONENTS];
+                    for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+                        bytes[i] = static_cast<BYTE>( color.components[i][j]*255.0f + 0.5f );
+                    params.res[pixel_y*params.width + pixel_x] = D3DCOLOR_RGBA( bytes[0], bytes[1], bytes[2], bytes[3] );
+                }
+            }
+        }
+    }
+}
+
+PixelShaderInterpreter::PixelShaderInterpreter(const ShaderCode &code)
+: code(code)
+{
+    _ASSERT( code.type == SHADER_PIXEL );
+    ZeroMemory( constants, sizeof(constants) );
+    ZeroMemory( textures, sizeof(textures) );
+    for( unsigned i = 0; i < SHADER_PS_TEXTURE_REGISTERS; ++i )
+        filters[i] = D3DTEXF_POINT;
+    for( unsigned i = 0; i < code.definitions.size(); ++i )
+    {
+        const ShaderDefinition &definition = code.definitions[i];
+        for( unsigned j = 0; j < SHADER_COMPONENTS; ++j )
+            constants[definition.constant][j] = clamp_constant( definition.value[j] );
+    }
+}
+
+void PixelShaderInterpreter::set_constants(unsigned first, const float *data, unsigned count)
+{
+    _ASSERT( data != NULL || count == 0 );
+    _ASSERT( first <= SHADER_PS_CONST_REGISTERS && count <= SHADER_PS_CONST_REGISTERS - first );
+    for( unsigned i = 0; i < count; ++i )
+    {
+        // definitions win
+        const ShaderDefinition *definition = NULL;
+        for( unsigned j = 0; j < code.definitions.size(); ++j )
+        {
+            if( code.definitions[j].constant == first + i )
+                definition = &code.definitions[j];
+        }
+        for( unsigned j = 0; j < SHADER_COMPONENTS; ++j )
+            constants[first + i][j] = clamp_constant( ( definition != NULL ) ? definition->value[j] : data[i*SHADER_COMPONENTS + j] );
+    }
+}
+
+void PixelShaderInterpreter::set_texture(unsigned sampler, const PsSurface &surface, D3DTEXTUREFILTERTYPE filter)
+{
+    _ASSERT( sampler < SHADER_PS_TEXTURE_REGISTERS );
+    _ASSERT( surface.texels != NULL && surface.width > 0 && surface.height > 0 && surface.pitch >= surface.width );
+    _ASSERT( filter == D3DTEXF_POINT || filter == D3DTEXF_LINEAR );
+    textures[sampler] = surface;
+    filters[sampler] = filter;
+}
+
+void PixelShaderInterpreter::sample(unsigned sampler, const BatchRegister &texcoords, BatchRegister &res) const
+// texels are fetched lane by lane: SSE has no gather
+{
+    const PsSurface &surface = textures[sampler];
+    for( unsigned j = 0; j < SHADER_BATCH_SIZE; ++j )
+    {
+        D3DXCOLOR color( 0, 0, 0, 1 );
+        if( surface.texels != NULL )
+        {
+            const float u = texcoords.components[0][j]*surface.width;
+            const float v = texcoords.components[1][j]*surface.height;
+            if( filters[sampler] == D3DTEXF_LINEAR )
+            {
+                // between the centers of 4 texels, which are at halves
+                const float left = floorf( u - 0.5f );
+                const float top = floorf( v - 0.5f );
+                const int x = static_cast<int>( left );
+                const int y = static_cast<int>( top );
+                const float weight_x = u - 0.5f - left;
+                color = lerp( lerp( get_texel( surface, x, y ),     get_texel( surface, x + 1, y ),     weight_x ),
+                              lerp( get_texel( surface, x, y + 1 ), get_texel( surface, x + 1, y + 1 ), weight_x ),
+                              v - 0.5f - top );
+            }
+            else
+            {
+                color = get_texel( surface, static_cast<int>( floorf(u) ), static_cast<int>( floorf(v) ) );
+            }
+        }
+        res.components[0][j] = color.r;
+        res.components[1][j] = color.g;
+        res.components[2][j] = color.b;
+        res.components[3][j] = color.a;
+    }
+}
+
+void PixelShaderInterpreter::run(const PsInputs &inputs, BatchRegister &res) const
+{
+    BatchRegister temps[SHADER_PS_TEMP_REGISTERS];
+    ZeroMemory( temps, sizeof(temps) );
+
+    BatchRegister sources[SHADER_MAX_SOURCES];
+    BatchRegister value;
+    for( unsigned i = 0; i < code.instructions.size(); ++i )
+    {
+        const ShaderInstruction &instruction = code.instructions[i];
+        if( instruction.opcode == SHADER_OP_PHASE )
+        {
+            // alpha is not kept between phases: the shader must write it again before reading
+            for( unsigned j = 0; j < SHADER_PS_TEMP_REGISTERS; ++j )
+                ZeroMemory( temps[j].components[SHADER_COMPONENTS - 1], sizeof(temps[j].components[SHADER_COMPONENTS - 1]) );
+            continue;
+        }
+        for( unsigned j = 0; j < instruction.sources_count; ++j )
+        {
+            const ShaderOperand &source = instruction.sources[j];
+            switch( source.type )
+            {
+            case SHADER_OPERAND_TEMP:       load_source( temps[source.index], source, sources[j] ); break;
+            case SHADER_OPERAND_INPUT:      load_source( inputs.colors[source.index], source, sources[j] ); break;
+            case SHADER_OPERAND_TEXTURE:    load_source( inputs.textures[source.index], source, sources[j] ); break;
+            case SHADER_OPERAND_CONST:      load_constant( constants[source.index], source, sources[j] ); break;
+            default:                        _ASSERT( false );
+            }
+        }
+
+        switch( instruction.opcode )
+        {
+        case SHADER_OP_TEXLD:   sample( instruction.dest.index, sources[0], value ); break;
+        case SHADER_OP_TEXCRD:  value = sources[0]; break;
+        default:                execute( instruction.opcode, sources, value );
+        }
+        _ASSERT( instruction.dest.type == SHADER_OPERAND_TEMP );
+        clamp( value, -PS_MAX_VALUE, PS_MAX_VALUE );
+        write_masked( value, instruction.dest.write_mask, temps[instruction.dest.index] );
+    }
+    res = temps[0];
+    clamp( res, 0.0f, 1.0f );
+}
+
+void run_pixel_shader( const PixelShaderInterpreter &shader, const PsGradient *textures, const PsGradient *colors,
+                       unsigned width, unsigned height, unsigned threads_count, D3DCOLOR *res )
+{
+    _ASSERT( textures != NULL && colors != NULL );
+    _ASSERT( res != NULL || width*height == 0 );
+
+    RUN_PARAMS params;
+    params.shader = &shader;
+    params.textures = textures;
+    params.colors = colors;
+    params.width = width;
+    params.height = height;
+    params.res = res;
+    parallel_for( ( height + QUAD_SIZE - 1 )/QUAD_SIZE, threads_count, run_rows, &params );
+}
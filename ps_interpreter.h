@@ -0,0 +1,66 @@
+#pragma once
+#include "common.h"
+#include "shader_batch.h"
+
+// Pixel shaders (ps_1_4) of shader_asm.h run on the CPU, without a device: target.psh with the filter the application sets,
+// for batches of SHADER_BATCH_SIZE pixels (see shader_batch.h). A batch is 4 quads (2x2 pixels each, as the device shades them)
+// side by side: 8 pixels of two neighbouring rows. As on the device, the temporary registers are clamped to [-8, 8],
+// the constants to [-1, 1], and alpha of the temporary registers is not kept after `phase'
+
+// A surface in memory, as a texture is sampled and a render target is written: D3DCOLOR texels, rows `pitch' texels apart
+struct PsSurface
+{
+    const D3DCOLOR *texels;
+    unsigned width;
+    unsigned height;
+    unsigned pitch;
+};
+
+// t# and v# of a batch
+struct PsInputs
+{
+    BatchRegister textures[SHADER_PS_TEXTURE_REGISTERS];
+    BatchRegister colors[SHADER_PS_INPUT_REGISTERS];
+};
+
+// A register interpolated over a screen-aligned primitive: the value at the center of the pixel (x, y) is
+// origin + (x + 0.5)*ddx + (y + 0.5)*ddy
+struct PsGradient
+{
+    D3DXVECTOR4 origin;
+    D3DXVECTOR4 ddx;
+    D3DXVECTOR4 ddy;
+};
+
+class PixelShaderInterpreter
+{
+private:
+    ShaderCode code;
+    float constants[SHADER_PS_CONST_REGISTERS][SHADER_COMPONENTS];
+    PsSurface textures[SHADER_PS_TEXTURE_REGISTERS];
+    D3DTEXTUREFILTERTYPE filters[SHADER_PS_TEXTURE_REGISTERS];
+
+    void sample(unsigned sampler, const BatchRegister &texcoords, BatchRegister &res) const;
+
+public:
+    // Constants are 0 and samplers have no textures until they are set
+    explicit PixelShaderInterpreter(const ShaderCode &code);
+
+    const ShaderCode &get_code() const { return code; }
+
+    // `count' registers from `first' as SetPixelShaderConstantF() sets them: 4 floats each.
+    // Constants defined by the shader (def) are always of their definitions
+    void set_constants(unsigned first, const float *data, unsigned count);
+    // The texture of the sampler, which is not copied: D3DTEXF_POINT or D3DTEXF_LINEAR, addresses wrap (as the device does
+    // by default). A sampler without a texture gives (0, 0, 0, 1)
+    void set_texture(unsigned sampler, const PsSurface &surface, D3DTEXTUREFILTERTYPE filter);
+
+    // r0 of the batch, saturated as the render target takes it. It may be called by several threads at once
+    void run(const PsInputs &inputs, BatchRegister &res) const;
+};
+
+// Shades a `width' x `height' render target covered by a screen-aligned primitive: t# and v# are interpolated by `textures'
+// (SHADER_PS_TEXTURE_REGISTERS of them) and `colors' (SHADER_PS_INPUT_REGISTERS), and r0 is written into `res' (rows `width'
+// texels apart) rounded to 8 bits per component. Pairs of rows are split between `threads_count' threads (see parallel.h)
+void run_pixel_shader( const PixelShaderInterpreter &shader, const PsGradient *textures, const PsGradient *colors,
+                       unsigned width, unsigned height, unsigned threads_count, D3DCOLOR *res );
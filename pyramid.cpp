@@ -1,18 +1,11 @@
 #include "pyramid.h"
+#include "normals.h"
+#include "parallel.h"
 
-void pyramid( float side, Vertex *res_vertices, Index *res_indices,
-              D3DCOLOR color, DWORD tesselate_degree )
+namespace
 {
-    const D3DXVECTOR3 normal_up(0,0,1);
-    const Vertex pyramid_vertices[]=
-    {
-        Vertex(D3DXVECTOR3(  side, -side,  0.00f ),normal_up),
-        Vertex(D3DXVECTOR3( -side, -side,  0.00f ),normal_up),
-        Vertex(D3DXVECTOR3( -side,  side,  0.00f ),normal_up),
-        Vertex(D3DXVECTOR3(  side,  side,  0.00f ),normal_up),
-        Vertex(D3DXVECTOR3(  0.0f,  0.0f,  sqrt(side) ),normal_up),
-        Vertex(D3DXVECTOR3(  0.0f,  0.0f, -sqrt(side) ),normal_up),
-    };
+    const unsigned PYRAMID_VERTICES_COUNT = 6;
+    const DWORD ADAPTIVE_MAX_BASE_DEGREE = 8;
     const Index pyramid_indices[PLANES_PER_PYRAMID*VERTICES_PER_TRIANGLE] =
     {
         0, 4, 3,
@@ -26,10 +19,93 @@ void pyramid( float side, Vertex *res_vertices, Index *res_indices,
         1, 0, 5,
     };
 
+    void get_pyramid_vertices( float side, Vertex *pyramid_vertices )
+    {
+        const D3DXVECTOR3 normal_up(0,0,1);
+        pyramid_vertices[0] = Vertex(D3DXVECTOR3(  side, -side,  0.00f ),normal_up);
+        pyramid_vertices[1] = Vertex(D3DXVECTOR3( -side, -side,  0.00f ),normal_up);
+        pyramid_vertices[2] = Vertex(D3DXVECTOR3( -side,  side,  0.00f ),normal_up);
+        pyramid_vertices[3] = Vertex(D3DXVECTOR3(  side,  side,  0.00f ),normal_up);
+        pyramid_vertices[4] = Vertex(D3DXVECTOR3(  0.0f,  0.0f,  sqrt(side) ),normal_up);
+        pyramid_vertices[5] = Vertex(D3DXVECTOR3(  0.0f,  0.0f, -sqrt(side) ),normal_up);
+    }
+}
+
+void pyramid( float side, Vertex *res_vertices, Index *res_indices,
+              D3DCOLOR color, DWORD tesselate_degree )
+{
+    Vertex pyramid_vertices[PYRAMID_VERTICES_COUNT];
+    get_pyramid_vertices( side, pyramid_vertices );
+
     for( DWORD i = 0; i < PLANES_PER_PYRAMID; ++i )
     {
         tessellate( pyramid_vertices, pyramid_indices, i*VERTICES_PER_TRIANGLE,
                     &res_vertices[i*tesselated_vertices_count(tesselate_degree)], i*tesselated_vertices_count(tesselate_degree),
                     &res_indices[i*tesselated_indices_count(tesselate_degree)], color, tesselate_degree );
     }
+}
+
+void pyramid( const PyramidDesc &desc, MeshSink &sink )
+{
+    Vertex *res_vertices = lock_vertices<Vertex>( sink, desc.vertices_count() );
+    Index *res_indices = sink.lock_indices( desc.indices_count() );
+    pyramid( desc.side, res_vertices, res_indices, desc.color, desc.tesselate_degree );
+    sink.unlock( desc.primitive_type() );
+}
+
+void pyramid_adaptive_counts( float side, float radius, float max_error,
+                              Index &vertices_count, DWORD &indices_count )
+{
+    pyramid_adaptive( side, radius, max_error, NULL, NULL, 0, vertices_count, indices_count );
+}
+
+void pyramid_adaptive( float side, float radius, float max_error,
+                       Vertex *res_vertices, Index *res_indices, D3DCOLOR color,
+                       Index &vertices_count, DWORD &indices_count )
+{
+    Vertex pyramid_vertices[PYRAMID_VERTICES_COUNT];
+    get_pyramid_vertices( side, pyramid_vertices );
+
+    // halving alone gives 4 times more triangles at a time, so a uniform start is chosen to give the fewest of them
+    DWORD base_degree = 1;
+    DWORD min_indices_count = 0;
+    for( DWORD degree = 1; degree <= ADAPTIVE_MAX_BASE_DEGREE; ++degree )
+    {
+        Index plane_vertices_count;
+        DWORD plane_indices_count;
+        tessellate_adaptive( pyramid_vertices, pyramid_indices, 0, NULL, 0, NULL, color,
+                             degree, radius, max_error, plane_vertices_count, plane_indices_count );
+        if( degree == 1 || plane_indices_count < min_indices_count )
+        {
+            base_degree = degree;
+            min_indices_count = plane_indices_count;
+        }
+    }
+
+    vertices_count = 0;
+    indices_count = 0;
+    for( DWORD i = 0; i < PLANES_PER_PYRAMID; ++i )
+    {
+        Index plane_vertices_count;
+        DWORD plane_indices_count;
+        tessellate_adaptive( pyramid_vertices, pyramid_indices, i*VERTICES_PER_TRIANGLE,
+                             ( res_vertices != NULL ) ? &res_vertices[vertices_count] : NULL, vertices_count,
+                             ( res_indices != NULL ) ? &res_indices[indices_count] : NULL, color,
+                             base_degree, radius, max_error, plane_vertices_count, plane_indices_count );
+        vertices_count += plane_vertices_count;
+        indices_count += plane_indices_count;
+    }
+}
+
+void pyramid_adaptive( const AdaptivePyramidDesc &desc, MeshSink &sink )
+{
+    Vertex *res_vertices = lock_vertices<Vertex>( sink, desc.vertices_count() );
+    Index *res_indices = sink.lock_indices( desc.indices_count() );
+    Index vertices_count;
+    DWORD indices_count;
+    pyramid_adaptive( desc.side, desc.radius, desc.max_error, res_vertices, res_indices, desc.color, vertices_count, indices_count );
+    _ASSERT( vertices_count == desc.vertices_count() && indices_count == desc.indices_count() );
+
+    smooth_normals( res_vertices, vertices_count, res_indices, indices_count, NORMALS_BY_ANGLE, desc.crease_angle, get_threads_count() );
+    sink.unlock( desc.primitive_type() );
 }
\ No newline at end of file
@@ -1,7 +1,8 @@
 #pragma once
-#include "main.h"
+#include "common.h"
 #include "Vertex.h"
 #include "tessellate.h"
+#include "mesh_sink.h"
 
 inline Index pyramid_vertices_count(DWORD tessellate_degree)
 {
@@ -14,3 +15,56 @@ inline DWORD pyramid_indices_count(DWORD tessellate_degree)
 
 void pyramid( float side, Vertex *res_vertices, Index *res_indices,
               D3DCOLOR color, DWORD tesselate_degree );
+
+// Everything the pyramid depends on, with its sizes
+struct PyramidDesc
+{
+    float side;
+    D3DCOLOR color;
+    DWORD tesselate_degree;
+
+    PyramidDesc( float side, D3DCOLOR color, DWORD tesselate_degree )
+    : side(side), color(color), tesselate_degree(tesselate_degree) {}
+
+    Index vertices_count() const { return pyramid_vertices_count(tesselate_degree); }
+    DWORD indices_count() const { return pyramid_indices_count(tesselate_degree); }
+    D3DPRIMITIVETYPE primitive_type() const { return D3DPT_TRIANGLELIST; }
+};
+
+// The same written into the sink
+void pyramid( const PyramidDesc &desc, MeshSink &sink );
+
+// The pyramid tessellated adaptively for morphing into the sphere of `radius' (see tessellate_adaptive()):
+// pyramid_adaptive_counts() gives the exact sizes of arrays, pyramid_adaptive() writes them and returns the same numbers
+void pyramid_adaptive_counts( float side, float radius, float max_error,
+                              Index &vertices_count, DWORD &indices_count );
+void pyramid_adaptive( float side, float radius, float max_error,
+                       Vertex *res_vertices, Index *res_indices, D3DCOLOR color,
+                       Index &vertices_count, DWORD &indices_count );
+
+// The same as PyramidDesc for the adaptive pyramid: sizes are counted by the constructor (which tessellates it without writing).
+// Normals are smoothed by angles over copies of vertices within `crease_angle' (see smooth_normals())
+struct AdaptivePyramidDesc
+{
+    float side;
+    float radius;
+    float max_error;
+    D3DCOLOR color;
+    float crease_angle;
+private:
+    Index counted_vertices;
+    DWORD counted_indices;
+public:
+    AdaptivePyramidDesc( float side, float radius, float max_error, D3DCOLOR color, float crease_angle )
+    : side(side), radius(radius), max_error(max_error), color(color), crease_angle(crease_angle)
+    {
+        pyramid_adaptive_counts( side, radius, max_error, counted_vertices, counted_indices );
+    }
+
+    Index vertices_count() const { return counted_vertices; }
+    DWORD indices_count() const { return counted_indices; }
+    D3DPRIMITIVETYPE primitive_type() const { return D3DPT_TRIANGLELIST; }
+};
+
+// The same written into the sink
+void pyramid_adaptive( const AdaptivePyramidDesc &desc, MeshSink &sink );
@@ -0,0 +1,563 @@
+#include "shader_asm.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cctype>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+namespace
+{
+    struct OPCODE_INFO
+    {
+        const char *name;
+        ShaderOpcode opcode;
+        unsigned sources_count;
+        bool vertex;    // of vertex shaders...
+        bool pixel;     // ... and of pixel ones
+    };
+    const OPCODE_INFO OPCODES[] =
+    {
+        { "mov",    SHADER_OP_MOV,    1, true,  true  },
+        { "add",    SHADER_OP_ADD,    2, true,  true  },
+        { "sub",    SHADER_OP_SUB,    2, true,  true  },
+        { "mul",    SHADER_OP_MUL,    2, true,  true  },
+        { "mad",    SHADER_OP_MAD,    3, true,  true  },
+        { "dp3",    SHADER_OP_DP3,    2, true,  true  },
+        { "dp4",    SHADER_OP_DP4,    2, true,  true  },
+        { "m4x4",   SHADER_OP_M4X4,   2, true,  false },
+        { "m4x3",   SHADER_OP_M4X3,   2, true,  false },
+        { "m3x3",   SHADER_OP_M3X3,   2, true,  false },
+        { "rsq",    SHADER_OP_RSQ,    1, true,  false },
+        { "rcp",    SHADER_OP_RCP,    1, true,  false },
+        { "dst",    SHADER_OP_DST,    2, true,  false },
+        { "lit",    SHADER_OP_LIT,    1, true,  false },
+        { "min",    SHADER_OP_MIN,    2, true,  false },
+        { "max",    SHADER_OP_MAX,    2, true,  false },
+        { "sge",    SHADER_OP_SGE,    2, true,  false },
+        { "slt",    SHADER_OP_SLT,    2, true,  false },
+        { "texld",  SHADER_OP_TEXLD,  1, false, true  },
+        { "texcrd", SHADER_OP_TEXCRD, 1, false, true  },
+        { "phase",  SHADER_OP_PHASE,  0, false, true  },
+    };
+
+    struct USAGE_INFO
+    {
+        const char *name;
+        D3DDECLUSAGE usage;
+    };
+    const USAGE_INFO USAGES[] =
+    {
+        { "position",       D3DDECLUSAGE_POSITION },
+        { "blendweight",    D3DDECLUSAGE_BLENDWEIGHT },
+        { "blendindices",   D3DDECLUSAGE_BLENDINDICES },
+        { "normal",         D3DDECLUSAGE_NORMAL },
+        { "psize",          D3DDECLUSAGE_PSIZE },
+        { "texcoord",       D3DDECLUSAGE_TEXCOORD },
+        { "tangent",        D3DDECLUSAGE_TANGENT },
+        { "binormal",       D3DDECLUSAGE_BINORMAL },
+        { "color",          D3DDECLUSAGE_COLOR },
+        { "fog",            D3DDECLUSAGE_FOG },
+        { "depth",          D3DDECLUSAGE_DEPTH },
+    };
+
+    const char ADDRESS_REGISTER[] = "a0.x";
+
+    // Whole text is a number: parses it into `res'
+    bool parse_unsigned(const std::string &text, unsigned &res)
+    {
+        if( text.empty() || text.size() > 3 ) // no register numbers are longer
+            return false;
+        res = 0;
+        for( unsigned i = 0; i < text.size(); ++i )
+        {
+            if( !isdigit( static_cast<unsigned char>( text[i] ) ) )
+                return false;
+            res = res*10 + ( text[i] - '0' );
+        }
+        return true;
+    }
+
+    bool parse_float(const std::string &text, float &res)
+    {
+        if( text.empty() )
+            return false;
+        char *end = NULL;
+        res = static_cast<float>( strtod( text.c_str(), &end ) );
+        return *end == '\0';
+    }
+
+    unsigned get_component(char c)
+    // 0 to 3 for x to w (or r to a), SHADER_COMPONENTS for anything else
+    {
+        switch( c )
+        {
+        case 'x': case 'r': return 0;
+        case 'y': case 'g': return 1;
+        case 'z': case 'b': return 2;
+        case 'w': case 'a': return 3;
+        default:            return SHADER_COMPONENTS;
+        }
+    }
+
+    // The register without its swizzle or mask: r#, v#, c#, c[a0.x + #], a0, oPos, oD#, oT# of vertex shaders, t# of pixel ones
+    void parse_register(const std::string &name, ShaderType shader, unsigned line, ShaderOperand &res)
+    {
+        unsigned index = 0;
+        if( name.size() > 3 && name[0] == 'c' && name[1] == '[' && name[name.size() - 1] == ']' )
+        {
+            // c[a0.x + #], c[# + a0.x] or c[a0.x]
+            const std::string address = name.substr( 2, name.size() - 3 );
+            const size_t plus = address.find( '+' );
+            const std::string first = address.substr( 0, plus );
+            const std::string second = ( plus == std::string::npos ) ? std::string( ADDRESS_REGISTER ) : address.substr( plus + 1 );
+            const std::string &offset = ( first == ADDRESS_REGISTER ) ? second : first;
+            if( shader != SHADER_VERTEX || ( first != ADDRESS_REGISTER && second != ADDRESS_REGISTER ) ||
+                !( offset == ADDRESS_REGISTER ? ( index = 0, true ) : parse_unsigned( offset, index ) ) )
+            {
+                throw ShaderParseError( line );
+            }
+            res.type = SHADER_OPERAND_CONST;
+            res.relative = true;
+        }
+        else if( name == "a0" )
+            res.type = SHADER_OPERAND_ADDRESS;
+        else if( name == "opos" )
+            res.type = SHADER_OPERAND_POSITION;
+        else if( name.size() > 2 && name[0] == 'o' && ( name[1] == 'd' || name[1] == 't' ) && parse_unsigned( name.substr(2), index ) )
+            res.type = ( name[1] == 'd' ) ? SHADER_OPERAND_COLOR : SHADER_OPERAND_TEXCOORD;
+        else if( name.size() > 1 && parse_unsigned( name.substr(1), index ) &&
+                 ( name[0] == 'r' || name[0] == 'v' || name[0] == 'c' || name[0] == 't' ) )
+        {
+            res.type = ( name[0] == 'r' ) ? SHADER_OPERAND_TEMP :
+                       ( name[0] == 'v' ) ? SHADER_OPERAND_INPUT :
+                       ( name[0] == 'c' ) ? SHADER_OPERAND_CONST : SHADER_OPERAND_TEXTURE;
+        }
+        else
+            throw ShaderParseError( line );
+        res.index = index;
+        if( index >= get_registers_count( shader, res.type ) )
+            throw ShaderParseError( line );
+    }
+
+    // [-]register[.swizzle] of a source, or register[.mask] of the destination
+    void parse_operand(const std::string &text, bool dest, ShaderType shader, unsigned line, ShaderOperand &res)
+    {
+        res.relative = false;
+        res.negate = false;
+        res.write_mask = 0;
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+            res.swizzle[i] = static_cast<BYTE>( i );
+
+        std::string name = text;
+        if( !name.empty() && name[0] == '-' )
+        {
+            if( dest )
+                throw ShaderParseError( line );
+            res.negate = true;
+            name = name.substr(1);
+        }
+        // the dot of the swizzle is after the brackets of relative addressing
+        const size_t bracket = name.rfind( ']' );
+        const size_t dot = name.find( '.', ( bracket == std::string::npos ) ? 0 : bracket );
+        const std::string components = ( dot == std::string::npos ) ? std::string() : name.substr( dot + 1 );
+        parse_register( name.substr( 0, dot ), shader, line, res );
+
+        if( dot != std::string::npos && ( components.empty() || components.size() > SHADER_COMPONENTS ) )
+            throw ShaderParseError( line );
+        if( dest )
+        {
+            if( res.type == SHADER_OPERAND_INPUT || res.type == SHADER_OPERAND_CONST || res.type == SHADER_OPERAND_TEXTURE )
+                throw ShaderParseError( line );
+            if( components.empty() )
+                res.write_mask = ( 1 << SHADER_COMPONENTS ) - 1;
+            // components of a mask are in their order
+            int last = -1;
+            for( unsigned i = 0; i < components.size(); ++i )
+            {
+                const unsigned component = get_component( components[i] );
+                if( component == SHADER_COMPONENTS || static_cast<int>( component ) <= last )
+                    throw ShaderParseError( line );
+                res.write_mask |= 1 << component;
+                last = component;
+            }
+        }
+        else
+        {
+            if( res.type != SHADER_OPERAND_TEMP && res.type != SHADER_OPERAND_INPUT &&
+                res.type != SHADER_OPERAND_CONST && res.type != SHADER_OPERAND_TEXTURE )
+            {
+                throw ShaderParseError( line );
+            }
+            // a short swizzle repeats its last component: .x is .xxxx, .xy is .xyyy
+            for( unsigned i = 0; i < components.size(); ++i )
+            {
+                const unsigned component = get_component( components[i] );
+                if( component == SHADER_COMPONENTS )
+                    throw ShaderParseError( line );
+                for( unsigned j = i; j < SHADER_COMPONENTS; ++j )
+                    res.swizzle[j] = static_cast<BYTE>( component );
+            }
+        }
+    }
+
+    // Operands separated by commas, without spaces
+    void split_operands(const std::string &text, std::vector<std::string> &res)
+    {
+        res.clear();
+        std::string operand;
+        for( unsigned i = 0; i < text.size(); ++i )
+        {
+            if( text[i] == ',' )
+            {
+                res.push_back( operand );
+                operand.clear();
+            }
+            else if( !isspace( static_cast<unsigned char>( text[i] ) ) )
+                operand += text[i];
+        }
+        if( !operand.empty() || !res.empty() )
+            res.push_back( operand );
+    }
+
+    void parse_version(const std::string &word, unsigned line, ShaderCode &res)
+    {
+        // vs_1_minor or ps_1_4
+        if( word.size() != 6 || word[2] != '_' || word[4] != '_' ||
+            !parse_unsigned( word.substr(3, 1), res.major_version ) || !parse_unsigned( word.substr(5, 1), res.minor_version ) ||
+            res.major_version != 1 )
+        {
+            throw ShaderParseError( line );
+        }
+        if( word.compare( 0, 2, "vs" ) == 0 )
+            res.type = SHADER_VERTEX;
+        else if( word.compare( 0, 2, "ps" ) == 0 && res.minor_version == 4 )
+            res.type = SHADER_PIXEL;
+        else
+            throw ShaderParseError( line );
+    }
+
+    void parse_declaration(const std::string &word, const std::vector<std::string> &operands, unsigned line, ShaderCode &res)
+    {
+        // dcl_usage[index] v#
+        const std::string usage = word.substr( 4 );
+        ShaderDeclaration declaration;
+        bool found = false;
+        for( unsigned i = 0; i < array_size(USAGES) && !found; ++i )
+        {
+            const size_t length = strlen( USAGES[i].name );
+            if( usage.compare( 0, length, USAGES[i].name ) != 0 )
+                continue;
+            declaration.usage = USAGES[i].usage;
+            declaration.usage_index = 0;
+            found = ( usage.size() == length || parse_unsigned( usage.substr( length ), declaration.usage_index ) );
+        }
+        ShaderOperand input;
+        if( !found || operands.size() != 1 || res.type != SHADER_VERTEX )
+            throw ShaderParseError( line );
+        parse_operand( operands[0], false, res.type, line, input );
+        if( input.type != SHADER_OPERAND_INPUT || input.negate )
+            throw ShaderParseError( line );
+        declaration.input = input.index;
+        res.declarations.push_back( declaration );
+    }
+
+    void parse_definition(const std::vector<std::string> &operands, unsigned line, ShaderCode &res)
+    {
+        // def c#, x, y, z, w
+        ShaderDefinition definition;
+        ShaderOperand constant;
+        if( operands.size() != 1 + SHADER_COMPONENTS )
+            throw ShaderParseError( line );
+        parse_operand( operands[0], false, res.type, line, constant );
+        if( constant.type != SHADER_OPERAND_CONST || constant.relative || constant.negate )
+            throw ShaderParseError( line );
+        definition.constant = constant.index;
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+        {
+            if( !parse_float( operands[1 + i], definition.value[i] ) )
+                throw ShaderParseError( line );
+        }
+        res.definitions.push_back( definition );
+    }
+
+    bool has_phase(const ShaderCode &code)
+    {
+        for( unsigned i = 0; i < code.instructions.size(); ++i )
+        {
+            if( code.instructions[i].opcode == SHADER_OP_PHASE )
+                return true;
+        }
+        return false;
+    }
+
+    void parse_instruction(const std::string &word, const std::vector<std::string> &operands, unsigned line, ShaderCode &res)
+    {
+        const OPCODE_INFO *info = NULL;
+        for( unsigned i = 0; i < array_size(OPCODES) && info == NULL; ++i )
+        {
+            if( word == OPCODES[i].name )
+                info = &OPCODES[i];
+        }
+        if( info == NULL || !( res.type == SHADER_VERTEX ? info->vertex : info->pixel ) )
+            throw ShaderParseError( line );
+
+        ShaderInstruction instruction = ShaderInstruction();
+        instruction.opcode = info->opcode;
+        instruction.sources_count = info->sources_count;
+        instruction.line = line;
+        if( instruction.opcode == SHADER_OP_PHASE )
+        {
+            // once, without operands
+            if( !operands.empty() || has_phase( res ) )
+                throw ShaderParseError( line );
+            res.instructions.push_back( instruction );
+            return;
+        }
+        if( operands.size() != 1 + info->sources_count )
+            throw ShaderParseError( line );
+        parse_operand( operands[0], true, res.type, line, instruction.dest );
+        for( unsigned i = 0; i < info->sources_count; ++i )
+            parse_operand( operands[1 + i], false, res.type, line, instruction.sources[i] );
+
+        // only mov writes the address register, and only its x
+        if( instruction.dest.type == SHADER_OPERAND_ADDRESS &&
+            ( instruction.opcode != SHADER_OP_MOV || instruction.dest.write_mask != 1 ) )
+        {
+            throw ShaderParseError( line );
+        }
+        // the matrix of a matrix instruction is in constant registers from the second source
+        if( get_matrix_rows( instruction.opcode ) != 0 )
+        {
+            const ShaderOperand &matrix = instruction.sources[1];
+            if( matrix.type != SHADER_OPERAND_CONST || matrix.negate || matrix.index + get_matrix_rows( instruction.opcode ) > SHADER_CONST_REGISTERS )
+                throw ShaderParseError( line );
+        }
+        // t# are read by texld and texcrd only; texld of the second phase may read coordinates computed in r# by the first one
+        const bool texture = ( instruction.opcode == SHADER_OP_TEXLD || instruction.opcode == SHADER_OP_TEXCRD );
+        for( unsigned i = 0; i < instruction.sources_count; ++i )
+        {
+            const ShaderOperand &source = instruction.sources[i];
+            const bool dependent = ( instruction.opcode == SHADER_OP_TEXLD && source.type == SHADER_OPERAND_TEMP && has_phase( res ) );
+            if( ( source.type == SHADER_OPERAND_TEXTURE ) != texture && !dependent )
+                throw ShaderParseError( line );
+            if( texture && source.negate )
+                throw ShaderParseError( line );
+        }
+        res.instructions.push_back( instruction );
+    }
+
+    const char COMPONENT_NAMES[] = "xyzw";
+
+    void write_operand(const ShaderOperand &operand, bool dest, std::ostream &res)
+    {
+        if( operand.negate )
+            res << '-';
+        switch( operand.type )
+        {
+        case SHADER_OPERAND_TEMP:       res << 'r' << operand.index; break;
+        case SHADER_OPERAND_INPUT:      res << 'v' << operand.index; break;
+        case SHADER_OPERAND_ADDRESS:    res << "a0"; break;
+        case SHADER_OPERAND_POSITION:   res << "oPos"; break;
+        case SHADER_OPERAND_COLOR:      res << "oD" << operand.index; break;
+        case SHADER_OPERAND_TEXCOORD:   res << "oT" << operand.index; break;
+        case SHADER_OPERAND_TEXTURE:    res << 't' << operand.index; break;
+        case SHADER_OPERAND_CONST:
+            if( operand.relative )
+                res << "c[a0.x + " << operand.index << ']';
+            else
+                res << 'c' << operand.index;
+            break;
+        default:
+            _ASSERT( false );
+        }
+        if( dest )
+        {
+            if( operand.write_mask == ( 1 << SHADER_COMPONENTS ) - 1 )
+                return;
+            res << '.';
+            for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+            {
+                if( ( operand.write_mask & ( 1 << i ) ) != 0 )
+                    res << COMPONENT_NAMES[i];
+            }
+            return;
+        }
+        // the shortest swizzle: a repeated last component is left out
+        unsigned length = SHADER_COMPONENTS;
+        while( length > 1 && operand.swizzle[length - 1] == operand.swizzle[length - 2] )
+            --length;
+        bool identity = true;
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+            identity = identity && ( operand.swizzle[i] == i );
+        if( identity )
+            return;
+        res << '.';
+        for( unsigned i = 0; i < length; ++i )
+            res << COMPONENT_NAMES[operand.swizzle[i]];
+    }
+}
+
+unsigned get_registers_count(ShaderType shader, ShaderOperandType type)
+{
+    if( shader == SHADER_PIXEL )
+    {
+        switch( type )
+        {
+        case SHADER_OPERAND_TEMP:       return SHADER_PS_TEMP_REGISTERS;
+        case SHADER_OPERAND_INPUT:      return SHADER_PS_INPUT_REGISTERS;
+        case SHADER_OPERAND_CONST:      return SHADER_PS_CONST_REGISTERS;
+        case SHADER_OPERAND_TEXTURE:    return SHADER_PS_TEXTURE_REGISTERS;
+        default:                        return 0;
+        }
+    }
+    switch( type )
+    {
+    case SHADER_OPERAND_TEMP:       return SHADER_TEMP_REGISTERS;
+    case SHADER_OPERAND_INPUT:      return SHADER_INPUT_REGISTERS;
+    case SHADER_OPERAND_CONST:      return SHADER_CONST_REGISTERS;
+    case SHADER_OPERAND_ADDRESS:    return 1;
+    case SHADER_OPERAND_POSITION:   return 1;
+    case SHADER_OPERAND_COLOR:      return SHADER_COLOR_OUTPUTS;
+    case SHADER_OPERAND_TEXCOORD:   return SHADER_TEXCOORD_OUTPUTS;
+    default:                        return 0;
+    }
+}
+
+unsigned get_matrix_rows(ShaderOpcode opcode)
+{
+    switch( opcode )
+    {
+    case SHADER_OP_M4X4:    return 4;
+    case SHADER_OP_M4X3:    return 3;
+    case SHADER_OP_M3X3:    return 3;
+    default:                return 0;
+    }
+}
+
+void parse_shader(const char *text, ShaderCode &res)
+{
+    _ASSERT( text != NULL );
+    res.declarations.clear();
+    res.definitions.clear();
+    res.instructions.clear();
+
+    std::istringstream lines( text );
+    std::string line_text;
+    bool version_read = false;
+    std::vector<std::string> operands;
+    for( unsigned line = 1; std::getline( lines, line_text ); ++line )
+    {
+        // comments are from ';' or "//" to the end of the line; names are case-insensitive
+        line_text = line_text.substr( 0, std::min( line_text.find( ';' ), line_text.find( "//" ) ) );
+        for( unsigned i = 0; i < line_text.size(); ++i )
+            line_text[i] = static_cast<char>( tolower( static_cast<unsigned char>( line_text[i] ) ) );
+
+        std::istringstream words( line_text );
+        std::string word;
+        if( !( words >> word ) )
+            continue; // an empty line
+        std::string rest;
+        std::getline( words, rest );
+        split_operands( rest, operands );
+
+        if( !version_read )
+        {
+            if( !operands.empty() )
+                throw ShaderParseError( line );
+            parse_version( word, line, res );
+            version_read = true;
+        }
+        else if( word.compare( 0, 4, "dcl_" ) == 0 )
+            parse_declaration( word, operands, line, res );
+        else if( word == "def" )
+            parse_definition( operands, line, res );
+        else
+            parse_instruction( word, operands, line, res );
+    }
+    if( !version_read )
+        throw ShaderParseError( 1 );
+}
+
+unsigned get_instruction_slots(const ShaderCode &code)
+{
+    unsigned slots = 0;
+    for( unsigned i = 0; i < code.instructions.size(); ++i )
+    {
+        const ShaderOpcode opcode = code.instructions[i].opcode;
+        if( opcode != SHADER_OP_PHASE )
+            slots += ( get_matrix_rows( opcode ) != 0 ) ? get_matrix_rows( opcode ) : 1;
+    }
+    return slots;
+}
+
+void write_shader(const ShaderCode &code, std::string &res)
+{
+    std::ostringstream text;
+    text << ( code.type == SHADER_VERTEX ? "vs_" : "ps_" ) << code.major_version << '_' << code.minor_version << '\n';
+    for( unsigned i = 0; i < code.declarations.size(); ++i )
+    {
+        const ShaderDeclaration &declaration = code.declarations[i];
+        for( unsigned j = 0; j < array_size(USAGES); ++j )
+        {
+            if( USAGES[j].usage == declaration.usage )
+                text << "dcl_" << USAGES[j].name;
+        }
+        if( declaration.usage_index != 0 )
+            text << declaration.usage_index;
+        text << " v" << declaration.input << '\n';
+    }
+    for( unsigned i = 0; i < code.definitions.size(); ++i )
+    {
+        const ShaderDefinition &definition = code.definitions[i];
+        text << "def c" << definition.constant;
+        for( unsigned j = 0; j < SHADER_COMPONENTS; ++j )
+        {
+            std::ostringstream value;
+            value.precision( 9 ); // enough for a float to be read back exactly
+            value << definition.value[j];
+            // a float the way the files write it, with its point
+            if( value.str().find_first_of( ".e" ) == std::string::npos )
+                value << ".0";
+            text << ", " << value.str();
+        }
+        text << '\n';
+    }
+    for( unsigned i = 0; i < code.instructions.size(); ++i )
+    {
+        const ShaderInstruction &instruction = code.instructions[i];
+        for( unsigned j = 0; j < array_size(OPCODES); ++j )
+        {
+            if( OPCODES[j].opcode == instruction.opcode )
+                text << OPCODES[j].name;
+        }
+        if( instruction.opcode != SHADER_OP_PHASE )
+        {
+            text << ' ';
+            write_operand( instruction.dest, true, text );
+            for( unsigned j = 0; j < instruction.sources_count; ++j )
+            {
+                text << ", ";
+                write_operand( instruction.sources[j], false, text );
+            }
+        }
+        text << '\n';
+    }
+    res = text.str();
+}
+
+void load_shader(const char *filename, ShaderCode &res)
+{
+    _ASSERT( filename != NULL );
+    std::ifstream file( filename, std::ios::in | std::ios::binary );
+    if( !file )
+        throw ShaderFileError();
+    std::ostringstream text;
+    text << file.rdbuf();
+    if( file.bad() )
+        throw ShaderFileError();
+    parse_shader( text.str().c_str(), res );
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include "common.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#include <string>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// Shader assembly as the .vsh and .psh files of the application are written, parsed into instructions for running the shaders
+// without a device (see vs_interpreter.h and ps_interpreter.h). Only what the shaders use is understood; anything else is a ShaderParseError
+
+// They must be macros, not constants, because they must be known at compile-time (they are used for array initialization in another module)
+#define SHADER_MAX_SOURCES 3
+#define SHADER_COMPONENTS 4 // x, y, z, w
+#define SHADER_TEMP_REGISTERS 12    // r0-r11 of vs_1_1
+#define SHADER_INPUT_REGISTERS 16
+#define SHADER_CONST_REGISTERS 256  // as many as devices running the application have (c111 is used)
+#define SHADER_COLOR_OUTPUTS 2
+#define SHADER_TEXCOORD_OUTPUTS 8
+// ps_1_4 has fewer registers
+#define SHADER_PS_TEMP_REGISTERS 6
+#define SHADER_PS_INPUT_REGISTERS 2     // v0-v1 are colors
+#define SHADER_PS_CONST_REGISTERS 8
+#define SHADER_PS_TEXTURE_REGISTERS 6   // t0-t5, and as many samplers
+
+enum ShaderType
+{
+    SHADER_VERTEX,  // vs_1_x
+    SHADER_PIXEL,   // ps_1_4
+};
+
+enum ShaderOpcode
+{
+    SHADER_OP_MOV,
+    SHADER_OP_ADD,
+    SHADER_OP_SUB,
+    SHADER_OP_MUL,
+    SHADER_OP_MAD,
+    SHADER_OP_DP3,
+    SHADER_OP_DP4,
+    SHADER_OP_M4X4,
+    SHADER_OP_M4X3,
+    SHADER_OP_M3X3,
+    SHADER_OP_RSQ,
+    SHADER_OP_RCP,
+    SHADER_OP_DST,
+    SHADER_OP_LIT,
+    SHADER_OP_MIN,
+    SHADER_OP_MAX,
+    SHADER_OP_SGE,
+    SHADER_OP_SLT,
+    SHADER_OP_TEXLD,    // of ps_1_4: samples the texture of the sampler numbered as the destination register
+    SHADER_OP_TEXCRD,
+    SHADER_OP_PHASE,    // no operands: the second phase of ps_1_4 starts
+};
+
+enum ShaderOperandType
+{
+    SHADER_OPERAND_TEMP,        // r#
+    SHADER_OPERAND_INPUT,       // v#
+    SHADER_OPERAND_CONST,       // c#, or c[a0.x + #]
+    SHADER_OPERAND_ADDRESS,     // a0
+    SHADER_OPERAND_POSITION,    // oPos
+    SHADER_OPERAND_COLOR,       // oD#
+    SHADER_OPERAND_TEXCOORD,    // oT#
+    SHADER_OPERAND_TEXTURE,     // t# of a pixel shader
+};
+
+struct ShaderOperand
+{
+    ShaderOperandType type;
+    unsigned index;
+    bool relative;                      // c[a0.x + index]
+    bool negate;                        // of a source
+    BYTE swizzle[SHADER_COMPONENTS];    // of a source: the component taken for each one (0 to 3 for x to w)
+    BYTE write_mask;                    // of the destination: bit i is set if component i is written
+};
+
+struct ShaderInstruction
+{
+    ShaderOpcode opcode;
+    unsigned sources_count;
+    ShaderOperand dest;
+    ShaderOperand sources[SHADER_MAX_SOURCES];
+    unsigned line; // in the text, from 1
+};
+
+// dcl_usage[index] v#
+struct ShaderDeclaration
+{
+    D3DDECLUSAGE usage;
+    unsigned usage_index;
+    unsigned input;
+};
+
+// def c#, x, y, z, w: set whenever the shader runs, over constants set from outside
+struct ShaderDefinition
+{
+    unsigned constant;
+    float value[SHADER_COMPONENTS];
+};
+
+struct ShaderCode
+{
+    ShaderType type;
+    unsigned major_version; // of vs_major_minor or ps_major_minor
+    unsigned minor_version;
+    std::vector<ShaderDeclaration> declarations;
+    std::vector<ShaderDefinition> definitions;
+    std::vector<ShaderInstruction> instructions;
+};
+
+// Number of rows (constant registers) a matrix instruction reads, or 0 for other instructions
+unsigned get_matrix_rows(ShaderOpcode opcode);
+
+// Number of registers of the type a shader has, 0 if it has none
+unsigned get_registers_count(ShaderType shader, ShaderOperandType type);
+
+// Parses the text of a vertex shader (vs_1_x) or a pixel shader (ps_1_4), throws ShaderParseError
+void parse_shader(const char *text, ShaderCode &res);
+// ... read from the file, throws ShaderFileError if it cannot be read
+void load_shader(const char *filename, ShaderCode &res);
+
+// Instruction slots of the shader as the device counts them: a matrix instruction takes one for each row
+unsigned get_instruction_slots(const ShaderCode &code);
+
+// The text of the shader, which parse_shader() and D3DXAssembleShader() read (without comments)
+void write_shader(const ShaderCode &code, std::string &res);
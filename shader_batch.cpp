@@ -0,0 +1,161 @@
+#include "shader_batch.h"
+#include <cmath>
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <algorithm>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+namespace
+{
+    const float LIT_MAX_POWER = 128.0f; // the power of `lit' is clamped to [-128, 128]
+
+    // Componentwise operations: res = op(a, b, c) for SHADER_SSE_LANES lanes
+    struct Add { __m128 operator()(__m128 a, __m128 b, __m128) const { return _mm_add_ps(a, b); } };
+    struct Sub { __m128 operator()(__m128 a, __m128 b, __m128) const { return _mm_sub_ps(a, b); } };
+    struct Mul { __m128 operator()(__m128 a, __m128 b, __m128) const { return _mm_mul_ps(a, b); } };
+    struct Mad { __m128 operator()(__m128 a, __m128 b, __m128 c) const { return _mm_add_ps( _mm_mul_ps(a, b), c ); } };
+    struct Min { __m128 operator()(__m128 a, __m128 b, __m128) const { return _mm_min_ps(a, b); } };
+    struct Max { __m128 operator()(__m128 a, __m128 b, __m128) const { return _mm_max_ps(a, b); } };
+    struct Sge { __m128 operator()(__m128 a, __m128 b, __m128) const { return _mm_and_ps( _mm_cmpge_ps(a, b), _mm_set1_ps(1.0f) ); } };
+    struct Slt { __m128 operator()(__m128 a, __m128 b, __m128) const { return _mm_and_ps( _mm_cmplt_ps(a, b), _mm_set1_ps(1.0f) ); } };
+
+    template<class Op> void componentwise(const BatchRegister *sources, BatchRegister &res, Op op)
+    {
+        const BatchRegister &c = sources[SHADER_MAX_SOURCES - 1]; // read by mad only
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+        {
+            for( unsigned j = 0; j < SHADER_BATCH_SIZE; j += SHADER_SSE_LANES )
+            {
+                const __m128 value = op( _mm_loadu_ps( &sources[0].components[i][j] ), _mm_loadu_ps( &sources[1].components[i][j] ),
+                                         _mm_loadu_ps( &c.components[i][j] ) );
+                _mm_storeu_ps( &res.components[i][j], value );
+            }
+        }
+    }
+
+    // rsq and rcp of the last component: as the device does, rsq takes the absolute value, and both give infinity for 0
+    void reciprocal(const BatchRegister &a, bool sqrt, BatchRegister &res)
+    {
+        const __m128 sign_mask = _mm_set1_ps( -0.0f );
+        for( unsigned j = 0; j < SHADER_BATCH_SIZE; j += SHADER_SSE_LANES )
+        {
+            __m128 value = _mm_loadu_ps( &a.components[SHADER_COMPONENTS - 1][j] );
+            if( sqrt )
+                value = _mm_sqrt_ps( _mm_andnot_ps( sign_mask, value ) );
+            value = _mm_div_ps( _mm_set1_ps(1.0f), value );
+            for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+                _mm_storeu_ps( &res.components[i][j], value );
+        }
+    }
+
+    // dst: (1, a.y*b.y, a.z, b.w)
+    void distance(const BatchRegister &a, const BatchRegister &b, BatchRegister &res)
+    {
+        for( unsigned j = 0; j < SHADER_BATCH_SIZE; j += SHADER_SSE_LANES )
+        {
+            _mm_storeu_ps( &res.components[0][j], _mm_set1_ps(1.0f) );
+            _mm_storeu_ps( &res.components[1][j], _mm_mul_ps( _mm_loadu_ps( &a.components[1][j] ), _mm_loadu_ps( &b.components[1][j] ) ) );
+            _mm_storeu_ps( &res.components[2][j], _mm_loadu_ps( &a.components[2][j] ) );
+            _mm_storeu_ps( &res.components[3][j], _mm_loadu_ps( &b.components[3][j] ) );
+        }
+    }
+
+    // lit: (1, max(a.x, 0), a.x > 0 && a.y > 0 ? a.y**a.w : 0, 1), the power clamped to [-128, 128].
+    // pow() has no SSE counterpart, so it is done lane by lane
+    void light(const BatchRegister &a, BatchRegister &res)
+    {
+        for( unsigned j = 0; j < SHADER_BATCH_SIZE; ++j )
+        {
+            const float x = a.components[0][j];
+            const float y = a.components[1][j];
+            const float power = std::max( -LIT_MAX_POWER, std::min( a.components[3][j], LIT_MAX_POWER ) );
+            res.components[0][j] = 1.0f;
+            res.components[1][j] = ( x > 0 ) ? x : 0.0f;
+            res.components[2][j] = ( x > 0 && y > 0 ) ? powf( y, power ) : 0.0f;
+            res.components[3][j] = 1.0f;
+        }
+    }
+}
+
+void load_source(const BatchRegister &source, const ShaderOperand &operand, BatchRegister &res)
+{
+    const __m128 sign = _mm_set1_ps( operand.negate ? -1.0f : 1.0f );
+    for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+    {
+        for( unsigned j = 0; j < SHADER_BATCH_SIZE; j += SHADER_SSE_LANES )
+            _mm_storeu_ps( &res.components[i][j], _mm_mul_ps( _mm_loadu_ps( &source.components[operand.swizzle[i]][j] ), sign ) );
+    }
+}
+
+void load_constant(const float constant[SHADER_COMPONENTS], const ShaderOperand &operand, BatchRegister &res)
+{
+    const float sign = operand.negate ? -1.0f : 1.0f;
+    for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+    {
+        const __m128 value = _mm_set1_ps( sign*constant[operand.swizzle[i]] );
+        for( unsigned j = 0; j < SHADER_BATCH_SIZE; j += SHADER_SSE_LANES )
+            _mm_storeu_ps( &res.components[i][j], value );
+    }
+}
+
+void execute(ShaderOpcode opcode, const BatchRegister *sources, BatchRegister &res)
+{
+    switch( opcode )
+    {
+    case SHADER_OP_MOV:     res = sources[0]; break;
+    case SHADER_OP_ADD:     componentwise( sources, res, Add() ); break;
+    case SHADER_OP_SUB:     componentwise( sources, res, Sub() ); break;
+    case SHADER_OP_MUL:     componentwise( sources, res, Mul() ); break;
+    case SHADER_OP_MAD:     componentwise( sources, res, Mad() ); break;
+    case SHADER_OP_MIN:     componentwise( sources, res, Min() ); break;
+    case SHADER_OP_MAX:     componentwise( sources, res, Max() ); break;
+    case SHADER_OP_SGE:     componentwise( sources, res, Sge() ); break;
+    case SHADER_OP_SLT:     componentwise( sources, res, Slt() ); break;
+    case SHADER_OP_DP3:     dot( sources[0], sources[1], 3, res ); break;
+    case SHADER_OP_DP4:     dot( sources[0], sources[1], 4, res ); break;
+    case SHADER_OP_RSQ:     reciprocal( sources[0], true, res ); break;
+    case SHADER_OP_RCP:     reciprocal( sources[0], false, res ); break;
+    case SHADER_OP_DST:     distance( sources[0], sources[1], res ); break;
+    case SHADER_OP_LIT:     light( sources[0], res ); break;
+    default:                _ASSERT( false );
+    }
+}
+
+void dot(const BatchRegister &a, const BatchRegister &b, unsigned size, BatchRegister &res)
+{
+    for( unsigned j = 0; j < SHADER_BATCH_SIZE; j += SHADER_SSE_LANES )
+    {
+        __m128 sum = _mm_setzero_ps();
+        for( unsigned i = 0; i < size; ++i )
+            sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( &a.components[i][j] ), _mm_loadu_ps( &b.components[i][j] ) ) );
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+            _mm_storeu_ps( &res.components[i][j], sum );
+    }
+}
+
+void write_masked(const BatchRegister &value, BYTE write_mask, BatchRegister &res)
+{
+    for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+    {
+        if( ( write_mask & ( 1 << i ) ) == 0 )
+            continue;
+        for( unsigned j = 0; j < SHADER_BATCH_SIZE; j += SHADER_SSE_LANES )
+            _mm_storeu_ps( &res.components[i][j], _mm_loadu_ps( &value.components[i][j] ) );
+    }
+}
+
+void clamp(BatchRegister &res, float min_value, float max_value)
+{
+    const __m128 min_batch = _mm_set1_ps( min_value );
+    const __m128 max_batch = _mm_set1_ps( max_value );
+    for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+    {
+        for( unsigned j = 0; j < SHADER_BATCH_SIZE; j += SHADER_SSE_LANES )
+        {
+            const __m128 value = _mm_loadu_ps( &res.components[i][j] );
+            _mm_storeu_ps( &res.components[i][j], _mm_min_ps( _mm_max_ps( value, min_batch ), max_batch ) );
+        }
+    }
+}
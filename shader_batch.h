@@ -0,0 +1,35 @@
+#pragma once
+#include "common.h"
+#include "shader_asm.h"
+#include <xmmintrin.h>
+
+// Registers of a batch of SHADER_BATCH_SIZE vertices or pixels, as the interpreters of shaders keep them (see vs_interpreter.h
+// and ps_interpreter.h): a column of lanes for each component, so an instruction is dispatched once for the whole batch
+// and done by SSE for 4 lanes at a time
+
+// They must be macros, not constants, because they must be known at compile-time (they are used for array initialization in another module)
+#define SHADER_BATCH_SIZE 16
+#define SHADER_SSE_LANES 4
+
+struct BatchRegister
+{
+    float components[SHADER_COMPONENTS][SHADER_BATCH_SIZE];
+};
+
+// The source operand from the register it reads: swizzled and negated
+void load_source(const BatchRegister &source, const ShaderOperand &operand, BatchRegister &res);
+// ... from a constant register, the same for all lanes
+void load_constant(const float constant[SHADER_COMPONENTS], const ShaderOperand &operand, BatchRegister &res);
+
+// The result of an instruction which reads its loaded sources only: anything but matrix instructions and texture ones.
+// Scalar instructions (rsq, rcp) take the last component of the swizzled source and write all components, as the device does
+void execute(ShaderOpcode opcode, const BatchRegister *sources, BatchRegister &res);
+
+// The dot product of the first `size' components, in all components of `res'
+void dot(const BatchRegister &a, const BatchRegister &b, unsigned size, BatchRegister &res);
+
+// Writes components of `value' set in the mask into `res'
+void write_masked(const BatchRegister &value, BYTE write_mask, BatchRegister &res);
+
+// Clamps all components to [min_value, max_value]
+void clamp(BatchRegister &res, float min_value, float max_value);
@@ -0,0 +1,714 @@
+#include "shader_opt.h"
+#include "shader_batch.h"
+#include <cmath>
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <algorithm>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+namespace
+{
+    const BYTE ALL_COMPONENTS = ( 1 << SHADER_COMPONENTS ) - 1;
+    const BYTE XYZ_COMPONENTS = 0x7;
+    const BYTE W_COMPONENT = 0x8;
+    const float PS_MAX_VALUE = 8.0f;        // temporary registers of ps_1_4 are in [-8, 8]...
+    const float PS_MAX_CONSTANT = 1.0f;     // ... and constants in [-1, 1]
+
+    // Positions of the source (before its swizzle) which the instruction reads for the components it writes
+    BYTE get_source_positions(const ShaderInstruction &instruction, unsigned source)
+    {
+        const BYTE mask = instruction.dest.write_mask;
+        switch( instruction.opcode )
+        {
+        case SHADER_OP_DP3:     return XYZ_COMPONENTS;
+        case SHADER_OP_DP4:     return ALL_COMPONENTS;
+        case SHADER_OP_RSQ:
+        case SHADER_OP_RCP:     return W_COMPONENT;
+        case SHADER_OP_DST:     return ( mask & 0x2 ) | ( mask & ( source == 0 ? 0x4 : 0x8 ) ); // (1, src0.y*src1.y, src0.z, src1.w)
+        case SHADER_OP_LIT:     return 0xB; // x, y, w
+        case SHADER_OP_M3X3:    return ( source == 0 ) ? XYZ_COMPONENTS : ALL_COMPONENTS;
+        case SHADER_OP_M4X4:
+        case SHADER_OP_M4X3:
+        case SHADER_OP_TEXLD:
+        case SHADER_OP_TEXCRD:  return ALL_COMPONENTS;
+        default:                return mask; // componentwise
+        }
+    }
+
+    // Components of its register which the source reads
+    BYTE get_read_mask(const ShaderInstruction &instruction, unsigned source)
+    {
+        const BYTE positions = get_source_positions( instruction, source );
+        BYTE res = 0;
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+        {
+            if( ( positions & ( 1 << i ) ) != 0 )
+                res |= 1 << instruction.sources[source].swizzle[i];
+        }
+        return res;
+    }
+
+    // Components of the temporary register which the instruction reads
+    BYTE get_temp_reads(const ShaderInstruction &instruction, unsigned temp)
+    {
+        BYTE res = 0;
+        for( unsigned i = 0; i < instruction.sources_count; ++i )
+        {
+            if( instruction.sources[i].type == SHADER_OPERAND_TEMP && instruction.sources[i].index == temp )
+                res |= get_read_mask( instruction, i );
+        }
+        return res;
+    }
+
+    // The instruction writes the register the source reads (or a0 of its relative addressing)
+    bool overwrites(const ShaderInstruction &instruction, const ShaderOperand &source)
+    {
+        if( instruction.opcode == SHADER_OP_PHASE )
+            return false;
+        if( source.relative )
+            return instruction.dest.type == SHADER_OPERAND_ADDRESS;
+        return instruction.dest.type == source.type && instruction.dest.index == source.index;
+    }
+
+    bool is_same_register(const ShaderOperand &a, const ShaderOperand &b)
+    {
+        return a.type == b.type && a.index == b.index && a.relative == b.relative;
+    }
+
+    // vs_1_1 reads one constant register and one input register at most, ps_1_4 two constant registers
+    bool fits_read_ports(ShaderType shader, const ShaderInstruction &instruction)
+    {
+        unsigned constants_count = 0;
+        unsigned inputs_count = 0;
+        for( unsigned i = 0; i < instruction.sources_count; ++i )
+        {
+            const ShaderOperand &source = instruction.sources[i];
+            bool repeated = false;
+            for( unsigned j = 0; j < i; ++j )
+                repeated = repeated || is_same_register( source, instruction.sources[j] );
+            if( repeated )
+                continue;
+            if( source.type == SHADER_OPERAND_CONST )
+                ++constants_count;
+            if( source.type == SHADER_OPERAND_INPUT )
+                ++inputs_count;
+        }
+        if( shader == SHADER_VERTEX )
+            return constants_count <= 1 && inputs_count <= 1;
+        return constants_count <= 2;
+    }
+
+    // Sources of ps_1_4 arithmetic take the identity swizzle or replicate a component
+    bool is_pixel_swizzle(const ShaderOperand &operand)
+    {
+        bool identity = true;
+        bool replicate = true;
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+        {
+            identity = identity && operand.swizzle[i] == i;
+            replicate = replicate && operand.swizzle[i] == operand.swizzle[0];
+        }
+        return identity || replicate;
+    }
+
+    // What `reader' reads of a register written from `source' (a mov's, or a factor of a mul), read from `source' itself
+    ShaderOperand compose(const ShaderOperand &source, const ShaderOperand &reader)
+    {
+        ShaderOperand res = source;
+        res.negate = ( source.negate != reader.negate );
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+            res.swizzle[i] = source.swizzle[reader.swizzle[i]];
+        return res;
+    }
+
+    bool is_identity_mov(const ShaderInstruction &instruction)
+    {
+        if( instruction.opcode != SHADER_OP_MOV || !is_same_register( instruction.dest, instruction.sources[0] ) ||
+            instruction.sources[0].negate )
+        {
+            return false;
+        }
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+        {
+            if( instruction.sources[0].swizzle[i] != i )
+                return false;
+        }
+        return true;
+    }
+
+    void make_mov(ShaderInstruction &instruction, const ShaderOperand &source)
+    {
+        const ShaderOperand copy = source; // it may be a source of the instruction
+        instruction.opcode = SHADER_OP_MOV;
+        instruction.sources_count = 1;
+        instruction.sources[0] = copy;
+    }
+
+    // Constant registers the shader reads: matrices read their rows, relative addressing reads all registers from
+    // its offset (as the first of them is `relative_first')
+    void get_read_constants(const ShaderCode &code, std::vector<bool> &res, unsigned &relative_first)
+    {
+        const unsigned count = get_registers_count( code.type, SHADER_OPERAND_CONST );
+        res.assign( count, false );
+        relative_first = count;
+        for( unsigned i = 0; i < code.instructions.size(); ++i )
+        {
+            const ShaderInstruction &instruction = code.instructions[i];
+            for( unsigned j = 0; j < instruction.sources_count; ++j )
+            {
+                const ShaderOperand &source = instruction.sources[j];
+                if( source.type != SHADER_OPERAND_CONST )
+                    continue;
+                if( source.relative )
+                {
+                    relative_first = std::min( relative_first, source.index );
+                    continue;
+                }
+                const unsigned rows = ( j == 1 && get_matrix_rows( instruction.opcode ) != 0 ) ? get_matrix_rows( instruction.opcode ) : 1;
+                for( unsigned k = source.index; k < source.index + rows && k < count; ++k )
+                    res[k] = true;
+            }
+        }
+    }
+
+    const ShaderDefinition *find_definition(const ShaderCode &code, unsigned constant)
+    {
+        for( unsigned i = 0; i < code.definitions.size(); ++i )
+        {
+            if( code.definitions[i].constant == constant )
+                return &code.definitions[i];
+        }
+        return NULL;
+    }
+
+    // A constant register defined as `value' in the components of the mask: of a definition which has it, or of a new one
+    // in a register the shader does not read. False if there is none
+    bool find_constant(ShaderCode &code, const float value[SHADER_COMPONENTS], BYTE mask, unsigned &res)
+    {
+        for( unsigned i = 0; i < code.definitions.size(); ++i )
+        {
+            bool equal = true;
+            for( unsigned j = 0; j < SHADER_COMPONENTS; ++j )
+                equal = equal && ( ( mask & ( 1 << j ) ) == 0 || code.definitions[i].value[j] == value[j] );
+            if( equal )
+            {
+                res = code.definitions[i].constant;
+                return true;
+            }
+        }
+        std::vector<bool> read;
+        unsigned relative_first;
+        get_read_constants( code, read, relative_first );
+        for( unsigned i = 0; i < relative_first; ++i )
+        {
+            if( read[i] || find_definition( code, i ) != NULL )
+                continue;
+            ShaderDefinition definition;
+            definition.constant = i;
+            for( unsigned j = 0; j < SHADER_COMPONENTS; ++j )
+                definition.value[j] = ( ( mask & ( 1 << j ) ) != 0 ) ? value[j] : 0.0f;
+            code.definitions.push_back( definition );
+            res = i;
+            return true;
+        }
+        return false;
+    }
+
+    //-------------------------------------------------------------------------------------------------------------------
+    // Dead code
+
+    // Components of registers read after an instruction before they are overwritten
+    struct LIVE_REGISTERS
+    {
+        BYTE temps[SHADER_TEMP_REGISTERS];
+        BYTE address;
+        BYTE position;
+        BYTE colors[SHADER_COLOR_OUTPUTS];
+        BYTE texcoords[SHADER_TEXCOORD_OUTPUTS];
+    };
+
+    BYTE *get_live(LIVE_REGISTERS &live, const ShaderOperand &operand)
+    {
+        switch( operand.type )
+        {
+        case SHADER_OPERAND_TEMP:       return &live.temps[operand.index];
+        case SHADER_OPERAND_ADDRESS:    return &live.address;
+        case SHADER_OPERAND_POSITION:   return &live.position;
+        case SHADER_OPERAND_COLOR:      return &live.colors[operand.index];
+        case SHADER_OPERAND_TEXCOORD:   return &live.texcoords[operand.index];
+        default:                        return NULL; // never written
+        }
+    }
+
+    // Narrows the write mask to the components which are read, false if the instruction cannot be narrowed
+    bool narrow_mask(ShaderType shader, BYTE read, ShaderInstruction &instruction)
+    {
+        ShaderOperand &dest = instruction.dest;
+        if( dest.type == SHADER_OPERAND_ADDRESS )
+            return false;
+        switch( instruction.opcode )
+        {
+        case SHADER_OP_M4X4:
+            // m4x3 is m4x4 without the last row, and it writes xyz
+            if( ( read & W_COMPONENT ) != 0 || ( dest.write_mask & XYZ_COMPONENTS ) != XYZ_COMPONENTS )
+                return false;
+            instruction.opcode = SHADER_OP_M4X3;
+            dest.write_mask = XYZ_COMPONENTS;
+            return true;
+        case SHADER_OP_M4X3:
+        case SHADER_OP_M3X3:
+        case SHADER_OP_TEXLD:
+        case SHADER_OP_TEXCRD:
+            return false;
+        default:
+            {
+                // masks of ps_1_4 are kept to rgb, a or both
+                const BYTE mask = ( shader == SHADER_VERTEX ) ? read :
+                                  ( ( read & XYZ_COMPONENTS ) != 0 ? ( dest.write_mask & XYZ_COMPONENTS ) : 0 ) | ( read & W_COMPONENT );
+                if( mask == dest.write_mask )
+                    return false;
+                dest.write_mask = mask;
+                return true;
+            }
+        }
+    }
+
+    bool eliminate_dead_code(ShaderCode &code, ShaderOptimizationStats &stats)
+    // backwards, with the registers live after each instruction
+    {
+        LIVE_REGISTERS live;
+        ZeroMemory( &live, sizeof(live) );
+        if( code.type == SHADER_VERTEX )
+        {
+            live.position = ALL_COMPONENTS;
+            memset( live.colors, ALL_COMPONENTS, sizeof(live.colors) );
+            memset( live.texcoords, ALL_COMPONENTS, sizeof(live.texcoords) );
+        }
+        else
+        {
+            live.temps[0] = ALL_COMPONENTS; // the color of the pixel
+        }
+
+        std::vector<ShaderInstruction> &instructions = code.instructions;
+        bool changed = false;
+        for( unsigned i = static_cast<unsigned>( instructions.size() ); i-- > 0; )
+        {
+            ShaderInstruction &instruction = instructions[i];
+            if( instruction.opcode == SHADER_OP_PHASE )
+            {
+                // alpha of temporaries written before `phase' is not read after it
+                for( unsigned j = 0; j < SHADER_TEMP_REGISTERS; ++j )
+                    live.temps[j] &= XYZ_COMPONENTS;
+                continue;
+            }
+            BYTE &dest_live = *get_live( live, instruction.dest );
+            const BYTE read = instruction.dest.write_mask & dest_live;
+            if( read == 0 || is_identity_mov( instruction ) )
+            {
+                instructions.erase( instructions.begin() + i );
+                ++stats.removed;
+                changed = true;
+                continue;
+            }
+            if( read != instruction.dest.write_mask && narrow_mask( code.type, read, instruction ) )
+            {
+                ++stats.narrowed;
+                changed = true;
+            }
+            dest_live &= ~instruction.dest.write_mask;
+            for( unsigned j = 0; j < instruction.sources_count; ++j )
+            {
+                const ShaderOperand &source = instruction.sources[j];
+                if( source.relative )
+                    live.address |= 1;
+                if( source.type == SHADER_OPERAND_TEMP )
+                    live.temps[source.index] |= get_read_mask( instruction, j );
+            }
+        }
+        return changed;
+    }
+
+    //-------------------------------------------------------------------------------------------------------------------
+    // Constant folding
+
+    // Values of temporaries known at an instruction
+    struct KNOWN_VALUES
+    {
+        bool known[SHADER_TEMP_REGISTERS][SHADER_COMPONENTS];
+        float values[SHADER_TEMP_REGISTERS][SHADER_COMPONENTS];
+    };
+
+    // The value the source has at the position, false if it is not known
+    bool get_source_value( const ShaderCode &code, const KNOWN_VALUES &known, const ShaderOperand &source, unsigned position,
+                           float &res )
+    {
+        const unsigned component = source.swizzle[position];
+        if( source.type == SHADER_OPERAND_CONST && !source.relative )
+        {
+            const ShaderDefinition *definition = find_definition( code, source.index );
+            if( definition == NULL )
+                return false; // set from outside
+            res = definition->value[component];
+            if( code.type == SHADER_PIXEL )
+                res = std::max( -PS_MAX_CONSTANT, std::min( res, PS_MAX_CONSTANT ) );
+        }
+        else if( source.type == SHADER_OPERAND_TEMP && known.known[source.index][component] )
+            res = known.values[source.index][component];
+        else
+            return false;
+        if( source.negate )
+            res = -res;
+        return true;
+    }
+
+    // The source is `value' at all positions the instruction reads
+    bool is_uniform( const ShaderCode &code, const KNOWN_VALUES &known, const ShaderInstruction &instruction, unsigned source,
+                     float value )
+    {
+        const BYTE positions = get_source_positions( instruction, source );
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+        {
+            float source_value;
+            if( ( positions & ( 1 << i ) ) != 0 &&
+                ( !get_source_value( code, known, instruction.sources[source], i, source_value ) || source_value != value ) )
+            {
+                return false;
+            }
+        }
+        return positions != 0;
+    }
+
+    // The result of the instruction if all it reads is known, as the interpreters compute it
+    bool evaluate( const ShaderCode &code, const KNOWN_VALUES &known, const ShaderInstruction &instruction,
+                   float res[SHADER_COMPONENTS] )
+    {
+        if( get_matrix_rows( instruction.opcode ) != 0 || instruction.opcode == SHADER_OP_TEXLD ||
+            instruction.opcode == SHADER_OP_TEXCRD || instruction.opcode == SHADER_OP_PHASE )
+        {
+            return false;
+        }
+        BatchRegister sources[SHADER_MAX_SOURCES];
+        for( unsigned i = 0; i < instruction.sources_count; ++i )
+        {
+            const BYTE positions = get_source_positions( instruction, i );
+            for( unsigned j = 0; j < SHADER_COMPONENTS; ++j )
+            {
+                float value = 0;
+                if( ( positions & ( 1 << j ) ) != 0 && !get_source_value( code, known, instruction.sources[i], j, value ) )
+                    return false;
+                std::fill( sources[i].components[j], sources[i].components[j] + SHADER_BATCH_SIZE, value );
+            }
+        }
+        BatchRegister result;
+        execute( instruction.opcode, sources, result );
+        if( code.type == SHADER_PIXEL )
+            clamp( result, -PS_MAX_VALUE, PS_MAX_VALUE );
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+            res[i] = result.components[i][0];
+        return true;
+    }
+
+    // mov dest, c# of the value, false if it cannot be defined
+    bool fold(ShaderCode &code, const float value[SHADER_COMPONENTS], ShaderInstruction &instruction)
+    {
+        const BYTE mask = instruction.dest.write_mask;
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+        {
+            if( code.type == SHADER_PIXEL && ( mask & ( 1 << i ) ) != 0 && fabs( value[i] ) > PS_MAX_CONSTANT )
+                return false;
+        }
+        unsigned constant;
+        if( !find_constant( code, value, mask, constant ) )
+            return false;
+        ShaderOperand source = ShaderOperand();
+        source.type = SHADER_OPERAND_CONST;
+        source.index = constant;
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+            source.swizzle[i] = static_cast<BYTE>( i );
+        make_mov( instruction, source );
+        return true;
+    }
+
+    // Folds or simplifies the instruction, false if it is left as it is
+    bool simplify(ShaderCode &code, const KNOWN_VALUES &known, ShaderInstruction &instruction)
+    {
+        if( instruction.dest.type == SHADER_OPERAND_ADDRESS ||
+            ( instruction.opcode == SHADER_OP_MOV && instruction.sources[0].type == SHADER_OPERAND_CONST ) )
+        {
+            return false;
+        }
+        float value[SHADER_COMPONENTS];
+        if( evaluate( code, known, instruction, value ) && fold( code, value, instruction ) )
+            return true;
+
+        const float ZERO[SHADER_COMPONENTS] = { 0, 0, 0, 0 };
+        ShaderOperand *sources = instruction.sources;
+        switch( instruction.opcode )
+        {
+        case SHADER_OP_MUL:
+            for( unsigned i = 0; i < 2; ++i )
+            {
+                if( is_uniform( code, known, instruction, i, 0.0f ) )
+                    return fold( code, ZERO, instruction );
+                if( is_uniform( code, known, instruction, i, 1.0f ) || is_uniform( code, known, instruction, i, -1.0f ) )
+                {
+                    ShaderOperand factor = sources[1 - i];
+                    factor.negate = ( factor.negate != is_uniform( code, known, instruction, i, -1.0f ) );
+                    make_mov( instruction, factor );
+                    return true;
+                }
+            }
+            break;
+        case SHADER_OP_ADD:
+            for( unsigned i = 0; i < 2; ++i )
+            {
+                if( is_uniform( code, known, instruction, i, 0.0f ) )
+                {
+                    make_mov( instruction, sources[1 - i] );
+                    return true;
+                }
+            }
+            break;
+        case SHADER_OP_SUB:
+            if( is_uniform( code, known, instruction, 1, 0.0f ) )
+            {
+                make_mov( instruction, sources[0] );
+                return true;
+            }
+            break;
+        case SHADER_OP_MAD:
+            if( is_uniform( code, known, instruction, 2, 0.0f ) )
+            {
+                instruction.opcode = SHADER_OP_MUL;
+                instruction.sources_count = 2;
+                return true;
+            }
+            for( unsigned i = 0; i < 2; ++i )
+            {
+                if( is_uniform( code, known, instruction, i, 0.0f ) )
+                {
+                    make_mov( instruction, sources[2] );
+                    return true;
+                }
+                if( is_uniform( code, known, instruction, i, 1.0f ) )
+                {
+                    const ShaderOperand factor = sources[1 - i];
+                    instruction.opcode = SHADER_OP_ADD;
+                    instruction.sources_count = 2;
+                    sources[0] = factor;
+                    sources[1] = sources[2];
+                    return true;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+        return false;
+    }
+
+    bool fold_constants(ShaderCode &code, ShaderOptimizationStats &stats)
+    {
+        KNOWN_VALUES known;
+        ZeroMemory( &known, sizeof(known) );
+        bool changed = false;
+        for( unsigned i = 0; i < code.instructions.size(); ++i )
+        {
+            ShaderInstruction &instruction = code.instructions[i];
+            if( instruction.opcode == SHADER_OP_PHASE )
+            {
+                for( unsigned j = 0; j < SHADER_TEMP_REGISTERS; ++j )
+                    known.known[j][SHADER_COMPONENTS - 1] = false;
+                continue;
+            }
+            if( simplify( code, known, instruction ) )
+            {
+                ++stats.folded;
+                changed = true;
+            }
+            if( instruction.dest.type == SHADER_OPERAND_TEMP )
+            {
+                float value[SHADER_COMPONENTS];
+                const bool evaluated = evaluate( code, known, instruction, value );
+                for( unsigned j = 0; j < SHADER_COMPONENTS; ++j )
+                {
+                    if( ( instruction.dest.write_mask & ( 1 << j ) ) == 0 )
+                        continue;
+                    known.known[instruction.dest.index][j] = evaluated;
+                    known.values[instruction.dest.index][j] = value[j];
+                }
+            }
+        }
+        return changed;
+    }
+
+    //-------------------------------------------------------------------------------------------------------------------
+    // Copy propagation and combining
+
+    bool propagate_copies(ShaderCode &code, ShaderOptimizationStats &stats)
+    {
+        std::vector<ShaderInstruction> &instructions = code.instructions;
+        bool changed = false;
+        for( unsigned i = 0; i < instructions.size(); ++i )
+        {
+            const ShaderInstruction &copy = instructions[i];
+            const ShaderOperand &source = copy.sources[0];
+            if( copy.opcode != SHADER_OP_MOV || copy.dest.type != SHADER_OPERAND_TEMP ||
+                ( source.type == SHADER_OPERAND_TEMP && source.index == copy.dest.index ) )
+            {
+                continue;
+            }
+            for( unsigned j = i + 1; j < instructions.size(); ++j )
+            {
+                ShaderInstruction &reader = instructions[j];
+                if( reader.opcode == SHADER_OP_PHASE )
+                    break;
+                // texture instructions read t# or r# as they are; matrices are constants
+                const unsigned sources_count = ( reader.opcode == SHADER_OP_TEXLD || reader.opcode == SHADER_OP_TEXCRD ) ? 0 :
+                                               ( get_matrix_rows( reader.opcode ) != 0 ) ? 1 : reader.sources_count;
+                for( unsigned k = 0; k < sources_count; ++k )
+                {
+                    const ShaderOperand &operand = reader.sources[k];
+                    if( operand.type != SHADER_OPERAND_TEMP || operand.index != copy.dest.index ||
+                        ( get_read_mask( reader, k ) & ~copy.dest.write_mask ) != 0 )
+                    {
+                        continue;
+                    }
+                    ShaderInstruction candidate = reader;
+                    candidate.sources[k] = compose( source, operand );
+                    if( !fits_read_ports( code.type, candidate ) ||
+                        ( code.type == SHADER_PIXEL && !is_pixel_swizzle( candidate.sources[k] ) ) )
+                    {
+                        continue;
+                    }
+                    reader = candidate;
+                    ++stats.propagated;
+                    changed = true;
+                }
+                if( overwrites( reader, copy.dest ) || overwrites( reader, source ) )
+                    break;
+            }
+        }
+        return changed;
+    }
+
+    // The components of the temporary are read from instruction `first' on before they are overwritten
+    bool is_read_after(const ShaderCode &code, unsigned first, unsigned temp, BYTE mask)
+    {
+        for( unsigned i = first; i < code.instructions.size() && mask != 0; ++i )
+        {
+            const ShaderInstruction &instruction = code.instructions[i];
+            if( instruction.opcode == SHADER_OP_PHASE )
+            {
+                mask &= XYZ_COMPONENTS;
+                continue;
+            }
+            if( ( get_temp_reads( instruction, temp ) & mask ) != 0 )
+                return true;
+            if( instruction.dest.type == SHADER_OPERAND_TEMP && instruction.dest.index == temp )
+                mask &= ~instruction.dest.write_mask;
+        }
+        return mask != 0 && code.type == SHADER_PIXEL && temp == 0; // r0 is the color of the pixel
+    }
+
+    bool combine_instructions(ShaderCode &code, ShaderOptimizationStats &stats)
+    {
+        std::vector<ShaderInstruction> &instructions = code.instructions;
+        bool changed = false;
+        for( unsigned j = 0; j < instructions.size(); ++j )
+        {
+            const ShaderInstruction &add = instructions[j];
+            if( add.opcode != SHADER_OP_ADD )
+                continue;
+            for( unsigned k = 0; k < 2; ++k )
+            {
+                const ShaderOperand &product = add.sources[k];
+                const ShaderOperand &addend = add.sources[1 - k];
+                if( product.type != SHADER_OPERAND_TEMP || is_same_register( product, addend ) )
+                    continue;
+                // the mul which writes the product last, in the same phase
+                unsigned i = j;
+                while( i-- > 0 && instructions[i].opcode != SHADER_OP_PHASE && !overwrites( instructions[i], product ) )
+                    ;
+                if( i >= j || instructions[i].opcode != SHADER_OP_MUL || ( get_read_mask( add, k ) & ~instructions[i].dest.write_mask ) != 0 )
+                    continue;
+                const ShaderInstruction &mul = instructions[i];
+
+                // nothing else reads the product, and the factors are not overwritten before the add
+                bool intact = true;
+                for( unsigned m = i + 1; m < j && intact; ++m )
+                {
+                    intact = ( get_temp_reads( instructions[m], product.index ) & mul.dest.write_mask ) == 0 &&
+                             !overwrites( instructions[m], mul.sources[0] ) && !overwrites( instructions[m], mul.sources[1] );
+                }
+                const BYTE left = mul.dest.write_mask & ( is_same_register( add.dest, product ) ? ~add.dest.write_mask : ALL_COMPONENTS );
+                if( !intact || is_read_after( code, j + 1, product.index, left ) )
+                    continue;
+
+                ShaderInstruction mad = add;
+                mad.opcode = SHADER_OP_MAD;
+                mad.sources_count = 3;
+                mad.sources[0] = compose( mul.sources[0], product );
+                mad.sources[1] = compose( mul.sources[1], product );
+                mad.sources[1].negate = mul.sources[1].negate; // the sign of the product is of the first factor
+                mad.sources[2] = addend;
+                if( !fits_read_ports( code.type, mad ) ||
+                    ( code.type == SHADER_PIXEL && ( !is_pixel_swizzle( mad.sources[0] ) || !is_pixel_swizzle( mad.sources[1] ) ) ) )
+                {
+                    continue;
+                }
+                instructions[j] = mad;
+                instructions.erase( instructions.begin() + i );
+                ++stats.combined;
+                changed = true;
+                --j; // the mad has moved there
+                break;
+            }
+        }
+        return changed;
+    }
+
+    void remove_unused_definitions(ShaderCode &code)
+    {
+        std::vector<bool> read;
+        unsigned relative_first;
+        get_read_constants( code, read, relative_first );
+        for( unsigned i = static_cast<unsigned>( code.definitions.size() ); i-- > 0; )
+        {
+            const unsigned constant = code.definitions[i].constant;
+            if( !read[constant] && constant < relative_first )
+                code.definitions.erase( code.definitions.begin() + i );
+        }
+    }
+}
+
+void optimize_shader(ShaderCode &code, ShaderOptimizationStats &stats)
+{
+    stats = ShaderOptimizationStats();
+    stats.source_slots = get_instruction_slots( code );
+    bool changed = true;
+    while( changed )
+    {
+        changed = false;
+        if( eliminate_dead_code( code, stats ) )
+            changed = true;
+        if( fold_constants( code, stats ) )
+            changed = true;
+        if( propagate_copies( code, stats ) )
+            changed = true;
+        if( combine_instructions( code, stats ) )
+            changed = true;
+    }
+    remove_unused_definitions( code );
+    stats.slots = get_instruction_slots( code );
+}
+
+bool reads_constant(const ShaderCode &code, unsigned constant)
+{
+    std::vector<bool> read;
+    unsigned relative_first;
+    get_read_constants( code, read, relative_first );
+    return constant >= relative_first || ( constant < read.size() && read[constant] );
+}
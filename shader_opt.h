@@ -0,0 +1,33 @@
+#pragma once
+#include "common.h"
+#include "shader_asm.h"
+
+// An optimizer of parsed shader assembly (see shader_asm.h), run before the shaders are assembled for the device:
+// the .vsh and .psh files are kept as readable as they were written, and the device gets the shortest code they allow.
+// Passes are repeated while any of them changes the code:
+// - dead code: instructions whose results are not read before they are overwritten (or the shader ends) are removed,
+//   and write masks of temporaries are narrowed to the components which are read (m4x4 becomes m4x3 if w is not);
+// - constant folding: an instruction of constants (def) and temporaries of known values becomes a mov of a constant defined
+//   for it in a register the shader does not read, and multiplying by 1 or 0, adding 0 are simplified;
+// - copy propagation: readers of a mov read its source instead, so that the mov becomes dead;
+// - combining: mul whose result is read by an add only becomes a mad with it.
+// Limits of the versions are kept: a vs_1_1 instruction reads one constant and one input register at most,
+// a ps_1_4 one reads two constants, takes sources swizzled as they were (identity or replicate) and no values are moved
+// across `phase'. Rounding may differ as a mad does not round its product, as optimizing compilers do
+
+struct ShaderOptimizationStats
+{
+    unsigned source_slots;  // instruction slots (see get_instruction_slots()) of the code before...
+    unsigned slots;         // ... and after
+    unsigned removed;       // instructions
+    unsigned narrowed;      // write masks
+    unsigned folded;        // instructions folded or simplified
+    unsigned propagated;    // sources read from the source of a mov
+    unsigned combined;      // mul and add pairs
+};
+
+// Optimizes the code in place; unreferenced definitions are removed at last
+void optimize_shader(ShaderCode &code, ShaderOptimizationStats &stats);
+
+// The shader reads the constant register: matrices read their rows, relative addressing reads all registers from its offset
+bool reads_constant(const ShaderCode &code, unsigned constant);
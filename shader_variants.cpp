@@ -0,0 +1,59 @@
+#include "shader_variants.h"
+#include "shader_opt.h"
+
+const unsigned SHADER_REG_AMBIENT_COLOR = 15;
+const unsigned SHADER_REG_POINT_COLOR = 16;
+const unsigned SHADER_REG_SPECULAR_COEF = 19;
+
+namespace
+{
+    const ShaderFeature FEATURES[] = { SHADER_FEATURE_POINT_LIGHT, SHADER_FEATURE_AMBIENT, SHADER_FEATURE_SPECULAR };
+
+    unsigned get_feature_register(ShaderFeature feature)
+    {
+        switch( feature )
+        {
+        case SHADER_FEATURE_POINT_LIGHT:    return SHADER_REG_POINT_COLOR;
+        case SHADER_FEATURE_AMBIENT:        return SHADER_REG_AMBIENT_COLOR;
+        default:                            return SHADER_REG_SPECULAR_COEF;
+        }
+    }
+
+    // def c#, 0, 0, 0, 0 over the definition of the register, if any
+    void define_zero(unsigned constant, ShaderCode &code)
+    {
+        ShaderDefinition definition = ShaderDefinition();
+        definition.constant = constant;
+        for( unsigned i = 0; i < code.definitions.size(); ++i )
+        {
+            if( code.definitions[i].constant == constant )
+            {
+                code.definitions[i] = definition;
+                return;
+            }
+        }
+        code.definitions.push_back( definition );
+    }
+}
+
+DWORD get_used_features(const ShaderCode &code)
+{
+    DWORD res = 0;
+    for( unsigned i = 0; i < array_size(FEATURES); ++i )
+    {
+        if( reads_constant( code, get_feature_register( FEATURES[i] ) ) )
+            res |= FEATURES[i];
+    }
+    return res;
+}
+
+void make_shader_variant(const ShaderCode &code, DWORD features, ShaderCode &res)
+{
+    res = code;
+    for( unsigned i = 0; i < array_size(FEATURES); ++i )
+    {
+        const unsigned reg = get_feature_register( FEATURES[i] );
+        if( ( features & FEATURES[i] ) == 0 && reads_constant( code, reg ) )
+            define_zero( reg, res );
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "common.h"
+#include "shader_asm.h"
+
+// Lighting paths of vertex shaders, as flags. A variant of a shader without some of them has the constant registers
+// of the missing ones defined as 0, so that the optimizer (see shader_opt.h) folds their code out. The variant runs
+// as the shader itself does with these registers set to 0
+enum ShaderFeature
+{
+    SHADER_FEATURE_POINT_LIGHT  = 1,    // SHADER_REG_POINT_COLOR
+    SHADER_FEATURE_AMBIENT      = 2,    // SHADER_REG_AMBIENT_COLOR
+    SHADER_FEATURE_SPECULAR     = 4,    // SHADER_REG_SPECULAR_COEF
+};
+const DWORD ALL_SHADER_FEATURES = SHADER_FEATURE_POINT_LIGHT | SHADER_FEATURE_AMBIENT | SHADER_FEATURE_SPECULAR;
+
+// c15, c16 and c19: the colors of the lights and the specular coefficient Application sets
+extern const unsigned SHADER_REG_AMBIENT_COLOR;
+extern const unsigned SHADER_REG_POINT_COLOR;
+extern const unsigned SHADER_REG_SPECULAR_COEF;
+
+// Features whose registers the shader reads: other flags make no variants
+DWORD get_used_features(const ShaderCode &code);
+
+// The variant of `code' with `features' into `res': registers of the others which it reads are defined as 0 (over their definitions, if any)
+void make_shader_variant(const ShaderCode &code, DWORD features, ShaderCode &res);
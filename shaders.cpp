@@ -1,12 +1,92 @@
 #include "shaders.h"
+#include "shader_opt.h"
+
+namespace
+{
+    // Parses the file into `res', false if the optimizer cannot parse it
+    bool load_shader_code(const char *filename, ShaderCode &res)
+    {
+        try
+        {
+            load_shader( filename, res );
+        }
+        catch( ShaderParseError & )
+        {
+            return false;
+        }
+        catch( ShaderFileError & )
+        {
+            return false;
+        }
+        return true;
+    }
+
+    // Assembles the code optimized
+    HRESULT assemble_code(const ShaderCode &code, ID3DXBuffer **res, unsigned &source_slots, unsigned &slots)
+    {
+        ShaderCode optimized = code;
+        ShaderOptimizationStats stats;
+        optimize_shader( optimized, stats );
+        source_slots = stats.source_slots;
+        slots = stats.slots;
+        std::string text;
+        write_shader( optimized, text );
+        return D3DXAssembleShader( text.c_str(), static_cast<UINT>( text.size() ), NULL, NULL, 0, res, NULL );
+    }
+}
 
 VertexShader::VertexShader(IDirect3DDevice9 *device, const char *shader_filename)
-: device(device), shader(NULL)
+: device(device), used_features(0), source_slots(0), slots(0)
+{
+    if( !load_shader_code( shader_filename, code ) )
+    {
+        create_variant( 0, shader_filename ); // no variants
+        return;
+    }
+    used_features = get_used_features( code );
+    try
+    {
+        // subsets of `used_features' down to 0, the whole set first
+        for( DWORD features = used_features; ; features = ( features - 1 ) & used_features )
+        {
+            create_variant( features );
+            if( features == 0 )
+                break;
+        }
+    }
+    // using catch(...) because every caught exception is rethrown
+    catch(...)
+    {
+        release_variants();
+        throw;
+    }
+}
+
+void VertexShader::create_variant(DWORD features, const char *shader_filename)
 {
+    IDirect3DVertexShader9 *shader = NULL;
     ID3DXBuffer * shader_buffer = NULL;
     try
     {
-        if( FAILED( D3DXAssembleShaderFromFileA( shader_filename, NULL, NULL, NULL, &shader_buffer, NULL ) ) )
+        HRESULT result;
+        if( shader_filename != NULL )
+        {
+            result = D3DXAssembleShaderFromFileA( shader_filename, NULL, NULL, NULL, &shader_buffer, NULL );
+        }
+        else
+        {
+            ShaderCode variant;
+            make_shader_variant( code, features, variant );
+            unsigned variant_source_slots;
+            unsigned variant_slots;
+            result = assemble_code( variant, &shader_buffer, variant_source_slots, variant_slots );
+            if( features == used_features )
+            {
+                source_slots = variant_source_slots;
+                slots = variant_slots;
+            }
+        }
+        if( FAILED( result ) )
             throw VertexShaderAssemblyError();
         if( FAILED( device->CreateVertexShader( (DWORD*) shader_buffer->GetBufferPointer(), &shader ) ) )
             throw VertexShaderInitError();
@@ -18,29 +98,43 @@ VertexShader::VertexShader(IDirect3DDevice9 *device, const char *shader_filename
         throw;
     }
     release_interface(shader_buffer);
+    variants[features] = shader;
 }
 
-void VertexShader::set()
+void VertexShader::set(DWORD features)
 {
-    check_render( device->SetVertexShader(shader) );
+    const Variants::const_iterator variant = variants.find( features & used_features );
+    _ASSERT( variant != variants.end() );
+    check_render( device->SetVertexShader( variant->second ) );
+}
+
+void VertexShader::release_variants()
+{
+    for( Variants::iterator iter = variants.begin(); iter != variants.end(); ++iter )
+        release_interface( iter->second );
+    variants.clear();
 }
 
 VertexShader::~VertexShader()
 {
-    release_interface( shader );
+    release_variants();
 }
 
 
 
 PixelShader::PixelShader(IDirect3DDevice9 *device, const char *shader_filename)
-: device(device), shader(NULL)
+: device(device), shader(NULL), source_slots(0), slots(0)
 {
     if( shader_filename != NULL )
     {
         ID3DXBuffer * shader_buffer = NULL;
         try
         {
-            if( FAILED( D3DXAssembleShaderFromFileA( shader_filename, NULL, NULL, NULL, &shader_buffer, NULL ) ) )
+            ShaderCode code;
+            const HRESULT result = load_shader_code( shader_filename, code ) ?
+                                   assemble_code( code, &shader_buffer, source_slots, slots ) :
+                                   D3DXAssembleShaderFromFileA( shader_filename, NULL, NULL, NULL, &shader_buffer, NULL );
+            if( FAILED( result ) )
                 throw PixelShaderAssemblyError();
             if( FAILED( device->CreatePixelShader( (DWORD*) shader_buffer->GetBufferPointer(), &shader ) ) )
                 throw PixelShaderInitError();
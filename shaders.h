@@ -1,15 +1,39 @@
 #pragma once
 
 #include "main.h"
+#include "shader_asm.h"
+#include "shader_variants.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <map>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// Shader files are optimized before they are assembled (see shader_opt.h); a file the optimizer cannot parse
+// is assembled as it is, and its instruction slots are not counted (they are 0)
 
 class VertexShader
 {
 private:
+    typedef std::map<DWORD, IDirect3DVertexShader9*> Variants;
+
     IDirect3DDevice9            *device;
-    IDirect3DVertexShader9      *shader;        // vertex shader
+    ShaderCode                  code;           // of the file, which variants are made of
+    DWORD                       used_features;  // features whose registers the shader reads: other flags make no variants
+    Variants                    variants;       // vertex shaders by their features (of `used_features')
+    unsigned                    source_slots;   // instruction slots of the file...
+    unsigned                    slots;          // ... and of the shader with all features
+
+    // Creates the variant of `code' (see shader_variants.h), or of the file as it is if it is given
+    void create_variant(DWORD features, const char *shader_filename = NULL);
+    void release_variants();
 public:
+    // Variants of all subsets of the used features are created at once, so that setting one never assembles
     VertexShader(IDirect3DDevice9 *device, const char *shader_filename);
-    void set();
+    void set(DWORD features = ALL_SHADER_FEATURES);
+    unsigned get_source_slots() const { return source_slots; }
+    unsigned get_slots() const { return slots; }
     ~VertexShader();
 };
 
@@ -18,8 +42,12 @@ class PixelShader
 private:
     IDirect3DDevice9            *device;
     IDirect3DPixelShader9       *shader;        // pixel shader
+    unsigned                    source_slots;   // instruction slots of the file...
+    unsigned                    slots;          // ... and of the shader
 public:
     PixelShader(IDirect3DDevice9 *device, const char *shader_filename = NULL); // NULL means use no shader
     void set();
+    unsigned get_source_slots() const { return source_slots; }
+    unsigned get_slots() const { return slots; }
     ~PixelShader();
 };
@@ -0,0 +1,444 @@
+#include "simplify.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#include <queue>
+#include <map>
+#include <algorithm>
+#include <iterator>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+namespace
+{
+    // Border edges are kept by planes perpendicular to them, weighted much heavier than faces
+    const double BORDER_WEIGHT = 10.0;
+
+    const DWORD REMOVED_TRIANGLE = static_cast<DWORD>(-1);
+
+    // Symmetric 4x4 matrix of the quadric error: error(p) = (p,1)^T * Q * (p,1)
+    struct Quadric
+    {
+        double a00, a01, a02, a03;
+        double      a11, a12, a13;
+        double           a22, a23;
+        double                a33;
+        double area; // accumulated area of faces, weights attribute error
+
+        Quadric() : a00(0), a01(0), a02(0), a03(0), a11(0), a12(0), a13(0), a22(0), a23(0), a33(0), area(0) {}
+
+        // adds weighted plane (n,p) + d = 0 with unit normal n
+        void add_plane(const D3DXVECTOR3 &n, double d, double weight)
+        {
+            a00 += weight*n.x*n.x; a01 += weight*n.x*n.y; a02 += weight*n.x*n.z; a03 += weight*n.x*d;
+            a11 += weight*n.y*n.y; a12 += weight*n.y*n.z; a13 += weight*n.y*d;
+            a22 += weight*n.z*n.z; a23 += weight*n.z*d;
+            a33 += weight*d*d;
+        }
+        Quadric &operator+=(const Quadric &q)
+        {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+            a11 += q.a11; a12 += q.a12; a13 += q.a13;
+            a22 += q.a22; a23 += q.a23;
+            a33 += q.a33;
+            area += q.area;
+            return *this;
+        }
+        double error(const D3DXVECTOR3 &p) const
+        {
+            const double x = p.x, y = p.y, z = p.z;
+            double result = x*(a00*x + 2*(a01*y + a02*z + a03))
+                          + y*(a11*y + 2*(a12*z + a13))
+                          + z*(a22*z + 2*a23)
+                          + a33;
+            return result > 0 ? result : 0; // rounding errors may give small negative values
+        }
+    };
+
+    struct Collapse
+    {
+        float cost;
+        Index from;         // `from' vertex moves into `to' vertex
+        Index to;
+
+        bool operator<(const Collapse &other) const { return cost > other.cost; } // for min-heap
+    };
+
+    typedef std::vector<DWORD> Triangles;
+
+    class Simplifier
+    {
+    private:
+        const D3DXVECTOR3 *positions;
+        const float *attributes;
+        unsigned attributes_count;
+        Index vertices_count;
+        Index *indices;
+        DWORD triangles_count;
+        const SimplificationParams &params;
+
+        std::vector<Quadric> quadrics;
+        std::vector<Triangles> vertex_triangles;    // triangles around each vertex
+        std::vector<bool> locked;                   // vertices which must not move
+        std::vector<bool> border;                   // vertices on the border of an open mesh
+        std::vector<bool> removed;
+        std::priority_queue<Collapse> collapses;
+        DWORD alive_triangles_count;
+
+        const Index *triangle(DWORD t) const { return &indices[t*VERTICES_PER_TRIANGLE]; }
+        Index *triangle(DWORD t) { return &indices[t*VERTICES_PER_TRIANGLE]; }
+
+        void lock_seams();
+        void compute_quadrics();
+        void add_border_quadrics();
+
+        static D3DXVECTOR3 face_normal(const D3DXVECTOR3 &p1, const D3DXVECTOR3 &p2, const D3DXVECTOR3 &p3);
+        unsigned triangles_with_edge(Index from, Index to) const;
+        void get_neighbours(Index vertex, std::vector<Index> &neighbours) const;
+        bool is_collapse_valid(Index from, Index to) const;
+        float collapse_cost(Index from, Index to) const;
+        void push_collapse(Index from, Index to);
+        void collapse(Index from, Index to);
+        void remove_triangle_from(Index vertex, DWORD t);
+
+    public:
+        Simplifier( const D3DXVECTOR3 *positions, const float *attributes, unsigned attributes_count, Index vertices_count,
+                    Index *indices, DWORD indices_count, const SimplificationParams &params );
+        DWORD run(); // returns the new number of indices
+    };
+
+    Simplifier::Simplifier( const D3DXVECTOR3 *positions, const float *attributes, unsigned attributes_count, Index vertices_count,
+                            Index *indices, DWORD indices_count, const SimplificationParams &params )
+    : positions(positions), attributes(attributes), attributes_count(attributes_count), vertices_count(vertices_count),
+      indices(indices), triangles_count(indices_count/VERTICES_PER_TRIANGLE), params(params),
+      quadrics(vertices_count), vertex_triangles(vertices_count), locked(vertices_count, false), border(vertices_count, false),
+      removed(vertices_count, false), alive_triangles_count(triangles_count)
+    {
+        for( DWORD t = 0; t < triangles_count; ++t )
+        {
+            for( unsigned i = 0; i < VERTICES_PER_TRIANGLE; ++i )
+                vertex_triangles[ triangle(t)[i] ].push_back(t);
+        }
+        lock_seams();
+        compute_quadrics();
+        add_border_quadrics();
+    }
+
+    void Simplifier::lock_seams()
+    // vertices with equal positions are seams between parts with different attributes: moving one would make a crack
+    {
+        std::map< std::pair<float, std::pair<float, float> >, Index > first_with_position;
+        for( Index v = 0; v < vertices_count; ++v )
+        {
+            std::pair<float, std::pair<float, float> > key( positions[v].x, std::make_pair(positions[v].y, positions[v].z) );
+            std::pair<std::map< std::pair<float, std::pair<float, float> >, Index >::iterator, bool> inserted
+                = first_with_position.insert( std::make_pair(key, v) );
+            if( !inserted.second )
+            {
+                locked[v] = true;
+                locked[inserted.first->second] = true;
+            }
+        }
+    }
+
+    D3DXVECTOR3 Simplifier::face_normal(const D3DXVECTOR3 &p1, const D3DXVECTOR3 &p2, const D3DXVECTOR3 &p3)
+    // not normalized: its length is the doubled area
+    {
+        D3DXVECTOR3 normal;
+        D3DXVECTOR3 e1 = p2 - p1;
+        D3DXVECTOR3 e2 = p3 - p1;
+        D3DXVec3Cross( &normal, &e1, &e2 );
+        return normal;
+    }
+
+    void Simplifier::compute_quadrics()
+    {
+        for( DWORD t = 0; t < triangles_count; ++t )
+        {
+            const Index *tri = triangle(t);
+            D3DXVECTOR3 normal = face_normal( positions[tri[0]], positions[tri[1]], positions[tri[2]] );
+            float double_area = D3DXVec3Length( &normal );
+            if( double_area == 0 )
+                continue;
+            normal /= double_area;
+            double area = double_area/2;
+            double d = -D3DXVec3Dot( &normal, &positions[tri[0]] );
+            for( unsigned i = 0; i < VERTICES_PER_TRIANGLE; ++i )
+            {
+                quadrics[tri[i]].add_plane( normal, d, area );
+                quadrics[tri[i]].area += area/VERTICES_PER_TRIANGLE;
+            }
+        }
+    }
+
+    unsigned Simplifier::triangles_with_edge(Index from, Index to) const
+    {
+        unsigned count = 0;
+        const Triangles &around = vertex_triangles[from];
+        for( unsigned i = 0; i < around.size(); ++i )
+        {
+            const Index *tri = triangle(around[i]);
+            if( tri[0] == to || tri[1] == to || tri[2] == to )
+                ++count;
+        }
+        return count;
+    }
+
+    void Simplifier::add_border_quadrics()
+    // edges having only one triangle are borders: keep them with planes perpendicular to the triangle
+    {
+        for( DWORD t = 0; t < triangles_count; ++t )
+        {
+            const Index *tri = triangle(t);
+            D3DXVECTOR3 normal = face_normal( positions[tri[0]], positions[tri[1]], positions[tri[2]] );
+            D3DXVec3Normalize( &normal, &normal );
+            for( unsigned i = 0; i < VERTICES_PER_TRIANGLE; ++i )
+            {
+                Index a = tri[i];
+                Index b = tri[(i + 1) % VERTICES_PER_TRIANGLE];
+                if( triangles_with_edge(a, b) != 1 )
+                    continue;
+                border[a] = border[b] = true;
+
+                D3DXVECTOR3 edge = positions[b] - positions[a];
+                D3DXVECTOR3 border_normal;
+                D3DXVec3Cross( &border_normal, &edge, &normal );
+                D3DXVec3Normalize( &border_normal, &border_normal );
+                double d = -D3DXVec3Dot( &border_normal, &positions[a] );
+                double weight = BORDER_WEIGHT*D3DXVec3LengthSq( &edge );
+                quadrics[a].add_plane( border_normal, d, weight );
+                quadrics[b].add_plane( border_normal, d, weight );
+            }
+        }
+    }
+
+    bool Simplifier::is_collapse_valid(Index from, Index to) const
+    {
+        if( locked[from] || removed[from] || removed[to] )
+            return false;
+
+        const unsigned shared_triangles = triangles_with_edge(from, to);
+        if( shared_triangles == 0 )
+            return false; // not an edge anymore
+        // border vertex may only slide along the border
+        if( border[from] && shared_triangles != 1 )
+            return false;
+
+        // link condition: common neighbours of both ends must be only the opposite vertices
+        // of the shared triangles, otherwise the collapse makes the mesh non-manifold
+        std::vector<Index> from_neighbours, to_neighbours, common;
+        get_neighbours( from, from_neighbours );
+        get_neighbours( to, to_neighbours );
+        std::set_intersection( from_neighbours.begin(), from_neighbours.end(), to_neighbours.begin(), to_neighbours.end(),
+                               std::back_inserter(common) );
+        if( common.size() > shared_triangles )
+            return false;
+
+        // triangles must not flip
+        const Triangles &around_from = vertex_triangles[from];
+        for( unsigned i = 0; i < around_from.size(); ++i )
+        {
+            const Index *tri = triangle(around_from[i]);
+            if( tri[0] == to || tri[1] == to || tri[2] == to )
+                continue; // will be removed
+            D3DXVECTOR3 moved[VERTICES_PER_TRIANGLE];
+            for( unsigned j = 0; j < VERTICES_PER_TRIANGLE; ++j )
+                moved[j] = positions[ tri[j] == from ? to : tri[j] ];
+            D3DXVECTOR3 before = face_normal( positions[tri[0]], positions[tri[1]], positions[tri[2]] );
+            D3DXVECTOR3 after = face_normal( moved[0], moved[1], moved[2] );
+            if( D3DXVec3Dot( &before, &after ) <= 0 )
+                return false;
+        }
+        return true;
+    }
+
+    float Simplifier::collapse_cost(Index from, Index to) const
+    {
+        Quadric q = quadrics[from];
+        q += quadrics[to];
+        double cost = q.error( positions[to] );
+
+        // attributes of `from' vertex are lost: error is weighted by the area it represents
+        double attribute_error = 0;
+        for( unsigned i = 0; i < attributes_count; ++i )
+        {
+            double difference = attributes[from*attributes_count + i] - attributes[to*attributes_count + i];
+            attribute_error += difference*difference;
+        }
+        cost += params.attribute_weight*quadrics[from].area*attribute_error;
+
+        if( params.keep_density )
+        {
+            // the longest edge appearing after the collapse, relative to the allowed length at this distance
+            double longest = 0;
+            const Triangles &around = vertex_triangles[from];
+            for( unsigned i = 0; i < around.size(); ++i )
+            {
+                const Index *tri = triangle(around[i]);
+                for( unsigned j = 0; j < VERTICES_PER_TRIANGLE; ++j )
+                {
+                    D3DXVECTOR3 edge = positions[tri[j]] - positions[to];
+                    double length = D3DXVec3LengthSq( &edge );
+                    if( tri[j] != from && length > longest )
+                        longest = length;
+                }
+            }
+            D3DXVECTOR3 from_dense_point = positions[from] - params.dense_point;
+            double relative_distance = D3DXVec3Length( &from_dense_point )/params.dense_radius;
+            cost += params.dense_weight*longest/( 1 + relative_distance*relative_distance );
+        }
+        return static_cast<float>(cost);
+    }
+
+    void Simplifier::get_neighbours(Index vertex, std::vector<Index> &neighbours) const
+    // writes sorted unique vertices sharing an edge with `vertex'
+    {
+        neighbours.clear();
+        const Triangles &around = vertex_triangles[vertex];
+        for( unsigned i = 0; i < around.size(); ++i )
+        {
+            const Index *tri = triangle(around[i]);
+            for( unsigned j = 0; j < VERTICES_PER_TRIANGLE; ++j )
+                if( tri[j] != vertex )
+                    neighbours.push_back( tri[j] );
+        }
+        std::sort( neighbours.begin(), neighbours.end() );
+        neighbours.erase( std::unique( neighbours.begin(), neighbours.end() ), neighbours.end() );
+    }
+
+    void Simplifier::push_collapse(Index from, Index to)
+    {
+        if( locked[from] )
+            return;
+        Collapse collapse;
+        collapse.cost = collapse_cost(from, to);
+        collapse.from = from;
+        collapse.to = to;
+        collapses.push( collapse );
+    }
+
+    void Simplifier::remove_triangle_from(Index vertex, DWORD t)
+    {
+        Triangles &around = vertex_triangles[vertex];
+        Triangles::iterator found = std::find( around.begin(), around.end(), t );
+        if( found != around.end() )
+        {
+            *found = around.back();
+            around.pop_back();
+        }
+    }
+
+    void Simplifier::collapse(Index from, Index to)
+    {
+        std::vector<Index> from_neighbours, to_neighbours, new_neighbours;
+        get_neighbours( from, from_neighbours );
+        get_neighbours( to, to_neighbours );
+        std::set_difference( from_neighbours.begin(), from_neighbours.end(), to_neighbours.begin(), to_neighbours.end(),
+                             std::back_inserter(new_neighbours) );
+
+        Triangles around = vertex_triangles[from];
+        for( unsigned i = 0; i < around.size(); ++i )
+        {
+            const DWORD t = around[i];
+            Index *tri = triangle(t);
+            if( tri[0] == to || tri[1] == to || tri[2] == to )
+            {
+                // degenerates into an edge: remove it
+                for( unsigned j = 0; j < VERTICES_PER_TRIANGLE; ++j )
+                    if( tri[j] != from )
+                        remove_triangle_from( tri[j], t );
+                tri[0] = tri[1] = tri[2] = REMOVED_TRIANGLE;
+                --alive_triangles_count;
+            }
+            else
+            {
+                for( unsigned j = 0; j < VERTICES_PER_TRIANGLE; ++j )
+                    if( tri[j] == from )
+                        tri[j] = to;
+                vertex_triangles[to].push_back(t);
+            }
+        }
+        vertex_triangles[from].clear();
+        removed[from] = true;
+        quadrics[to] += quadrics[from];
+
+        // collapses of the old edges around `to' became more expensive: they are updated when popped;
+        // edges which came from `from' are new
+        for( unsigned i = 0; i < new_neighbours.size(); ++i )
+        {
+            if( new_neighbours[i] == to )
+                continue;
+            push_collapse( new_neighbours[i], to );
+            push_collapse( to, new_neighbours[i] );
+        }
+    }
+
+    DWORD Simplifier::run()
+    {
+        for( DWORD t = 0; t < triangles_count; ++t )
+        {
+            const Index *tri = triangle(t);
+            for( unsigned i = 0; i < VERTICES_PER_TRIANGLE; ++i )
+                push_collapse( tri[i], tri[(i + 1) % VERTICES_PER_TRIANGLE] ); // the opposite one is pushed by the neighbour triangle
+        }
+        // border edges have no neighbour triangle
+        for( DWORD t = 0; t < triangles_count; ++t )
+        {
+            const Index *tri = triangle(t);
+            for( unsigned i = 0; i < VERTICES_PER_TRIANGLE; ++i )
+            {
+                Index a = tri[i];
+                Index b = tri[(i + 1) % VERTICES_PER_TRIANGLE];
+                if( border[a] && border[b] && triangles_with_edge(a, b) == 1 )
+                    push_collapse( b, a );
+            }
+        }
+
+        while( !collapses.empty() )
+        {
+            if( params.target_triangles_count != 0 && alive_triangles_count <= params.target_triangles_count )
+                break;
+            Collapse next = collapses.top();
+            collapses.pop();
+            if( next.cost > params.target_error )
+                break;
+            if( !is_collapse_valid(next.from, next.to) )
+                continue; // may become valid after neighbours change, then it will be pushed again
+
+            // Costs only grow when quadrics absorb each other, so they are not updated after every collapse:
+            // the collapse is checked when popped and pushed back if it has become more expensive
+            float cost = collapse_cost( next.from, next.to );
+            if( cost > next.cost )
+            {
+                next.cost = cost;
+                collapses.push( next );
+                continue;
+            }
+            collapse( next.from, next.to );
+        }
+
+        // write remaining triangles into the beginning of indices
+        DWORD index = 0;
+        for( DWORD t = 0; t < triangles_count; ++t )
+        {
+            const Index *tri = triangle(t);
+            if( tri[0] != REMOVED_TRIANGLE )
+                add_triangle( tri[0], tri[1], tri[2], indices, index );
+        }
+        return index;
+    }
+}
+
+DWORD simplify( const D3DXVECTOR3 *positions, const float *attributes, unsigned attributes_count, Index vertices_count,
+                Index *indices, DWORD indices_count, const SimplificationParams &params )
+{
+    _ASSERT(positions != NULL);
+    _ASSERT(attributes != NULL || attributes_count == 0);
+    _ASSERT(indices != NULL);
+    _ASSERT(indices_count % VERTICES_PER_TRIANGLE == 0);
+    _ASSERT(params.dense_radius > 0);
+
+    Simplifier simplifier( positions, attributes, attributes_count, vertices_count, indices, indices_count, params );
+    return simplifier.run();
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include "common.h"
+#include "Vertex.h"
+
+// Maximal number of vertex attributes (besides position) taken into account by simplification
+#define MAX_SIMPLIFICATION_ATTRIBUTES 8
+
+struct SimplificationParams
+{
+    // Simplification stops when any of the targets is reached
+    DWORD target_triangles_count;   // 0 means "no limit"
+    float target_error;             // the cheapest collapse is more expensive than this
+
+    // Errors of attributes (normal, color, skinning weight) are multiplied by this before adding to geometric error
+    float attribute_weight;
+
+    // Keeping density where per-vertex lighting needs it (e.g. near the point light):
+    // edges around `dense_point' stay shorter than sqrt(target_error/dense_weight),
+    // and farther than `dense_radius' they are allowed to grow linearly with distance
+    bool keep_density;
+    D3DXVECTOR3 dense_point;
+    float dense_radius;
+    float dense_weight;
+
+    SimplificationParams()
+        : target_triangles_count(0), target_error(0), attribute_weight(1.0f),
+          keep_density(false), dense_point(0, 0, 0), dense_radius(1.0f), dense_weight(1.0f) {}
+};
+
+// Garland-Heckbert quadric error simplification of an indexed triangle list with edge collapses.
+// Vertices are never moved (each collapse moves one end of the edge into another), so the positions
+// and attributes stay exactly as generated; vertices that have the same position (seams between
+// parts with different normals or colors) and borders of open meshes are preserved.
+// `attributes' are `attributes_count' floats per vertex.
+// Rewrites `indices' and returns the new number of indices; unused vertices may be removed by compact_vertices()
+DWORD simplify( const D3DXVECTOR3 *positions, const float *attributes, unsigned attributes_count, Index vertices_count,
+                Index *indices, DWORD indices_count, const SimplificationParams &params );
+
+// Attributes (besides position) of vertex types that simplification tries to preserve, returns count written
+inline unsigned get_simplification_attributes(const Vertex &vertex, float *attributes)
+{
+    D3DXCOLOR color(vertex.color);
+    attributes[0] = vertex.normal.x;
+    attributes[1] = vertex.normal.y;
+    attributes[2] = vertex.normal.z;
+    attributes[3] = color.r;
+    attributes[4] = color.g;
+    attributes[5] = color.b;
+    return 6;
+}
+inline unsigned get_simplification_attributes(const SkinningVertex &vertex, float *attributes)
+{
+    unsigned count = get_simplification_attributes(static_cast<const Vertex&>(vertex), attributes);
+    // the weighted mean of bones: weights of different bones are not comparable one by one
+    float mean_bone = 0;
+    for( unsigned i = 0; i < BONE_INFLUENCES_COUNT; ++i )
+        mean_bone += vertex.weights[i]*vertex.bones[i];
+    attributes[count] = mean_bone/MAX_BONES_COUNT;
+    return count + 1;
+}
+
+// A helper for any vertex type: gathers positions and attributes and calls simplify()
+template<class VertexType> DWORD simplify( const VertexType *vertices, Index vertices_count,
+                                           Index *indices, DWORD indices_count, const SimplificationParams &params )
+{
+    _ASSERT(vertices != NULL);
+    D3DXVECTOR3 *positions = new D3DXVECTOR3[vertices_count];
+    float *attributes = NULL;
+    try
+    {
+        float vertex_attributes[MAX_SIMPLIFICATION_ATTRIBUTES];
+        const unsigned attributes_count = vertices_count > 0 ? get_simplification_attributes(vertices[0], vertex_attributes) : 0;
+        _ASSERT( attributes_count <= MAX_SIMPLIFICATION_ATTRIBUTES );
+
+        attributes = new float[vertices_count*attributes_count];
+        for( Index i = 0; i < vertices_count; ++i )
+        {
+            positions[i] = vertices[i].pos;
+            get_simplification_attributes(vertices[i], &attributes[i*attributes_count]);
+        }
+        DWORD result = simplify( positions, attributes, attributes_count, vertices_count, indices, indices_count, params );
+        delete_array(&attributes);
+        delete_array(&positions);
+        return result;
+    }
+    // using catch(...) because every caught exception is rethrown
+    catch(...)
+    {
+        delete_array(&attributes);
+        delete_array(&positions);
+        throw;
+    }
+}
+
+// Removes vertices not referenced by `indices' (keeping the order of others) and renumbers indices.
+// Returns the new number of vertices
+template<class VertexType> Index compact_vertices( VertexType *vertices, Index vertices_count, Index *indices, DWORD indices_count )
+{
+    _ASSERT(vertices != NULL);
+    _ASSERT(indices != NULL);
+    const Index UNUSED = static_cast<Index>(-1);
+    Index *remap = new Index[vertices_count];
+    for( Index i = 0; i < vertices_count; ++i )
+        remap[i] = UNUSED;
+    for( DWORD i = 0; i < indices_count; ++i )
+        remap[indices[i]] = 0;
+
+    Index new_count = 0;
+    for( Index i = 0; i < vertices_count; ++i )
+    {
+        if( remap[i] != UNUSED )
+        {
+            remap[i] = new_count;
+            vertices[new_count++] = vertices[i];
+        }
+    }
+    for( DWORD i = 0; i < indices_count; ++i )
+        indices[i] = remap[indices[i]];
+
+    delete_array(&remap);
+    return new_count;
+}
@@ -0,0 +1,186 @@
+#include "skinning.h"
+#include "parallel.h"
+#include "matrices.h"
+
+const float SKINNING_PERIOD = 2.0f;
+const float SKINNING_ANGLE = D3DX_PI/8.0f;
+const unsigned SKINNING_POSES_PER_PERIOD = 64;
+const float SKINNING_POSE_TOLERANCE = 5e-4f;
+
+namespace
+{
+    const float SKINNING_OMEGA = 2.0f*D3DX_PI/SKINNING_PERIOD;
+
+    // Everything the threads share; SSE copies of the matrices are made by each thread on its stack
+    struct SKINNING_PARAMS
+    {
+        const SoftwareColumns *vertices;
+        const D3DXMATRIX *bones;
+        unsigned bones_count;
+        const D3DXMATRIX *position_and_rotation;
+        const D3DXMATRIX *view;
+        const LightingConstants *lighting;
+        SoftwareColumns *res;
+        DeformedStreams *deformed; // of skin_deformed_vertices() which has neither the matrices nor `res'
+    };
+
+    // Bones of an influence of a batch (`batch_bones' from its column), each bone in the lane of its vertex.
+    // Only rows 0-2 are loaded: the last one is not read by transform_point() and transform_vector()
+    void gather_bones(const D3DXMATRIX *bones, unsigned bones_count, const float *batch_bones, SoftwareMatrix &res)
+    {
+        UNREFERENCED_PARAMETER(bones_count); // for checks only
+        if( batch_bones[0] == batch_bones[1] && batch_bones[1] == batch_bones[2] && batch_bones[2] == batch_bones[3] )
+        {
+            // the usual case: neighbouring vertices share bones
+            const unsigned bone = static_cast<unsigned>( batch_bones[0] );
+            _ASSERT( bone < bones_count );
+            for( unsigned i = 0; i < 3; ++i )
+            {
+                for( unsigned j = 0; j < 4; ++j )
+                    res.m[i][j] = _mm_set1_ps( bones[bone](i, j) );
+            }
+            return;
+        }
+        const D3DXMATRIX *lanes[SOFTWARE_BATCH_SIZE];
+        for( unsigned i = 0; i < SOFTWARE_BATCH_SIZE; ++i )
+        {
+            const unsigned bone = static_cast<unsigned>( batch_bones[i] );
+            _ASSERT( bone < bones_count );
+            lanes[i] = &bones[bone];
+        }
+        for( unsigned i = 0; i < 3; ++i )
+        {
+            for( unsigned j = 0; j < 4; ++j )
+                res.m[i][j] = _mm_setr_ps( (*lanes[0])(i, j), (*lanes[1])(i, j), (*lanes[2])(i, j), (*lanes[3])(i, j) );
+        }
+    }
+
+    // The sums of positions and normals of the batch from `first' by bones multiplied by weights
+    void skin_batch(const SKINNING_PARAMS &params, Index first, SoftwareVector &skinned_position, SoftwareVector &skinned_normal)
+    {
+        const SoftwareColumns &vertices = *params.vertices;
+        const SoftwareVector position = load_vector( vertices, SOFTWARE_POSITION_X, first );
+        const SoftwareVector normal = load_vector( vertices, SOFTWARE_NORMAL_X, first );
+
+        const SoftwareVector zero = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+        skinned_position = zero;
+        skinned_normal = zero;
+        for( unsigned i = 0; i < BONE_INFLUENCES_COUNT; ++i )
+        {
+            const __m128 weight = _mm_loadu_ps( vertices.get_column(SOFTWARE_WEIGHT + i) + first );
+            if( _mm_movemask_ps( _mm_cmpneq_ps( weight, _mm_setzero_ps() ) ) == 0 )
+                continue; // the influence is not used by the batch
+            SoftwareMatrix bone;
+            gather_bones( params.bones, params.bones_count, vertices.get_column(SOFTWARE_BONE + i) + first, bone );
+            skinned_position = add( skinned_position, scale( transform_point( bone, position ), weight ) );
+            skinned_normal = add( skinned_normal, scale( transform_vector( bone, normal ), weight ) );
+        }
+    }
+
+    void skin_batches(void *context, unsigned thread, DWORD begin, DWORD end)
+    // batches [begin, end)
+    {
+        UNREFERENCED_PARAMETER(thread);
+        const SKINNING_PARAMS &params = *static_cast<SKINNING_PARAMS*>(context);
+        const SoftwareColumns &vertices = *params.vertices;
+
+        const SoftwareMatrix position_and_rotation( *params.position_and_rotation );
+        const SoftwareMatrix view( *params.view );
+        const SoftwareLighting lighting( *params.lighting, true );
+
+        for( DWORD batch = begin; batch < end; ++batch )
+        {
+            const Index first = batch*SOFTWARE_BATCH_SIZE;
+            SoftwareVector skinned_position;
+            SoftwareVector skinned_normal;
+            skin_batch( params, first, skinned_position, skinned_normal );
+            const SoftwareVector world_position = transform_point( position_and_rotation, skinned_position );
+            const SoftwareVector world_normal = transform_vector( position_and_rotation, skinned_normal );
+
+            __m128 color[SOFTWARE_COLOR_COMPONENTS];
+            for( unsigned i = 0; i < SOFTWARE_COLOR_COMPONENTS; ++i )
+                color[i] = _mm_loadu_ps( vertices.get_column(SOFTWARE_COLOR_R + i) + first );
+            __m128 res_position[4];
+            __m128 res_color[SOFTWARE_COLOR_COMPONENTS];
+            project( view, world_position, res_position );
+            lighting.light( world_position, world_normal, color, res_color );
+            store_output( res_position, res_color, first, *params.res );
+        }
+    }
+
+    void skin_deformed_batches(void *context, unsigned thread, DWORD begin, DWORD end)
+    // batches [begin, end) from the first batch of the deformed streams
+    {
+        UNREFERENCED_PARAMETER(thread);
+        const SKINNING_PARAMS &params = *static_cast<SKINNING_PARAMS*>(context);
+        const DWORD first_batch = get_first_batch( *params.deformed );
+        for( DWORD batch = first_batch + begin; batch < first_batch + end; ++batch )
+        {
+            const Index first = batch*SOFTWARE_BATCH_SIZE;
+            SoftwareVector skinned_position;
+            SoftwareVector skinned_normal;
+            skin_batch( params, first, skinned_position, skinned_normal );
+            store_deformed( skinned_position, skinned_normal, first, *params.deformed );
+        }
+    }
+}
+
+void skin_vertices( const SoftwareColumns &vertices, const D3DXMATRIX *bones, unsigned bones_count, const D3DXMATRIX &position_and_rotation,
+                    const D3DXMATRIX &view, const LightingConstants &lighting, unsigned threads_count, SoftwareColumns &res )
+{
+    _ASSERT( bones != NULL && bones_count > 0 );
+    _ASSERT( vertices.get_columns_count() == SOFTWARE_SKINNING_VERTEX_COLUMNS );
+    _ASSERT( res.get_columns_count() == SOFTWARE_OUTPUT_COLUMNS );
+    _ASSERT( res.get_count() == vertices.get_count() );
+
+    SKINNING_PARAMS params;
+    params.vertices = &vertices;
+    params.bones = bones;
+    params.bones_count = bones_count;
+    params.position_and_rotation = &position_and_rotation;
+    params.view = &view;
+    params.lighting = &lighting;
+    params.res = &res;
+    params.deformed = NULL;
+    parallel_for( vertices.get_batches_count(), threads_count, skin_batches, &params );
+}
+
+void skin_deformed_vertices( const SoftwareColumns &vertices, const D3DXMATRIX *bones, unsigned bones_count, unsigned threads_count,
+                             DeformedStreams &res )
+{
+    _ASSERT( bones != NULL && bones_count > 0 );
+    _ASSERT( vertices.get_columns_count() == SOFTWARE_SKINNING_VERTEX_COLUMNS );
+    _ASSERT( res.first_vertex <= res.end_vertex && res.end_vertex <= vertices.get_count() );
+
+    SKINNING_PARAMS params;
+    params.vertices = &vertices;
+    params.bones = bones;
+    params.bones_count = bones_count;
+    params.position_and_rotation = NULL;
+    params.view = NULL;
+    params.lighting = NULL;
+    params.res = NULL;
+    params.deformed = &res;
+    parallel_for( get_end_batch(res) - get_first_batch(res), threads_count, skin_deformed_batches, &params );
+}
+
+void bend_bones(float time, const D3DXVECTOR3 &bone_center, unsigned bones_count, D3DXMATRIX *res_bones)
+{
+    _ASSERT( bones_count > 0 && res_bones != NULL );
+    const float angle = SKINNING_ANGLE*sin(SKINNING_OMEGA*time);
+    const unsigned last_bone = bones_count - 1;
+    for( unsigned i = 0; i <= last_bone; ++i )
+        res_bones[i] = rotate_x_matrix( ( last_bone == 0 ) ? angle : angle*i/last_bone, bone_center );
+}
+
+void sample_bent_bones(const D3DXVECTOR3 &bone_center, unsigned bones_count, PoseCache &res)
+{
+    _ASSERT( res.get_period() == SKINNING_PERIOD && res.get_poses_count() == SKINNING_POSES_PER_PERIOD );
+    _ASSERT( res.get_pose_size() == bones_count*sizeof(D3DXMATRIX)/sizeof(float) );
+    std::vector<D3DXMATRIX> bones( bones_count, rotate_x_matrix( 0.0f ) );
+    for( unsigned i = 0; i < SKINNING_POSES_PER_PERIOD; ++i )
+    {
+        bend_bones( res.get_sample_time(i), bone_center, bones_count, &bones[0] );
+        res.set_pose( i, bones[0] );
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "common.h"
+#include "lighting.h"
+#include "pose_cache.h"
+
+// skinning.vsh on the CPU (see software.h): positions and normals are blended between BONE_INFLUENCES_COUNT bones
+// by the weights, moved by the position-and-rotation matrix and lit; results are oPos (through the `view' matrix) and oD0.
+// Bones of the vertices are of the mesh (all `bones_count' of them), there are no palettes as in vertex buffers (see palette.h).
+// Matrices of bones and of the model are affine (the last row is 0 0 0 1) as all matrices of matrices.h are,
+// so w of a skinned position is 1 and a normal (a vector) takes no translation.
+// `vertices' have SOFTWARE_SKINNING_VERTEX_COLUMNS, `res' has SOFTWARE_OUTPUT_COLUMNS of as many vertices;
+// batches of vertices are split between `threads_count' threads (see parallel.h)
+void skin_vertices( const SoftwareColumns &vertices, const D3DXMATRIX *bones, unsigned bones_count, const D3DXMATRIX &position_and_rotation,
+                    const D3DXMATRIX &view, const LightingConstants &lighting, unsigned threads_count, SoftwareColumns &res );
+
+// Skinning only, for both passes of a model deformed on the CPU (see Model::set_software_deformation()): vertices
+// [res.first_vertex, res.end_vertex) are blended by the bones as above and written into `res' in model space.
+// Normals are not normalized: the pass-through shaders normalize them after the position-and-rotation matrix as skinning.vsh does
+void skin_deformed_vertices( const SoftwareColumns &vertices, const D3DXMATRIX *bones, unsigned bones_count, unsigned threads_count,
+                             DeformedStreams &res );
+
+// The animation of SkinningModel: the chain of bones bends around the x axis through `bone_center' back and forth
+// with the period SKINNING_PERIOD, the bones turn by angles growing from zero at its beginning to SKINNING_ANGLE at its end
+// (at most). Bones at `time' into `bones_count' matrices of `res_bones'
+extern const float SKINNING_PERIOD;
+extern const float SKINNING_ANGLE;
+void bend_bones(float time, const D3DXVECTOR3 &bone_center, unsigned bones_count, D3DXMATRIX *res_bones);
+
+// The same bones sampled SKINNING_POSES_PER_PERIOD times per period into `res', a PoseCache of SKINNING_PERIOD,
+// SKINNING_POSES_PER_PERIOD and `bones_count' matrices. Interpolated elements are within SKINNING_POSE_TOLERANCE
+// of bend_bones() for bone centers up to a unit away from the origin
+extern const unsigned SKINNING_POSES_PER_PERIOD;
+extern const float SKINNING_POSE_TOLERANCE;
+void sample_bent_bones(const D3DXVECTOR3 &bone_center, unsigned bones_count, PoseCache &res);
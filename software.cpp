@@ -0,0 +1,116 @@
+#include "software.h"
+
+SoftwareColumns::SoftwareColumns(unsigned columns_count, Index count)
+: columns_count(columns_count), count(count)
+{
+    _ASSERT( columns_count > 0 );
+    const DWORD64 batches_count = ( static_cast<DWORD64>( count ) + SOFTWARE_BATCH_SIZE - 1 )/SOFTWARE_BATCH_SIZE;
+    padded_count = ::get_count( batches_count*SOFTWARE_BATCH_SIZE );
+    data.resize( get_array_size( static_cast<DWORD64>( padded_count )*columns_count, sizeof(float) )/sizeof(float) );
+}
+
+void SoftwareColumns::pad()
+{
+    if( count == 0 )
+        return;
+    for( unsigned i = 0; i < columns_count; ++i )
+    {
+        float *column = get_column(i);
+        for( Index j = count; j < padded_count; ++j )
+            column[j] = column[count - 1];
+    }
+}
+
+namespace
+{
+    void load_vertex_columns(const Vertex &vertex, Index i, SoftwareColumns &res)
+    {
+        const D3DXCOLOR color( vertex.color );
+        res.get_column(SOFTWARE_POSITION_X)[i] = vertex.pos.x;
+        res.get_column(SOFTWARE_POSITION_Y)[i] = vertex.pos.y;
+        res.get_column(SOFTWARE_POSITION_Z)[i] = vertex.pos.z;
+        res.get_column(SOFTWARE_NORMAL_X)[i] = vertex.normal.x;
+        res.get_column(SOFTWARE_NORMAL_Y)[i] = vertex.normal.y;
+        res.get_column(SOFTWARE_NORMAL_Z)[i] = vertex.normal.z;
+        res.get_column(SOFTWARE_COLOR_R)[i] = color.r;
+        res.get_column(SOFTWARE_COLOR_G)[i] = color.g;
+        res.get_column(SOFTWARE_COLOR_B)[i] = color.b;
+        res.get_column(SOFTWARE_COLOR_A)[i] = color.a;
+    }
+}
+
+void load_software_vertices(const Vertex *vertices, Index vertices_count, SoftwareColumns &res)
+{
+    _ASSERT( vertices != NULL || vertices_count == 0 );
+    _ASSERT( res.get_columns_count() == SOFTWARE_VERTEX_COLUMNS && res.get_count() == vertices_count );
+    for( Index i = 0; i < vertices_count; ++i )
+        load_vertex_columns( vertices[i], i, res );
+    res.pad();
+}
+
+void load_software_vertices(const SkinningVertex *vertices, Index vertices_count, SoftwareColumns &res)
+{
+    _ASSERT( vertices != NULL || vertices_count == 0 );
+    _ASSERT( res.get_columns_count() == SOFTWARE_SKINNING_VERTEX_COLUMNS && res.get_count() == vertices_count );
+    for( Index i = 0; i < vertices_count; ++i )
+    {
+        load_vertex_columns( vertices[i], i, res );
+        for( unsigned j = 0; j < BONE_INFLUENCES_COUNT; ++j )
+        {
+            res.get_column(SOFTWARE_WEIGHT + j)[i] = vertices[i].weights[j];
+            res.get_column(SOFTWARE_BONE + j)[i] = vertices[i].bones[j];
+        }
+    }
+    res.pad();
+}
+
+SoftwareMatrix::SoftwareMatrix(const D3DXMATRIX &matrix)
+{
+    for( unsigned i = 0; i < 4; ++i )
+    {
+        for( unsigned j = 0; j < 4; ++j )
+            m[i][j] = _mm_set1_ps( matrix(i, j) );
+    }
+}
+
+void project(const SoftwareMatrix &view, const SoftwareVector &p, __m128 res[4])
+{
+    for( unsigned i = 0; i < 4; ++i )
+    {
+        res[i] = _mm_add_ps( _mm_add_ps( _mm_mul_ps(view.m[i][0], p.x), _mm_mul_ps(view.m[i][1], p.y) ),
+                             _mm_add_ps( _mm_mul_ps(view.m[i][2], p.z), view.m[i][3] ) );
+    }
+}
+
+void store_output(const __m128 position[4], const __m128 color[SOFTWARE_COLOR_COMPONENTS], Index first, SoftwareColumns &res)
+{
+    _ASSERT( res.get_columns_count() == SOFTWARE_OUTPUT_COLUMNS );
+    _ASSERT( first + SOFTWARE_BATCH_SIZE <= res.get_padded_count() );
+    for( unsigned i = 0; i < 4; ++i )
+        _mm_storeu_ps( res.get_column(SOFTWARE_OUT_X + i) + first, position[i] );
+    for( unsigned i = 0; i < SOFTWARE_COLOR_COMPONENTS; ++i )
+        _mm_storeu_ps( res.get_column(SOFTWARE_OUT_R + i) + first, color[i] );
+}
+
+void store_deformed(const SoftwareVector &position, const SoftwareVector &normal, Index first, DeformedStreams &res)
+{
+    _ASSERT( res.positions != NULL && res.normals != NULL && res.colors != NULL );
+    float components[6][SOFTWARE_BATCH_SIZE];
+    _mm_storeu_ps( components[0], position.x );
+    _mm_storeu_ps( components[1], position.y );
+    _mm_storeu_ps( components[2], position.z );
+    _mm_storeu_ps( components[3], normal.x );
+    _mm_storeu_ps( components[4], normal.y );
+    _mm_storeu_ps( components[5], normal.z );
+    for( unsigned i = 0; i < SOFTWARE_BATCH_SIZE; ++i )
+    {
+        const Index vertex = first + i;
+        if( vertex < res.first_vertex || vertex >= res.end_vertex )
+            continue;
+        DeformedPosition &position_res = res.positions[vertex - res.first_vertex];
+        DeformedNormal &normal_res = res.normals[vertex - res.first_vertex];
+        position_res.pos = D3DXVECTOR3( components[0][i], components[1][i], components[2][i] );
+        normal_res.normal = D3DXVECTOR4( components[3][i], components[4][i], components[5][i], 0 );
+        normal_res.color = res.colors[vertex];
+    }
+}
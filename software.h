@@ -0,0 +1,216 @@
+#pragma once
+#include "common.h"
+#include "Vertex.h"
+#include <xmmintrin.h>
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// Software vertex processing: vertex shaders of the models done on the CPU, as a fallback without a device
+// and as an oracle to check the shaders against. Vertices are kept as columns (a structure of arrays),
+// so that one SSE instruction processes SOFTWARE_BATCH_SIZE vertices. Lighting is in lighting.h
+
+// Floats in an SSE register
+#define SOFTWARE_BATCH_SIZE 4
+
+// Columns of loaded vertices (see load_software_vertices())...
+enum SoftwareInput
+{
+    SOFTWARE_POSITION_X,
+    SOFTWARE_POSITION_Y,
+    SOFTWARE_POSITION_Z,
+    SOFTWARE_NORMAL_X,
+    SOFTWARE_NORMAL_Y,
+    SOFTWARE_NORMAL_Z,
+    SOFTWARE_COLOR_R,
+    SOFTWARE_COLOR_G,
+    SOFTWARE_COLOR_B,
+    SOFTWARE_COLOR_A,
+    SOFTWARE_VERTEX_COLUMNS,                    // columns of Vertex...
+    SOFTWARE_WEIGHT = SOFTWARE_VERTEX_COLUMNS,  // ... and BONE_INFLUENCES_COUNT weights of SkinningVertex after them,
+    SOFTWARE_BONE = SOFTWARE_WEIGHT + BONE_INFLUENCES_COUNT, // ... then as many bones (whole numbers)
+    SOFTWARE_SKINNING_VERTEX_COLUMNS = SOFTWARE_BONE + BONE_INFLUENCES_COUNT,
+};
+
+// ... and of processed ones: oPos and oD0 of the shader (the color is saturated as the shader output is)
+enum SoftwareOutput
+{
+    SOFTWARE_OUT_X,
+    SOFTWARE_OUT_Y,
+    SOFTWARE_OUT_Z,
+    SOFTWARE_OUT_W,
+    SOFTWARE_OUT_R,
+    SOFTWARE_OUT_G,
+    SOFTWARE_OUT_B,
+    SOFTWARE_OUT_A,
+    SOFTWARE_OUTPUT_COLUMNS,
+};
+
+// Columns of floats of `count' vertices. Columns are padded to whole batches: the padding repeats the last vertex,
+// so a batch never reads garbage (nor makes denormals or infinities out of it)
+class SoftwareColumns
+{
+private:
+    std::vector<float> data;
+    unsigned columns_count;
+    Index count;
+    Index padded_count;
+public:
+    SoftwareColumns(unsigned columns_count, Index count);
+
+    unsigned get_columns_count() const { return columns_count; }
+    Index get_count() const { return count; }
+    Index get_padded_count() const { return padded_count; }
+    DWORD get_batches_count() const { return padded_count/SOFTWARE_BATCH_SIZE; }
+
+    float *get_column(unsigned column)
+    {
+        _ASSERT( column < columns_count );
+        return &data[column*padded_count];
+    }
+    const float *get_column(unsigned column) const
+    {
+        _ASSERT( column < columns_count );
+        return &data[column*padded_count];
+    }
+    // Copies the last vertex into the padding
+    void pad();
+};
+
+// Columns of Vertex or SkinningVertex: `res' must have SOFTWARE_VERTEX_COLUMNS or SOFTWARE_SKINNING_VERTEX_COLUMNS
+// columns of `vertices_count' vertices; colors are converted to floats as the shader gets them
+void load_software_vertices(const Vertex *vertices, Index vertices_count, SoftwareColumns &res);
+void load_software_vertices(const SkinningVertex *vertices, Index vertices_count, SoftwareColumns &res);
+
+// Components of RGBA colors of a batch
+#define SOFTWARE_COLOR_COMPONENTS 4
+
+// Structures with SSE members are kept on the stack only: the heap of Win32 does not align them.
+// A point or a vector of a batch of vertices
+struct SoftwareVector
+{
+    __m128 x, y, z;
+};
+
+// Elements of a matrix, each in all lanes (m[i][j] is _ij of D3DXMATRIX, 0-based)
+struct SoftwareMatrix
+{
+    __m128 m[4][4];
+    SoftwareMatrix() {}
+    explicit SoftwareMatrix(const D3DXMATRIX &matrix);
+};
+
+inline SoftwareVector load_vector(const SoftwareColumns &columns, unsigned x_column, Index first)
+// of the batch from `first': x, y, z are columns from `x_column'
+{
+    SoftwareVector res;
+    res.x = _mm_loadu_ps( columns.get_column(x_column) + first );
+    res.y = _mm_loadu_ps( columns.get_column(x_column + 1) + first );
+    res.z = _mm_loadu_ps( columns.get_column(x_column + 2) + first );
+    return res;
+}
+
+inline SoftwareVector add(const SoftwareVector &a, const SoftwareVector &b)
+{
+    SoftwareVector res = { _mm_add_ps(a.x, b.x), _mm_add_ps(a.y, b.y), _mm_add_ps(a.z, b.z) };
+    return res;
+}
+
+inline SoftwareVector subtract(const SoftwareVector &a, const SoftwareVector &b)
+{
+    SoftwareVector res = { _mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z) };
+    return res;
+}
+
+inline SoftwareVector scale(const SoftwareVector &v, __m128 k)
+{
+    SoftwareVector res = { _mm_mul_ps(v.x, k), _mm_mul_ps(v.y, k), _mm_mul_ps(v.z, k) };
+    return res;
+}
+
+inline __m128 dot(const SoftwareVector &a, const SoftwareVector &b)
+{
+    return _mm_add_ps( _mm_add_ps( _mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y) ), _mm_mul_ps(a.z, b.z) );
+}
+
+// 1/sqrt(x) by the approximation of SSE (12 bits) and one step of Newton's method, which makes it almost exact.
+// As `rsq' of the shaders, it gives infinity for 0
+inline __m128 fast_reciprocal_sqrt(__m128 x)
+{
+    const __m128 y = _mm_rsqrt_ps(x);
+    const __m128 newton = _mm_sub_ps( _mm_set1_ps(1.5f), _mm_mul_ps( _mm_mul_ps( _mm_set1_ps(0.5f), x ), _mm_mul_ps(y, y) ) );
+    const __m128 infinite = _mm_cmpeq_ps( x, _mm_setzero_ps() );
+    return _mm_or_ps( _mm_and_ps( infinite, y ), _mm_andnot_ps( infinite, _mm_mul_ps(y, newton) ) );
+}
+
+// 1/x by the approximation of SSE and one step of Newton's method
+inline __m128 fast_reciprocal(__m128 x)
+{
+    const __m128 y = _mm_rcp_ps(x);
+    return _mm_mul_ps( y, _mm_sub_ps( _mm_set1_ps(2.0f), _mm_mul_ps(x, y) ) );
+}
+
+// As transform_point() and transform_vector() of matrices.h: a column multiplied from the right
+inline SoftwareVector transform_point(const SoftwareMatrix &m, const SoftwareVector &p)
+{
+    SoftwareVector res;
+    __m128 *components[3] = { &res.x, &res.y, &res.z };
+    for( unsigned i = 0; i < 3; ++i )
+    {
+        *components[i] = _mm_add_ps( _mm_add_ps( _mm_mul_ps(m.m[i][0], p.x), _mm_mul_ps(m.m[i][1], p.y) ),
+                                     _mm_add_ps( _mm_mul_ps(m.m[i][2], p.z), m.m[i][3] ) );
+    }
+    return res;
+}
+
+inline SoftwareVector transform_vector(const SoftwareMatrix &m, const SoftwareVector &v)
+{
+    SoftwareVector res;
+    __m128 *components[3] = { &res.x, &res.y, &res.z };
+    for( unsigned i = 0; i < 3; ++i )
+    {
+        *components[i] = _mm_add_ps( _mm_add_ps( _mm_mul_ps(m.m[i][0], v.x), _mm_mul_ps(m.m[i][1], v.y) ),
+                                     _mm_mul_ps(m.m[i][2], v.z) );
+    }
+    return res;
+}
+
+// oPos: the point (w = 1) by the whole view matrix
+void project(const SoftwareMatrix &view, const SoftwareVector &p, __m128 res[4]);
+
+// Writes oPos and oD0 of the batch from `first' into SOFTWARE_OUTPUT_COLUMNS of `res'
+void store_output(const __m128 position[4], const __m128 color[SOFTWARE_COLOR_COMPONENTS], Index first, SoftwareColumns &res);
+
+// Vertices deformed on the CPU for both passes (see Model::set_software_deformation()) are plain vertices
+// as VERTEX_STREAMS_DECL_ARRAY splits them: positions in stream 0...
+struct DeformedPosition
+{
+    D3DXVECTOR3 pos;
+};
+// ... normals and colors in stream 1
+struct DeformedNormal
+{
+    D3DXVECTOR4 normal;
+    D3DCOLOR color;
+};
+
+// Locked streams of vertices [first_vertex, end_vertex), which deforming kernels write
+struct DeformedStreams
+{
+    Index first_vertex;
+    Index end_vertex;
+    DeformedPosition *positions;    // of `first_vertex' and on
+    DeformedNormal *normals;
+    const D3DCOLOR *colors;         // of all vertices: they are not deformed
+};
+
+// Batches of vertices [res.first_vertex, res.end_vertex) (the first one and the last one may be partly out of it)
+inline DWORD get_first_batch(const DeformedStreams &res) { return res.first_vertex/SOFTWARE_BATCH_SIZE; }
+inline DWORD get_end_batch(const DeformedStreams &res) { return ( res.end_vertex + SOFTWARE_BATCH_SIZE - 1 )/SOFTWARE_BATCH_SIZE; }
+
+// Writes the position and the normal (w = 0, as of a vector) of vertices of the batch from `first' into `res';
+// vertices out of its range are skipped
+void store_deformed(const SoftwareVector &position, const SoftwareVector &normal, Index first, DeformedStreams &res);
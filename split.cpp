@@ -0,0 +1,129 @@
+#include "split.h"
+
+namespace
+{
+    // Limits which every D3D9 device has (see D3DCAPS9 of the reference rasterizer for 16-bit index hardware)
+    const DWORD MIN_MAX_PRIMITIVES_COUNT = 0xFFFF;
+    const Index MIN_MAX_VERTEX_INDEX = 0xFFFF;
+
+    void add_subrange( DWORD first_index, DWORD indices_count, Index min_index, Index max_index,
+                       const DrawLimits &limits, std::vector<SubRange> &subranges )
+    {
+        SubRange subrange;
+        subrange.first_index = first_index;
+        subrange.indices_count = indices_count;
+        subrange.min_index = min_index;
+        subrange.max_index = max_index;
+        subrange.short_indices = max_index - min_index <= SHORT_INDEX_MAX;
+        subrange.rebased = ( subrange.short_indices && max_index > SHORT_INDEX_MAX ) || max_index > limits.max_vertex_index;
+        subranges.push_back( subrange );
+    }
+}
+
+DrawLimits get_draw_limits(DWORD max_primitive_count, DWORD max_vertex_index)
+{
+    DrawLimits limits = { MIN_MAX_PRIMITIVES_COUNT, MIN_MAX_VERTEX_INDEX };
+    if( max_primitive_count > limits.max_primitives_count )
+        limits.max_primitives_count = max_primitive_count;
+    if( max_vertex_index > limits.max_vertex_index )
+        limits.max_vertex_index = max_vertex_index;
+    return limits;
+}
+
+void split_range( const Index *indices, DWORD first_index, DWORD indices_count, D3DPRIMITIVETYPE primitive_type,
+                  const DrawLimits &limits, std::vector<SubRange> &subranges )
+{
+    _ASSERT( indices != NULL || indices_count == 0 );
+    _ASSERT( primitive_type == D3DPT_TRIANGLELIST || primitive_type == D3DPT_TRIANGLESTRIP );
+    _ASSERT( limits.max_primitives_count >= 2 ); // a strip piece has at least two triangles (to keep the winding)
+    const bool strip = primitive_type == D3DPT_TRIANGLESTRIP;
+    const DWORD primitives_count = get_primitives_count( primitive_type, indices_count );
+    const Index *range = indices + first_index;
+
+    // the piece is primitives [first, end); its indices are [first*step, end*step + overlap)
+    const DWORD step = strip ? 1 : VERTICES_PER_TRIANGLE;
+    const DWORD overlap = strip ? 2 : 0;
+    const DWORD min_primitives_count = strip ? 2 : 1;
+    DWORD first = 0;
+    while( first < primitives_count )
+    {
+        Index min_index = range[first*step];
+        Index max_index = min_index;
+        // the end of the piece, and the same piece cut at an even triangle with its bounds (for strips)
+        DWORD end = first;
+        DWORD even_end = first;
+        Index even_min_index = min_index;
+        Index even_max_index = max_index;
+        while( end < primitives_count && end - first < limits.max_primitives_count )
+        {
+            Index new_min_index = min_index;
+            Index new_max_index = max_index;
+            for( DWORD i = end*step; i < (end + 1)*step + overlap; ++i )
+            {
+                if( range[i] < new_min_index )
+                    new_min_index = range[i];
+                if( range[i] > new_max_index )
+                    new_max_index = range[i];
+            }
+            // a primitive which is too wide by itself is drawn anyway (with its pair in a strip): nothing would draw it better
+            if( new_max_index - new_min_index > limits.max_vertex_index && end - first >= min_primitives_count )
+                break;
+            min_index = new_min_index;
+            max_index = new_max_index;
+            ++end;
+            if( ( end - first ) % 2 == 0 )
+            {
+                even_end = end;
+                even_min_index = min_index;
+                even_max_index = max_index;
+            }
+        }
+        if( strip && end < primitives_count && even_end != first )
+        {
+            end = even_end;
+            min_index = even_min_index;
+            max_index = even_max_index;
+        }
+        // 64-bit so that the last index of a range ending at MAXDWORD is counted right
+        const DWORD64 piece_indices_count = static_cast<DWORD64>(end - first)*step + overlap;
+        add_subrange( first_index + first*step, get_count( piece_indices_count ), min_index, max_index, limits, subranges );
+        first = end;
+    }
+}
+
+void write_subrange(const Index *indices, const SubRange &subrange, void *destination)
+{
+    _ASSERT( indices != NULL && destination != NULL );
+    const Index shift = subrange.rebased ? subrange.min_index : 0;
+    const Index *source = &indices[subrange.first_index];
+    if( subrange.short_indices )
+    {
+        ShortIndex *short_destination = static_cast<ShortIndex*>( destination );
+        for( DWORD i = 0; i < subrange.indices_count; ++i )
+            short_destination[i] = static_cast<ShortIndex>( source[i] - shift );
+    }
+    else
+    {
+        Index *index_destination = static_cast<Index*>( destination );
+        for( DWORD i = 0; i < subrange.indices_count; ++i )
+            index_destination[i] = source[i] - shift;
+    }
+}
+
+bool join_range(IndexRange &last, const IndexRange &range, D3DPRIMITIVETYPE primitive_type, const DrawLimits &limits)
+{
+    const DWORD min_index = ( range.min_index < last.min_index ) ? range.min_index : last.min_index;
+    const DWORD last_end = last.min_index + last.vertices_count;
+    const DWORD range_end = range.min_index + range.vertices_count;
+    const DWORD end = ( range_end > last_end ) ? range_end : last_end;
+    if( last.short_indices != range.short_indices || last.base_vertex != range.base_vertex || last.palette != range.palette ||
+        last.first_index + last.indices_count != range.first_index ||
+        last.source_first_index + last.indices_count != range.source_first_index ||
+        get_primitives_count( primitive_type, get_count( static_cast<DWORD64>(last.indices_count) + range.indices_count ) ) > limits.max_primitives_count ||
+        end - min_index > static_cast<DWORD64>(limits.max_vertex_index) + 1 )
+        return false;
+    last.indices_count += range.indices_count;
+    last.min_index = min_index;
+    last.vertices_count = end - min_index;
+    return true;
+}
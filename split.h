@@ -0,0 +1,60 @@
+#pragma once
+#include "common.h"
+#include "Vertex.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// What one DrawIndexedPrimitive() may draw on the device (from D3DCAPS9)
+struct DrawLimits
+{
+    DWORD max_primitives_count; // MaxPrimitiveCount
+    Index max_vertex_index;     // MaxVertexIndex: the largest index in the index buffer
+};
+
+// Limits of the device from its D3DCAPS9, raised to the smallest ones any D3D9 device has (pass zeros if the caps are unknown)
+DrawLimits get_draw_limits(DWORD max_primitive_count, DWORD max_vertex_index);
+
+// A piece of a range of indices which is drawn by one call
+struct SubRange
+{
+    DWORD first_index;
+    DWORD indices_count;
+    Index min_index;    // the smallest and the largest index in it
+    Index max_index;
+    // Its indices are stored minus `min_index' (which is added to the base vertex instead) if they fit
+    // into SHORT_INDEX_MAX only so, or if they do not fit into `max_vertex_index' otherwise
+    bool rebased;
+    bool short_indices; // stored as ShortIndex
+};
+
+// Splits the range [first_index, first_index + indices_count) of `indices' into the fewest sub-ranges within `limits'
+// (greedily, in order) and appends them to `subranges'. A strip is split at even triangles, so that the winding
+// of the rest is kept, and neighbouring pieces share two indices. Sub-ranges spanning at most SHORT_INDEX_MAX+1 vertices
+// get 16-bit indices. Counts are in 64 bits: ranges of up to MAXDWORD indices never wrap around
+void split_range( const Index *indices, DWORD first_index, DWORD indices_count, D3DPRIMITIVETYPE primitive_type,
+                  const DrawLimits &limits, std::vector<SubRange> &subranges );
+
+// Writes the indices of the sub-range (minus `min_index' if it is rebased) to `destination',
+// which is an array of ShortIndex if the sub-range has short indices, else of Index
+void write_subrange(const Index *indices, const SubRange &subrange, void *destination);
+
+// What one DrawIndexedPrimitive() draws
+struct IndexRange
+{
+    DWORD first_index;          // in the index buffer of its index size
+    DWORD indices_count;
+    DWORD base_vertex;
+    DWORD min_index;            // indices refer to `vertices_count' vertices from `min_index'
+    DWORD vertices_count;
+    bool short_indices;
+    DWORD source_first_index;   // where the indices were given: strips are joined only if they are one strip there
+    unsigned palette;           // of the cluster (see Model::set_palette())
+};
+
+// Appends `range' to `last' if it continues `last' both in the index buffer and where indices were given,
+// and the both are still drawn by one call within `limits'. Returns whether it is joined
+bool join_range(IndexRange &last, const IndexRange &range, D3DPRIMITIVETYPE primitive_type, const DrawLimits &limits);
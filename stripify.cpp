@@ -0,0 +1,260 @@
+#include "stripify.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#include <algorithm>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+const unsigned VERTEX_CACHE_SIZE = 16;
+
+namespace
+{
+    // Strip is taken if it transforms at most this share of vertices more than the best order
+    const float CACHE_MISS_TOLERANCE = 0.05f;
+
+    const DWORD NO_TRIANGLE = static_cast<DWORD>(-1);
+    const unsigned ROTATIONS_COUNT = VERTICES_PER_TRIANGLE;
+
+    // Directed edge of a triangle: triangles of a strip keep winding order,
+    // so the next triangle must contain the edge in the direction depending on parity
+    struct Edge
+    {
+        Index from;
+        Index to;
+        DWORD triangle;
+
+        bool operator<(const Edge &other) const
+        {
+            return from != other.from ? from < other.from : to < other.to;
+        }
+    };
+
+    class Stripifier
+    {
+    private:
+        const Index *indices;
+        DWORD triangles_count;
+
+        std::vector<Edge> edges;        // sorted for searching
+        std::vector<bool> used;         // already in some strip
+        std::vector<DWORD> trial_marks; // triangles of the strip being grown now have the current mark
+        DWORD trial_mark;
+
+        const Index *triangle(DWORD t) const { return &indices[t*VERTICES_PER_TRIANGLE]; }
+        bool is_free(DWORD t) const { return !used[t] && trial_marks[t] != trial_mark; }
+
+        DWORD find_triangle(Index from, Index to) const;
+        Index third_vertex(DWORD t, Index from, Index to) const;
+        void grow(DWORD first, unsigned rotation, std::vector<Index> &strip, std::vector<DWORD> &strip_triangles);
+
+    public:
+        Stripifier(const Index *list_indices, DWORD list_indices_count);
+        DWORD run(Index *strip_indices);
+    };
+
+    Stripifier::Stripifier(const Index *list_indices, DWORD list_indices_count)
+    : indices(list_indices), triangles_count(list_indices_count/VERTICES_PER_TRIANGLE),
+      used(triangles_count, false), trial_marks(triangles_count, 0), trial_mark(0)
+    {
+        edges.reserve(triangles_count*VERTICES_PER_TRIANGLE);
+        for( DWORD t = 0; t < triangles_count; ++t )
+        {
+            const Index *vertices = triangle(t);
+            if( vertices[0] == vertices[1] || vertices[1] == vertices[2] || vertices[0] == vertices[2] )
+            {
+                used[t] = true; // degenerate triangles are not drawn anyway
+                continue;
+            }
+            for( unsigned i = 0; i < VERTICES_PER_TRIANGLE; ++i )
+            {
+                Edge edge = { vertices[i], vertices[(i + 1) % VERTICES_PER_TRIANGLE], t };
+                edges.push_back(edge);
+            }
+        }
+        std::sort( edges.begin(), edges.end() );
+    }
+
+    DWORD Stripifier::find_triangle(Index from, Index to) const
+    // returns a free triangle with the directed edge, or NO_TRIANGLE
+    {
+        Edge key = { from, to, 0 };
+        std::vector<Edge>::const_iterator iter = std::lower_bound( edges.begin(), edges.end(), key );
+        for( ; iter != edges.end() && iter->from == from && iter->to == to; ++iter )
+        {
+            if( is_free(iter->triangle) )
+                return iter->triangle;
+        }
+        return NO_TRIANGLE;
+    }
+
+    Index Stripifier::third_vertex(DWORD t, Index from, Index to) const
+    {
+        const Index *vertices = triangle(t);
+        for( unsigned i = 0; i < VERTICES_PER_TRIANGLE; ++i )
+        {
+            if( vertices[i] == from && vertices[(i + 1) % VERTICES_PER_TRIANGLE] == to )
+                return vertices[(i + 2) % VERTICES_PER_TRIANGLE];
+        }
+        _ASSERT( false );
+        return vertices[0];
+    }
+
+    void Stripifier::grow(DWORD first, unsigned rotation, std::vector<Index> &strip, std::vector<DWORD> &strip_triangles)
+    // grows the strip starting from `first' triangle rotated by `rotation' as long as possible
+    {
+        ++trial_mark;
+        strip.clear();
+        strip_triangles.clear();
+
+        const Index *vertices = triangle(first);
+        for( unsigned i = 0; i < VERTICES_PER_TRIANGLE; ++i )
+            strip.push_back( vertices[(i + rotation) % VERTICES_PER_TRIANGLE] );
+        strip_triangles.push_back(first);
+        trial_marks[first] = trial_mark;
+
+        for(;;)
+        {
+            // next triangle is (v[n-2], v[n-1], new) if its number n-2 is even and (v[n-1], v[n-2], new) if odd
+            const size_t n = strip.size();
+            const bool even = ( (n - 2) % 2 == 0 );
+            Index from = even ? strip[n - 2] : strip[n - 1];
+            Index to = even ? strip[n - 1] : strip[n - 2];
+
+            DWORD next = find_triangle(from, to);
+            if( next == NO_TRIANGLE )
+                break;
+            strip.push_back( third_vertex(next, from, to) );
+            strip_triangles.push_back(next);
+            trial_marks[next] = trial_mark;
+        }
+    }
+
+    DWORD Stripifier::run(Index *strip_indices)
+    {
+        std::vector<Index> strip, best_strip;
+        std::vector<DWORD> strip_triangles, best_strip_triangles;
+        DWORD count = 0;
+
+        // triangles are taken in their order: generators already give them in a cache-friendly order
+        for( DWORD t = 0; t < triangles_count; ++t )
+        {
+            if( used[t] )
+                continue;
+
+            // the longest strip of three starting with different edges
+            best_strip.clear();
+            for( unsigned rotation = 0; rotation < ROTATIONS_COUNT; ++rotation )
+            {
+                grow(t, rotation, strip, strip_triangles);
+                if( strip.size() > best_strip.size() )
+                {
+                    best_strip.swap(strip);
+                    best_strip_triangles.swap(strip_triangles);
+                }
+            }
+            for( unsigned i = 0; i < best_strip_triangles.size(); ++i )
+                used[best_strip_triangles[i]] = true;
+
+            if( count != 0 )
+            {
+                // joining with degenerate triangles: the last vertex and the first one are repeated...
+                Index last = strip_indices[count - 1];
+                strip_indices[count++] = last;
+                strip_indices[count++] = best_strip[0];
+                // ...and the first triangle of a strip must have an even number to keep its winding
+                if( count % 2 != 0 )
+                    strip_indices[count++] = best_strip[0];
+            }
+            for( unsigned i = 0; i < best_strip.size(); ++i )
+                strip_indices[count++] = best_strip[i];
+        }
+        return count;
+    }
+}
+
+DWORD stripify(const Index *list_indices, DWORD list_indices_count, Index *strip_indices)
+{
+    _ASSERT(list_indices != NULL);
+    _ASSERT(strip_indices != NULL);
+    Stripifier stripifier(list_indices, list_indices_count);
+    DWORD count = stripifier.run(strip_indices);
+    _ASSERT( count <= max_strip_indices_count(list_indices_count) );
+    return count;
+}
+
+float average_cache_miss_ratio(D3DPRIMITIVETYPE primitive_type, const Index *indices, DWORD indices_count,
+                               Index vertices_count, unsigned cache_size /*= VERTEX_CACHE_SIZE*/)
+{
+    _ASSERT(indices != NULL);
+    _ASSERT(cache_size != 0);
+    // vertex is in FIFO cache if less than `cache_size' vertices were loaded after it
+    std::vector<DWORD> load_time(vertices_count, 0); // 0 is "never loaded"
+    DWORD misses = 0;
+    for( DWORD i = 0; i < indices_count; ++i )
+    {
+        Index vertex = indices[i];
+        _ASSERT( vertex < vertices_count );
+        if( load_time[vertex] == 0 || misses - load_time[vertex] >= cache_size )
+        {
+            ++misses;
+            load_time[vertex] = misses;
+        }
+    }
+
+    // only real triangles count: degenerate ones are the price of strips
+    DWORD triangles_count = 0;
+    const DWORD primitives_count = get_primitives_count(primitive_type, indices_count);
+    for( DWORD t = 0; t < primitives_count; ++t )
+    {
+        const Index *vertices = primitive_type == D3DPT_TRIANGLESTRIP ? &indices[t] : &indices[t*VERTICES_PER_TRIANGLE];
+        if( vertices[0] != vertices[1] && vertices[1] != vertices[2] && vertices[0] != vertices[2] )
+            ++triangles_count;
+    }
+    return triangles_count != 0 ? static_cast<float>(misses)/triangles_count : 0.0f;
+}
+
+D3DPRIMITIVETYPE choose_primitive_type(Index *list_indices, DWORD &indices_count, Index vertices_count, DWORD *range_starts, unsigned ranges_count)
+{
+    _ASSERT(list_indices != NULL);
+    _ASSERT(range_starts != NULL);
+    if( indices_count == 0 )
+        return D3DPT_TRIANGLELIST;
+
+    std::vector<Index> strip_indices( max_strip_indices_count(indices_count) );
+    std::vector<Index> range_strip;
+    std::vector<DWORD> strip_range_starts(ranges_count);
+    DWORD strip_indices_count = 0;
+    for( unsigned i = 0; i < ranges_count; ++i )
+    {
+        const DWORD range_end = ( i + 1 < ranges_count ) ? range_starts[i + 1] : indices_count;
+        _ASSERT( range_starts[i] <= range_end );
+        range_strip.resize( max_strip_indices_count(range_end - range_starts[i]) );
+        DWORD range_strip_count = range_strip.empty() ? 0 : stripify( &list_indices[range_starts[i]], range_end - range_starts[i], &range_strip[0] );
+
+        // joining with degenerate triangles the same way stripify() joins strips inside a range
+        if( strip_indices_count != 0 && range_strip_count != 0 )
+        {
+            Index last = strip_indices[strip_indices_count - 1];
+            strip_indices[strip_indices_count++] = last;
+            strip_indices[strip_indices_count++] = range_strip[0];
+            if( strip_indices_count % 2 != 0 )
+                strip_indices[strip_indices_count++] = range_strip[0];
+        }
+        strip_range_starts[i] = strip_indices_count;
+        for( DWORD j = 0; j < range_strip_count; ++j )
+            strip_indices[strip_indices_count++] = range_strip[j];
+    }
+
+    float list_ratio = average_cache_miss_ratio(D3DPT_TRIANGLELIST, list_indices, indices_count, vertices_count);
+    float strip_ratio = average_cache_miss_ratio(D3DPT_TRIANGLESTRIP, &strip_indices[0], strip_indices_count, vertices_count);
+    if( strip_indices_count >= indices_count || strip_ratio > list_ratio*(1.0f + CACHE_MISS_TOLERANCE) )
+        return D3DPT_TRIANGLELIST;
+
+    memcpy( list_indices, &strip_indices[0], strip_indices_count*sizeof(list_indices[0]) );
+    indices_count = strip_indices_count;
+    for( unsigned i = 0; i < ranges_count; ++i )
+        range_starts[i] = strip_range_starts[i];
+    return D3DPT_TRIANGLESTRIP;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "common.h"
+#include "Vertex.h"
+
+// Size of FIFO post-transform vertex cache assumed when index orders are compared
+extern const unsigned VERTEX_CACHE_SIZE;
+
+// Strip may be up to twice longer than list: every triangle may need its own strip joined with degenerates
+inline DWORD max_strip_indices_count(DWORD list_indices_count)
+{
+    return get_count( 2*static_cast<DWORD64>(list_indices_count) );
+}
+
+// Number of list indices needed for the triangles of `indices_count' indices of given type
+inline DWORD get_list_indices_count(D3DPRIMITIVETYPE primitive_type, DWORD indices_count)
+{
+    return get_count( VERTICES_PER_TRIANGLE*static_cast<DWORD64>( get_primitives_count(primitive_type, indices_count) ) );
+}
+
+// Turns indexed triangle list into one D3DPT_TRIANGLESTRIP, joining strips with degenerate triangles.
+// Triangles keep their winding order; `strip_indices' must have space for max_strip_indices_count() indices.
+// Returns the number of strip indices written
+DWORD stripify(const Index *list_indices, DWORD list_indices_count, Index *strip_indices);
+
+// Simulates FIFO vertex cache of `cache_size' vertices and returns average number of vertices
+// transformed per (non-degenerate) triangle: from 0.5 for an ideal order of a big grid up to 3.0
+float average_cache_miss_ratio(D3DPRIMITIVETYPE primitive_type, const Index *indices, DWORD indices_count,
+                               Index vertices_count, unsigned cache_size = VERTEX_CACHE_SIZE);
+
+// Chooses between triangle list and triangle strip: the smallest index buffer which is transformed
+// (almost) as fast as the list. `list_indices' are rewritten with the chosen primitive type and `indices_count' is updated.
+// The list is split into ranges which must stay separately drawable (e.g. clusters; a whole mesh is one range starting at 0):
+// `range_starts' are `ranges_count' ascending first indices of ranges, they are replaced by the first indices
+// of the same triangles in the result. A strip gets a range of every strip index till the next range.
+// Returns the chosen primitive type
+D3DPRIMITIVETYPE choose_primitive_type(Index *list_indices, DWORD &indices_count, Index vertices_count, DWORD *range_starts, unsigned ranges_count);
@@ -1,5 +1,122 @@
 #include "tessellate.h"
 
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <map>
+#include <vector>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+namespace
+{
+    // Halving stops here even if the error is still big (e.g. for a zero `max_error')
+    const unsigned ADAPTIVE_MAX_DEPTH = 16;
+
+    struct ADAPTIVE_PARAMS
+    {
+        // output buffers (NULL when only counting)
+        Vertex *res_vertices;
+        Index *res_indices;
+        Index res_vertices_offset;
+        // vertex data
+        D3DCOLOR color;
+        D3DXVECTOR3 normal;
+        // sphere
+        float radius;
+        float max_error;
+        // state
+        std::vector<D3DXVECTOR3> positions; // of all vertices written (or counted)
+        std::map< std::pair<Index, Index>, Index > midpoints; // vertices in the middle of halved edges
+        DWORD indices_count;
+    };
+
+    bool needs_halving(const ADAPTIVE_PARAMS &params, Index from, Index to)
+    {
+        const D3DXVECTOR3 &a = params.positions[from];
+        const D3DXVECTOR3 &b = params.positions[to];
+        const float lengths = D3DXVec3Length(&a)*D3DXVec3Length(&b);
+        if( lengths == 0 )
+            return false;
+        float cos_angle = D3DXVec3Dot(&a, &b)/lengths;
+        if( cos_angle < -1.0f )
+            cos_angle = -1.0f;
+        // the middle of the chord is at radius*cos(angle/2) from the center
+        return params.radius*( 1.0f - sqrt( (1.0f + cos_angle)/2.0f ) ) > params.max_error;
+    }
+
+    Index add_vertex(ADAPTIVE_PARAMS &params, const D3DXVECTOR3 &position)
+    {
+        const Index vertex = static_cast<Index>( params.positions.size() );
+        params.positions.push_back( position );
+        if( params.res_vertices != NULL )
+            params.res_vertices[vertex] = Vertex( position, params.color, params.normal );
+        return vertex;
+    }
+
+    Index get_midpoint(ADAPTIVE_PARAMS &params, Index from, Index to)
+    {
+        const std::pair<Index, Index> edge( from < to ? from : to, from < to ? to : from );
+        std::map< std::pair<Index, Index>, Index >::const_iterator found = params.midpoints.find( edge );
+        if( found != params.midpoints.end() )
+            return found->second;
+        // the same ends in the same order give the same point in a neighbouring triangle too
+        const Index vertex = add_vertex( params, (params.positions[edge.first] + params.positions[edge.second])/2.0f );
+        params.midpoints[edge] = vertex;
+        return vertex;
+    }
+
+    void subdivide(ADAPTIVE_PARAMS &params, Index i1, Index i2, Index i3, unsigned depth)
+    {
+        const bool halve12 = depth < ADAPTIVE_MAX_DEPTH && needs_halving( params, i1, i2 );
+        const bool halve23 = depth < ADAPTIVE_MAX_DEPTH && needs_halving( params, i2, i3 );
+        const bool halve31 = depth < ADAPTIVE_MAX_DEPTH && needs_halving( params, i3, i1 );
+        const unsigned halved_count = (halve12 ? 1 : 0) + (halve23 ? 1 : 0) + (halve31 ? 1 : 0);
+
+        if( halved_count == 0 )
+        {
+            if( params.res_indices != NULL )
+                add_triangle( i1, i2, i3, params.res_indices, params.indices_count, params.res_vertices_offset );
+            else
+                params.indices_count += VERTICES_PER_TRIANGLE;
+            return;
+        }
+        if( halved_count == 3 )
+        {
+            const Index m12 = get_midpoint( params, i1, i2 );
+            const Index m23 = get_midpoint( params, i2, i3 );
+            const Index m31 = get_midpoint( params, i3, i1 );
+            subdivide( params, i1, m12, m31, depth + 1 );
+            subdivide( params, m12, i2, m23, depth + 1 );
+            subdivide( params, m31, m23, i3, depth + 1 );
+            subdivide( params, m12, m23, m31, depth + 1 );
+            return;
+        }
+        // turning the triangle (keeping its winding) so that the first edge is halved and, if two edges are, the second one too
+        if( halved_count == 1 )
+        {
+            if( halve23 )
+                { Index t = i1; i1 = i2; i2 = i3; i3 = t; }
+            else if( halve31 )
+                { Index t = i1; i1 = i3; i3 = i2; i2 = t; }
+            const Index m12 = get_midpoint( params, i1, i2 );
+            subdivide( params, i1, m12, i3, depth + 1 );
+            subdivide( params, m12, i2, i3, depth + 1 );
+        }
+        else
+        {
+            if( !halve12 )
+                { Index t = i1; i1 = i2; i2 = i3; i3 = t; }
+            else if( !halve23 )
+                { Index t = i1; i1 = i3; i3 = i2; i2 = t; }
+            const Index m12 = get_midpoint( params, i1, i2 );
+            const Index m23 = get_midpoint( params, i2, i3 );
+            subdivide( params, m12, i2, m23, depth + 1 );
+            subdivide( params, i1, m12, m23, depth + 1 );
+            subdivide( params, i1, m23, i3, depth + 1 );
+        }
+    }
+}
+
 void tessellate(const Vertex *src_vertices, const Index *src_indices, DWORD src_index_offset,
                 Vertex *res_vertices, Index res_vertices_offset, Index *res_indices, D3DCOLOR color, DWORD tesselate_degree)
 // Divides each side of triangle into given number of parts
@@ -48,3 +165,66 @@ void tessellate(const Vertex *src_vertices, const Index *src_indices, DWORD src_
         }
     }
 }
+
+void tessellate_adaptive(const Vertex *src_vertices, const Index *src_indices, DWORD src_index_offset,
+                         Vertex *res_vertices, Index res_vertices_offset, Index *res_indices, D3DCOLOR color,
+                         DWORD base_degree, float radius, float max_error, Index &res_vertices_count, DWORD &res_indices_count)
+{
+    _ASSERT(src_vertices != NULL);
+    _ASSERT(src_indices != NULL);
+    _ASSERT( (res_vertices == NULL) == (res_indices == NULL) );
+    _ASSERT(base_degree != 0);
+    const Index i1 = src_indices[src_index_offset];
+    const Index i2 = src_indices[src_index_offset + 1];
+    const Index i3 = src_indices[src_index_offset + 2];
+    const D3DXVECTOR3 &p1 = src_vertices[i1].pos;
+    const D3DXVECTOR3 &p2 = src_vertices[i2].pos;
+    const D3DXVECTOR3 &p3 = src_vertices[i3].pos;
+
+    ADAPTIVE_PARAMS params;
+    params.res_vertices = res_vertices;
+    params.res_indices = res_indices;
+    params.res_vertices_offset = res_vertices_offset;
+    params.color = color;
+    // the same normal as tessellate() gives
+    D3DXVECTOR3 step_down = p1 - p2;
+    D3DXVECTOR3 step_right = p3 - p1;
+    D3DXVec3Cross(&params.normal, &step_down, &step_right);
+    D3DXVec3Normalize(&params.normal, &params.normal);
+    params.radius = radius;
+    params.max_error = max_error;
+    params.indices_count = 0;
+
+    // the uniform grid of tessellate(): a point is a weighted sum of the corners, so that a neighbouring triangle
+    // gets exactly the same points on the shared side (adding zero and swapping two terms do not change the sum)
+    std::vector<Index> grid_triangles;
+    Index vertex = 0;
+    for( Index line = 0; line <= base_degree; ++line )
+    {
+        for( Index column = 0; column < line + 1; ++column )
+        {
+            const float weight1 = static_cast<float>(line - column);
+            const float weight2 = static_cast<float>(base_degree - line);
+            const float weight3 = static_cast<float>(column);
+            add_vertex( params, (p1*weight1 + p2*weight2 + p3*weight3)/static_cast<float>(base_degree) );
+            if( column != 0 )
+            {
+                grid_triangles.push_back( vertex );
+                grid_triangles.push_back( vertex - 1 );
+                grid_triangles.push_back( vertex - line - 1 );
+            }
+            if( ( column != 0 ) && ( column != line ) )
+            {
+                grid_triangles.push_back( vertex );
+                grid_triangles.push_back( vertex - line - 1 );
+                grid_triangles.push_back( vertex - line );
+            }
+            ++vertex;
+        }
+    }
+    for( unsigned i = 0; i < grid_triangles.size(); i += VERTICES_PER_TRIANGLE )
+        subdivide( params, grid_triangles[i], grid_triangles[i + 1], grid_triangles[i + 2], 0 );
+
+    res_vertices_count = static_cast<Index>( params.positions.size() );
+    res_indices_count = params.indices_count;
+}
@@ -1,5 +1,5 @@
 #pragma once
-#include "main.h"
+#include "common.h"
 #include "Vertex.h"
 
 inline Index tesselated_vertices_count(DWORD tessellate_degree)
@@ -16,3 +16,13 @@ inline DWORD tesselated_indices_count(DWORD tessellate_degree)
 //   assuming that there are already `res_vertices_offset' vertices before `res_vertices' pointer.
 void tessellate(const Vertex *src_vertices, const Index *src_indices, DWORD src_index_offset,
                 Vertex *res_vertices, Index res_vertices_offset, Index *res_indices, D3DCOLOR color, DWORD tesselate_degree);
+
+// Divides the triangle adaptively for morphing into the sphere of `radius' around the origin (see morphing.vsh):
+// first uniformly like tessellate() with `base_degree', then an edge is halved while the chord between its ends
+// projected onto the sphere is farther than `max_error' from the sphere.
+// Halving depends on the ends of an edge only, so neighbouring triangles halve shared edges equally and there are no cracks.
+// Writes data like tessellate() and returns numbers of vertices and indices written;
+// with NULL `res_vertices' and `res_indices' only counts them, so that arrays of exact size can be allocated
+void tessellate_adaptive(const Vertex *src_vertices, const Index *src_indices, DWORD src_index_offset,
+                         Vertex *res_vertices, Index res_vertices_offset, Index *res_indices, D3DCOLOR color,
+                         DWORD base_degree, float radius, float max_error, Index &res_vertices_count, DWORD &res_indices_count);
@@ -0,0 +1,53 @@
+#include "tests.h"
+#include <cstdio>
+
+// Runs the tests of tests.h: `tests [directory of the project]' (the parent directory by default).
+// Returns 0 if all checks pass
+int main(int argc, char *argv[])
+{
+    if( argc > 1 )
+        set_project_directory( argv[1] );
+    srand( 1 ); // the same random vertices each time
+    try
+    {
+        test_vs_interpreter();
+        test_ps_interpreter();
+        test_lighting();
+        test_morphing();
+        test_skinning();
+        test_shader_opt();
+        test_shader_variants();
+        test_simplify();
+        test_tessellate();
+        test_codec();
+        test_split();
+        test_stripify();
+        test_clusters();
+        test_pose_cache();
+        test_parallel();
+        test_normals();
+    }
+    catch(const ShaderParseError &e)
+    {
+        printf( "FAILED: shader assembly cannot be parsed, line %u\n", e.get_line() );
+        return 1;
+    }
+    catch(const RuntimeError &e)
+    {
+        _tprintf( _T("FAILED: %s\n"), e.message() );
+        return 1;
+    }
+    catch(...)
+    {
+        printf( "FAILED: an exception\n" );
+        return 1;
+    }
+    const unsigned failed_count = get_failed_checks_count();
+    if( failed_count != 0 )
+    {
+        printf( "%u checks FAILED\n", failed_count );
+        return 1;
+    }
+    printf( "all checks passed\n" );
+    return 0;
+}
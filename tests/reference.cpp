@@ -0,0 +1,162 @@
+#include "reference.h"
+#include <cmath>
+
+namespace
+{
+    // `lit' of the shaders clamps the power to it
+    const double MAX_SPECULAR_F = 128.0;
+
+    ReferenceVector add(const ReferenceVector &a, const ReferenceVector &b)
+    {
+        return ReferenceVector( a.x + b.x, a.y + b.y, a.z + b.z );
+    }
+    ReferenceVector subtract(const ReferenceVector &a, const ReferenceVector &b)
+    {
+        return ReferenceVector( a.x - b.x, a.y - b.y, a.z - b.z );
+    }
+    ReferenceVector scale(const ReferenceVector &v, double k)
+    {
+        return ReferenceVector( v.x*k, v.y*k, v.z*k );
+    }
+    double dot(const ReferenceVector &a, const ReferenceVector &b)
+    {
+        return a.x*b.x + a.y*b.y + a.z*b.z;
+    }
+    ReferenceVector normalize(const ReferenceVector &v)
+    {
+        return scale( v, 1.0/sqrt( dot(v, v) ) );
+    }
+
+    ReferenceVector transform_point(const D3DXMATRIX &m, const ReferenceVector &p)
+    {
+        return ReferenceVector( m._11*p.x + m._12*p.y + m._13*p.z + m._14,
+                                m._21*p.x + m._22*p.y + m._23*p.z + m._24,
+                                m._31*p.x + m._32*p.y + m._33*p.z + m._34 );
+    }
+    ReferenceVector transform_vector(const D3DXMATRIX &m, const ReferenceVector &v)
+    {
+        return ReferenceVector( m._11*v.x + m._12*v.y + m._13*v.z,
+                                m._21*v.x + m._22*v.y + m._23*v.z,
+                                m._31*v.x + m._32*v.y + m._33*v.z );
+    }
+
+    double saturate(double value)
+    {
+        return value < 0 ? 0 : ( value > 1 ? 1 : value );
+    }
+
+    void get_output( const D3DXMATRIX &view, const LightingConstants &lighting, const ReferenceVector &world_position,
+                     const ReferenceVector &world_normal, D3DCOLOR color, ReferenceOutput &res )
+    // oPos and oD0 of the vertex in world space
+    {
+        for( unsigned i = 0; i < 4; ++i )
+        {
+            const float *row = view.m[i];
+            res.values[SOFTWARE_OUT_X + i] = row[0]*world_position.x + row[1]*world_position.y + row[2]*world_position.z + row[3];
+        }
+        light_reference( lighting, true, world_position, world_normal, color, res.values + SOFTWARE_OUT_R );
+    }
+}
+
+void light_reference( const LightingConstants &lighting, bool specular, const ReferenceVector &position, const ReferenceVector &normal,
+                      D3DCOLOR color, double res[SOFTWARE_COLOR_COMPONENTS] )
+{
+    const ReferenceVector n = normalize( normal );
+    const ReferenceVector to_light = subtract( ReferenceVector( lighting.point_position ), position );
+    const double distance = sqrt( dot(to_light, to_light) );
+    const ReferenceVector l = scale( to_light, 1.0/distance );
+    const double attenuation = 1.0/( lighting.attenuation.x + lighting.attenuation.y*distance + lighting.attenuation.z*distance*distance );
+    const double cos_theta = dot( l, n );
+    const double diffuse = cos_theta*lighting.diffuse_coef*attenuation;
+
+    double specular_light = 0;
+    if( specular )
+    {
+        const ReferenceVector v = normalize( subtract( ReferenceVector( lighting.eye ), position ) );
+        const ReferenceVector r = subtract( scale( n, 2*cos_theta ), l );
+        const double cos_phi = dot( r, v );
+        double f = lighting.specular_f;
+        f = ( f > MAX_SPECULAR_F ) ? MAX_SPECULAR_F : ( ( f < -MAX_SPECULAR_F ) ? -MAX_SPECULAR_F : f );
+        // `lit' gives 0 where the cosine is not positive
+        const double power = ( cos_phi > 0 ) ? pow( cos_phi, f ) : 0;
+        specular_light = power*lighting.specular_coef*attenuation;
+    }
+
+    const D3DXCOLOR vertex_color( color );
+    const float *vertex_components = vertex_color;
+    const float *point_components = lighting.point_color;
+    const float *ambient_components = lighting.ambient_color;
+    for( unsigned i = 0; i < SOFTWARE_COLOR_COMPONENTS; ++i )
+    {
+        const double diffuse_component = point_components[i]*diffuse;
+        const double specular_component = point_components[i]*specular_light;
+        const double light = ( diffuse_component > 0 ? diffuse_component : 0 ) + ( specular_component > 0 ? specular_component : 0 )
+                           + ambient_components[i];
+        res[i] = saturate( vertex_components[i]*light );
+    }
+}
+
+void skin_reference( const std::vector<SkinningVertex> &vertices, const D3DXMATRIX *bones, unsigned bones_count,
+                     const D3DXMATRIX &position_and_rotation, const D3DXMATRIX &view, const LightingConstants &lighting,
+                     std::vector<ReferenceOutput> &res )
+{
+    _ASSERT( bones != NULL );
+    UNREFERENCED_PARAMETER( bones_count );
+    res.resize( vertices.size() );
+    for( unsigned i = 0; i < vertices.size(); ++i )
+    {
+        const SkinningVertex &vertex = vertices[i];
+        const ReferenceVector p( vertex.pos );
+        const ReferenceVector n( vertex.normal.x, vertex.normal.y, vertex.normal.z );
+        // blended by weights of the transformed position and normal
+        ReferenceVector skinned_position;
+        ReferenceVector skinned_normal;
+        for( unsigned j = 0; j < BONE_INFLUENCES_COUNT; ++j )
+        {
+            _ASSERT( vertex.bones[j] < bones_count );
+            const D3DXMATRIX &bone = bones[vertex.bones[j]];
+            skinned_position = add( skinned_position, scale( transform_point( bone, p ), vertex.weights[j] ) );
+            skinned_normal = add( skinned_normal, scale( transform_vector( bone, n ), vertex.weights[j] ) );
+        }
+        get_output( view, lighting, transform_point( position_and_rotation, skinned_position ),
+                    transform_vector( position_and_rotation, skinned_normal ), vertex.color, res[i] );
+    }
+}
+
+void morph_reference( const std::vector<Vertex> &vertices, float final_radius, float morphing_param, const D3DXMATRIX &position_and_rotation,
+                      const D3DXMATRIX &view, const LightingConstants &lighting, std::vector<ReferenceOutput> &res )
+{
+    const double t = morphing_param;
+    res.resize( vertices.size() );
+    for( unsigned i = 0; i < vertices.size(); ++i )
+    {
+        const Vertex &vertex = vertices[i];
+        const ReferenceVector p( vertex.pos );
+        const ReferenceVector n( vertex.normal.x, vertex.normal.y, vertex.normal.z );
+        const double length = sqrt( dot(p, p) );
+        // along the radius to the sphere, the normal turned to the radius
+        const ReferenceVector morphed_position = scale( p, 1 + t*( final_radius/length - 1 ) );
+        const ReferenceVector morphed_normal = normalize( add( n, scale( subtract( scale(p, 1/length), n ), t ) ) );
+
+        get_output( view, lighting, transform_point( position_and_rotation, morphed_position ),
+                    transform_vector( position_and_rotation, morphed_normal ), vertex.color, res[i] );
+    }
+}
+
+double get_max_difference(const std::vector<ReferenceOutput> &expected, const SoftwareColumns &actual, unsigned first, unsigned count)
+{
+    _ASSERT( expected.size() == actual.get_count() );
+    double res = 0;
+    for( unsigned i = first; i < first + count; ++i )
+    {
+        const float *column = actual.get_column(i);
+        for( unsigned j = 0; j < expected.size(); ++j )
+        {
+            const double value = expected[j].values[i];
+            const double difference = fabs( value - column[j] )/( 1.0 + fabs(value) );
+            if( difference > res || difference != difference ) // NaN is kept
+                res = difference;
+        }
+    }
+    return res;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "tests.h"
+
+// References of the software kernels in double precision: the math of the vertex shaders done exactly,
+// vertex by vertex, with the inputs of the kernels (floats) converted to doubles
+
+struct ReferenceVector
+{
+    double x, y, z;
+
+    ReferenceVector() : x(0), y(0), z(0) {}
+    ReferenceVector(double x, double y, double z) : x(x), y(y), z(z) {}
+    explicit ReferenceVector(const D3DXVECTOR3 &v) : x(v.x), y(v.y), z(v.z) {}
+};
+
+// oPos and oD0 of a vertex, as SOFTWARE_OUTPUT_COLUMNS
+struct ReferenceOutput
+{
+    double values[SOFTWARE_OUTPUT_COLUMNS];
+};
+
+// The lighting block of the shaders (see lighting.h) of a vertex of `color' in world space; the normal is normalized here
+void light_reference( const LightingConstants &lighting, bool specular, const ReferenceVector &position, const ReferenceVector &normal,
+                      D3DCOLOR color, double res[SOFTWARE_COLOR_COMPONENTS] );
+
+// skinning.vsh (see skinning.h): bones of the vertices are of the mesh, all `bones_count' of them
+void skin_reference( const std::vector<SkinningVertex> &vertices, const D3DXMATRIX *bones, unsigned bones_count,
+                     const D3DXMATRIX &position_and_rotation, const D3DXMATRIX &view, const LightingConstants &lighting,
+                     std::vector<ReferenceOutput> &res );
+
+// morphing.vsh (see morphing.h)
+void morph_reference( const std::vector<Vertex> &vertices, float final_radius, float morphing_param, const D3DXMATRIX &position_and_rotation,
+                      const D3DXMATRIX &view, const LightingConstants &lighting, std::vector<ReferenceOutput> &res );
+
+// The largest difference of the columns [first, first + count) of the kernel from the reference, relative to 1 + |reference|
+double get_max_difference(const std::vector<ReferenceOutput> &expected, const SoftwareColumns &actual, unsigned first, unsigned count);
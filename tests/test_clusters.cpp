@@ -0,0 +1,185 @@
+#include "tests.h"
+#include "../clusters.h"
+#include "../matrices.h"
+#include <cstdio>
+#include <cstdlib>
+
+// is_cluster_visible(): clusters out of the frustum are culled, and with back-face culling so are clusters whose normal
+// cone is turned away from the eye, but never a cluster of which a single triangle faces the eye. The cones are those
+// build_cluster() makes of a flat patch and of a cap of a sphere, moved by a model matrix
+
+namespace
+{
+    const float PATCH_HALF_SIDE = 0.5f;
+    const unsigned CAP_RINGS = 4;
+    const unsigned CAP_SEGMENTS = 12;
+    const float CAP_ANGLE = D3DX_PI/6; // from the pole to the edge of the cap
+    const float CONE_TOLERANCE = 1e-4f;
+    const unsigned RANDOM_EYES_COUNT = 20000;
+    const float RANDOM_EYE_DISTANCE = 6.0f;
+
+    float get_random(float max_value)
+    // from -max_value to max_value
+    {
+        return ( 2.0f*rand()/RAND_MAX - 1.0f )*max_value;
+    }
+
+    void add_triangle(Index a, Index b, Index c, std::vector<Index> &res)
+    {
+        res.push_back( a );
+        res.push_back( b );
+        res.push_back( c );
+    }
+
+    // A mesh of positions and outer normals
+    struct TestMesh
+    {
+        std::vector<D3DXVECTOR3> positions;
+        std::vector<D3DXVECTOR3> normals;
+        std::vector<Index> indices;
+    };
+
+    // A square in the plane z = 0 facing +z
+    void make_patch(TestMesh &res)
+    {
+        const float corners[][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+        for( unsigned i = 0; i < array_size(corners); ++i )
+        {
+            res.positions.push_back( D3DXVECTOR3( corners[i][0]*PATCH_HALF_SIDE, corners[i][1]*PATCH_HALF_SIDE, 0 ) );
+            res.normals.push_back( D3DXVECTOR3( 0, 0, 1 ) );
+        }
+        add_triangle( 0, 1, 2, res.indices );
+        add_triangle( 0, 2, 3, res.indices );
+    }
+
+    // A cap of the unit sphere around +z, its normals are the radii
+    void make_cap(TestMesh &res)
+    {
+        res.positions.push_back( D3DXVECTOR3( 0, 0, 1 ) );
+        for( unsigned ring = 1; ring <= CAP_RINGS; ++ring )
+        {
+            const float theta = CAP_ANGLE*ring/CAP_RINGS;
+            for( unsigned segment = 0; segment < CAP_SEGMENTS; ++segment )
+            {
+                const float phi = 2*D3DX_PI*segment/CAP_SEGMENTS;
+                res.positions.push_back( D3DXVECTOR3( sin(theta)*cos(phi), sin(theta)*sin(phi), cos(theta) ) );
+            }
+        }
+        res.normals = res.positions;
+        for( unsigned segment = 0; segment < CAP_SEGMENTS; ++segment )
+            add_triangle( 0, 1 + segment, 1 + (segment + 1) % CAP_SEGMENTS, res.indices );
+        for( unsigned ring = 1; ring < CAP_RINGS; ++ring )
+        {
+            const Index inner = 1 + (ring - 1)*CAP_SEGMENTS;
+            const Index outer = inner + CAP_SEGMENTS;
+            for( unsigned segment = 0; segment < CAP_SEGMENTS; ++segment )
+            {
+                const unsigned next = (segment + 1) % CAP_SEGMENTS;
+                add_triangle( inner + segment, outer + segment, outer + next, res.indices );
+                add_triangle( inner + segment, outer + next, inner + next, res.indices );
+            }
+        }
+    }
+
+    void build_test_cluster(const TestMesh &mesh, Cluster &res)
+    {
+        build_cluster( &mesh.positions[0], &mesh.normals[0], static_cast<Index>( mesh.positions.size() ),
+                       &mesh.indices[0], static_cast<DWORD>( mesh.indices.size() ), res );
+    }
+
+    // Whether a single triangle (moved by the matrix) faces the eye
+    bool is_any_triangle_facing(const TestMesh &mesh, const D3DXMATRIX &model_matrix, const D3DXVECTOR3 &eye)
+    {
+        for( unsigned i = 0; i < mesh.indices.size(); i += VERTICES_PER_TRIANGLE )
+        {
+            const D3DXVECTOR3 a = transform_point( model_matrix, mesh.positions[mesh.indices[i]] );
+            const D3DXVECTOR3 b = transform_point( model_matrix, mesh.positions[mesh.indices[i + 1]] );
+            const D3DXVECTOR3 c = transform_point( model_matrix, mesh.positions[mesh.indices[i + 2]] );
+            const D3DXVECTOR3 edge1 = b - a;
+            const D3DXVECTOR3 edge2 = c - a;
+            D3DXVECTOR3 normal;
+            D3DXVec3Cross( &normal, &edge1, &edge2 );
+            const D3DXVECTOR3 to_eye = eye - a;
+            if( D3DXVec3Dot( &normal, &to_eye ) > 0 )
+                return true;
+        }
+        return false;
+    }
+
+    void check_patch()
+    {
+        TestMesh patch;
+        make_patch( patch );
+        Cluster cluster;
+        build_test_cluster( patch, cluster );
+        check( fabs( cluster.cone_axis.z - 1 ) < CONE_TOLERANCE && cluster.cone_angle < CONE_TOLERANCE,
+               "build_cluster() of a flat patch: the cone is its normal" );
+
+        // the frustum of the identity matrix: |x| <= 1, |y| <= 1, z >= 0; the patch is moved to z = 5
+        D3DXMATRIX identity = shift_matrix( D3DXVECTOR3( 0, 0, 0 ) );
+        const Frustum frustum( identity );
+        const D3DXMATRIX model_matrix = shift_matrix( D3DXVECTOR3( 0, 0, 5 ) );
+        const D3DXMATRIX far_away = shift_matrix( D3DXVECTOR3( 5, 0, 5 ) );
+        check( is_cluster_visible( cluster, model_matrix, frustum, D3DXVECTOR3( 0, 0, 10 ), true ),
+               "is_cluster_visible(): the patch seen from its front is visible" );
+        check( !is_cluster_visible( cluster, model_matrix, frustum, D3DXVECTOR3( 0, 0, 0 ), true ) &&
+               is_cluster_visible( cluster, model_matrix, frustum, D3DXVECTOR3( 0, 0, 0 ), false ),
+               "is_cluster_visible(): the patch seen from its back is culled only with back-face culling" );
+        check( is_cluster_visible( cluster, model_matrix, frustum, D3DXVECTOR3( 10, 0, 5 ), true ),
+               "is_cluster_visible(): the patch seen edge-on is visible" );
+        // a little behind the plane: the bounding sphere decides
+        check( !is_cluster_visible( cluster, model_matrix, frustum, D3DXVECTOR3( 10, 0, 4 ), true ) &&
+               is_cluster_visible( cluster, model_matrix, frustum, D3DXVECTOR3( 10, 0, 4.95f ), true ),
+               "is_cluster_visible(): the patch seen from a little behind is culled unless its sphere may be seen from the front" );
+        check( is_cluster_visible( cluster, model_matrix, frustum, D3DXVECTOR3( 0.1f, 0, 4.9f ), true ),
+               "is_cluster_visible(): the patch seen from inside its sphere is visible" );
+        check( !is_cluster_visible( cluster, far_away, frustum, D3DXVECTOR3( 5, 0, 10 ), false ),
+               "is_cluster_visible(): the patch out of the frustum is culled" );
+
+        // wide cones are never culled by their normals
+        Cluster wide = cluster;
+        merge_normal_cone( wide, D3DXVECTOR3( 0, 0, -1 ), 0 );
+        check( wide.cone_angle >= D3DX_PI/2 && is_cluster_visible( wide, model_matrix, frustum, D3DXVECTOR3( 0, 0, 0 ), true ),
+               "is_cluster_visible(): a cluster facing both sides is visible from its back" );
+    }
+
+    void check_cap()
+    {
+        TestMesh cap;
+        make_cap( cap );
+        Cluster cluster;
+        build_test_cluster( cap, cluster );
+        char what[256];
+        sprintf( what, "build_cluster() of a cap of a sphere: the cone around +z (angle %g) contains the normals of the triangles",
+                 cluster.cone_angle );
+        check( fabs( cluster.cone_axis.z - 1 ) < CONE_TOLERANCE && cluster.cone_angle > 0 && cluster.cone_angle < CAP_ANGLE, what );
+
+        // a frustum which contains everything (the far plane is ignored): only the cone culls
+        const D3DXMATRIX everywhere( 1e-3f, 0, 0, 0,
+                                     0, 1e-3f, 0, 0,
+                                     0, 0, 0, 1,
+                                     0, 0, 0, 1 );
+        const Frustum frustum( everywhere );
+        const D3DXMATRIX model_matrix = rotate_and_shift_matrix( D3DXVECTOR3( 0.3f, -0.7f, 1.1f ), D3DXVECTOR3( 0.5f, 0.2f, -0.4f ) );
+        unsigned culled_count = 0;
+        unsigned wrongly_culled_count = 0;
+        for( unsigned i = 0; i < RANDOM_EYES_COUNT; ++i )
+        {
+            const D3DXVECTOR3 eye( get_random( RANDOM_EYE_DISTANCE ), get_random( RANDOM_EYE_DISTANCE ), get_random( RANDOM_EYE_DISTANCE ) );
+            if( is_cluster_visible( cluster, model_matrix, frustum, eye, true ) )
+                continue;
+            ++culled_count;
+            if( is_any_triangle_facing( cap, model_matrix, eye ) )
+                ++wrongly_culled_count;
+        }
+        sprintf( what, "is_cluster_visible() of a moved cap of a sphere from %u random eyes: %u culled, none facing the eye",
+                 RANDOM_EYES_COUNT, culled_count );
+        check( culled_count > 0 && wrongly_culled_count == 0, what );
+    }
+}
+
+void test_clusters()
+{
+    check_patch();
+    check_cap();
+}
@@ -0,0 +1,232 @@
+#include "tests.h"
+#include "../codec.h"
+#include "../plane.h"
+#include "../cylinder.h"
+#include "../pyramid.h"
+#include <cstdio>
+#include <cstring>
+
+// The codec of the mesh cache is lossless: vertices and indices of plane(), cylinder() and pyramid() and random bit patterns
+// (NaN and infinite floats among them) come back exactly, also scattered into streams. Truncated and corrupted code is rejected
+
+namespace
+{
+    const int PLANE_STEPS = 50;             // per half side
+    const DWORD PYRAMID_DEGREE = 20;
+    const DWORD SMALL_PYRAMID_DEGREE = 1;   // every prefix of its code is tried
+    const Index RANDOM_VERTICES_COUNT = 1000;
+    const DWORD RANDOM_INDICES_COUNT = 3000;
+    const double MIN_VERTICES_RATIO = 2.0;  // of generated meshes: raw size to code size
+    const double MIN_INDICES_RATIO = 2.0;
+
+    const BYTE BAD_PREDICTORS[] = { 0, 3, 0xff };
+    const BYTE BAD_DISTANCES[] = { 0, 4, 0xff };
+
+    DWORD random_dword()
+    {
+        return ( static_cast<DWORD>( rand() & 0xff ) << 24 ) | ( static_cast<DWORD>( rand() & 0xff ) << 16 ) |
+               ( static_cast<DWORD>( rand() & 0xff ) << 8 ) | static_cast<DWORD>( rand() & 0xff );
+    }
+
+    bool decodes_vertices(const std::vector<BYTE> &code, size_t size, unsigned vertex_size, Index vertices_count)
+    {
+        std::vector<DWORD> decoded( vertices_count*vertex_size/sizeof(DWORD) + 1 );
+        return decode_vertices( code.empty() ? NULL : &code[0], size, &decoded[0], vertex_size, vertices_count );
+    }
+
+    bool decodes_indices(const std::vector<BYTE> &code, size_t size, DWORD indices_count)
+    {
+        std::vector<Index> decoded( indices_count + 1 );
+        return decode_indices( code.empty() ? NULL : &code[0], size, &decoded[0], indices_count );
+    }
+
+    // Encodes and decodes the vertices, also into two streams of columns in reverse order with padding
+    void check_vertices(const char *name, const void *vertices, unsigned vertex_size, Index vertices_count, double min_ratio)
+    {
+        char what[256];
+        std::vector<BYTE> code;
+        encode_vertices( vertices, vertex_size, vertices_count, code );
+        const size_t raw_size = static_cast<size_t>( vertices_count )*vertex_size;
+
+        std::vector<DWORD> decoded( raw_size/sizeof(DWORD) + 1 );
+        const bool decoded_ok = decode_vertices( &code[0], code.size(), &decoded[0], vertex_size, vertices_count );
+        sprintf( what, "codec: vertices of %s are restored exactly (%u bytes, %u of code, ratio %.2f)",
+                 name, static_cast<unsigned>( raw_size ), static_cast<unsigned>( code.size() ), static_cast<double>( raw_size )/code.size() );
+        check( decoded_ok && memcmp( &decoded[0], vertices, raw_size ) == 0, what );
+        if( min_ratio > 0 )
+        {
+            sprintf( what, "codec: vertices of %s take at most 1/%g of their size", name, min_ratio );
+            check( raw_size >= min_ratio*code.size(), what );
+        }
+
+        // even columns go into stream 0, odd ones into stream 1, each stream with a padding DWORD per vertex
+        const unsigned columns_count = vertex_size/sizeof(DWORD);
+        const unsigned stream_columns[2] = { (columns_count + 1)/2, columns_count/2 };
+        std::vector<BYTE> streams[2];
+        std::vector<VertexColumn> columns( columns_count );
+        for( unsigned s = 0; s < 2; ++s )
+            streams[s].resize( vertices_count*(stream_columns[s] + 1)*sizeof(DWORD) + 1 );
+        for( unsigned j = 0; j < columns_count; ++j )
+        {
+            const unsigned s = j % 2;
+            columns[j].destination = &streams[s][0];
+            columns[j].stride = (stream_columns[s] + 1)*sizeof(DWORD);
+            columns[j].offset = (stream_columns[s] - 1 - j/2)*sizeof(DWORD);
+        }
+        bool scattered_ok = decode_vertex_columns( &code[0], code.size(), &columns[0], columns_count, vertices_count );
+        const DWORD *source = static_cast<const DWORD*>( vertices );
+        for( Index i = 0; i < vertices_count && scattered_ok; ++i )
+        {
+            for( unsigned j = 0; j < columns_count; ++j )
+            {
+                DWORD value;
+                memcpy( &value, &streams[j % 2][i*columns[j].stride + columns[j].offset], sizeof(value) );
+                scattered_ok = scattered_ok && value == source[i*columns_count + j];
+            }
+        }
+        sprintf( what, "codec: vertices of %s are restored exactly by decode_vertex_columns() into streams", name );
+        check( scattered_ok, what );
+
+        // NULL destinations check the code only
+        for( unsigned j = 0; j < columns_count; ++j )
+            columns[j].destination = NULL;
+        sprintf( what, "codec: code of vertices of %s is checked without destinations", name );
+        check( decode_vertex_columns( &code[0], code.size(), &columns[0], columns_count, vertices_count ), what );
+
+        // truncated, with a byte more, or of the wrong size of a vertex or count
+        sprintf( what, "codec: truncated code of vertices of %s is rejected", name );
+        check( !decodes_vertices( code, 0, vertex_size, vertices_count ) && !decodes_vertices( code, 1, vertex_size, vertices_count ) &&
+               !decodes_vertices( code, code.size()/2, vertex_size, vertices_count ) &&
+               !decodes_vertices( code, code.size() - 1, vertex_size, vertices_count ), what );
+        std::vector<BYTE> longer( code );
+        longer.push_back( 0 );
+        sprintf( what, "codec: code of vertices of %s with a trailing byte is rejected", name );
+        check( !decodes_vertices( longer, longer.size(), vertex_size, vertices_count ), what );
+        sprintf( what, "codec: code of vertices of %s decoded as more vertices or with a wrong vertex size is rejected", name );
+        check( !decodes_vertices( code, code.size(), vertex_size, vertices_count + 1 ) &&
+               !decodes_vertices( code, code.size(), vertex_size + sizeof(DWORD), vertices_count ) &&
+               !decodes_vertices( code, code.size(), vertex_size - 1, vertices_count ), what );
+
+        // the predictor of the first column is broken
+        bool bad_predictors_rejected = true;
+        for( unsigned i = 0; i < array_size(BAD_PREDICTORS); ++i )
+        {
+            std::vector<BYTE> corrupted( code );
+            corrupted[0] = BAD_PREDICTORS[i];
+            bad_predictors_rejected = bad_predictors_rejected && !decodes_vertices( corrupted, corrupted.size(), vertex_size, vertices_count );
+        }
+        sprintf( what, "codec: code of vertices of %s with a broken predictor is rejected", name );
+        check( bad_predictors_rejected, what );
+    }
+
+    void check_indices(const char *name, const Index *indices, DWORD indices_count, double min_ratio)
+    {
+        char what[256];
+        std::vector<BYTE> code;
+        encode_indices( indices, indices_count, code );
+        const size_t raw_size = static_cast<size_t>( indices_count )*sizeof(Index);
+
+        std::vector<Index> decoded( indices_count + 1 );
+        const bool decoded_ok = decode_indices( &code[0], code.size(), &decoded[0], indices_count );
+        sprintf( what, "codec: indices of %s are restored exactly (%u bytes, %u of code, ratio %.2f)",
+                 name, static_cast<unsigned>( raw_size ), static_cast<unsigned>( code.size() ), static_cast<double>( raw_size )/code.size() );
+        check( decoded_ok && memcmp( &decoded[0], indices, raw_size ) == 0, what );
+        if( min_ratio > 0 )
+        {
+            sprintf( what, "codec: indices of %s take at most 1/%g of their size", name, min_ratio );
+            check( raw_size >= min_ratio*code.size(), what );
+        }
+
+        sprintf( what, "codec: truncated code of indices of %s is rejected", name );
+        check( !decodes_indices( code, 0, indices_count ) && !decodes_indices( code, 1, indices_count ) &&
+               !decodes_indices( code, code.size()/2, indices_count ) && !decodes_indices( code, code.size() - 1, indices_count ), what );
+        std::vector<BYTE> longer( code );
+        longer.push_back( 0 );
+        sprintf( what, "codec: code of indices of %s with a trailing byte or decoded as more indices is rejected", name );
+        check( !decodes_indices( longer, longer.size(), indices_count ) && !decodes_indices( code, code.size(), indices_count + 1 ), what );
+
+        bool bad_distances_rejected = true;
+        for( unsigned i = 0; i < array_size(BAD_DISTANCES); ++i )
+        {
+            std::vector<BYTE> corrupted( code );
+            corrupted[0] = BAD_DISTANCES[i];
+            bad_distances_rejected = bad_distances_rejected && !decodes_indices( corrupted, corrupted.size(), indices_count );
+        }
+        sprintf( what, "codec: code of indices of %s with a broken distance is rejected", name );
+        check( bad_distances_rejected, what );
+    }
+
+    // Varints of more than 32 bits: five bytes with bits beyond, and six bytes
+    void check_long_varints()
+    {
+        const BYTE beyond_32_bits[] = { 1, 0xff, 0xff, 0xff, 0xff, 0x1f };
+        const BYTE six_bytes[] = { 1, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 };
+        const BYTE longest[] = { 1, 0xff, 0xff, 0xff, 0xff, 0x0f }; // 0xffffffff still fits
+        Index index;
+        check( !decode_indices( beyond_32_bits, sizeof(beyond_32_bits), &index, 1 ), "codec: a varint with bits beyond 32 is rejected" );
+        check( !decode_indices( six_bytes, sizeof(six_bytes), &index, 1 ), "codec: a varint of six bytes is rejected" );
+        check( decode_indices( longest, sizeof(longest), &index, 1 ) && index == 0x80000000, "codec: the longest varint is decoded" );
+    }
+
+    // Every prefix of the code of a small mesh is rejected
+    void check_prefixes()
+    {
+        std::vector<Vertex> vertices( pyramid_vertices_count( SMALL_PYRAMID_DEGREE ) );
+        std::vector<Index> indices( pyramid_indices_count( SMALL_PYRAMID_DEGREE ) );
+        pyramid( 1.0f, &vertices[0], &indices[0], D3DCOLOR_XRGB(255, 0, 0), SMALL_PYRAMID_DEGREE );
+        std::vector<BYTE> vertices_code;
+        std::vector<BYTE> indices_code;
+        encode_vertices( &vertices[0], sizeof(Vertex), static_cast<Index>( vertices.size() ), vertices_code );
+        encode_indices( &indices[0], static_cast<DWORD>( indices.size() ), indices_code );
+        bool rejected = true;
+        for( size_t size = 0; size < vertices_code.size(); ++size )
+            rejected = rejected && !decodes_vertices( vertices_code, size, sizeof(Vertex), static_cast<Index>( vertices.size() ) );
+        for( size_t size = 0; size < indices_code.size(); ++size )
+            rejected = rejected && !decodes_indices( indices_code, size, static_cast<DWORD>( indices.size() ) );
+        check( rejected, "codec: every prefix of the code of a small pyramid() is rejected" );
+    }
+}
+
+void test_codec()
+{
+    {
+        const PlaneDesc desc( 2.0f, 3.0f, D3DCOLOR_XRGB(50, 255, 50), PLANE_STEPS );
+        std::vector<Vertex> vertices( desc.vertices_count() );
+        std::vector<Index> indices( desc.indices_count() );
+        plane( desc.length, desc.width, &vertices[0], &indices[0], desc.color, desc.steps_per_half_side );
+        check_vertices( "plane()", &vertices[0], sizeof(Vertex), static_cast<Index>( vertices.size() ), MIN_VERTICES_RATIO );
+        check_indices( "plane()", &indices[0], static_cast<DWORD>( indices.size() ), MIN_INDICES_RATIO );
+    }
+    {
+        const D3DCOLOR colors[] = { D3DCOLOR_XRGB(250, 30, 10), D3DCOLOR_XRGB(0, 150, 250) };
+        const CylinderDesc desc( 0.7f, 2.0f, colors, array_size(colors), 100 );
+        std::vector<SkinningVertex> vertices( desc.vertices_count() );
+        std::vector<Index> indices( desc.indices_count() );
+        cylinder( desc.radius, desc.height, desc.colors, desc.colors_count, desc.bones_count, &vertices[0], &indices[0],
+                  desc.edges_per_base, desc.edges_per_height, desc.edges_per_cap );
+        check_vertices( "cylinder()", &vertices[0], sizeof(SkinningVertex), static_cast<Index>( vertices.size() ), MIN_VERTICES_RATIO );
+        check_indices( "cylinder()", &indices[0], static_cast<DWORD>( indices.size() ), MIN_INDICES_RATIO );
+    }
+    {
+        std::vector<Vertex> vertices( pyramid_vertices_count( PYRAMID_DEGREE ) );
+        std::vector<Index> indices( pyramid_indices_count( PYRAMID_DEGREE ) );
+        pyramid( 1.0f, &vertices[0], &indices[0], D3DCOLOR_XRGB(0, 0, 255), PYRAMID_DEGREE );
+        check_vertices( "pyramid()", &vertices[0], sizeof(Vertex), static_cast<Index>( vertices.size() ), MIN_VERTICES_RATIO );
+        check_indices( "pyramid()", &indices[0], static_cast<DWORD>( indices.size() ), MIN_INDICES_RATIO );
+    }
+    {
+        // any bit patterns: NaN, infinities and denormals among them
+        std::vector<DWORD> vertices( RANDOM_VERTICES_COUNT*sizeof(Vertex)/sizeof(DWORD) );
+        for( unsigned i = 0; i < vertices.size(); ++i )
+            vertices[i] = random_dword();
+        vertices[0] = 0x7fc00001; // a NaN with a payload
+        vertices[1] = 0xff800000; // -infinity
+        std::vector<Index> indices( RANDOM_INDICES_COUNT );
+        for( unsigned i = 0; i < indices.size(); ++i )
+            indices[i] = random_dword();
+        check_vertices( "random bits", &vertices[0], sizeof(Vertex), RANDOM_VERTICES_COUNT, 0 );
+        check_indices( "random bits", &indices[0], RANDOM_INDICES_COUNT, 0 );
+    }
+    check_long_varints();
+    check_prefixes();
+}
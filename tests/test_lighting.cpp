@@ -0,0 +1,182 @@
+#include "reference.h"
+#include "../lighting.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cfloat>
+
+// The specular power of the software lighting: fast_log2(), fast_exp2() and fast_power() against the math library
+// over the cosines and powers lighting gives them (0, denormals and the clamp of `lit' to +-128 too),
+// and light_vertices() against the exact lighting with such powers
+
+namespace
+{
+    const unsigned LANES = 4;
+    // of the cosines of all magnitudes, from the smallest denormal to 1
+    const unsigned COSINES_PER_OCTAVE = 16;
+    const int MIN_COSINE_LOG2 = -149;
+    // f as Application may set it: `lit' clamps it to +-128, which the lighting takes as it is
+    const float SPECULAR_FS[] = { -200.0f, -128.0f, -35.0f, -1.0f, 0, 0.5f, 1.0f, 8.0f, 35.0f, 128.0f, 200.0f };
+    const float MAX_SPECULAR_F = 128.0f;
+    // fast_exp2() keeps to normalized numbers
+    const double MIN_EXP2 = -125.99;
+    const double MAX_EXP2 = 127.99;
+
+    const double LOG2_TOLERANCE = 2e-7;         // relative to 1 + |log2|, as the result is a float
+    const double EXP2_TOLERANCE = 5e-6;         // relative
+    // relative: exp2 of f*log2, which is a float of up to 128 (its rounding is up to 128*6e-8 times ln 2 of the power)
+    const double POWER_TOLERANCE = 1e-5;
+    const double COLOR_TOLERANCE = 1e-4;        // as lighting.h promises
+    const Index VERTICES_COUNT = 1000;
+
+    void get_lanes(__m128 x, float res[LANES])
+    {
+        _mm_storeu_ps( res, x );
+    }
+
+    float get_lane(__m128 x, unsigned lane)
+    {
+        float lanes[LANES];
+        get_lanes( x, lanes );
+        return lanes[lane];
+    }
+
+    // 0, denormals, normalized numbers up to 1 and a little over (cosines of estimated unit vectors)
+    void make_cosines(std::vector<float> &res)
+    {
+        res.clear();
+        res.push_back( 0 );
+        res.push_back( FLT_MIN );
+        res.push_back( 1.0f );
+        res.push_back( 1.0f + FLT_EPSILON );
+        for( int i = MIN_COSINE_LOG2*static_cast<int>(COSINES_PER_OCTAVE); i <= 0; ++i )
+            res.push_back( static_cast<float>( pow( 2.0, static_cast<double>(i)/COSINES_PER_OCTAVE ) ) );
+        // and around 1, where specular highlights are
+        for( unsigned i = 0; i < 1000; ++i )
+            res.push_back( 0.9f + 0.1f*i/1000 );
+    }
+
+    double test_log2(const std::vector<float> &cosines)
+    // the largest error of positive numbers, relative to 1 + |log2|
+    {
+        double res = 0;
+        for( unsigned i = 0; i < cosines.size(); ++i )
+        {
+            if( cosines[i] <= 0 )
+                continue;
+            const double exact = log( static_cast<double>( cosines[i] ) )/log(2.0);
+            const double error = fabs( get_lane( fast_log2( _mm_set1_ps(cosines[i]) ), 0 ) - exact )/( 1.0 + fabs(exact) );
+            if( error > res || error != error )
+                res = error;
+        }
+        return res;
+    }
+
+    double test_exp2()
+    // the largest relative error over the range and beyond it, where the range clamps
+    {
+        double res = 0;
+        for( double x = -150.0; x <= 150.0; x += 1.0/64 + 1e-3 )
+        {
+            const double clamped = ( x < MIN_EXP2 ) ? MIN_EXP2 : ( ( x > MAX_EXP2 ) ? MAX_EXP2 : x );
+            const double exact = pow( 2.0, clamped );
+            const double error = fabs( get_lane( fast_exp2( _mm_set1_ps( static_cast<float>(x) ) ), 0 ) - exact )/exact;
+            if( error > res || error != error )
+                res = error;
+        }
+        return res;
+    }
+
+    double test_power(const std::vector<float> &cosines, float f, bool &zero_kept, bool &finite)
+    // the largest relative error where the exact power is a normalized float; beyond that the power must be clamped
+    {
+        double res = 0;
+        zero_kept = true;
+        finite = true;
+        for( unsigned i = 0; i < cosines.size(); ++i )
+        {
+            const float actual = get_lane( fast_power( _mm_set1_ps(cosines[i]), _mm_set1_ps(f) ), 0 );
+            if( cosines[i] <= 0 )
+            {
+                zero_kept = zero_kept && ( actual == 0 );
+                continue;
+            }
+            finite = finite && ( actual == actual ) && actual <= FLT_MAX;
+            const double exact_log2 = f*log( static_cast<double>( cosines[i] ) )/log(2.0);
+            if( exact_log2 < MIN_EXP2 || exact_log2 > MAX_EXP2 )
+                continue; // clamped, which fast_exp2() checks
+            const double exact = pow( 2.0, exact_log2 );
+            const double error = fabs( actual - exact )/exact;
+            if( error > res || error != error )
+                res = error;
+        }
+        return res;
+    }
+
+    // Vertices all around the light and the eye, so that cosines take all values
+    void make_lit_vertices(const TestScene &scene, std::vector<Vertex> &res)
+    {
+        std::vector<SkinningVertex> vertices;
+        make_test_vertices( VERTICES_COUNT, vertices );
+        res.assign( vertices.begin(), vertices.end() );
+        for( unsigned i = 0; i < res.size(); ++i )
+        {
+            // the sphere around the light, normals turned by the index
+            res[i].pos = scene.lighting.point_position + res[i].pos;
+            const float turn = static_cast<float>(i % 7)/3.0f - 1.0f;
+            res[i].set_normal( D3DXVECTOR3( res[i].normal.x + turn, res[i].normal.y - turn, res[i].normal.z ) );
+        }
+    }
+
+    double test_lighting(const TestScene &scene, float f)
+    {
+        LightingConstants lighting = scene.lighting;
+        lighting.specular_f = f;
+        std::vector<Vertex> vertices;
+        make_lit_vertices( scene, vertices );
+        SoftwareColumns columns( SOFTWARE_VERTEX_COLUMNS, VERTICES_COUNT );
+        load_software_vertices( &vertices[0], VERTICES_COUNT, columns );
+        SoftwareColumns actual( SOFTWARE_OUTPUT_COLUMNS, VERTICES_COUNT );
+        light_vertices( columns, lighting, true, 1, actual );
+
+        std::vector<ReferenceOutput> expected( VERTICES_COUNT );
+        for( unsigned i = 0; i < VERTICES_COUNT; ++i )
+        {
+            const ReferenceVector normal( vertices[i].normal.x, vertices[i].normal.y, vertices[i].normal.z );
+            light_reference( lighting, true, ReferenceVector( vertices[i].pos ), normal, vertices[i].color,
+                             expected[i].values + SOFTWARE_OUT_R );
+        }
+        return get_max_difference( expected, actual, SOFTWARE_OUT_R, SOFTWARE_COLOR_COMPONENTS );
+    }
+}
+
+void test_lighting()
+{
+    std::vector<float> cosines;
+    make_cosines( cosines );
+    check_error( "fast_log2() against log2 from denormals to 1", test_log2( cosines ), LOG2_TOLERANCE );
+    check_error( "fast_exp2() against exp2, clamped to normalized numbers", test_exp2(), EXP2_TOLERANCE );
+
+    TestScene scene;
+    make_test_scene( scene );
+    char what[128];
+    for( unsigned i = 0; i < array_size(SPECULAR_FS); ++i )
+    {
+        const float f = SPECULAR_FS[i];
+        // the lighting clamps the rest to +-128
+        if( fabs(f) <= MAX_SPECULAR_F )
+        {
+            bool zero_kept;
+            bool finite;
+            const double error = test_power( cosines, f, zero_kept, finite );
+            sprintf( what, "fast_power() against pow, f = %g: relative", f );
+            check_error( what, error, POWER_TOLERANCE );
+            sprintf( what, "fast_power() of 0, f = %g, is 0", f );
+            check( zero_kept, what );
+            sprintf( what, "fast_power() of cosines from denormals, f = %g, is finite", f );
+            check( finite, what );
+        }
+        sprintf( what, "light_vertices() against the exact lighting, f = %g: oD0", f );
+        check_error( what, test_lighting( scene, f ), COLOR_TOLERANCE );
+    }
+}
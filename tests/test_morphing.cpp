@@ -0,0 +1,44 @@
+#include "reference.h"
+#include "../morphing.h"
+#include <cstdio>
+
+// morph_vertices() against its reference in double precision, from the start of morphing to its end
+// and by one thread or many (the batches they take must not matter)
+
+namespace
+{
+    const Index VERTICES_COUNT = 1001; // not a multiple of SOFTWARE_BATCH_SIZE: the last batch is padded
+    const float MORPHING_PARAMS[] = { 0, 0.25f, 0.6f, 1.0f };
+    const unsigned THREADS_COUNTS[] = { 1, 3 };
+    // relative to 1 + |reference| (see get_max_difference())
+    const double POSITION_TOLERANCE = 1e-5;
+    const double COLOR_TOLERANCE = 1e-4; // as lighting.h promises
+}
+
+void test_morphing()
+{
+    TestScene scene;
+    make_test_scene( scene );
+    std::vector<SkinningVertex> skinning_vertices;
+    make_test_vertices( VERTICES_COUNT, skinning_vertices );
+    std::vector<Vertex> vertices( skinning_vertices.begin(), skinning_vertices.end() );
+    SoftwareColumns columns( SOFTWARE_VERTEX_COLUMNS, VERTICES_COUNT );
+    load_software_vertices( &vertices[0], VERTICES_COUNT, columns );
+
+    SoftwareColumns actual( SOFTWARE_OUTPUT_COLUMNS, VERTICES_COUNT );
+    std::vector<ReferenceOutput> expected;
+    for( unsigned i = 0; i < array_size(MORPHING_PARAMS); ++i )
+    {
+        morph_reference( vertices, scene.final_radius, MORPHING_PARAMS[i], scene.position_and_rotation, scene.view, scene.lighting, expected );
+        for( unsigned j = 0; j < array_size(THREADS_COUNTS); ++j )
+        {
+            morph_vertices( columns, scene.final_radius, MORPHING_PARAMS[i], scene.position_and_rotation, scene.view, scene.lighting,
+                            THREADS_COUNTS[j], actual );
+            char what[128];
+            sprintf( what, "morph_vertices() against the reference, t = %g, %u threads: oPos", MORPHING_PARAMS[i], THREADS_COUNTS[j] );
+            check_error( what, get_max_difference( expected, actual, SOFTWARE_OUT_X, 4 ), POSITION_TOLERANCE );
+            sprintf( what, "morph_vertices() against the reference, t = %g, %u threads: oD0", MORPHING_PARAMS[i], THREADS_COUNTS[j] );
+            check_error( what, get_max_difference( expected, actual, SOFTWARE_OUT_R, SOFTWARE_COLOR_COMPONENTS ), COLOR_TOLERANCE );
+        }
+    }
+}
@@ -0,0 +1,132 @@
+#include "tests.h"
+#include "../normals.h"
+#include "../pyramid.h"
+#include <cstdio>
+
+// smooth_normals(): copies of the corners of a cube keep the normals of their faces with the crease angle 0 (and below
+// the right angle between the faces), and turn to the diagonals of the cube with D3DX_PI. Normals of a curved mesh
+// with creases do not depend on the number of threads, and the overload for vertices gives what the one for positions does
+
+namespace
+{
+    const unsigned CUBE_FACES_COUNT = 6;
+    const unsigned FACE_CORNERS_COUNT = 4;
+    const float NORMAL_TOLERANCE = 1e-5f;
+    const unsigned THREADS_COUNTS[] = { 2, 3, 8 }; // against one thread
+    const float PYRAMID_RADIUS = 1.0f;
+    const float PYRAMID_SIDE = 2.0f;
+    const float PYRAMID_MAX_ERROR = 0.01f;
+    const float PYRAMID_CREASE_ANGLE = D3DX_PI/4;
+
+    // A cube of the side 2 around the origin, faces apart: each corner has three copies, one per face.
+    // Front faces are clockwise, as smooth_normals() expects
+    void make_cube(std::vector<D3DXVECTOR3> &positions, std::vector<D3DXVECTOR3> &face_normals, std::vector<Index> &indices)
+    {
+        // the normal of each face and two directions along it, u x v = normal
+        const D3DXVECTOR3 x( 1, 0, 0 );
+        const D3DXVECTOR3 y( 0, 1, 0 );
+        const D3DXVECTOR3 z( 0, 0, 1 );
+        const D3DXVECTOR3 faces[CUBE_FACES_COUNT][3] = { { x, y, z }, { -x, z, y }, { y, z, x }, { -y, x, z }, { z, x, y }, { -z, y, x } };
+        const float corners[FACE_CORNERS_COUNT][2] = { { -1, -1 }, { -1, 1 }, { 1, 1 }, { 1, -1 } };
+        const Index face_indices[] = { 0, 1, 2,  0, 2, 3 };
+        for( unsigned i = 0; i < CUBE_FACES_COUNT; ++i )
+        {
+            const Index first = static_cast<Index>( positions.size() );
+            for( unsigned j = 0; j < FACE_CORNERS_COUNT; ++j )
+            {
+                positions.push_back( faces[i][0] + corners[j][0]*faces[i][1] + corners[j][1]*faces[i][2] );
+                face_normals.push_back( faces[i][0] );
+            }
+            for( unsigned j = 0; j < array_size(face_indices); ++j )
+                indices.push_back( first + face_indices[j] );
+        }
+    }
+
+    float get_max_difference(const std::vector<D3DXVECTOR3> &a, const std::vector<D3DXVECTOR3> &b)
+    {
+        float max_difference = 0;
+        for( unsigned i = 0; i < a.size(); ++i )
+        {
+            const D3DXVECTOR3 difference = a[i] - b[i];
+            const float length = D3DXVec3Length( &difference );
+            if( length > max_difference )
+                max_difference = length;
+        }
+        return max_difference;
+    }
+
+    void check_cube()
+    {
+        std::vector<D3DXVECTOR3> positions;
+        std::vector<D3DXVECTOR3> face_normals;
+        std::vector<Index> indices;
+        make_cube( positions, face_normals, indices );
+        const Index vertices_count = static_cast<Index>( positions.size() );
+        const DWORD indices_count = static_cast<DWORD>( indices.size() );
+        const NormalWeighting weightings[] = { NORMALS_BY_AREA, NORMALS_BY_ANGLE };
+        const char *weighting_names[] = { "by area", "by angle" };
+        std::vector<D3DXVECTOR3> normals( vertices_count );
+        char what[256];
+        for( unsigned i = 0; i < array_size(weightings); ++i )
+        {
+            const float flat_creases[] = { 0, D3DX_PI/3 };
+            for( unsigned j = 0; j < array_size(flat_creases); ++j )
+            {
+                smooth_normals( &positions[0], vertices_count, &indices[0], indices_count, weightings[i], flat_creases[j], 1, &normals[0] );
+                sprintf( what, "smooth_normals() %s of a cube with the crease angle %g: normals of the faces", weighting_names[i], flat_creases[j] );
+                check_error( what, get_max_difference( normals, face_normals ), NORMAL_TOLERANCE );
+            }
+        }
+
+        // by angle each face adds the right angle at each of its corners, however its triangles split it
+        std::vector<D3DXVECTOR3> diagonals( vertices_count );
+        for( Index v = 0; v < vertices_count; ++v )
+            diagonals[v] = positions[v]/sqrt(3.0f);
+        smooth_normals( &positions[0], vertices_count, &indices[0], indices_count, NORMALS_BY_ANGLE, D3DX_PI, 1, &normals[0] );
+        check_error( "smooth_normals() by angle of a cube with the crease angle D3DX_PI: diagonals of the cube",
+                     get_max_difference( normals, diagonals ), NORMAL_TOLERANCE );
+    }
+
+    void check_pyramid()
+    {
+        Index vertices_count = 0;
+        DWORD indices_count = 0;
+        pyramid_adaptive_counts( PYRAMID_SIDE, PYRAMID_RADIUS, PYRAMID_MAX_ERROR, vertices_count, indices_count );
+        std::vector<Vertex> vertices( vertices_count );
+        std::vector<Index> indices( indices_count );
+        pyramid_adaptive( PYRAMID_SIDE, PYRAMID_RADIUS, PYRAMID_MAX_ERROR, &vertices[0], &indices[0], D3DCOLOR_XRGB(0, 0, 255),
+                          vertices_count, indices_count );
+        std::vector<D3DXVECTOR3> positions( vertices_count );
+        for( Index v = 0; v < vertices_count; ++v )
+            positions[v] = vertices[v].pos;
+
+        std::vector<D3DXVECTOR3> expected( vertices_count );
+        smooth_normals( &positions[0], vertices_count, &indices[0], indices_count, NORMALS_BY_ANGLE, PYRAMID_CREASE_ANGLE, 1, &expected[0] );
+        char what[256];
+        for( unsigned i = 0; i < array_size(THREADS_COUNTS); ++i )
+        {
+            std::vector<D3DXVECTOR3> actual( vertices_count );
+            smooth_normals( &positions[0], vertices_count, &indices[0], indices_count, NORMALS_BY_ANGLE, PYRAMID_CREASE_ANGLE,
+                            THREADS_COUNTS[i], &actual[0] );
+            sprintf( what, "smooth_normals() of pyramid_adaptive() (%u vertices) in %u threads as in one", vertices_count, THREADS_COUNTS[i] );
+            check_error( what, get_max_difference( actual, expected ), NORMAL_TOLERANCE );
+        }
+
+        smooth_normals( &vertices[0], vertices_count, &indices[0], indices_count, NORMALS_BY_ANGLE, PYRAMID_CREASE_ANGLE, 1 );
+        std::vector<D3DXVECTOR3> vertex_normals( vertices_count );
+        bool positions_kept = true;
+        for( Index v = 0; v < vertices_count; ++v )
+        {
+            vertex_normals[v] = D3DXVECTOR3( vertices[v].normal.x, vertices[v].normal.y, vertices[v].normal.z );
+            positions_kept = positions_kept && vertices[v].pos == positions[v] && vertices[v].normal.w == 0;
+        }
+        check( positions_kept, "smooth_normals() of vertices keeps their positions and sets normals as vectors" );
+        check_error( "smooth_normals() of vertices of pyramid_adaptive() as of their positions", get_max_difference( vertex_normals, expected ), 0 );
+    }
+}
+
+void test_normals()
+{
+    check_cube();
+    check_pyramid();
+}
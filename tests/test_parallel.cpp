@@ -0,0 +1,89 @@
+#include "tests.h"
+#include "../parallel.h"
+#include <cstdio>
+
+// parallel_for() does every item once, in ranges of threads numbered below the threads count: with threads started
+// for the call, with those of a WorkerPool called many times (as every frame), with more threads than the pool has,
+// and with a parallel_for() nested in a task while the pool is busy
+
+namespace
+{
+    const unsigned POOL_THREADS_COUNT = 4;
+    const unsigned CALLS_COUNT = 1000;
+    const DWORD ITEMS_COUNT = 1000;
+    const DWORD NESTED_ITEMS_COUNT = 100;
+
+    struct COUNTING_PARAMS
+    {
+        std::vector<unsigned> *done;          // times each item was done
+        std::vector<unsigned> *threads_used;  // ranges done by each thread number
+        bool nested;                          // the first range does NESTED_ITEMS_COUNT other items with parallel_for()
+        std::vector<unsigned> *nested_done;
+        std::vector<unsigned> *nested_threads_used;
+    };
+
+    void count_items(void *context, unsigned thread, DWORD begin, DWORD end)
+    {
+        const COUNTING_PARAMS &params = *static_cast<const COUNTING_PARAMS*>( context );
+        if( thread < params.threads_used->size() )
+            ++(*params.threads_used)[thread];
+        for( DWORD i = begin; i < end; ++i )
+            ++(*params.done)[i];
+        if( params.nested && thread == 0 )
+        {
+            COUNTING_PARAMS nested_params = { params.nested_done, params.nested_threads_used, false, NULL, NULL };
+            parallel_for( NESTED_ITEMS_COUNT, POOL_THREADS_COUNT, count_items, &nested_params );
+        }
+    }
+
+    // Whether each item was done `calls_count' times and each thread did one range per call
+    bool is_counted(const std::vector<unsigned> &done, const std::vector<unsigned> &threads_used, unsigned calls_count)
+    {
+        for( unsigned i = 0; i < done.size(); ++i )
+        {
+            if( done[i] != calls_count )
+                return false;
+        }
+        for( unsigned i = 0; i < threads_used.size(); ++i )
+        {
+            if( threads_used[i] != calls_count )
+                return false;
+        }
+        return true;
+    }
+
+    bool check_calls(unsigned threads_count, unsigned calls_count, bool nested)
+    {
+        std::vector<unsigned> done( ITEMS_COUNT, 0 );
+        // one more thread number to catch numbers out of range
+        std::vector<unsigned> threads_used( threads_count + 1, 0 );
+        std::vector<unsigned> nested_done( NESTED_ITEMS_COUNT, 0 );
+        std::vector<unsigned> nested_threads_used( POOL_THREADS_COUNT + 1, 0 );
+        COUNTING_PARAMS params = { &done, &threads_used, nested, &nested_done, &nested_threads_used };
+        for( unsigned i = 0; i < calls_count; ++i )
+            parallel_for( ITEMS_COUNT, threads_count, count_items, &params );
+
+        threads_used.pop_back();
+        nested_threads_used.pop_back();
+        return is_counted( done, threads_used, calls_count ) &&
+               ( !nested || is_counted( nested_done, nested_threads_used, calls_count ) ) &&
+               threads_used.size() == threads_count;
+    }
+}
+
+void test_parallel()
+{
+    char what[256];
+    sprintf( what, "parallel_for() without a pool: %u items in %u threads", ITEMS_COUNT, POOL_THREADS_COUNT );
+    check( check_calls( POOL_THREADS_COUNT, 1, false ), what );
+
+    WorkerPool pool( POOL_THREADS_COUNT );
+    sprintf( what, "parallel_for() with a pool of %u threads: %u calls", POOL_THREADS_COUNT, CALLS_COUNT );
+    check( check_calls( POOL_THREADS_COUNT, CALLS_COUNT, false ), what );
+    sprintf( what, "parallel_for() with a pool of %u threads: %u calls in 1, 2 and %u threads", POOL_THREADS_COUNT, CALLS_COUNT,
+             2*POOL_THREADS_COUNT );
+    check( check_calls( 1, CALLS_COUNT, false ) && check_calls( 2, CALLS_COUNT, false ) &&
+           check_calls( 2*POOL_THREADS_COUNT, CALLS_COUNT, false ), what );
+    sprintf( what, "parallel_for() with a pool of %u threads: %u calls each nesting another one", POOL_THREADS_COUNT, CALLS_COUNT/10 );
+    check( check_calls( POOL_THREADS_COUNT, CALLS_COUNT/10, true ), what );
+}
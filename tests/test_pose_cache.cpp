@@ -0,0 +1,102 @@
+#include "tests.h"
+#include "../skinning.h"
+#include "../pose_cache.h"
+#include "../matrices.h"
+#include <cstdio>
+
+// PoseCache of the bones of SkinningModel against bend_bones() evaluated exactly, over several periods before and after
+// zero: elements of interpolated matrices are within SKINNING_POSE_TOLERANCE. Times at the samples give the samples,
+// and phases close to 1 and negative times wrap around to the first sample
+
+namespace
+{
+    const unsigned BONES_COUNT = 100; // as in the cylinders of the scene
+    const D3DXVECTOR3 BONE_CENTERS[] = { D3DXVECTOR3( 0, 0, -1 ), D3DXVECTOR3( 0, 0, 1 ) };
+    const float FIRST_PERIOD = -2.5f; // checked times are from FIRST_PERIOD to LAST_PERIOD periods...
+    const float LAST_PERIOD = 3.5f;
+    const unsigned STEPS_PER_SAMPLE = 7; // ... in steps between samples
+    const float SAMPLE_TOLERANCE = 1e-5f; // of the time of a sample: its rounding only
+
+    float get_max_difference(const std::vector<D3DXMATRIX> &a, const std::vector<D3DXMATRIX> &b)
+    {
+        float max_difference = 0;
+        for( unsigned i = 0; i < a.size(); ++i )
+        {
+            for( unsigned j = 0; j < sizeof(D3DXMATRIX)/sizeof(float); ++j )
+            {
+                const float difference = fabs( static_cast<const float*>( a[i] )[j] - static_cast<const float*>( b[i] )[j] );
+                if( difference > max_difference )
+                    max_difference = difference;
+            }
+        }
+        return max_difference;
+    }
+}
+
+void test_pose_cache()
+{
+    const D3DXMATRIX identity = rotate_and_shift_matrix( D3DXVECTOR3( 0, 0, 0 ), D3DXVECTOR3( 0, 0, 0 ) );
+    std::vector<D3DXMATRIX> exact( BONES_COUNT, identity );
+    std::vector<D3DXMATRIX> cached( BONES_COUNT, identity );
+    char what[256];
+    for( unsigned c = 0; c < array_size(BONE_CENTERS); ++c )
+    {
+        PoseCache poses( SKINNING_PERIOD, SKINNING_POSES_PER_PERIOD, BONES_COUNT*sizeof(D3DXMATRIX)/sizeof(float) );
+        sample_bent_bones( BONE_CENTERS[c], BONES_COUNT, poses );
+
+        // between the samples of several periods
+        const float step = SKINNING_PERIOD/(SKINNING_POSES_PER_PERIOD*STEPS_PER_SAMPLE);
+        const int first_step = static_cast<int>( FIRST_PERIOD*SKINNING_POSES_PER_PERIOD*STEPS_PER_SAMPLE );
+        const int last_step = static_cast<int>( LAST_PERIOD*SKINNING_POSES_PER_PERIOD*STEPS_PER_SAMPLE );
+        float max_difference = 0;
+        for( int i = first_step; i <= last_step; ++i )
+        {
+            const float time = i*step;
+            bend_bones( time, BONE_CENTERS[c], BONES_COUNT, &exact[0] );
+            poses.get( time, cached[0] );
+            const float difference = get_max_difference( exact, cached );
+            if( difference > max_difference )
+                max_difference = difference;
+        }
+        sprintf( what, "PoseCache of bend_bones() around (%g, %g, %g) from %g to %g periods", BONE_CENTERS[c].x, BONE_CENTERS[c].y,
+                 BONE_CENTERS[c].z, FIRST_PERIOD, LAST_PERIOD );
+        check_error( what, max_difference, SKINNING_POSE_TOLERANCE );
+
+        // at the samples themselves
+        float max_sample_difference = 0;
+        for( unsigned i = 0; i < SKINNING_POSES_PER_PERIOD; ++i )
+        {
+            bend_bones( poses.get_sample_time(i), BONE_CENTERS[c], BONES_COUNT, &exact[0] );
+            poses.get( poses.get_sample_time(i), cached[0] );
+            const float difference = get_max_difference( exact, cached );
+            if( difference > max_sample_difference )
+                max_sample_difference = difference;
+        }
+        sprintf( what, "PoseCache of bend_bones() around (%g, %g, %g) at the samples", BONE_CENTERS[c].x, BONE_CENTERS[c].y,
+                 BONE_CENTERS[c].z );
+        check_error( what, max_sample_difference, SAMPLE_TOLERANCE );
+    }
+
+    // the wrap-around: a phase rounded to 1 and negative times
+    const float pose[] = { 1.0f };
+    const float last_pose[] = { 3.0f };
+    PoseCache steps( SKINNING_PERIOD, 2, 1 );
+    steps.set_pose( 0, pose );
+    steps.set_pose( 1, last_pose );
+    float value = 0;
+    float before_period = 0;
+    float below_zero = 0;
+    float whole_periods = 0;
+    steps.get( -SKINNING_PERIOD*1e-9f, &before_period );                 // its phase 1 - 5e-10 rounds to 1
+    steps.get( -SKINNING_PERIOD/4, &below_zero );                         // 3/4 of the period: between the last sample and the first one
+    steps.get( -3*SKINNING_PERIOD, &whole_periods );
+    steps.get( SKINNING_PERIOD*3/4, &value );
+    sprintf( what, "PoseCache::get() wraps around: %g just below zero, %g at -1/4 of the period, %g at -3 periods", before_period,
+             below_zero, whole_periods );
+    check( fabs( before_period - pose[0] ) < SAMPLE_TOLERANCE && fabs( below_zero - (pose[0] + last_pose[0])/2 ) < SAMPLE_TOLERANCE &&
+           fabs( below_zero - value ) < SAMPLE_TOLERANCE && fabs( whole_periods - pose[0] ) < SAMPLE_TOLERANCE, what );
+    float almost_period = 0;
+    steps.get( SKINNING_PERIOD*0.999f, &almost_period );
+    sprintf( what, "PoseCache::get() close to the period goes back to the first sample: %g", almost_period );
+    check( almost_period > pose[0] && almost_period - pose[0] < 0.01f, what );
+}
@@ -0,0 +1,76 @@
+#include "tests.h"
+#include "../filter.h"
+#include "../parallel.h"
+#include <cstdio>
+#include <cstdlib>
+
+// target.psh run by the interpreter against the scalar reference of the filter pass, for each filter of the application.
+// They add the taps in different orders, so a component may differ by one step of 8 bits
+
+namespace
+{
+    // not multiples of the batch of the interpreter, so pixels out of the target are shaded too
+    const unsigned SOURCE_WIDTH = 61;
+    const unsigned SOURCE_HEIGHT = 37;
+    const int MAX_COMPONENT_DIFFERENCE = 1;
+
+    // Taps of the filters of Application.cpp: cells 1, 3, 4, 5, 7 of the 3x3 filters
+    const float FILTERS[][FILTER_TAPS_COUNT] =
+    {
+        {      0,      0,      1,      0,      0 }, // none
+        {      1,     -1,      0,      1,     -1 }, // emboss
+        { 1.0f/6, 1.0f/6, 1.0f/3, 1.0f/6, 1.0f/6 }, // blur
+        {     -1,     -1,      5,     -1,     -1 }, // sharpen
+        {     -1,     -1,      4,     -1,     -1 }, // edges
+    };
+    const char *FILTER_NAMES[] = { "none", "emboss", "blur", "sharpen", "edges" };
+
+    int get_max_difference(const std::vector<D3DCOLOR> &a, const std::vector<D3DCOLOR> &b)
+    // of components
+    {
+        int res = 0;
+        for( unsigned i = 0; i < a.size(); ++i )
+        {
+            for( unsigned shift = 0; shift < 32; shift += 8 )
+            {
+                const int difference = abs( static_cast<int>( ( a[i] >> shift ) & 0xFF ) - static_cast<int>( ( b[i] >> shift ) & 0xFF ) );
+                if( difference > res )
+                    res = difference;
+            }
+        }
+        return res;
+    }
+}
+
+void test_ps_interpreter()
+{
+    ShaderCode code;
+    load_project_shader( "target.psh", code );
+    std::vector<D3DCOLOR> texels( SOURCE_WIDTH*SOURCE_HEIGHT );
+    for( unsigned i = 0; i < texels.size(); ++i )
+        texels[i] = D3DCOLOR_ARGB( rand() % 256, rand() % 256, rand() % 256, rand() % 256 );
+    const PsSurface source = { &texels[0], SOURCE_WIDTH, SOURCE_HEIGHT, SOURCE_WIDTH };
+
+    std::vector<D3DCOLOR> expected( texels.size() );
+    std::vector<D3DCOLOR> actual( texels.size() );
+    for( unsigned i = 0; i < array_size(FILTERS); ++i )
+    {
+        filter_surface( source, FILTERS[i], &expected[0] );
+        PixelShaderInterpreter shader( code );
+        PsGradient textures[SHADER_PS_TEXTURE_REGISTERS];
+        PsGradient colors[SHADER_PS_INPUT_REGISTERS];
+        set_filter_pass( source, FILTERS[i], shader, textures, colors );
+        run_pixel_shader( shader, textures, colors, SOURCE_WIDTH, SOURCE_HEIGHT, get_threads_count(), &actual[0] );
+
+        char what[128];
+        sprintf( what, "target.psh against filter_surface(), %s filter, steps of 8 bits", FILTER_NAMES[i] );
+        check_error( what, get_max_difference( expected, actual ), MAX_COMPONENT_DIFFERENCE );
+
+        // texels are sampled at their centers, where linear filtering gives the same
+        for( unsigned j = 0; j < FILTER_TAPS_COUNT; ++j )
+            shader.set_texture( j, source, D3DTEXF_LINEAR );
+        run_pixel_shader( shader, textures, colors, SOURCE_WIDTH, SOURCE_HEIGHT, get_threads_count(), &actual[0] );
+        sprintf( what, "target.psh with linear filtering against filter_surface(), %s filter, steps of 8 bits", FILTER_NAMES[i] );
+        check_error( what, get_max_difference( expected, actual ), MAX_COMPONENT_DIFFERENCE );
+    }
+}
@@ -0,0 +1,134 @@
+#include "tests.h"
+#include "../ps_interpreter.h"
+#include "../parallel.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+// Every shader of the project against itself optimized (see shader_opt.h) and written for the device: both run by the interpreters
+// on the same random inputs and constants must give the same outputs. A mad does not round its product as mul and add do,
+// so outputs may differ in their last bits
+
+namespace
+{
+    const char *PIXEL_SHADERS[] = { "target.psh" };
+
+    const unsigned VERTEX_RUNS_COUNT = 50;      // batches, each with other constants
+    const double VERTEX_TOLERANCE = 1e-4;       // relative to 1 + |a|
+    const unsigned PIXEL_RUNS_COUNT = 10;
+    const unsigned TEXTURE_SIZE = 32;
+    const int PIXEL_TOLERANCE = 1;              // steps of 8 bits
+
+    float get_random(float max_value)
+    // from -max_value to max_value
+    {
+        return ( 2.0f*rand()/RAND_MAX - 1.0f )*max_value;
+    }
+
+    double compare_vertex_shaders(const ShaderCode &code, const ShaderCode &optimized)
+    // the largest difference of outputs
+    {
+        double res = 0;
+        for( unsigned run = 0; run < VERTEX_RUNS_COUNT; ++run )
+        {
+            VertexShaderInterpreter original_shader( code );
+            VertexShaderInterpreter optimized_shader( optimized );
+            std::vector<float> constants;
+            make_random_constants( constants );
+            original_shader.set_constants( 0, &constants[0], SHADER_CONST_REGISTERS );
+            optimized_shader.set_constants( 0, &constants[0], SHADER_CONST_REGISTERS );
+
+            VsInputs inputs;
+            make_random_inputs( inputs );
+            VsOutputs original_outputs;
+            VsOutputs optimized_outputs;
+            original_shader.run( inputs, original_outputs );
+            optimized_shader.run( inputs, optimized_outputs );
+            res = std::max( res, get_max_difference( original_outputs, optimized_outputs ) );
+        }
+        return res;
+    }
+
+    int compare_pixel_shaders(const ShaderCode &code, const ShaderCode &optimized)
+    // the largest difference of components of the target
+    {
+        std::vector<D3DCOLOR> texels( TEXTURE_SIZE*TEXTURE_SIZE );
+        std::vector<D3DCOLOR> original_target( texels.size() );
+        std::vector<D3DCOLOR> optimized_target( texels.size() );
+        int res = 0;
+        for( unsigned run = 0; run < PIXEL_RUNS_COUNT; ++run )
+        {
+            for( unsigned i = 0; i < texels.size(); ++i )
+                texels[i] = D3DCOLOR_ARGB( rand() % 256, rand() % 256, rand() % 256, rand() % 256 );
+            const PsSurface surface = { &texels[0], TEXTURE_SIZE, TEXTURE_SIZE, TEXTURE_SIZE };
+
+            PixelShaderInterpreter original_shader( code );
+            PixelShaderInterpreter optimized_shader( optimized );
+            float constants[SHADER_PS_CONST_REGISTERS][SHADER_COMPONENTS];
+            for( unsigned i = 0; i < SHADER_PS_CONST_REGISTERS; ++i )
+            {
+                for( unsigned j = 0; j < SHADER_COMPONENTS; ++j )
+                    constants[i][j] = get_random( 1.0f );
+            }
+            original_shader.set_constants( 0, constants[0], SHADER_PS_CONST_REGISTERS );
+            optimized_shader.set_constants( 0, constants[0], SHADER_PS_CONST_REGISTERS );
+
+            // texture coordinates of random gradients, sampled between texels
+            PsGradient textures[SHADER_PS_TEXTURE_REGISTERS];
+            PsGradient colors[SHADER_PS_INPUT_REGISTERS];
+            for( unsigned i = 0; i < SHADER_PS_TEXTURE_REGISTERS; ++i )
+            {
+                original_shader.set_texture( i, surface, D3DTEXF_LINEAR );
+                optimized_shader.set_texture( i, surface, D3DTEXF_LINEAR );
+                textures[i].origin = D3DXVECTOR4( get_random( 1.0f ), get_random( 1.0f ), 0, 1.0f );
+                textures[i].ddx = D3DXVECTOR4( get_random( 2.0f )/TEXTURE_SIZE, get_random( 2.0f )/TEXTURE_SIZE, 0, 0 );
+                textures[i].ddy = D3DXVECTOR4( get_random( 2.0f )/TEXTURE_SIZE, get_random( 2.0f )/TEXTURE_SIZE, 0, 0 );
+            }
+            for( unsigned i = 0; i < SHADER_PS_INPUT_REGISTERS; ++i )
+            {
+                colors[i].origin = D3DXVECTOR4( 0.5f, 0.5f, 0.5f, 0.5f );
+                colors[i].ddx = D3DXVECTOR4( 0.5f/TEXTURE_SIZE, 0, 0, 0 );
+                colors[i].ddy = D3DXVECTOR4( 0, 0.5f/TEXTURE_SIZE, 0, 0 );
+            }
+            run_pixel_shader( original_shader, textures, colors, TEXTURE_SIZE, TEXTURE_SIZE, get_threads_count(), &original_target[0] );
+            run_pixel_shader( optimized_shader, textures, colors, TEXTURE_SIZE, TEXTURE_SIZE, get_threads_count(), &optimized_target[0] );
+
+            for( unsigned i = 0; i < texels.size(); ++i )
+            {
+                for( unsigned shift = 0; shift < 32; shift += 8 )
+                {
+                    const int difference = abs( static_cast<int>( ( original_target[i] >> shift ) & 0xFF ) -
+                                                static_cast<int>( ( optimized_target[i] >> shift ) & 0xFF ) );
+                    res = std::max( res, difference );
+                }
+            }
+        }
+        return res;
+    }
+}
+
+void test_shader_opt()
+{
+    char what[128];
+    for( unsigned i = 0; i < TEST_VERTEX_SHADERS_COUNT; ++i )
+    {
+        ShaderCode code;
+        ShaderCode optimized;
+        load_project_shader( TEST_VERTEX_SHADERS[i], code );
+        get_device_code( code, optimized );
+        sprintf( what, "%s against its optimized code: %u slots, %u optimized", TEST_VERTEX_SHADERS[i],
+                 get_instruction_slots(code), get_instruction_slots(optimized) );
+        check_error( what, compare_vertex_shaders( code, optimized ), VERTEX_TOLERANCE );
+    }
+    for( unsigned i = 0; i < array_size(PIXEL_SHADERS); ++i )
+    {
+        ShaderCode code;
+        ShaderCode optimized;
+        load_project_shader( PIXEL_SHADERS[i], code );
+        get_device_code( code, optimized );
+        sprintf( what, "%s against its optimized code: %u slots, %u optimized, steps of 8 bits", PIXEL_SHADERS[i],
+                 get_instruction_slots(code), get_instruction_slots(optimized) );
+        check_error( what, compare_pixel_shaders( code, optimized ), PIXEL_TOLERANCE );
+    }
+}
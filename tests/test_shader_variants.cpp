@@ -0,0 +1,76 @@
+#include "tests.h"
+#include "../shader_variants.h"
+#include <cstdio>
+#include <algorithm>
+
+// Every variant of every .vsh (see shader_variants.h) as the device gets it against the shader itself run with the registers
+// of the missing features set to 0: both run by the interpreter on the same random inputs and constants must give the same outputs
+
+namespace
+{
+    const unsigned RUNS_COUNT = 20;     // batches, each with other constants
+    const double TOLERANCE = 1e-4;      // relative to 1 + |a|, as mad of the optimized code rounds differently
+
+    struct FEATURE_REGISTER
+    {
+        ShaderFeature feature;
+        unsigned reg;
+    };
+    const FEATURE_REGISTER FEATURE_REGISTERS[] =
+    {
+        { SHADER_FEATURE_POINT_LIGHT,   SHADER_REG_POINT_COLOR      },
+        { SHADER_FEATURE_AMBIENT,       SHADER_REG_AMBIENT_COLOR    },
+        { SHADER_FEATURE_SPECULAR,      SHADER_REG_SPECULAR_COEF    },
+    };
+
+    double compare_variant(const ShaderCode &code, const ShaderCode &variant, DWORD features)
+    // the largest difference of outputs
+    {
+        double res = 0;
+        for( unsigned run = 0; run < RUNS_COUNT; ++run )
+        {
+            VertexShaderInterpreter shader( code );
+            VertexShaderInterpreter variant_shader( variant );
+            std::vector<float> constants;
+            make_random_constants( constants );
+            variant_shader.set_constants( 0, &constants[0], SHADER_CONST_REGISTERS );
+            for( unsigned i = 0; i < array_size(FEATURE_REGISTERS); ++i )
+            {
+                if( ( features & FEATURE_REGISTERS[i].feature ) == 0 )
+                    std::fill_n( &constants[FEATURE_REGISTERS[i].reg*SHADER_COMPONENTS], SHADER_COMPONENTS, 0.0f );
+            }
+            shader.set_constants( 0, &constants[0], SHADER_CONST_REGISTERS );
+
+            VsInputs inputs;
+            make_random_inputs( inputs );
+            VsOutputs outputs;
+            VsOutputs variant_outputs;
+            shader.run( inputs, outputs );
+            variant_shader.run( inputs, variant_outputs );
+            res = std::max( res, get_max_difference( outputs, variant_outputs ) );
+        }
+        return res;
+    }
+}
+
+void test_shader_variants()
+{
+    char what[128];
+    for( unsigned i = 0; i < TEST_VERTEX_SHADERS_COUNT; ++i )
+    {
+        ShaderCode code;
+        load_project_shader( TEST_VERTEX_SHADERS[i], code );
+        const DWORD used_features = get_used_features( code );
+        // all combinations, also of features the shader does not use: VertexShader::set() takes them all
+        for( DWORD features = 0; features <= ALL_SHADER_FEATURES; ++features )
+        {
+            ShaderCode variant;
+            ShaderCode device_variant;
+            make_shader_variant( code, features, variant );
+            get_device_code( variant, device_variant );
+            sprintf( what, "%s with features %lu of %lu against the shader without the others: %u slots", TEST_VERTEX_SHADERS[i],
+                     static_cast<unsigned long>(features), static_cast<unsigned long>(used_features), get_instruction_slots(device_variant) );
+            check_error( what, compare_variant( code, device_variant, features ), TOLERANCE );
+        }
+    }
+}
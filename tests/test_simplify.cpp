@@ -0,0 +1,247 @@
+#include "tests.h"
+#include "../simplify.h"
+#include "../plane.h"
+#include "../cylinder.h"
+#include "../pyramid.h"
+#include <cfloat>
+#include <cstdio>
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <algorithm>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// simplify() on the output of plane(), cylinder() and pyramid(): flat parts lose their inner vertices without changing
+// the surface, seams and borders stay, targets are met, and the density option keeps small triangles near the point
+
+namespace
+{
+    const int PLANE_STEPS = 20;             // per half side: 3200 triangles
+    const float PLANE_SIDE = 2.0f;
+    const float FLAT_ERROR = 1e-6f;         // only collapses which keep a flat surface as it is
+    const double AREA_TOLERANCE = 1e-5;     // relative
+
+    // The density term decides near the point and far from it, but moving the border costs more than DENSE_ERROR
+    const float DENSE_RADIUS = 0.3f;
+    const float DENSE_WEIGHT = 1e-3f;
+    const float DENSE_ERROR = 1e-5f;
+    const float DENSE_DISTANCE = 0.6f;      // a vertex moved from farther makes triangles too big to be near the point
+
+    const float CYLINDER_RADIUS = 0.5f;
+    const float CYLINDER_HEIGHT = 2.0f;
+    const unsigned CYLINDER_BONES = 4;
+    const Index CYLINDER_EDGES[] = { 24, 16, 4 }; // per base, per height, per cap
+    const unsigned CYLINDER_REDUCTION = 4;  // the target is a quarter of triangles
+    const double VOLUME_TOLERANCE = 0.05;   // relative: the target is reached at any error
+
+    const float PYRAMID_SIDE = 1.0f;
+    const DWORD PYRAMID_DEGREE = 8;
+
+    D3DXVECTOR3 get_normal(const D3DXVECTOR3 *positions, const Index *triangle)
+    // not normalized: its length is the doubled area
+    {
+        const D3DXVECTOR3 edge1 = positions[triangle[1]] - positions[triangle[0]];
+        const D3DXVECTOR3 edge2 = positions[triangle[2]] - positions[triangle[0]];
+        D3DXVECTOR3 normal;
+        D3DXVec3Cross( &normal, &edge1, &edge2 );
+        return normal;
+    }
+
+    // Area of the projection onto XY: negative for triangles facing down
+    double get_area(const D3DXVECTOR3 *positions, const Index *indices, DWORD indices_count)
+    {
+        double area = 0;
+        for( DWORD i = 0; i < indices_count; i += VERTICES_PER_TRIANGLE )
+            area += get_normal( positions, &indices[i] ).z/2.0;
+        return area;
+    }
+
+    // Volume enclosed by a closed mesh (negative if triangles face inside)
+    double get_volume(const D3DXVECTOR3 *positions, const Index *indices, DWORD indices_count)
+    {
+        double volume = 0;
+        for( DWORD i = 0; i < indices_count; i += VERTICES_PER_TRIANGLE )
+        {
+            const D3DXVECTOR3 normal = get_normal( positions, &indices[i] );
+            volume += D3DXVec3Dot( &normal, &positions[indices[i]] )/6.0;
+        }
+        return volume;
+    }
+
+    template<class VertexType> void get_positions(const std::vector<VertexType> &vertices, std::vector<D3DXVECTOR3> &res)
+    {
+        res.resize( vertices.size() );
+        for( unsigned i = 0; i < vertices.size(); ++i )
+            res[i] = vertices[i].pos;
+    }
+
+    // Every triangle refers to existing vertices and is not degenerate
+    bool are_triangles_valid(const Index *indices, DWORD indices_count, Index vertices_count)
+    {
+        if( indices_count % VERTICES_PER_TRIANGLE != 0 )
+            return false;
+        for( DWORD i = 0; i < indices_count; i += VERTICES_PER_TRIANGLE )
+        {
+            const Index *triangle = &indices[i];
+            if( triangle[0] >= vertices_count || triangle[1] >= vertices_count || triangle[2] >= vertices_count ||
+                triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2] )
+                return false;
+        }
+        return true;
+    }
+
+    // Triangles with the centroid within `radius' from the point and the longest edge of them
+    void get_triangles_near( const D3DXVECTOR3 *positions, const Index *indices, DWORD indices_count,
+                             const D3DXVECTOR3 &point, float radius, DWORD &count, float &longest_edge )
+    {
+        count = 0;
+        longest_edge = 0;
+        for( DWORD i = 0; i < indices_count; i += VERTICES_PER_TRIANGLE )
+        {
+            const D3DXVECTOR3 &p1 = positions[indices[i]];
+            const D3DXVECTOR3 &p2 = positions[indices[i + 1]];
+            const D3DXVECTOR3 &p3 = positions[indices[i + 2]];
+            const D3DXVECTOR3 to_point = (p1 + p2 + p3)/3.0f - point;
+            if( D3DXVec3Length( &to_point ) > radius )
+                continue;
+            ++count;
+            const D3DXVECTOR3 edges[VERTICES_PER_TRIANGLE] = { p2 - p1, p3 - p2, p1 - p3 };
+            for( unsigned j = 0; j < VERTICES_PER_TRIANGLE; ++j )
+                longest_edge = std::max( longest_edge, D3DXVec3Length( &edges[j] ) );
+        }
+    }
+
+    void test_plane()
+    {
+        std::vector<Vertex> vertices( plane_vertices_count( PLANE_STEPS ) );
+        std::vector<Index> indices( plane_indices_count( PLANE_STEPS ) );
+        plane( PLANE_SIDE, PLANE_SIDE, &vertices[0], &indices[0], D3DCOLOR_XRGB(255, 255, 255), PLANE_STEPS );
+        std::vector<D3DXVECTOR3> positions;
+        get_positions( vertices, positions );
+        const DWORD triangles_count = static_cast<DWORD>( indices.size() )/VERTICES_PER_TRIANGLE;
+
+        // a flat grid of one color and one normal: only the corners are needed
+        SimplificationParams params;
+        params.target_error = FLAT_ERROR;
+        std::vector<Index> flat( indices );
+        const DWORD flat_count = simplify( &vertices[0], static_cast<Index>( vertices.size() ), &flat[0], static_cast<DWORD>( flat.size() ), params );
+        const double area = get_area( &positions[0], &indices[0], static_cast<DWORD>( indices.size() ) );
+        check( are_triangles_valid( &flat[0], flat_count, static_cast<Index>( vertices.size() ) ), "simplify() of plane(): valid triangles" );
+        check( flat_count/VERTICES_PER_TRIANGLE < triangles_count/50, "simplify() of plane(): triangles are removed" );
+        // a triangle facing down would cancel a part of the area
+        check_error( "simplify() of plane(): the area", fabs( get_area( &positions[0], &flat[0], flat_count ) - area )/fabs(area), AREA_TOLERANCE );
+
+        // the same with the density kept near a point of the plane
+        const D3DXVECTOR3 dense_point( PLANE_SIDE/4, PLANE_SIDE/4, 0 );
+        SimplificationParams dense_params;
+        dense_params.target_error = DENSE_ERROR;
+        dense_params.keep_density = true;
+        dense_params.dense_point = dense_point;
+        dense_params.dense_radius = DENSE_RADIUS;
+        dense_params.dense_weight = DENSE_WEIGHT;
+        std::vector<Index> dense( indices );
+        const DWORD dense_count = simplify( &vertices[0], static_cast<Index>( vertices.size() ), &dense[0], static_cast<DWORD>( dense.size() ), dense_params );
+        check( are_triangles_valid( &dense[0], dense_count, static_cast<Index>( vertices.size() ) ), "simplify() of plane() keeping density: valid triangles" );
+        check( dense_count < indices.size(), "simplify() of plane() keeping density: triangles are removed" );
+        check_error( "simplify() of plane() keeping density: the area",
+                     fabs( get_area( &positions[0], &dense[0], dense_count ) - area )/fabs(area), AREA_TOLERANCE );
+
+        DWORD near_count;
+        float longest_near;
+        get_triangles_near( &positions[0], &dense[0], dense_count, dense_point, DENSE_RADIUS, near_count, longest_near );
+        DWORD flat_near_count;
+        float flat_longest_near;
+        get_triangles_near( &positions[0], &flat[0], flat_count, dense_point, DENSE_RADIUS, flat_near_count, flat_longest_near );
+        DWORD far_count;
+        float longest_far;
+        get_triangles_near( &positions[0], &dense[0], dense_count, -dense_point, DENSE_RADIUS, far_count, longest_far );
+        // an edge of length `l' made by moving a vertex at the distance `r' costs DENSE_WEIGHT*l^2/(1 + (r/DENSE_RADIUS)^2)
+        const float max_near_edge = sqrt( DENSE_ERROR/DENSE_WEIGHT*( 1 + (DENSE_DISTANCE/DENSE_RADIUS)*(DENSE_DISTANCE/DENSE_RADIUS) ) );
+        char what[128];
+        sprintf( what, "simplify() of plane() keeping density: the longest edge near the point (%g)", longest_near );
+        check( longest_near <= max_near_edge, what );
+        sprintf( what, "simplify() of plane() keeping density: %u triangles near the point, %u far from it, %u without density",
+                 near_count, far_count, flat_near_count );
+        check( near_count > 2*far_count && near_count > 10*flat_near_count, what );
+    }
+
+    void test_cylinder()
+    {
+        const D3DCOLOR color = D3DCOLOR_XRGB(255, 0, 0);
+        const CylinderDesc desc( CYLINDER_RADIUS, CYLINDER_HEIGHT, &color, 1, CYLINDER_BONES, CYLINDER_EDGES[0], CYLINDER_EDGES[1], CYLINDER_EDGES[2] );
+        std::vector<SkinningVertex> vertices( desc.vertices_count() );
+        std::vector<Index> strip( desc.indices_count() );
+        cylinder( desc.radius, desc.height, desc.colors, desc.colors_count, desc.bones_count, &vertices[0], &strip[0],
+                  desc.edges_per_base, desc.edges_per_height, desc.edges_per_cap );
+        std::vector<Index> indices( VERTICES_PER_TRIANGLE*get_primitives_count( D3DPT_TRIANGLESTRIP, static_cast<DWORD>( strip.size() ) ) );
+        indices.resize( strip_to_list( &strip[0], static_cast<DWORD>( strip.size() ), &indices[0] ) );
+        std::vector<D3DXVECTOR3> positions;
+        get_positions( vertices, positions );
+        const double volume = get_volume( &positions[0], &indices[0], static_cast<DWORD>( indices.size() ) );
+
+        // any error: only the number of triangles stops it
+        SimplificationParams params;
+        params.target_error = FLT_MAX;
+        params.target_triangles_count = static_cast<DWORD>( indices.size() )/VERTICES_PER_TRIANGLE/CYLINDER_REDUCTION;
+        std::vector<Index> simplified( indices );
+        DWORD simplified_count = simplify( &vertices[0], static_cast<Index>( vertices.size() ), &simplified[0],
+                                           static_cast<DWORD>( simplified.size() ), params );
+        check( are_triangles_valid( &simplified[0], simplified_count, static_cast<Index>( vertices.size() ) ), "simplify() of cylinder(): valid triangles" );
+        check( simplified_count/VERTICES_PER_TRIANGLE <= params.target_triangles_count, "simplify() of cylinder(): the target number of triangles" );
+        check_error( "simplify() of cylinder(): the volume",
+                     fabs( get_volume( &positions[0], &simplified[0], simplified_count ) - volume )/fabs(volume), VOLUME_TOLERANCE );
+
+        // vertices of removed triangles go away, the rest stay as they are
+        std::vector<Index> compacted( simplified.begin(), simplified.begin() + simplified_count );
+        std::vector<SkinningVertex> compacted_vertices( vertices );
+        const Index compacted_vertices_count = compact_vertices( &compacted_vertices[0], static_cast<Index>( compacted_vertices.size() ),
+                                                                 &compacted[0], simplified_count );
+        bool same = compacted_vertices_count < vertices.size();
+        for( DWORD i = 0; i < simplified_count && same; ++i )
+            same = compacted[i] < compacted_vertices_count && compacted_vertices[compacted[i]].pos == vertices[simplified[i]].pos;
+        check( same, "compact_vertices() after simplify() of cylinder()" );
+    }
+
+    void test_pyramid()
+    {
+        std::vector<Vertex> vertices( pyramid_vertices_count( PYRAMID_DEGREE ) );
+        std::vector<Index> indices( pyramid_indices_count( PYRAMID_DEGREE ) );
+        pyramid( PYRAMID_SIDE, &vertices[0], &indices[0], D3DCOLOR_XRGB(0, 0, 255), PYRAMID_DEGREE );
+        std::vector<D3DXVECTOR3> positions;
+        get_positions( vertices, positions );
+        const double volume = get_volume( &positions[0], &indices[0], static_cast<DWORD>( indices.size() ) );
+
+        // faces are tessellated separately, so vertices of their edges are seams and stay,
+        // and the rest of a face is needed for nothing: it is a fan of about 3*PYRAMID_DEGREE triangles
+        SimplificationParams params;
+        params.target_error = FLAT_ERROR;
+        std::vector<Index> simplified( indices );
+        const DWORD simplified_count = simplify( &vertices[0], static_cast<Index>( vertices.size() ), &simplified[0],
+                                                 static_cast<DWORD>( simplified.size() ), params );
+        check( are_triangles_valid( &simplified[0], simplified_count, static_cast<Index>( vertices.size() ) ), "simplify() of pyramid(): valid triangles" );
+        check( simplified_count/VERTICES_PER_TRIANGLE <= PLANES_PER_PYRAMID*3*PYRAMID_DEGREE, "simplify() of pyramid(): triangles are removed" );
+        std::vector<bool> used( vertices.size(), false );
+        for( DWORD i = 0; i < simplified_count; ++i )
+            used[simplified[i]] = true;
+        bool seams_kept = true;
+        for( Index i = 0; i < vertices.size(); ++i )
+        {
+            for( Index j = i + 1; j < vertices.size(); ++j )
+            {
+                if( vertices[i].pos == vertices[j].pos && !( used[i] && used[j] ) )
+                    seams_kept = false;
+            }
+        }
+        check( seams_kept, "simplify() of pyramid(): seams are kept" );
+        check_error( "simplify() of pyramid(): the volume",
+                     fabs( get_volume( &positions[0], &simplified[0], simplified_count ) - volume )/fabs(volume), AREA_TOLERANCE );
+    }
+}
+
+void test_simplify()
+{
+    test_plane();
+    test_cylinder();
+    test_pyramid();
+}
@@ -0,0 +1,67 @@
+#include "reference.h"
+#include "../skinning.h"
+#include "../matrices.h"
+#include <cstdio>
+#include <cstdlib>
+
+// skin_vertices() against its reference in double precision: with the bones of the scene and with bones of arbitrary
+// affine poses, by one thread or many (the batches they take must not matter)
+
+namespace
+{
+    const Index VERTICES_COUNT = 1001; // not a multiple of SOFTWARE_BATCH_SIZE: the last batch is padded
+    const unsigned THREADS_COUNTS[] = { 1, 3 };
+    // relative to 1 + |reference| (see get_max_difference())
+    const double POSITION_TOLERANCE = 1e-5;
+    const double COLOR_TOLERANCE = 1e-4; // as lighting.h promises
+    // bones of the random pose turn by up to a right angle and move by up to a half
+    const float RANDOM_ANGLE = D3DX_PI/2;
+    const float RANDOM_SHIFT = 0.5f;
+
+    float get_random(float max_value)
+    // from -max_value to max_value
+    {
+        return ( 2.0f*rand()/RAND_MAX - 1.0f )*max_value;
+    }
+
+    D3DXVECTOR3 get_random_vector(float max_value)
+    {
+        return D3DXVECTOR3( get_random( max_value ), get_random( max_value ), get_random( max_value ) );
+    }
+
+    void check_pose( const char *pose, const SoftwareColumns &columns, const std::vector<SkinningVertex> &vertices,
+                     const std::vector<D3DXMATRIX> &bones, const TestScene &scene )
+    {
+        std::vector<ReferenceOutput> expected;
+        skin_reference( vertices, &bones[0], TEST_BONES_COUNT, scene.position_and_rotation, scene.view, scene.lighting, expected );
+        SoftwareColumns actual( SOFTWARE_OUTPUT_COLUMNS, VERTICES_COUNT );
+        for( unsigned i = 0; i < array_size(THREADS_COUNTS); ++i )
+        {
+            skin_vertices( columns, &bones[0], TEST_BONES_COUNT, scene.position_and_rotation, scene.view, scene.lighting,
+                           THREADS_COUNTS[i], actual );
+            char what[128];
+            sprintf( what, "skin_vertices() against the reference, %s, %u threads: oPos", pose, THREADS_COUNTS[i] );
+            check_error( what, get_max_difference( expected, actual, SOFTWARE_OUT_X, 4 ), POSITION_TOLERANCE );
+            sprintf( what, "skin_vertices() against the reference, %s, %u threads: oD0", pose, THREADS_COUNTS[i] );
+            check_error( what, get_max_difference( expected, actual, SOFTWARE_OUT_R, SOFTWARE_COLOR_COMPONENTS ), COLOR_TOLERANCE );
+        }
+    }
+}
+
+void test_skinning()
+{
+    TestScene scene;
+    make_test_scene( scene );
+    std::vector<SkinningVertex> vertices;
+    make_test_vertices( VERTICES_COUNT, vertices );
+    SoftwareColumns columns( SOFTWARE_SKINNING_VERTEX_COLUMNS, VERTICES_COUNT );
+    load_software_vertices( &vertices[0], VERTICES_COUNT, columns );
+
+    check_pose( "bones of the scene", columns, vertices, scene.bones, scene );
+
+    const D3DXMATRIX identity = rotate_and_shift_matrix( D3DXVECTOR3( 0, 0, 0 ), D3DXVECTOR3( 0, 0, 0 ) );
+    std::vector<D3DXMATRIX> random_bones( TEST_BONES_COUNT, identity );
+    for( unsigned i = 0; i < TEST_BONES_COUNT; ++i )
+        random_bones[i] = rotate_and_shift_matrix( get_random_vector( RANDOM_ANGLE ), get_random_vector( RANDOM_SHIFT ) );
+    check_pose( "random bones", columns, vertices, random_bones, scene );
+}
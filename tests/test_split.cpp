@@ -0,0 +1,318 @@
+#include "tests.h"
+#include "../split.h"
+#include <cstdio>
+
+// split_range() with small fake limits of a device: sub-ranges draw the same triangles with the same winding within
+// the limits (strips are cut at even triangles), 16-bit indices are taken by spans of up to 65536 vertices and rebased
+// when needed; join_range() joins neighbours only within the limits; counts of 64 bits throw instead of wrapping around
+
+namespace
+{
+    const DWORD LIST_TRIANGLES_COUNT = 50;
+    const DWORD STRIP_TRIANGLES_COUNTS[] = { 1, 2, 11, 12, 51 }; // odd ones too
+    const DWORD MAX_PRIMITIVES_COUNTS[] = { 2, 3, 4, 7 };
+    const Index INDEX_STEP = 7; // between neighbouring indices of the generated ranges
+    const Index SHORT_SPANS[] = { 0xFFFE, 0xFFFF, 0x10000 }; // max_index - min_index: of 65535, 65536 and 65537 vertices
+    const Index LARGE_MIN_INDEX = 0x12345;
+
+    // Triangles of the range as a list, in order, with their winding
+    void get_triangles(const Index *indices, DWORD first_index, DWORD indices_count, D3DPRIMITIVETYPE primitive_type,
+                       std::vector<Index> &res)
+    {
+        if( primitive_type == D3DPT_TRIANGLELIST )
+        {
+            res.insert( res.end(), indices + first_index, indices + first_index + indices_count );
+            return;
+        }
+        if( indices_count < 3 )
+            return;
+        std::vector<Index> list( (indices_count - 2)*VERTICES_PER_TRIANGLE );
+        list.resize( strip_to_list( indices + first_index, indices_count, &list[0] ) );
+        res.insert( res.end(), list.begin(), list.end() );
+    }
+
+    // Splits the range and checks that sub-ranges cover it in order within the limits, drawing the same triangles
+    void check_split( const char *name, const std::vector<Index> &indices, D3DPRIMITIVETYPE primitive_type,
+                      const DrawLimits &limits, std::vector<SubRange> &subranges )
+    {
+        const bool strip = primitive_type == D3DPT_TRIANGLESTRIP;
+        const DWORD indices_count = static_cast<DWORD>( indices.size() );
+        subranges.clear();
+        split_range( &indices[0], 0, indices_count, primitive_type, limits, subranges );
+
+        std::vector<Index> expected;
+        get_triangles( &indices[0], 0, indices_count, primitive_type, expected );
+        std::vector<Index> actual;
+        bool in_order = !subranges.empty() && subranges[0].first_index == 0;
+        bool within_limits = true;
+        bool even_cuts = true;
+        bool bounds_right = true;
+        for( unsigned i = 0; i < subranges.size(); ++i )
+        {
+            const SubRange &subrange = subranges[i];
+            get_triangles( &indices[0], subrange.first_index, subrange.indices_count, primitive_type, actual );
+            const DWORD primitives_count = get_primitives_count( primitive_type, subrange.indices_count );
+            if( i + 1 < subranges.size() )
+            {
+                // neighbouring pieces of a strip share two indices
+                in_order = in_order && subranges[i + 1].first_index + (strip ? 2 : 0) == subrange.first_index + subrange.indices_count;
+                even_cuts = even_cuts && ( !strip || primitives_count % 2 == 0 );
+            }
+            else
+            {
+                in_order = in_order && subrange.first_index + subrange.indices_count == indices_count;
+            }
+            within_limits = within_limits && primitives_count <= limits.max_primitives_count &&
+                            subrange.max_index - subrange.min_index <= limits.max_vertex_index;
+            Index min_index = indices[subrange.first_index];
+            Index max_index = min_index;
+            for( DWORD j = subrange.first_index; j < subrange.first_index + subrange.indices_count; ++j )
+            {
+                min_index = ( indices[j] < min_index ) ? indices[j] : min_index;
+                max_index = ( indices[j] > max_index ) ? indices[j] : max_index;
+            }
+            bounds_right = bounds_right && subrange.min_index == min_index && subrange.max_index == max_index;
+        }
+        char what[256];
+        sprintf( what, "split_range() of %s, %u primitives and index %u at most: %u sub-ranges cover the range in order",
+                 name, limits.max_primitives_count, limits.max_vertex_index, static_cast<unsigned>( subranges.size() ) );
+        check( in_order, what );
+        sprintf( what, "split_range() of %s, %u primitives and index %u at most: sub-ranges are within the limits with right bounds",
+                 name, limits.max_primitives_count, limits.max_vertex_index );
+        check( within_limits && bounds_right, what );
+        sprintf( what, "split_range() of %s, %u primitives and index %u at most: the same triangles with the same winding",
+                 name, limits.max_primitives_count, limits.max_vertex_index );
+        check( actual == expected, what );
+        if( strip )
+        {
+            sprintf( what, "split_range() of %s, %u primitives and index %u at most: cut at even triangles",
+                     name, limits.max_primitives_count, limits.max_vertex_index );
+            check( even_cuts, what );
+        }
+    }
+
+    // A strip of distinct indices going by `step' from `first'
+    void make_strip(DWORD triangles_count, Index first, Index step, std::vector<Index> &res)
+    {
+        res.resize( triangles_count + 2 );
+        for( DWORD i = 0; i < res.size(); ++i )
+            res[i] = first + i*step;
+    }
+
+    // A list of triangles of neighbouring indices going by `step'
+    void make_list(DWORD triangles_count, Index step, std::vector<Index> &res)
+    {
+        res.resize( triangles_count*VERTICES_PER_TRIANGLE );
+        for( DWORD i = 0; i < triangles_count; ++i )
+        {
+            res[i*VERTICES_PER_TRIANGLE] = i*step;
+            res[i*VERTICES_PER_TRIANGLE + 1] = (i + 2)*step;
+            res[i*VERTICES_PER_TRIANGLE + 2] = (i + 1)*step;
+        }
+    }
+
+    void check_primitive_limits()
+    {
+        char name[64];
+        std::vector<Index> indices;
+        std::vector<SubRange> subranges;
+        for( unsigned i = 0; i < array_size(MAX_PRIMITIVES_COUNTS); ++i )
+        {
+            const DrawLimits limits = { MAX_PRIMITIVES_COUNTS[i], SHORT_INDEX_MAX };
+            make_list( LIST_TRIANGLES_COUNT, 1, indices );
+            sprintf( name, "a list of %u triangles", LIST_TRIANGLES_COUNT );
+            check_split( name, indices, D3DPT_TRIANGLELIST, limits, subranges );
+            for( unsigned j = 0; j < array_size(STRIP_TRIANGLES_COUNTS); ++j )
+            {
+                make_strip( STRIP_TRIANGLES_COUNTS[j], 0, 1, indices );
+                sprintf( name, "a strip of %u triangles", STRIP_TRIANGLES_COUNTS[j] );
+                check_split( name, indices, D3DPT_TRIANGLESTRIP, limits, subranges );
+            }
+        }
+    }
+
+    void check_vertex_limits()
+    {
+        // 10 steps of indices at most: a piece takes a few triangles
+        const DrawLimits limits = { 1000, 10*INDEX_STEP };
+        std::vector<Index> indices;
+        std::vector<SubRange> subranges;
+        make_list( LIST_TRIANGLES_COUNT, INDEX_STEP, indices );
+        check_split( "a list of wide triangles", indices, D3DPT_TRIANGLELIST, limits, subranges );
+        for( unsigned j = 0; j < array_size(STRIP_TRIANGLES_COUNTS); ++j )
+        {
+            make_strip( STRIP_TRIANGLES_COUNTS[j], 0, INDEX_STEP, indices );
+            char name[64];
+            sprintf( name, "a strip of %u wide triangles", STRIP_TRIANGLES_COUNTS[j] );
+            check_split( name, indices, D3DPT_TRIANGLESTRIP, limits, subranges );
+        }
+
+        // a triangle too wide by itself is drawn anyway, alone
+        const Index wide[] = { 0, 1, 2,  0, 1000, 2,  3, 4, 5 };
+        indices.assign( wide, wide + array_size(wide) );
+        subranges.clear();
+        split_range( &indices[0], 0, static_cast<DWORD>( indices.size() ), D3DPT_TRIANGLELIST, limits, subranges );
+        check( subranges.size() == 3 && subranges[1].first_index == 3 && subranges[1].indices_count == 3 && subranges[1].max_index == 1000,
+               "split_range(): a triangle wider than the limit is a sub-range of its own" );
+    }
+
+    // Two triangles spanning `span' from `min_index'
+    void check_short_indices(Index min_index, Index span, const DrawLimits &limits, bool expected_short, bool expected_rebased)
+    {
+        const Index indices[] = { min_index, min_index + span/2, min_index + 1,  min_index + span, min_index + 1, min_index + span/2 };
+        std::vector<SubRange> subranges;
+        split_range( indices, 0, array_size(indices), D3DPT_TRIANGLELIST, limits, subranges );
+        char what[256];
+        sprintf( what, "split_range(): indices from %u spanning %u, index %u at most: one sub-range, %s indices%s",
+                 min_index, span, limits.max_vertex_index, expected_short ? "16-bit" : "32-bit", expected_rebased ? ", rebased" : "" );
+        check( subranges.size() == 1 && subranges[0].short_indices == expected_short && subranges[0].rebased == expected_rebased, what );
+        if( subranges.size() != 1 )
+            return;
+
+        // written indices plus the shift are the given ones
+        Index written[array_size(indices)];
+        ShortIndex short_written[array_size(indices)];
+        write_subrange( indices, subranges[0], expected_short ? static_cast<void*>( short_written ) : static_cast<void*>( written ) );
+        const Index shift = expected_rebased ? min_index : 0;
+        bool restored = true;
+        for( unsigned i = 0; i < array_size(indices); ++i )
+            restored = restored && ( expected_short ? short_written[i] : written[i] ) + shift == indices[i];
+        sprintf( what, "write_subrange(): indices from %u spanning %u, index %u at most: restored by the shift", min_index, span,
+                 limits.max_vertex_index );
+        check( restored, what );
+    }
+
+    void check_index_sizes()
+    {
+        const DrawLimits limits = { MAXDWORD, MAXDWORD };
+        for( unsigned i = 0; i < array_size(SHORT_SPANS); ++i )
+        {
+            const bool short_span = SHORT_SPANS[i] <= SHORT_INDEX_MAX;
+            // at 0 they need no shift; higher, 16-bit ones are rebased to fit
+            check_short_indices( 0, SHORT_SPANS[i], limits, short_span, false );
+            check_short_indices( LARGE_MIN_INDEX, SHORT_SPANS[i], limits, short_span, short_span );
+        }
+        // below 0xFFFF no shift is needed
+        check_short_indices( 100, 0xFF00, limits, true, false );
+        // 32-bit indices are rebased only if they do not fit into the device
+        const DrawLimits small_limits = { MAXDWORD, 0x100000 };
+        check_short_indices( 0x200000, 0x20000, small_limits, false, true );
+        check_short_indices( 0x20000, 0x20000, small_limits, false, false );
+    }
+
+    IndexRange make_range(DWORD first_index, DWORD indices_count, DWORD min_index, DWORD vertices_count)
+    {
+        IndexRange range;
+        range.first_index = first_index;
+        range.indices_count = indices_count;
+        range.base_vertex = 0;
+        range.min_index = min_index;
+        range.vertices_count = vertices_count;
+        range.short_indices = true;
+        range.source_first_index = first_index;
+        range.palette = 0;
+        return range;
+    }
+
+    void check_joining()
+    {
+        const DrawLimits limits = { 4, 99 };
+        // two triangles and two more, over 50 vertices each
+        const IndexRange first = make_range( 0, 6, 0, 50 );
+        const IndexRange second = make_range( 6, 6, 30, 50 );
+        IndexRange last = first;
+        check( join_range( last, second, D3DPT_TRIANGLELIST, limits ) && last.first_index == 0 && last.indices_count == 12 &&
+               last.min_index == 0 && last.vertices_count == 80, "join_range(): neighbours within the limits are joined" );
+
+        last = first;
+        const IndexRange third = make_range( 6, 9, 30, 50 );
+        check( !join_range( last, third, D3DPT_TRIANGLELIST, limits ) && last.indices_count == 6,
+               "join_range(): neighbours of more primitives than the limit are not joined" );
+        last = first;
+        const IndexRange wide = make_range( 6, 6, 60, 41 );
+        check( !join_range( last, wide, D3DPT_TRIANGLELIST, limits ), "join_range(): neighbours spanning more vertices than the limit are not joined" );
+        last = first;
+        const IndexRange exact = make_range( 6, 6, 60, 40 ); // 100 vertices: indices up to 99
+        check( join_range( last, exact, D3DPT_TRIANGLELIST, limits ) && last.vertices_count == 100,
+               "join_range(): neighbours spanning as many vertices as the limit are joined" );
+
+        // a strip of 4 indices joined with 2 more is a strip of 4 triangles
+        last = make_range( 0, 4, 0, 4 );
+        check( join_range( last, make_range( 4, 2, 4, 2 ), D3DPT_TRIANGLESTRIP, limits ) && last.indices_count == 6,
+               "join_range(): strips within the limits are joined" );
+        last = make_range( 0, 4, 0, 4 );
+        check( !join_range( last, make_range( 4, 3, 4, 3 ), D3DPT_TRIANGLESTRIP, limits ),
+               "join_range(): strips of more primitives than the limit are not joined" );
+
+        // what only looks like a neighbour
+        IndexRange gap = second;
+        ++gap.first_index;
+        ++gap.source_first_index;
+        IndexRange elsewhere = second;
+        ++elsewhere.source_first_index;
+        IndexRange other_size = second;
+        other_size.short_indices = false;
+        IndexRange other_base = second;
+        other_base.base_vertex = 1;
+        IndexRange other_palette = second;
+        other_palette.palette = 1;
+        const IndexRange others[] = { gap, elsewhere, other_size, other_base, other_palette };
+        bool apart = true;
+        for( unsigned i = 0; i < array_size(others); ++i )
+        {
+            last = first;
+            apart = apart && !join_range( last, others[i], D3DPT_TRIANGLELIST, limits );
+        }
+        check( apart, "join_range(): ranges apart in the buffer or where indices were given, of other index sizes, base vertices "
+                      "or palettes are not joined" );
+
+        // limits of a device of 32-bit indices: MaxVertexIndex + 1 must not wrap around
+        const DrawLimits largest = { MAXDWORD, MAXDWORD };
+        last = make_range( 0, 3, 0, 0x80000000 );
+        IndexRange high = make_range( 3, 3, 0x80000000, 0x7FFFFFFF );
+        check( join_range( last, high, D3DPT_TRIANGLELIST, largest ) && last.vertices_count == MAXDWORD,
+               "join_range(): the largest limits are not wrapped around" );
+    }
+
+    void check_large_counts()
+    {
+        bool thrown = false;
+        try
+        {
+            get_count( static_cast<DWORD64>( MAXDWORD ) + 1 );
+        }
+        catch( NoMemoryError & )
+        {
+            thrown = true;
+        }
+        check( thrown && get_count( MAXDWORD ) == MAXDWORD, "get_count(): counts over MAXDWORD throw NoMemoryError" );
+
+        thrown = false;
+        try
+        {
+            get_array_size( static_cast<DWORD64>(1) << 63, 2 ); // wraps around to 0 in 64 bits
+        }
+        catch( NoMemoryError & )
+        {
+            thrown = true;
+        }
+        check( thrown && get_array_size( MAXDWORD/4, 4 ) == static_cast<size_t>( MAXDWORD/4 )*4,
+               "get_array_size(): sizes which do not fit throw NoMemoryError" );
+
+        const DrawLimits limits = get_draw_limits( 0, 0 );
+        check( limits.max_primitives_count == 0xFFFF && limits.max_vertex_index == 0xFFFF,
+               "get_draw_limits(): unknown limits are the smallest of D3D9" );
+        const DrawLimits raised = get_draw_limits( 0x100000, 0xFFFFFF );
+        check( raised.max_primitives_count == 0x100000 && raised.max_vertex_index == 0xFFFFFF,
+               "get_draw_limits(): limits of the device are kept" );
+    }
+}
+
+void test_split()
+{
+    check_primitive_limits();
+    check_vertex_limits();
+    check_index_sizes();
+    check_joining();
+    check_large_counts();
+}
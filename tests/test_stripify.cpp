@@ -0,0 +1,169 @@
+#include "tests.h"
+#include "../stripify.h"
+#include "../pyramid.h"
+#include <cstdio>
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <algorithm>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// stripify() keeps every triangle with its winding, average_cache_miss_ratio() counts misses of a FIFO cache per real
+// triangle, and choose_primitive_type() takes the strip of a grid given row by row, but keeps the list of a wide grid given
+// in narrow bands (which the cache likes more than any strip), and keeps ranges separately drawable
+
+namespace
+{
+    const unsigned GRID_SIDES[] = { 8, 100 };   // quads per side
+    const unsigned CACHE_BAND = 6;              // columns of a band fitting into VERTEX_CACHE_SIZE
+    const unsigned WIDE_GRID_SIDE = 100;        // rows of its strip do not fit into the cache
+    const DWORD PYRAMID_DEGREE = 10;
+
+    void push_triangle(Index a, Index b, Index c, std::vector<Index> &res)
+    {
+        res.push_back( a );
+        res.push_back( b );
+        res.push_back( c );
+    }
+
+    // Triangles of a list grid of `side' x `side' quads, row by row in bands of `band' columns
+    void make_grid(unsigned side, unsigned band, std::vector<Index> &res)
+    {
+        res.clear();
+        for( unsigned first_column = 0; first_column < side; first_column += band )
+        {
+            for( unsigned y = 0; y < side; ++y )
+            {
+                for( unsigned x = first_column; x < first_column + band && x < side; ++x )
+                {
+                    const Index corner = y*(side + 1) + x;
+                    const Index above = corner + side + 1;
+                    push_triangle( corner, above, corner + 1, res );
+                    push_triangle( corner + 1, above, above + 1, res );
+                }
+            }
+        }
+    }
+
+    // Triangles of the indices (but degenerate ones) turned to start at their least index, which keeps the winding, and sorted
+    void get_sorted_triangles(D3DPRIMITIVETYPE primitive_type, const Index *indices, DWORD indices_count, std::vector<Index> &res)
+    {
+        std::vector<Index> list;
+        if( primitive_type == D3DPT_TRIANGLESTRIP )
+        {
+            list.resize( get_list_indices_count( primitive_type, indices_count ) + 1 );
+            list.resize( strip_to_list( indices, indices_count, &list[0] ) );
+        }
+        else
+        {
+            list.assign( indices, indices + indices_count );
+        }
+        std::vector< std::pair< Index, std::pair<Index, Index> > > triangles;
+        for( DWORD i = 0; i + VERTICES_PER_TRIANGLE <= list.size(); i += VERTICES_PER_TRIANGLE )
+        {
+            unsigned first = 0;
+            for( unsigned j = 1; j < VERTICES_PER_TRIANGLE; ++j )
+                first = ( list[i + j] < list[i + first] ) ? j : first;
+            triangles.push_back( std::make_pair( list[i + first], std::make_pair( list[i + (first + 1) % VERTICES_PER_TRIANGLE],
+                                                                                 list[i + (first + 2) % VERTICES_PER_TRIANGLE] ) ) );
+        }
+        std::sort( triangles.begin(), triangles.end() );
+        res.clear();
+        for( unsigned i = 0; i < triangles.size(); ++i )
+            push_triangle( triangles[i].first, triangles[i].second.first, triangles[i].second.second, res );
+    }
+
+    void check_stripify(const char *name, const std::vector<Index> &list)
+    {
+        std::vector<Index> strip( max_strip_indices_count( static_cast<DWORD>( list.size() ) ) );
+        const DWORD strip_count = stripify( &list[0], static_cast<DWORD>( list.size() ), &strip[0] );
+        std::vector<Index> expected;
+        std::vector<Index> actual;
+        get_sorted_triangles( D3DPT_TRIANGLELIST, &list[0], static_cast<DWORD>( list.size() ), expected );
+        get_sorted_triangles( D3DPT_TRIANGLESTRIP, &strip[0], strip_count, actual );
+        char what[128];
+        sprintf( what, "stripify() of %s: the same triangles with the same winding (%u list indices, %u strip ones)",
+                 name, static_cast<unsigned>( list.size() ), strip_count );
+        check( actual == expected, what );
+    }
+
+    void check_cache_miss_ratio()
+    {
+        const Index triangle[] = { 0, 1, 2 };
+        const Index quad[] = { 0, 1, 2,  2, 1, 3 };
+        const Index quad_strip[] = { 0, 1, 2, 3 };
+        const Index joined_strip[] = { 0, 1, 2, 2, 3, 3, 4, 5 }; // two triangles joined by degenerate ones
+        const Index evicted[] = { 0, 1, 2,  3, 4, 5,  0, 1, 2 };
+        check( average_cache_miss_ratio( D3DPT_TRIANGLELIST, triangle, array_size(triangle), 3 ) == 3.0f,
+               "average_cache_miss_ratio(): a triangle loads its 3 vertices" );
+        check( average_cache_miss_ratio( D3DPT_TRIANGLELIST, quad, array_size(quad), 4 ) == 2.0f &&
+               average_cache_miss_ratio( D3DPT_TRIANGLESTRIP, quad_strip, array_size(quad_strip), 4 ) == 2.0f,
+               "average_cache_miss_ratio(): a quad loads 2 vertices per triangle, as a list or a strip" );
+        check( average_cache_miss_ratio( D3DPT_TRIANGLESTRIP, joined_strip, array_size(joined_strip), 6 ) == 3.0f,
+               "average_cache_miss_ratio(): degenerate triangles are not counted" );
+        check( average_cache_miss_ratio( D3DPT_TRIANGLELIST, evicted, array_size(evicted), 6, 3 ) == 3.0f &&
+               average_cache_miss_ratio( D3DPT_TRIANGLELIST, evicted, array_size(evicted), 6, 6 ) == 2.0f,
+               "average_cache_miss_ratio(): vertices are evicted by the FIFO cache of the given size only" );
+    }
+
+    void check_choice(unsigned side, unsigned band, D3DPRIMITIVETYPE expected_type)
+    {
+        std::vector<Index> indices;
+        make_grid( side, band, indices );
+        const Index vertices_count = (side + 1)*(side + 1);
+        const std::vector<Index> list( indices );
+        // two ranges: the halves of the grid
+        DWORD range_starts[] = { 0, static_cast<DWORD>( list.size()/2 ) };
+        DWORD indices_count = static_cast<DWORD>( indices.size() );
+        const float list_ratio = average_cache_miss_ratio( D3DPT_TRIANGLELIST, &list[0], indices_count, vertices_count );
+        const D3DPRIMITIVETYPE type = choose_primitive_type( &indices[0], indices_count, vertices_count, range_starts, array_size(range_starts) );
+        const float ratio = average_cache_miss_ratio( type, &indices[0], indices_count, vertices_count );
+
+        char what[256];
+        sprintf( what, "choose_primitive_type() of a grid of %u quads per side in bands of %u: %s (%u indices, %.3f misses "
+                 "per triangle, %.3f of the list)", side, band, ( type == D3DPT_TRIANGLESTRIP ) ? "strip" : "list",
+                 indices_count, ratio, list_ratio );
+        check( type == expected_type, what );
+
+        // each range draws the triangles it did
+        bool ranges_kept = true;
+        for( unsigned i = 0; i < array_size(range_starts); ++i )
+        {
+            const DWORD list_first = ( i == 0 ) ? 0 : static_cast<DWORD>( list.size()/2 );
+            const DWORD list_end = ( i == 0 ) ? static_cast<DWORD>( list.size()/2 ) : static_cast<DWORD>( list.size() );
+            const DWORD range_end = ( i + 1 < array_size(range_starts) ) ? range_starts[i + 1] : indices_count;
+            std::vector<Index> expected;
+            std::vector<Index> actual;
+            get_sorted_triangles( D3DPT_TRIANGLELIST, &list[list_first], list_end - list_first, expected );
+            get_sorted_triangles( type, &indices[range_starts[i]], range_end - range_starts[i], actual );
+            ranges_kept = ranges_kept && actual == expected;
+        }
+        sprintf( what, "choose_primitive_type() of a grid of %u quads per side in bands of %u: ranges keep their triangles", side, band );
+        check( ranges_kept, what );
+    }
+}
+
+void test_stripify()
+{
+    for( unsigned i = 0; i < array_size(GRID_SIDES); ++i )
+    {
+        std::vector<Index> grid;
+        char name[64];
+        make_grid( GRID_SIDES[i], GRID_SIDES[i], grid );
+        sprintf( name, "a grid of %u quads per side", GRID_SIDES[i] );
+        check_stripify( name, grid );
+        make_grid( GRID_SIDES[i], CACHE_BAND, grid );
+        sprintf( name, "a grid of %u quads per side in bands", GRID_SIDES[i] );
+        check_stripify( name, grid );
+    }
+    std::vector<Vertex> vertices( pyramid_vertices_count( PYRAMID_DEGREE ) );
+    std::vector<Index> indices( pyramid_indices_count( PYRAMID_DEGREE ) );
+    pyramid( 1.0f, &vertices[0], &indices[0], D3DCOLOR_XRGB(0, 0, 255), PYRAMID_DEGREE );
+    check_stripify( "pyramid()", indices );
+
+    check_cache_miss_ratio();
+    for( unsigned i = 0; i < array_size(GRID_SIDES); ++i )
+        check_choice( GRID_SIDES[i], GRID_SIDES[i], D3DPT_TRIANGLESTRIP );
+    check_choice( WIDE_GRID_SIDE, CACHE_BAND, D3DPT_TRIANGLELIST );
+}
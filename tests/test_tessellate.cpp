@@ -0,0 +1,137 @@
+#include "tests.h"
+#include "../pyramid.h"
+#include <cstdio>
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <map>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// The adaptive pyramid (tessellate_adaptive()) for morphing into the sphere: counts given up front are exact,
+// faces tessellated separately meet without cracks, every edge is within the error, and it takes fewer triangles
+// than the uniform tessellation of the same error
+
+namespace
+{
+    const float SIDE = 1.0f;
+    const float RADIUS = 1.5f;
+    const float MAX_ERRORS[] = { 0.05f, 0.01f, 0.002f };
+    const DWORD MAX_UNIFORM_DEGREE = 200;
+    const float CREASE_ANGLE = D3DX_PI/4;
+    const Index GUARD = static_cast<Index>(-1); // after the counted arrays: must stay as it is
+
+    // The sink of a mesh into vectors of exactly the asked size
+    class VectorSink : public MeshSink
+    {
+    public:
+        std::vector<Vertex> vertices;
+        std::vector<Index> indices;
+        D3DPRIMITIVETYPE primitive_type;
+
+        VectorSink() : primitive_type(D3DPT_TRIANGLESTRIP) {}
+        virtual unsigned get_vertex_size() const { return sizeof(Vertex); }
+        virtual void *lock_vertices(Index vertices_count) { vertices.resize( vertices_count ); return &vertices[0]; }
+        virtual Index *lock_indices(DWORD indices_count) { indices.resize( indices_count ); return &indices[0]; }
+        virtual void unlock(D3DPRIMITIVETYPE type) { primitive_type = type; }
+    };
+
+    // How far the middle of the chord between the ends projected onto the sphere is from the sphere
+    float get_chord_error(const D3DXVECTOR3 &a, const D3DXVECTOR3 &b)
+    {
+        D3DXVECTOR3 a_on_sphere, b_on_sphere;
+        D3DXVec3Normalize( &a_on_sphere, &a );
+        D3DXVec3Normalize( &b_on_sphere, &b );
+        const D3DXVECTOR3 middle = (a_on_sphere + b_on_sphere)*(RADIUS/2);
+        return RADIUS - D3DXVec3Length( &middle );
+    }
+
+    // Checks that every edge (between positions, as vertices of faces are separate) is taken by one triangle
+    // in each direction, so the surface has no cracks; returns the largest chord error of the edges
+    bool is_closed(const std::vector<Vertex> &vertices, const Index *indices, DWORD indices_count, float &max_chord_error)
+    {
+        typedef std::pair<float, std::pair<float, float> > Point;
+        typedef std::map< std::pair<Point, Point>, std::pair<unsigned, unsigned> > Edges;
+        Edges edges; // triangles taking the edge from the lesser point and backwards
+        max_chord_error = 0;
+        for( DWORD i = 0; i < indices_count; i += VERTICES_PER_TRIANGLE )
+        {
+            for( unsigned j = 0; j < VERTICES_PER_TRIANGLE; ++j )
+            {
+                const D3DXVECTOR3 &a = vertices[ indices[i + j] ].pos;
+                const D3DXVECTOR3 &b = vertices[ indices[i + (j + 1) % VERTICES_PER_TRIANGLE] ].pos;
+                const Point from( a.x, std::make_pair( a.y, a.z ) );
+                const Point to( b.x, std::make_pair( b.y, b.z ) );
+                if( from < to )
+                    ++edges[ std::make_pair( from, to ) ].first;
+                else
+                    ++edges[ std::make_pair( to, from ) ].second;
+                const float error = get_chord_error( a, b );
+                if( error > max_chord_error )
+                    max_chord_error = error;
+            }
+        }
+        for( Edges::const_iterator it = edges.begin(); it != edges.end(); ++it )
+        {
+            if( it->second.first != 1 || it->second.second != 1 )
+                return false;
+        }
+        return true;
+    }
+}
+
+void test_tessellate()
+{
+    char what[128];
+    for( unsigned i = 0; i < array_size(MAX_ERRORS); ++i )
+    {
+        // counted without writing, then written into arrays of exactly that size
+        Index counted_vertices;
+        DWORD counted_indices;
+        pyramid_adaptive_counts( SIDE, RADIUS, MAX_ERRORS[i], counted_vertices, counted_indices );
+        std::vector<Vertex> vertices( counted_vertices + 1 );
+        std::vector<Index> indices( counted_indices + 1, GUARD );
+        Index vertices_count;
+        DWORD indices_count;
+        pyramid_adaptive( SIDE, RADIUS, MAX_ERRORS[i], &vertices[0], &indices[0], D3DCOLOR_XRGB(0, 255, 0), vertices_count, indices_count );
+        sprintf( what, "pyramid_adaptive(), error %g: counts are exact (%u vertices, %u indices)", MAX_ERRORS[i], vertices_count, indices_count );
+        check( vertices_count == counted_vertices && indices_count == counted_indices && indices[counted_indices] == GUARD, what );
+        bool in_range = true;
+        for( DWORD j = 0; j < indices_count; ++j )
+            in_range = in_range && indices[j] < vertices_count;
+        sprintf( what, "pyramid_adaptive(), error %g: indices refer to written vertices", MAX_ERRORS[i] );
+        check( in_range, what );
+        vertices.pop_back();
+
+        float max_chord_error;
+        sprintf( what, "pyramid_adaptive(), error %g: shared edges have no cracks", MAX_ERRORS[i] );
+        check( is_closed( vertices, &indices[0], indices_count, max_chord_error ), what );
+        sprintf( what, "pyramid_adaptive(), error %g: chord errors of edges", MAX_ERRORS[i] );
+        check_error( what, max_chord_error, MAX_ERRORS[i] );
+
+        // the uniform pyramid of the same error
+        DWORD degree = 1;
+        for( ; degree < MAX_UNIFORM_DEGREE; ++degree )
+        {
+            std::vector<Vertex> uniform_vertices( pyramid_vertices_count( degree ) );
+            std::vector<Index> uniform_indices( pyramid_indices_count( degree ) );
+            pyramid( SIDE, &uniform_vertices[0], &uniform_indices[0], D3DCOLOR_XRGB(0, 255, 0), degree );
+            float uniform_error;
+            is_closed( uniform_vertices, &uniform_indices[0], static_cast<DWORD>( uniform_indices.size() ), uniform_error );
+            if( uniform_error <= MAX_ERRORS[i] )
+                break;
+        }
+        sprintf( what, "pyramid_adaptive(), error %g: %u triangles, uniform pyramid() of degree %u: %u", MAX_ERRORS[i],
+                 indices_count/VERTICES_PER_TRIANGLE, degree, pyramid_indices_count( degree )/VERTICES_PER_TRIANGLE );
+        check( indices_count < pyramid_indices_count( degree ), what );
+
+        // the descriptor counts the same and writes into a sink of that size
+        const AdaptivePyramidDesc desc( SIDE, RADIUS, MAX_ERRORS[i], D3DCOLOR_XRGB(0, 255, 0), CREASE_ANGLE );
+        VectorSink sink;
+        pyramid_adaptive( desc, sink );
+        sprintf( what, "AdaptivePyramidDesc, error %g: counts are exact", MAX_ERRORS[i] );
+        check( desc.vertices_count() == counted_vertices && desc.indices_count() == counted_indices &&
+               sink.vertices.size() == counted_vertices && sink.indices.size() == counted_indices &&
+               sink.primitive_type == desc.primitive_type(), what );
+    }
+}
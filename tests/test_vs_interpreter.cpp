@@ -0,0 +1,248 @@
+#include "tests.h"
+#include "../skinning.h"
+#include "../morphing.h"
+#include "../blend_shapes.h"
+#include "../parallel.h"
+#include "../matrices.h"
+#include <cmath>
+#include <algorithm>
+
+// Every .vsh run by the interpreter against the software kernel doing the same on the CPU: oPos and oD0 of all vertices.
+// The kernels and the interpreter round differently (SSE estimates with a Newton step against exact operations),
+// so they must agree within tolerances, not bit for bit
+
+namespace
+{
+    const Index VERTICES_COUNT = 1000;
+    // relative to 1 + |a| (see get_max_difference())
+    const double POSITION_TOLERANCE = 1e-5;
+    const double COLOR_TOLERANCE = 1e-4;
+    // positions and normals of blend shapes are quantised to 16 bits
+    const double BLEND_SHAPES_TOLERANCE = 1e-3;
+    const float BLEND_SHAPES_MIN_DELTA = 1e-4f;
+    const unsigned LIGHT_RADIUS_REG = 4;
+    const unsigned TARGET_SHIFTS_REG = 40;
+    const unsigned TARGET_SHIFTS_COUNT = 5;
+
+    struct SHADER_RUN
+    {
+        VertexShaderInterpreter shader;
+        explicit SHADER_RUN(const char *filename, const TestScene &scene) : shader( load(filename) )
+        {
+            set_scene_constants( scene, shader );
+        }
+        static ShaderCode load(const char *filename)
+        {
+            ShaderCode code;
+            load_project_shader( filename, code );
+            return code;
+        }
+    };
+
+    void run(const char *filename, const TestScene &scene, const D3DVERTEXELEMENT9 *elements, const void *vertices,
+             unsigned vertex_size, Index count, SoftwareColumns &res)
+    {
+        SHADER_RUN run( filename, scene );
+        run_vertex_shader( run.shader, elements, vertices, vertex_size, count, get_threads_count(), res );
+    }
+
+    void check_output(const char *what, const SoftwareColumns &expected, const SoftwareColumns &actual,
+                      double position_tolerance, double color_tolerance)
+    {
+        const std::string name = what;
+        check_error( ( name + ": oPos" ).c_str(), get_max_difference( expected, actual, SOFTWARE_OUT_X, 4 ), position_tolerance );
+        check_error( ( name + ": oD0" ).c_str(), get_max_difference( expected, actual, SOFTWARE_OUT_R, 4 ), color_tolerance );
+    }
+
+    // Deformed vertices interleaved as Vertex, as the pass-through shaders read them
+    void interleave(const std::vector<DeformedPosition> &positions, const std::vector<DeformedNormal> &normals, std::vector<Vertex> &res)
+    {
+        res.resize( positions.size() );
+        for( unsigned i = 0; i < positions.size(); ++i )
+        {
+            res[i].pos = positions[i].pos;
+            res[i].normal = normals[i].normal;
+            res[i].color = normals[i].color;
+        }
+    }
+
+    void skin_deformed(const std::vector<SkinningVertex> &vertices, const TestScene &scene, std::vector<Vertex> &res)
+    {
+        const Index count = static_cast<Index>( vertices.size() );
+        SoftwareColumns columns( SOFTWARE_SKINNING_VERTEX_COLUMNS, count );
+        load_software_vertices( &vertices[0], count, columns );
+        std::vector<DeformedPosition> positions( count );
+        std::vector<DeformedNormal> normals( count );
+        std::vector<D3DCOLOR> colors( count );
+        for( Index i = 0; i < count; ++i )
+            colors[i] = vertices[i].color;
+        DeformedStreams streams = { 0, count, &positions[0], &normals[0], &colors[0] };
+        skin_deformed_vertices( columns, &scene.bones[0], TEST_BONES_COUNT, get_threads_count(), streams );
+        interleave( positions, normals, res );
+    }
+
+    void morph_deformed(const std::vector<Vertex> &vertices, const TestScene &scene, std::vector<Vertex> &res)
+    // by blend shapes, as MorphingModel does: the target is the sphere of the final radius
+    {
+        const Index count = static_cast<Index>( vertices.size() );
+        std::vector<Vertex> sphere( vertices );
+        for( Index i = 0; i < count; ++i )
+        {
+            const D3DXVECTOR3 &p = vertices[i].pos;
+            const D3DXVECTOR3 direction = p/sqrt( p.x*p.x + p.y*p.y + p.z*p.z );
+            sphere[i].pos = direction*scene.final_radius;
+            sphere[i].set_normal( direction );
+        }
+        BlendShapes shapes( &vertices[0], count );
+        shapes.add_target( &sphere[0], BLEND_SHAPES_MIN_DELTA );
+        std::vector<DeformedPosition> positions( count );
+        std::vector<DeformedNormal> normals( count );
+        std::vector<D3DCOLOR> colors( count );
+        for( Index i = 0; i < count; ++i )
+            colors[i] = vertices[i].color;
+        DeformedStreams streams = { 0, count, &positions[0], &normals[0], &colors[0] };
+        shapes.blend( &scene.morphing_param, get_threads_count(), streams );
+        interleave( positions, normals, res );
+    }
+
+    void light_plane(const std::vector<Vertex> &vertices, const TestScene &scene, SoftwareColumns &res)
+    // plane.vsh on the CPU: vertices moved into world space, lit without specular light and projected
+    {
+        const Index count = static_cast<Index>( vertices.size() );
+        std::vector<Vertex> world( vertices );
+        for( Index i = 0; i < count; ++i )
+        {
+            world[i].pos = transform_point( scene.position_and_rotation, vertices[i].pos );
+            world[i].set_normal( transform_vector( scene.position_and_rotation,
+                                                   D3DXVECTOR3( vertices[i].normal.x, vertices[i].normal.y, vertices[i].normal.z ) ) );
+        }
+        SoftwareColumns columns( SOFTWARE_VERTEX_COLUMNS, count );
+        load_software_vertices( &world[0], count, columns );
+        light_vertices( columns, scene.lighting, false, get_threads_count(), res );
+        const SoftwareMatrix view( scene.view );
+        for( Index first = 0; first < res.get_padded_count(); first += SOFTWARE_BATCH_SIZE )
+        {
+            __m128 position[4];
+            project( view, load_vector( columns, SOFTWARE_POSITION_X, first ), position );
+            for( unsigned i = 0; i < 4; ++i )
+                _mm_storeu_ps( res.get_column(SOFTWARE_OUT_X + i) + first, position[i] );
+        }
+    }
+
+    void light_source(const std::vector<Vertex> &vertices, const TestScene &scene, SoftwareColumns &res)
+    // light_source.vsh: the sphere of the light radius around the light, of the color of the light
+    {
+        for( Index i = 0; i < res.get_count(); ++i )
+        {
+            const D3DXVECTOR3 &p = vertices[i].pos;
+            const D3DXVECTOR3 point = p*( scene.light_radius/sqrt( p.x*p.x + p.y*p.y + p.z*p.z ) ) + scene.lighting.point_position;
+            const float *color = scene.lighting.point_color;
+            for( unsigned j = 0; j < 4; ++j )
+            {
+                const float *row = scene.view.m[j];
+                res.get_column(SOFTWARE_OUT_X + j)[i] = row[0]*point.x + row[1]*point.y + row[2]*point.z + row[3];
+                res.get_column(SOFTWARE_OUT_R + j)[i] = color[j];
+            }
+        }
+        res.pad();
+    }
+
+    void test_target(const TestScene &scene)
+    // target.vsh passes the position and shifts the texture coordinates
+    {
+        SHADER_RUN run( "target.vsh", scene );
+        float shifts[TARGET_SHIFTS_COUNT][SHADER_COMPONENTS];
+        for( unsigned i = 0; i < TARGET_SHIFTS_COUNT; ++i )
+        {
+            for( unsigned j = 0; j < SHADER_COMPONENTS; ++j )
+                shifts[i][j] = ( rand() - RAND_MAX/2 )/static_cast<float>( RAND_MAX );
+        }
+        run.shader.set_constants( TARGET_SHIFTS_REG, shifts[0], TARGET_SHIFTS_COUNT );
+
+        VsInputs inputs;
+        ZeroMemory( &inputs, sizeof(inputs) );
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+        {
+            for( unsigned j = 0; j < SHADER_BATCH_SIZE; ++j )
+            {
+                inputs.inputs[0].components[i][j] = rand()/static_cast<float>( RAND_MAX );
+                inputs.inputs[2].components[i][j] = rand()/static_cast<float>( RAND_MAX );
+            }
+        }
+        VsOutputs outputs;
+        run.shader.run( inputs, outputs );
+        double position_error = 0;
+        double texcoord_error = 0;
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+        {
+            for( unsigned j = 0; j < SHADER_BATCH_SIZE; ++j )
+            {
+                position_error = std::max( position_error,
+                                           fabs( static_cast<double>( outputs.position.components[i][j] ) - inputs.inputs[0].components[i][j] ) );
+                for( unsigned k = 0; k < TARGET_SHIFTS_COUNT; ++k )
+                {
+                    const double expected = static_cast<double>( inputs.inputs[2].components[i][j] ) + shifts[k][i];
+                    texcoord_error = std::max( texcoord_error, fabs( outputs.texcoords[k].components[i][j] - expected ) );
+                }
+            }
+        }
+        check_error( "target.vsh: oPos", position_error, 0 );
+        check_error( "target.vsh: oT0-oT4", texcoord_error, 1e-6 );
+    }
+}
+
+void test_vs_interpreter()
+{
+    TestScene scene;
+    make_test_scene( scene );
+    std::vector<SkinningVertex> skinning_vertices;
+    make_test_vertices( VERTICES_COUNT, skinning_vertices );
+    std::vector<Vertex> vertices( skinning_vertices.begin(), skinning_vertices.end() );
+    const unsigned threads_count = get_threads_count();
+    SoftwareColumns skinning_columns( SOFTWARE_SKINNING_VERTEX_COLUMNS, VERTICES_COUNT );
+    SoftwareColumns columns( SOFTWARE_VERTEX_COLUMNS, VERTICES_COUNT );
+    load_software_vertices( &skinning_vertices[0], VERTICES_COUNT, skinning_columns );
+    load_software_vertices( &vertices[0], VERTICES_COUNT, columns );
+    std::vector<Vertex> skinned;
+    std::vector<Vertex> morphed;
+    skin_deformed( skinning_vertices, scene, skinned );
+    morph_deformed( vertices, scene, morphed );
+
+    SoftwareColumns expected( SOFTWARE_OUTPUT_COLUMNS, VERTICES_COUNT );
+    SoftwareColumns actual( SOFTWARE_OUTPUT_COLUMNS, VERTICES_COUNT );
+
+    skin_vertices( skinning_columns, &scene.bones[0], TEST_BONES_COUNT, scene.position_and_rotation, scene.view,
+                   scene.lighting, threads_count, expected );
+    run( "skinning.vsh", scene, SKINNING_VERTEX_DECL_ARRAY, &skinning_vertices[0], sizeof(SkinningVertex), VERTICES_COUNT, actual );
+    check_output( "skinning.vsh against skin_vertices()", expected, actual, POSITION_TOLERANCE, COLOR_TOLERANCE );
+    run( "deformed.vsh", scene, VERTEX_DECL_ARRAY, &skinned[0], sizeof(Vertex), VERTICES_COUNT, actual );
+    check_output( "deformed.vsh after skin_deformed_vertices()", expected, actual, POSITION_TOLERANCE, COLOR_TOLERANCE );
+
+    morph_vertices( columns, scene.final_radius, scene.morphing_param, scene.position_and_rotation, scene.view,
+                    scene.lighting, threads_count, expected );
+    run( "morphing.vsh", scene, VERTEX_DECL_ARRAY, &vertices[0], sizeof(Vertex), VERTICES_COUNT, actual );
+    check_output( "morphing.vsh against morph_vertices()", expected, actual, POSITION_TOLERANCE, COLOR_TOLERANCE );
+    run( "deformed.vsh", scene, VERTEX_DECL_ARRAY, &morphed[0], sizeof(Vertex), VERTICES_COUNT, actual );
+    check_output( "deformed.vsh after BlendShapes::blend()", expected, actual, BLEND_SHAPES_TOLERANCE, BLEND_SHAPES_TOLERANCE );
+
+    light_plane( vertices, scene, expected );
+    run( "plane.vsh", scene, VERTEX_DECL_ARRAY, &vertices[0], sizeof(Vertex), VERTICES_COUNT, actual );
+    check_output( "plane.vsh against light_vertices()", expected, actual, POSITION_TOLERANCE, COLOR_TOLERANCE );
+
+    // shadows of deformed vertices are as those of the vertices deformed by the shaders
+    run( "deformed_shadow.vsh", scene, VERTEX_DECL_ARRAY, &skinned[0], sizeof(Vertex), VERTICES_COUNT, expected );
+    run( "skinning_shadow.vsh", scene, SKINNING_VERTEX_DECL_ARRAY, &skinning_vertices[0], sizeof(SkinningVertex), VERTICES_COUNT, actual );
+    check_output( "skinning_shadow.vsh against deformed_shadow.vsh", expected, actual, POSITION_TOLERANCE, COLOR_TOLERANCE );
+    run( "deformed_shadow.vsh", scene, VERTEX_DECL_ARRAY, &morphed[0], sizeof(Vertex), VERTICES_COUNT, expected );
+    run( "morphing_shadow.vsh", scene, VERTEX_DECL_ARRAY, &vertices[0], sizeof(Vertex), VERTICES_COUNT, actual );
+    check_output( "morphing_shadow.vsh against deformed_shadow.vsh", expected, actual, BLEND_SHAPES_TOLERANCE, BLEND_SHAPES_TOLERANCE );
+
+    light_source( vertices, scene, expected );
+    SHADER_RUN light( "light_source.vsh", scene );
+    const float light_radius[SHADER_COMPONENTS] = { scene.light_radius, scene.light_radius, scene.light_radius, scene.light_radius };
+    light.shader.set_constants( LIGHT_RADIUS_REG, light_radius, 1 );
+    run_vertex_shader( light.shader, VERTEX_DECL_ARRAY, &vertices[0], sizeof(Vertex), VERTICES_COUNT, threads_count, actual );
+    check_output( "light_source.vsh", expected, actual, POSITION_TOLERANCE, COLOR_TOLERANCE );
+
+    test_target( scene );
+}
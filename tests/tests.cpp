@@ -0,0 +1,319 @@
+#include "tests.h"
+#include "../matrices.h"
+#include "../shader_opt.h"
+#include "../shader_variants.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+const unsigned TEST_BONES_COUNT = 18;
+const char *const TEST_VERTEX_SHADERS[] =
+{
+    "deformed.vsh", "deformed_shadow.vsh", "light_source.vsh", "morphing.vsh", "morphing_shadow.vsh",
+    "plane.vsh", "skinning.vsh", "skinning_shadow.vsh", "target.vsh",
+};
+const unsigned TEST_VERTEX_SHADERS_COUNT = array_size(TEST_VERTEX_SHADERS);
+
+namespace
+{
+    unsigned failed_checks_count = 0;
+    std::string project_directory = "..";
+
+    // Registers and values as in Application.cpp
+    const unsigned SHADER_REG_VIEW_MX = 0;
+    const unsigned SHADER_REG_MODEL_DATA = 4;
+    const unsigned SHADER_REG_DIFFUSE_COEF = 14;
+    const unsigned SHADER_REG_POINT_POSITION = 17;
+    const unsigned SHADER_REG_ATTENUATION = 18;
+    const unsigned SHADER_REG_SPECULAR_F = 20;
+    const unsigned SHADER_REG_EYE = 21;
+    const unsigned SHADER_REG_POS_AND_ROT_MX = 27;
+    const unsigned SHADER_REG_SHADOW_PROJ_MX = 31;
+    const unsigned SHADER_REG_SHADOW_ATTENUATION = 35;
+    const unsigned SHADER_REG_BONE_PALETTE = 45;
+    const unsigned REGISTERS_PER_BONE = 3;
+    const unsigned VECTORS_IN_MATRIX = 4;
+    const unsigned BLEND_INDICES_INPUT = 4; // v4 of the skinning shaders
+
+    const float       DIFFUSE_COEF = 0.7f;
+    const D3DCOLOR    AMBIENT_COLOR = D3DCOLOR_XRGB(20, 20, 20);
+    const D3DCOLOR    POINT_COLOR = D3DCOLOR_XRGB(204, 204, 100);
+    const D3DXVECTOR3 POINT_POSITION(0.2f, -0.91f, 1.5f);
+    const D3DXVECTOR3 ATTENUATION(1.0f, 0, 0.3f);
+    const float       SPECULAR_COEF = 0.4f;
+    const float       SPECULAR_F = 35.0f;
+    const D3DXVECTOR3 SHADOW_ATTENUATION(0.8f, 0, 0.1f);
+
+    // The scene is seen from the eye...
+    const D3DXVECTOR3 EYE(1.5f, 2.0f, -3.5f);
+    // ... through a projection as Camera makes it (w is the depth)
+    const float NEAR_CLIP = 0.5f;
+    const D3DXMATRIX VIEW_MX( NEAR_CLIP,      0.1f,  0.2f,  0.3f,
+                                  -0.1f, NEAR_CLIP, -0.3f,  0.2f,
+                                   0.1f,      0.2f,  1.0f, -0.5f,
+                                  -0.2f,      0.4f,  0.8f,  4.0f );
+    // The model...
+    const D3DXVECTOR3 MODEL_ROTATION(0.3f, -0.7f, 0.2f);
+    const D3DXVECTOR3 MODEL_POSITION(0.3f, -0.2f, 0.4f);
+    // ... its shadow on the plane n.p = d
+    const D3DXVECTOR3 PLANE_NORMAL(0, 1.0f, 0);
+    const float PLANE_D = -1.5f;
+
+    const float FINAL_RADIUS = 1.5f;
+    const float MORPHING_PARAM = 0.6f;
+    const float LIGHT_RADIUS = 0.08f;
+    const float BONE_ANGLE = D3DX_PI/8.0f;
+    const float GOLDEN_ANGLE = D3DX_PI*(3.0f - 2.236068f); // as in benchmark.cpp
+
+    // Random constants which would make lighting meaningless: denominators of attenuation must stay away from 0
+    // and the specular power moderate
+    const float RANDOM_ATTENUATION[SHADER_COMPONENTS] = { 1.0f, 0.1f, 0.01f, 0 };
+    const float RANDOM_SPECULAR_F = 8.0f;
+    const float RANDOM_CONSTANTS_RANGE = 1.0f;
+    const float RANDOM_INPUTS_RANGE = 3.0f;
+
+    float get_random(float max_value)
+    // from -max_value to max_value
+    {
+        return ( 2.0f*rand()/RAND_MAX - 1.0f )*max_value;
+    }
+
+    double get_difference(float a, float b)
+    {
+        if( a != a && b != b ) // both NaN
+            return 0;
+        return fabs( static_cast<double>(a) - b )/( 1.0 + fabs(a) );
+    }
+
+    double get_max_difference(const BatchRegister &a, const BatchRegister &b)
+    {
+        double res = 0;
+        for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+        {
+            for( unsigned j = 0; j < SHADER_BATCH_SIZE; ++j )
+            {
+                const double difference = get_difference( a.components[i][j], b.components[i][j] );
+                if( difference > res || difference != difference ) // NaN is kept
+                    res = difference;
+            }
+        }
+        return res;
+    }
+
+    D3DCOLOR get_random_color()
+    // as random_color() of Vertex.h, which overflows where RAND_MAX is larger than of MSVC
+    {
+        return D3DCOLOR_XRGB( rand() % 256, rand() % 256, rand() % 256 );
+    }
+
+    float dot(const D3DXVECTOR3 &a, const D3DXVECTOR3 &b)
+    {
+        return a.x*b.x + a.y*b.y + a.z*b.z;
+    }
+
+    D3DXMATRIX get_shadow_projection(const D3DXVECTOR3 &light_position)
+    // as Plane::get_projection_matrix() makes it
+    {
+        const D3DXVECTOR3 &n = PLANE_NORMAL;
+        const D3DXVECTOR3 &L = light_position;
+        const float L_dot_n = dot( L, n );
+        const float d = PLANE_D;
+        return D3DXMATRIX( L_dot_n - d - L.x*n.x,           -L.x*n.y,           -L.x*n.z, d*L.x,
+                                     -L.y*n.x, L_dot_n - d - L.y*n.y,           -L.y*n.z, d*L.y,
+                                     -L.z*n.x,           -L.z*n.y, L_dot_n - d - L.z*n.z, d*L.z,
+                                         -n.x,               -n.y,               -n.z, L_dot_n );
+    }
+
+    // as Application sets constants
+    void set_float(VertexShaderInterpreter &res, unsigned reg, float value)
+    {
+        const float data[SHADER_COMPONENTS] = { value, value, value, value };
+        res.set_constants( reg, data, 1 );
+    }
+    void set_vector(VertexShaderInterpreter &res, unsigned reg, const D3DXVECTOR3 &vector)
+    {
+        res.set_constants( reg, D3DXVECTOR4( vector, 0 ), 1 );
+    }
+    void set_point(VertexShaderInterpreter &res, unsigned reg, const D3DXVECTOR3 &point)
+    {
+        res.set_constants( reg, D3DXVECTOR4( point, 1.0f ), 1 );
+    }
+    void set_color(VertexShaderInterpreter &res, unsigned reg, const D3DXCOLOR &color)
+    {
+        res.set_constants( reg, color, 1 );
+    }
+    void set_matrix(VertexShaderInterpreter &res, unsigned reg, const D3DXMATRIX &matrix)
+    {
+        res.set_constants( reg, matrix, VECTORS_IN_MATRIX );
+    }
+}
+
+void check(bool passed, const char *what)
+{
+    printf( "%s: %s\n", passed ? "ok" : "FAILED", what );
+    if( !passed )
+        ++failed_checks_count;
+}
+
+void check_error(const char *what, double error, double tolerance)
+{
+    const bool passed = ( error <= tolerance ); // NaN fails
+    printf( "%s: %s (error %g, tolerance %g)\n", passed ? "ok" : "FAILED", what, error, tolerance );
+    if( !passed )
+        ++failed_checks_count;
+}
+
+unsigned get_failed_checks_count()
+{
+    return failed_checks_count;
+}
+
+void set_project_directory(const char *directory)
+{
+    project_directory = directory;
+}
+
+std::string get_project_file(const char *filename)
+{
+    return project_directory + "/" + filename;
+}
+
+void load_project_shader(const char *filename, ShaderCode &res)
+{
+    load_shader( get_project_file(filename).c_str(), res );
+}
+
+void make_test_scene(TestScene &res)
+{
+    res.view = VIEW_MX;
+    res.position_and_rotation = rotate_and_shift_matrix( MODEL_ROTATION, MODEL_POSITION );
+    res.shadow_projection = get_shadow_projection( POINT_POSITION );
+
+    res.lighting.diffuse_coef = DIFFUSE_COEF;
+    res.lighting.ambient_color = D3DXCOLOR( AMBIENT_COLOR );
+    res.lighting.point_color = D3DXCOLOR( POINT_COLOR );
+    res.lighting.point_position = POINT_POSITION;
+    res.lighting.attenuation = ATTENUATION;
+    res.lighting.specular_coef = SPECULAR_COEF;
+    res.lighting.specular_f = SPECULAR_F;
+    res.lighting.eye = EYE;
+
+    res.final_radius = FINAL_RADIUS;
+    res.morphing_param = MORPHING_PARAM;
+    res.light_radius = LIGHT_RADIUS;
+
+    // the bones turn by angles growing along the chain, each about its point of the chain
+    res.bones.resize( TEST_BONES_COUNT );
+    for( unsigned i = 0; i < TEST_BONES_COUNT; ++i )
+    {
+        const float position = static_cast<float>(i)/(TEST_BONES_COUNT - 1);
+        res.bones[i] = rotate_x_matrix( BONE_ANGLE*position, D3DXVECTOR3( 0, 0, 2.0f*position - 1.0f ) );
+    }
+}
+
+void set_scene_constants(const TestScene &scene, VertexShaderInterpreter &res)
+{
+    set_matrix( res, SHADER_REG_VIEW_MX,          scene.view                      );
+    set_float ( res, SHADER_REG_MODEL_DATA,       scene.final_radius              );
+    set_float ( res, SHADER_REG_MODEL_DATA + 1,   scene.morphing_param            );
+    set_float ( res, SHADER_REG_DIFFUSE_COEF,     scene.lighting.diffuse_coef     );
+    set_color ( res, SHADER_REG_AMBIENT_COLOR,    scene.lighting.ambient_color    );
+    set_color ( res, SHADER_REG_POINT_COLOR,      scene.lighting.point_color      );
+    set_point ( res, SHADER_REG_POINT_POSITION,   scene.lighting.point_position   );
+    set_vector( res, SHADER_REG_ATTENUATION,      scene.lighting.attenuation      );
+    set_float ( res, SHADER_REG_SPECULAR_COEF,    scene.lighting.specular_coef    );
+    set_float ( res, SHADER_REG_SPECULAR_F,       scene.lighting.specular_f       );
+    set_point ( res, SHADER_REG_EYE,              scene.lighting.eye              );
+    set_matrix( res, SHADER_REG_POS_AND_ROT_MX,   scene.position_and_rotation     );
+    set_matrix( res, SHADER_REG_SHADOW_PROJ_MX,   scene.shadow_projection         );
+    set_vector( res, SHADER_REG_SHADOW_ATTENUATION, SHADOW_ATTENUATION            );
+    for( unsigned i = 0; i < scene.bones.size(); ++i )
+        res.set_constants( SHADER_REG_BONE_PALETTE + i*REGISTERS_PER_BONE, scene.bones[i], REGISTERS_PER_BONE );
+}
+
+void make_test_vertices(Index count, std::vector<SkinningVertex> &res)
+{
+    _ASSERT( count > 0 );
+    res.resize( count );
+    for( Index i = 0; i < count; ++i )
+    {
+        const float z = 2.0f*(i + 0.5f)/count - 1.0f;
+        const float r = sqrt(1.0f - z*z);
+        const float phi = GOLDEN_ANGLE*i;
+        const D3DXVECTOR3 point( r*cos(phi), r*sin(phi), z );
+        res[i] = SkinningVertex( point, get_random_color(), (z + 1.0f)/2.0f, TEST_BONES_COUNT, point );
+    }
+}
+
+double get_max_difference(const SoftwareColumns &a, const SoftwareColumns &b, unsigned first, unsigned count)
+{
+    _ASSERT( a.get_count() == b.get_count() );
+    double res = 0;
+    for( unsigned i = first; i < first + count; ++i )
+    {
+        const float *a_column = a.get_column(i);
+        const float *b_column = b.get_column(i);
+        for( Index j = 0; j < a.get_count(); ++j )
+        {
+            const double difference = fabs( static_cast<double>( a_column[j] ) - b_column[j] )/( 1.0 + fabs( a_column[j] ) );
+            if( difference > res || difference != difference ) // NaN is kept
+                res = difference;
+        }
+    }
+    return res;
+}
+
+void make_random_constants(std::vector<float> &res)
+{
+    res.resize( SHADER_CONST_REGISTERS*SHADER_COMPONENTS );
+    for( unsigned i = 0; i < res.size(); ++i )
+        res[i] = get_random( RANDOM_CONSTANTS_RANGE );
+    memcpy( &res[SHADER_REG_ATTENUATION*SHADER_COMPONENTS], RANDOM_ATTENUATION, sizeof(RANDOM_ATTENUATION) );
+    memcpy( &res[SHADER_REG_SHADOW_ATTENUATION*SHADER_COMPONENTS], RANDOM_ATTENUATION, sizeof(RANDOM_ATTENUATION) );
+    for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+        res[SHADER_REG_SPECULAR_F*SHADER_COMPONENTS + i] = RANDOM_SPECULAR_F;
+}
+
+void make_random_inputs(VsInputs &res)
+{
+    for( unsigned i = 0; i < SHADER_INPUT_REGISTERS; ++i )
+    {
+        for( unsigned j = 0; j < SHADER_COMPONENTS; ++j )
+        {
+            for( unsigned k = 0; k < SHADER_BATCH_SIZE; ++k )
+            {
+                // blend indices are colors: 3*255 registers for each bone (see skinning.vsh)
+                res.inputs[i].components[j][k] = ( i == BLEND_INDICES_INPUT ) ? ( rand() % TEST_BONES_COUNT )/255.0f
+                                                                              : get_random( RANDOM_INPUTS_RANGE );
+            }
+        }
+    }
+}
+
+double get_max_difference(const VsOutputs &a, const VsOutputs &b)
+{
+    double res = get_max_difference( a.position, b.position );
+    for( unsigned i = 0; i < SHADER_COLOR_OUTPUTS; ++i )
+    {
+        const double difference = get_max_difference( a.colors[i], b.colors[i] );
+        if( difference > res || difference != difference )
+            res = difference;
+    }
+    for( unsigned i = 0; i < SHADER_TEXCOORD_OUTPUTS; ++i )
+    {
+        const double difference = get_max_difference( a.texcoords[i], b.texcoords[i] );
+        if( difference > res || difference != difference )
+            res = difference;
+    }
+    return res;
+}
+
+void get_device_code(const ShaderCode &code, ShaderCode &res)
+{
+    ShaderCode optimized = code;
+    ShaderOptimizationStats stats;
+    optimize_shader( optimized, stats );
+    std::string text;
+    write_shader( optimized, text );
+    parse_shader( text.c_str(), res );
+}
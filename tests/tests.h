@@ -0,0 +1,84 @@
+#pragma once
+#include "../common.h"
+#include "../lighting.h"
+#include "../vs_interpreter.h"
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <vector>
+#include <string>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+// Tests of the modules which build without a device (see platform.h): the software kernels and the shader interpreters
+// are checked against each other and against references. A test_*() function checks a module; main() runs them all
+// and the tests fail if a single check fails. Shaders are read from the directory of the project, given to the tests
+
+// Reports the check; a failed one makes the tests fail
+void check(bool passed, const char *what);
+// ... of the largest error found, which must not exceed the tolerance
+void check_error(const char *what, double error, double tolerance);
+// Number of failed checks so far
+unsigned get_failed_checks_count();
+
+// The file of the project directory
+void set_project_directory(const char *directory);
+std::string get_project_file(const char *filename);
+// The .vsh files of the project
+extern const char *const TEST_VERTEX_SHADERS[];
+extern const unsigned TEST_VERTEX_SHADERS_COUNT;
+// A shader of the project, throws ShaderFileError or ShaderParseError
+void load_project_shader(const char *filename, ShaderCode &res);
+
+// The scene the tests run shaders and kernels in: constants as Application::render() sets them for a model
+struct TestScene
+{
+    D3DXMATRIX view;
+    D3DXMATRIX position_and_rotation;
+    D3DXMATRIX shadow_projection;   // onto the plane of the scene from the point light
+    LightingConstants lighting;
+    float final_radius;             // of morphing...
+    float morphing_param;           // ... at the moment
+    float light_radius;             // of the light source
+    std::vector<D3DXMATRIX> bones;  // of skinning: TEST_BONES_COUNT of them
+};
+// Bones of the tests fill the palette of the skinning shaders (BONE_PALETTE_SIZE of palette.h),
+// so bones of the mesh are bones of the palette
+extern const unsigned TEST_BONES_COUNT;
+void make_test_scene(TestScene &res);
+// Constant registers of the vertex shaders for the scene
+void set_scene_constants(const TestScene &scene, VertexShaderInterpreter &res);
+
+// Points of a spiral over the unit sphere (normals are their radii) with random colors,
+// skinned by the chain of TEST_BONES_COUNT bones along the height
+void make_test_vertices(Index count, std::vector<SkinningVertex> &res);
+
+// The largest difference of the columns [first, first + count) of two sets of columns, relative to 1 + |a|
+double get_max_difference(const SoftwareColumns &a, const SoftwareColumns &b, unsigned first, unsigned count);
+
+// Random constants of the vertex shaders into `res' (all registers), from -1 to 1 but for attenuations
+// and the specular power, which are kept as lighting needs them
+void make_random_constants(std::vector<float> &res);
+// Random inputs of a batch, from -3 to 3 but for blend indices, which are of bones of the palette
+void make_random_inputs(VsInputs &res);
+// The largest difference of all outputs, relative to 1 + |a|; NaN of both is no difference
+double get_max_difference(const VsOutputs &a, const VsOutputs &b);
+// The code as the device gets it: optimized (see shader_opt.h) and written as text
+void get_device_code(const ShaderCode &code, ShaderCode &res);
+
+void test_vs_interpreter();
+void test_ps_interpreter();
+void test_lighting();
+void test_morphing();
+void test_skinning();
+void test_shader_opt();
+void test_shader_variants();
+void test_simplify();
+void test_tessellate();
+void test_codec();
+void test_split();
+void test_stripify();
+void test_clusters();
+void test_pose_cache();
+void test_parallel();
+void test_normals();
@@ -0,0 +1,248 @@
+#include "vs_interpreter.h"
+#include "parallel.h"
+#include <cmath>
+
+#pragma warning( disable : 4996 ) // disable deprecated warning
+#pragma warning( disable : 4995 ) // disable deprecated warning
+#include <algorithm>
+#pragma warning( default : 4996 ) // disable deprecated warning
+#pragma warning( default : 4995 ) // disable deprecated warning
+
+namespace
+{
+    // Registers of the batch which are neither inputs nor outputs
+    struct VS_STATE
+    {
+        BatchRegister temps[SHADER_TEMP_REGISTERS];
+        int address[SHADER_BATCH_SIZE]; // a0.x of each lane
+    };
+
+    typedef float ConstantRegisters[SHADER_CONST_REGISTERS][SHADER_COMPONENTS];
+
+    // The source operand of the batch
+    void fetch( const ShaderOperand &operand, const VsInputs &inputs, const VS_STATE &state, const ConstantRegisters &constants,
+                BatchRegister &res )
+    {
+        if( operand.type == SHADER_OPERAND_TEMP || operand.type == SHADER_OPERAND_INPUT )
+        {
+            load_source( ( operand.type == SHADER_OPERAND_TEMP ) ? state.temps[operand.index] : inputs.inputs[operand.index], operand, res );
+            return;
+        }
+        _ASSERT( operand.type == SHADER_OPERAND_CONST );
+        // the usual case of relative addressing: neighbouring vertices share bones
+        const bool uniform = !operand.relative || std::count( state.address, state.address + SHADER_BATCH_SIZE, state.address[0] ) == SHADER_BATCH_SIZE;
+        const int uniform_index = static_cast<int>( operand.index ) + ( operand.relative ? state.address[0] : 0 );
+        if( uniform && uniform_index >= 0 && uniform_index < SHADER_CONST_REGISTERS )
+        {
+            load_constant( constants[uniform_index], operand, res );
+            return;
+        }
+        const float sign = operand.negate ? -1.0f : 1.0f;
+        for( unsigned j = 0; j < SHADER_BATCH_SIZE; ++j )
+        {
+            // each lane has its own register
+            const int index = static_cast<int>( operand.index ) + state.address[j];
+            const bool inside = ( index >= 0 && index < SHADER_CONST_REGISTERS );
+            for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+                res.components[i][j] = inside ? sign*constants[index][operand.swizzle[i]] : 0.0f;
+        }
+    }
+
+    // Everything the threads of run_vertex_shader() share
+    struct RUN_PARAMS
+    {
+        const VertexShaderInterpreter *shader;
+        const D3DVERTEXELEMENT9 *elements[SHADER_INPUT_REGISTERS]; // of each input, NULL if it is not declared
+        const BYTE *vertices;
+        unsigned vertex_size;
+        Index count;
+        SoftwareColumns *res;
+    };
+
+    // The element of the vertex as the shader gets it
+    void load_element(const D3DVERTEXELEMENT9 &element, const BYTE *vertex, float res[SHADER_COMPONENTS])
+    {
+        res[0] = res[1] = res[2] = 0.0f;
+        res[3] = 1.0f;
+        const BYTE *data = vertex + element.Offset;
+        switch( element.Type )
+        {
+        case D3DDECLTYPE_FLOAT1:
+        case D3DDECLTYPE_FLOAT2:
+        case D3DDECLTYPE_FLOAT3:
+        case D3DDECLTYPE_FLOAT4:
+            memcpy( res, data, ( element.Type - D3DDECLTYPE_FLOAT1 + 1 )*sizeof(float) );
+            break;
+        case D3DDECLTYPE_D3DCOLOR:
+            {
+                // ARGB in memory as BGRA: x is the red byte
+                const D3DXCOLOR color( *reinterpret_cast<const D3DCOLOR*>( data ) );
+                res[0] = color.r;
+                res[1] = color.g;
+                res[2] = color.b;
+                res[3] = color.a;
+            }
+            break;
+        case D3DDECLTYPE_UBYTE4:
+            for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+                res[i] = data[i];
+            break;
+        default:
+            _ASSERT( false );
+        }
+    }
+
+    void run_batches(void *context, unsigned thread, DWORD begin, DWORD end)
+    // batches [begin, end) of SHADER_BATCH_SIZE vertices
+    {
+        UNREFERENCED_PARAMETER(thread);
+        const RUN_PARAMS &params = *static_cast<RUN_PARAMS*>(context);
+        VsInputs inputs;
+        VsOutputs outputs;
+        ZeroMemory( &inputs, sizeof(inputs) );
+        for( DWORD batch = begin; batch < end; ++batch )
+        {
+            const Index first = batch*SHADER_BATCH_SIZE;
+            // lanes after the last vertex repeat it
+            for( unsigned j = 0; j < SHADER_BATCH_SIZE; ++j )
+            {
+                const Index vertex = std::min( first + j, params.count - 1 );
+                for( unsigned k = 0; k < SHADER_INPUT_REGISTERS; ++k )
+                {
+                    if( params.elements[k] == NULL )
+                        continue;
+                    float element[SHADER_COMPONENTS];
+                    load_element( *params.elements[k], params.vertices + vertex*params.vertex_size, element );
+                    for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+                        inputs.inputs[k].components[i][j] = element[i];
+                }
+            }
+            params.shader->run( inputs, outputs );
+            for( unsigned j = 0; j < SHADER_BATCH_SIZE && first + j < params.count; ++j )
+            {
+                for( unsigned i = 0; i < SHADER_COMPONENTS; ++i )
+                {
+                    params.res->get_column(SOFTWARE_OUT_X + i)[first + j] = outputs.position.components[i][j];
+                    params.res->get_column(SOFTWARE_OUT_R + i)[first + j] = outputs.colors[0].components[i][j];
+                }
+            }
+        }
+    }
+}
+
+VertexShaderInterpreter::VertexShaderInterpreter(const ShaderCode &code)
+: code(code)
+{
+    ZeroMemory( constants, sizeof(constants) );
+    for( unsigned i = 0; i < code.definitions.size(); ++i )
+        memcpy( constants[code.definitions[i].constant], code.definitions[i].value, sizeof(constants[0]) );
+}
+
+void VertexShaderInterpreter::set_constants(unsigned first, const float *data, unsigned count)
+{
+    _ASSERT( data != NULL || count == 0 );
+    _ASSERT( first <= SHADER_CONST_REGISTERS && count <= SHADER_CONST_REGISTERS - first );
+    memcpy( constants[first], data, count*sizeof(constants[0]) );
+    // definitions are set last, so that they win
+    for( unsigned i = 0; i < code.definitions.size(); ++i )
+    {
+        const ShaderDefinition &definition = code.definitions[i];
+        if( definition.constant >= first && definition.constant < first + count )
+            memcpy( constants[definition.constant], definition.value, sizeof(constants[0]) );
+    }
+}
+
+void VertexShaderInterpreter::run(const VsInputs &inputs, VsOutputs &res) const
+{
+    VS_STATE state;
+    ZeroMemory( &state, sizeof(state) );
+    ZeroMemory( &res, sizeof(res) );
+
+    BatchRegister sources[SHADER_MAX_SOURCES];
+    BatchRegister value;
+    for( unsigned i = 0; i < code.instructions.size(); ++i )
+    {
+        const ShaderInstruction &instruction = code.instructions[i];
+        const unsigned matrix_rows = get_matrix_rows( instruction.opcode );
+        for( unsigned j = 0; j < instruction.sources_count; ++j )
+        {
+            if( matrix_rows == 0 || j == 0 )
+                fetch( instruction.sources[j], inputs, state, constants, sources[j] );
+        }
+
+        switch( instruction.opcode )
+        {
+        case SHADER_OP_M4X4:
+        case SHADER_OP_M4X3:
+        case SHADER_OP_M3X3:
+            {
+                // component k is the dot product with the row c[n + k]
+                const unsigned size = ( instruction.opcode == SHADER_OP_M3X3 ) ? 3 : 4;
+                ShaderOperand row = instruction.sources[1];
+                for( unsigned k = 0; k < matrix_rows; ++k, ++row.index )
+                {
+                    fetch( row, inputs, state, constants, sources[1] );
+                    dot( sources[0], sources[1], size, sources[2] );
+                    memcpy( value.components[k], sources[2].components[k], sizeof(value.components[k]) );
+                }
+            }
+            break;
+        default:
+            execute( instruction.opcode, sources, value );
+        }
+
+        const ShaderOperand &dest = instruction.dest;
+        // a matrix instruction writes its rows only
+        const BYTE write_mask = ( matrix_rows != 0 ) ? dest.write_mask & ( ( 1 << matrix_rows ) - 1 ) : dest.write_mask;
+        switch( dest.type )
+        {
+        case SHADER_OPERAND_TEMP:       write_masked( value, write_mask, state.temps[dest.index] ); break;
+        case SHADER_OPERAND_POSITION:   write_masked( value, write_mask, res.position ); break;
+        case SHADER_OPERAND_COLOR:      write_masked( value, write_mask, res.colors[dest.index] ); break;
+        case SHADER_OPERAND_TEXCOORD:   write_masked( value, write_mask, res.texcoords[dest.index] ); break;
+        case SHADER_OPERAND_ADDRESS:
+            // as vs_1_1 does, mov to a0 rounds down
+            for( unsigned j = 0; j < SHADER_BATCH_SIZE; ++j )
+                state.address[j] = static_cast<int>( floorf( value.components[0][j] ) );
+            break;
+        default:
+            _ASSERT( false );
+        }
+    }
+    for( unsigned i = 0; i < SHADER_COLOR_OUTPUTS; ++i )
+        clamp( res.colors[i], 0.0f, 1.0f );
+}
+
+void run_vertex_shader( const VertexShaderInterpreter &shader, const D3DVERTEXELEMENT9 *elements, const void *vertices,
+                        unsigned vertex_size, Index count, unsigned threads_count, SoftwareColumns &res )
+{
+    _ASSERT( elements != NULL );
+    _ASSERT( vertices != NULL || count == 0 );
+    _ASSERT( res.get_columns_count() == SOFTWARE_OUTPUT_COLUMNS && res.get_count() == count );
+    if( count == 0 )
+        return;
+
+    RUN_PARAMS params;
+    params.shader = &shader;
+    params.vertices = static_cast<const BYTE*>( vertices );
+    params.vertex_size = vertex_size;
+    params.count = count;
+    params.res = &res;
+    for( unsigned i = 0; i < SHADER_INPUT_REGISTERS; ++i )
+        params.elements[i] = NULL;
+    const ShaderCode &code = shader.get_code();
+    for( unsigned i = 0; i < code.declarations.size(); ++i )
+    {
+        const ShaderDeclaration &declaration = code.declarations[i];
+        for( const D3DVERTEXELEMENT9 *element = elements; element->Stream != 0xFF; ++element )
+        {
+            if( element->Stream == 0 && element->Usage == declaration.usage && element->UsageIndex == declaration.usage_index )
+                params.elements[declaration.input] = element;
+        }
+        _ASSERT( params.elements[declaration.input] != NULL );
+    }
+
+    const DWORD batches_count = get_count( ( static_cast<DWORD64>( count ) + SHADER_BATCH_SIZE - 1 )/SHADER_BATCH_SIZE );
+    parallel_for( batches_count, threads_count, run_batches, &params );
+    res.pad();
+}
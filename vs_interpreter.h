@@ -0,0 +1,51 @@
+#pragma once
+#include "common.h"
+#include "shader_asm.h"
+#include "shader_batch.h"
+#include "software.h"
+
+// Vertex shaders of shader_asm.h run on the CPU, without a device: the .vsh files themselves with the constants
+// the application sets, for batches of SHADER_BATCH_SIZE vertices (see shader_batch.h).
+// It is an oracle for the software kernels (see software.h) and the shaders on machines without Direct3D
+
+// v# of a batch
+struct VsInputs
+{
+    BatchRegister inputs[SHADER_INPUT_REGISTERS];
+};
+
+// Output registers of a batch: oD# are saturated as the rasterizer gets them; registers not written are 0
+struct VsOutputs
+{
+    BatchRegister position;
+    BatchRegister colors[SHADER_COLOR_OUTPUTS];
+    BatchRegister texcoords[SHADER_TEXCOORD_OUTPUTS];
+};
+
+class VertexShaderInterpreter
+{
+private:
+    ShaderCode code;
+    float constants[SHADER_CONST_REGISTERS][SHADER_COMPONENTS];
+
+public:
+    // Constants are 0 until they are set
+    explicit VertexShaderInterpreter(const ShaderCode &code);
+
+    const ShaderCode &get_code() const { return code; }
+
+    // `count' registers from `first' as SetVertexShaderConstantF() sets them: 4 floats each.
+    // Constants defined by the shader (def) are always of their definitions
+    void set_constants(unsigned first, const float *data, unsigned count);
+
+    // Runs the shader for all lanes of the batch. Relative addressing out of the constants reads 0, as the device does.
+    // It may be called by several threads at once
+    void run(const VsInputs &inputs, VsOutputs &res) const;
+};
+
+// Runs the shader for `count' interleaved vertices of `vertex_size' bytes laid out by `elements' (stream 0 only;
+// FLOAT1-4, D3DCOLOR and UBYTE4 elements are read, missing components are of (0, 0, 0, 1)) split between `threads_count'
+// threads (see parallel.h), and writes oPos and oD0 into SOFTWARE_OUTPUT_COLUMNS of `res' of as many vertices,
+// to be compared with the software kernels. Every input the shader declares must be in `elements'
+void run_vertex_shader( const VertexShaderInterpreter &shader, const D3DVERTEXELEMENT9 *elements, const void *vertices,
+                        unsigned vertex_size, Index count, unsigned threads_count, SoftwareColumns &res );